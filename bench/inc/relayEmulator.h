@@ -0,0 +1,69 @@
+/**********************************************************************************************************************
+ * relayEmulator.h
+ * @brief:  KMTronic RS485 boards emulated on a pseudo terminal (POSIX only).
+ *          relayManager opens the slave side as if it were the USB adapter. A thread reads the master side, decodes
+ *          the [0xFF, relay, state] frames, keeps the state of every relay and timestamps each frame with the same
+ *          monotonic clock than pulseTimer, so the benchmark can compare them with its own timestamps. Status frames
+ *          ( 0xFF, 0xA0 + board, 0x00 ) are answered with the state of the relays of the board.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_EMULATOR_H_INCLUDED
+#define RELAY_EMULATOR_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
+#include "main.h"
+#include "relayFrame.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_EMULATOR_MAX_EVENTS      65536  // Frames remembered until clearRelayEmulator()
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// A relay frame as the boards got it
+typedef struct relayEmulatorEvent_type relayEmulatorEvent_t;
+struct relayEmulatorEvent_type
+{
+   uint64_t timeNs;                 // When the frame was complete (monotonic ns)
+   uint8_t  relay;
+   uint8_t  state;                  // RELAY_FRAME_ON or RELAY_FRAME_OFF
+};
+
+typedef struct relayEmulator_type relayEmulator_t;
+struct relayEmulator_type
+{
+   int                  masterFd;                          // Side read by the emulator
+   int                  slaveFd;                           // Kept open so the pty survives relayManager closing it
+   char                 slaveName[MAX_PATH];               // Device to give to relayManager ( -device )
+   pthread_t            thread;
+   pthread_mutex_t      lock;                              // Protects everything below
+   pthread_cond_t       newEvent;
+   volatile bool        stopRequested;
+   uint8_t              states[MAX_RELAYS_IN_RS485_CHAIN + 1];
+   relayEmulatorEvent_t events[RELAY_EMULATOR_MAX_EVENTS];
+   size_t               numOfEvents;
+   uint32_t             lostEvents;                        // Frames not remembered, the event list was full
+   uint32_t             statusFrames;                      // Status frames answered
+   uint32_t             badBytes;                          // Bytes thrown away looking for the start of a frame
+   uint8_t              frame[RELAY_FRAME_LENGTH];         // Frame being received
+   size_t               frameLength;
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool   startRelayEmulator( relayEmulator_t* /* emulator */ );
+void   stopRelayEmulator( relayEmulator_t* /* emulator */ );
+void   clearRelayEmulator( relayEmulator_t* /* emulator */ );
+size_t waitRelayEmulator( relayEmulator_t* /* emulator */, const size_t /* numOfEvents */,
+                          const uint64_t /* deadlineNs */ );
+bool   eventRelayEmulator( relayEmulator_t* /* emulator */, const size_t /* index */,
+                           relayEmulatorEvent_t* /* event */ );
+bool   isOnRelayEmulator( relayEmulator_t* /* emulator */, const uint8_t /* relay */ );
+
+#endif // RELAY_EMULATOR_H_INCLUDED
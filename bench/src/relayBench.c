@@ -0,0 +1,646 @@
+/**********************************************************************************************************************
+ * RelayBench
+ * @brief:   End to end benchmark of relayManager without boards (POSIX only). relayManager is run against the
+ *           boards of relayEmulator and every frame is timestamped when it reaches them. Reported, per mode:
+ *              latency      Request (process start or socket command) to the first ON frame
+ *              pulse error  Achieved - requested ON width, measured on the wire
+ *              overhead     Request to the last OFF frame minus the requested ON time, per impulse
+ *              throughput   Frames per second switching a whole chain at once, request to the last frame
+ *           Modes: oneshot (port opened and closed around every phase, a process per pulse), session (port kept
+ *           open for every impulse) and daemon (resident process driven through its socket).
+ * @author:  Xavier Aguirre Torres @ The MicroBoard Order
+ * @date:    December 2019
+ *
+ *********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fprintf(), snprintf(), setvbuf()
+#include <stdlib.h>     // atoi(), qsort()
+#include <string.h>     // strcmp(), strncmp(), strcpy(), strlen(), memset()
+#include <stdint.h>     // int64_t, uint64_t
+#include <signal.h>     // signal(), kill(), SIGINT, SIGPIPE, SIGTERM
+#include <fcntl.h>      // open(), O_WRONLY
+#include <unistd.h>     // fork(), execv(), dup2(), write(), read(), close(), unlink(), getpid()
+#include <sys/wait.h>   // waitpid()
+#include <sys/socket.h> // socket(), connect()
+#include <sys/un.h>     // struct sockaddr_un
+
+#include "main.h"
+#include "pulseTimer.h"
+#include "relayEmulator.h"
+
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _ARG_MANAGER          "-manager"
+#define _ARG_RUNS             "-runs"
+#define _ARG_EMULATE          "-emulate"
+
+#define _MANAGER_DEFAULT      "./relayManager"
+#define _RUNS_DEFAULT         20    // Pulses per mode
+#define _OPEN_TIME_DEFAULT    50    // ms, longer than the wire time of a frame at any baud rate
+#define _IMPULSES_DEFAULT     20    // Impulses of the session run
+#define _MAX_RUNS             1000
+#define _MAX_MANAGER_ARGS     16
+
+#define _FRAME_TIMEOUT_NS     ( 5ULL * NS_PER_SEC )   // A frame that does not arrive in this time is a failed run
+#define _SOCKET_TIMEOUT_MS    5000  // Time the daemon takes to create its socket
+
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+// Samples of one mode
+typedef struct benchResult_type benchResult_t;
+struct benchResult_type
+{
+   const char* mode;
+   int64_t     latencyNs[_MAX_RUNS];
+   int64_t     errorNs[_MAX_RUNS * 2];
+   int64_t     overheadNs[_MAX_RUNS];
+   int         numOfLatencies;
+   int         numOfErrors;
+   int         numOfOverheads;
+   int         failedRuns;
+};
+
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static char     _manager[MAX_PATH] = _MANAGER_DEFAULT;  // relayManager binary under test
+static int      _runs      = _RUNS_DEFAULT;
+static uint16_t _openTime  = _OPEN_TIME_DEFAULT;
+static int      _impulses  = _IMPULSES_DEFAULT;
+static bool     _emulateFlag = false;                   // When true only the emulator runs, to drive it by hand
+
+static relayEmulator_t _emulator;                       // Too big for the stack
+static benchResult_t   _result;
+static volatile sig_atomic_t _stopRequested = 0;
+
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static bool  _parseArgs( int argc, char** argv );
+static void  _onSignal( int signum );
+static pid_t _spawn( const char** args );
+static int   _waitExit( pid_t pid );
+static int   _connect( const char* socketPath );
+static bool  _command( int fd, const char* command, char* reply, size_t replySize );
+static void  _resetResult( const char* mode );
+static bool  _recordPulses( const uint64_t requestNs, const int numOfImpulses );
+static void  _printResult( void );
+static void  _printPercentiles( const char* name, int64_t* samples, const int numOfSamples );
+static int   _compareSamples( const void* a, const void* b );
+static void  _runOneShot( void );
+static void  _runSession( void );
+static void  _runDaemon( void );
+static void  _runEmulate( void );
+static void  _printThroughput( const char* mode, const uint64_t requestNs, const int numOfFrames );
+
+
+
+/* Main function -----------------------------------------------------------------------------------------------------*/
+int main( int argc, char** argv )
+{
+   if( !_parseArgs( argc, argv ) )
+   {
+      return -1;
+   }
+   setvbuf( stdout, NULL, _IOLBF, 0 );      // Results show up as they are measured, even through a pipe
+   signal( SIGPIPE, SIG_IGN );
+   initPulseTimer();
+   if( !startRelayEmulator( &_emulator ) )
+   {
+      return -1;
+   }
+   fprintf( stdout, "%s Boards emulated on %s\n", LOG_INFO, _emulator.slaveName );
+
+   if( _emulateFlag )
+   {
+      _runEmulate();
+   }
+   else
+   {
+      fprintf( stdout, "%s %s, %d runs, %u ms pulses, %d impulses per session\n", LOG_INFO, _manager, _runs,
+               _openTime, _impulses );
+      _runOneShot();
+      _runSession();
+      _runDaemon();
+   }
+
+   stopRelayEmulator( &_emulator );
+   return 0;
+}
+// END main( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_parseArgs( .. )
+ * @brief: Function to parse the benchmark arguments
+ * @param1 <int> argc : Number of arguments
+ * @param2 <char**> argv : Arguments
+ * @return: <bool> TRUE if every argument is valid
+ **********************************************************************************************************************/
+static bool _parseArgs( int argc, char** argv )
+{
+   for( int argn = 1; argn < argc; argn++ )
+   {
+      if( strcmp( argv[argn], _ARG_MANAGER ) == 0 && argn + 1 < argc && strlen( argv[argn + 1] ) < MAX_PATH )
+      {
+         strcpy( _manager, argv[++argn] );
+      }
+      else if( strcmp( argv[argn], _ARG_RUNS ) == 0 && argn + 1 < argc )
+      {
+         _runs = atoi( argv[++argn] );
+      }
+      else if( strcmp( argv[argn], ARG_OPEN_TIME ) == 0 && argn + 1 < argc )
+      {
+         _openTime = (uint16_t)atoi( argv[++argn] );
+      }
+      else if( strcmp( argv[argn], ARG_IMPULSES ) == 0 && argn + 1 < argc )
+      {
+         _impulses = atoi( argv[++argn] );
+      }
+      else if( strcmp( argv[argn], _ARG_EMULATE ) == 0 )
+      {
+         _emulateFlag = true;
+      }
+      else
+      {
+         fprintf( stdout, "Usage: %s [%s path] [%s n] [%s ms] [%s n] [%s]\n", argv[0], _ARG_MANAGER, _ARG_RUNS,
+                  ARG_OPEN_TIME, ARG_IMPULSES, _ARG_EMULATE );
+         fprintf( stdout, " [%s path]  (relayManager binary, default %s)\n", _ARG_MANAGER, _MANAGER_DEFAULT );
+         fprintf( stdout, " [%s n]        (pulses per mode, 1 to %d, default %d)\n", _ARG_RUNS, _MAX_RUNS,
+                  _RUNS_DEFAULT );
+         fprintf( stdout, " [%s ms]   (ON time of every pulse, default %d)\n", ARG_OPEN_TIME, _OPEN_TIME_DEFAULT );
+         fprintf( stdout, " [%s n]    (impulses of the session run, 1 to 255, default %d)\n", ARG_IMPULSES,
+                  _IMPULSES_DEFAULT );
+         fprintf( stdout, " [%s]       (only emulate the boards and print every frame, until Ctrl+C)\n",
+                  _ARG_EMULATE );
+         return false;
+      }
+   }
+   if( _runs < 1 || _runs > _MAX_RUNS || _openTime == 0 || _impulses < 1 || _impulses > 255 )
+   {
+      fprintf( stderr, "%s Runs must be 1 to %d, ON time over 0 ms and impulses 1 to 255\n", LOG_ERROR, _MAX_RUNS );
+      return false;
+   }
+   return true;
+}
+// END f_parseArgs( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_onSignal( .. )
+ * @brief: Function to end the emulate mode on SIGINT
+ * @param1 <int> signum : Signal received
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _onSignal( int signum )
+{
+   (void)signum;
+   _stopRequested = 1;
+}
+// END f_onSignal( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_spawn( .. )
+ * @brief: Function to run relayManager in the background, its output is thrown away
+ * @param1 <const char**> args : Arguments after the binary, NULL terminated
+ * @return: <pid_t> Process id, -1 if it could not be started
+ **********************************************************************************************************************/
+static pid_t _spawn( const char** args )
+{
+   char* argv[_MAX_MANAGER_ARGS + 2];
+   int   argc = 0;
+
+   argv[argc++] = _manager;
+   for( int i = 0; args[i] != NULL && argc <= _MAX_MANAGER_ARGS; i++ )
+   {
+      argv[argc++] = (char*)args[i];
+   }
+   argv[argc] = NULL;
+
+   pid_t pid = fork();
+   if( pid == 0 )
+   {
+      int devNull = open( "/dev/null", O_WRONLY );
+      dup2( devNull, STDOUT_FILENO );
+      dup2( devNull, STDERR_FILENO );
+      execv( _manager, argv );
+      _exit( 127 );
+   }
+   if( pid < 0 )
+   {
+      fprintf( stderr, "%s Could not start %s\n", LOG_ERROR, _manager );
+   }
+   return pid;
+}
+// END f_spawn( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_waitExit( .. )
+ * @brief: Function to wait for a relayManager process to end
+ * @param1 <pid_t> pid : Process id
+ * @return: <int> Exit status, -1 if it did not end normally
+ **********************************************************************************************************************/
+static int _waitExit( pid_t pid )
+{
+   int status;
+
+   if( waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status ) )
+   {
+      return -1;
+   }
+   return WEXITSTATUS( status );
+}
+// END f_waitExit( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_connect( .. )
+ * @brief: Function to connect to the daemon socket, waiting for the daemon to create it
+ * @param1 <const char*> socketPath : Path of the socket
+ * @return: <int> Socket, -1 if the daemon did not listen in time
+ **********************************************************************************************************************/
+static int _connect( const char* socketPath )
+{
+   struct sockaddr_un address;
+
+   if( strlen( socketPath ) >= sizeof( address.sun_path ) )
+   {
+      fprintf( stderr, "%s Socket path too long: %s\n", LOG_ERROR, socketPath );
+      return -1;
+   }
+   memset( &address, 0, sizeof( address ) );
+   address.sun_family = AF_UNIX;
+   strcpy( address.sun_path, socketPath );
+   for( int waitedMs = 0; waitedMs < _SOCKET_TIMEOUT_MS; waitedMs += 10 )
+   {
+      int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+      if( fd >= 0 && connect( fd, (struct sockaddr*)&address, sizeof( address ) ) == 0 )
+      {
+         return fd;
+      }
+      if( fd >= 0 )
+      {
+         close( fd );
+      }
+      SLEEP_MS( 10 );
+   }
+   fprintf( stderr, "%s Daemon not listening on %s\n", LOG_ERROR, socketPath );
+   return -1;
+}
+// END f_connect( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_command( .. )
+ * @brief: Function to send a command to the daemon and read its reply line
+ * @param1 <int> fd : Daemon socket
+ * @param2 <const char*> command : Command, with its '\n'
+ * @param3 <char*> reply : Buffer for the reply
+ * @param4 <size_t> replySize : Size of the reply buffer
+ * @return: <bool> TRUE if the reply starts with "OK"
+ **********************************************************************************************************************/
+static bool _command( int fd, const char* command, char* reply, size_t replySize )
+{
+   size_t used = 0;
+
+   if( write( fd, command, strlen( command ) ) != (ssize_t)strlen( command ) )
+   {
+      return false;
+   }
+   while( used < replySize - 1 )
+   {
+      ssize_t bytes = read( fd, reply + used, 1 );
+      if( bytes <= 0 || reply[used] == '\n' )
+      {
+         break;
+      }
+      used++;
+   }
+   reply[used] = '\0';
+   return strncmp( reply, "OK", 2 ) == 0;
+}
+// END f_command( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_resetResult( .. )
+ * @brief: Function to start the samples of a mode
+ * @param1 <const char*> mode : Name of the mode, printed with the results
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _resetResult( const char* mode )
+{
+   _result.mode = mode;
+   _result.numOfLatencies = 0;
+   _result.numOfErrors = 0;
+   _result.numOfOverheads = 0;
+   _result.failedRuns = 0;
+   clearRelayEmulator( &_emulator );
+}
+// END f_resetResult( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_recordPulses( .. )
+ * @brief: Function to wait for the ON/OFF frames of a run and add its samples. The frames are forgotten afterwards
+ * @param1 <uint64_t> requestNs : When the pulses were requested
+ * @param2 <int> numOfImpulses : Impulses of the run, two frames each
+ * @return: <bool> TRUE if every frame arrived
+ **********************************************************************************************************************/
+static bool _recordPulses( const uint64_t requestNs, const int numOfImpulses )
+{
+   relayEmulatorEvent_t on;
+   relayEmulatorEvent_t off;
+   size_t               numOfFrames = (size_t)numOfImpulses * 2;
+
+   if( waitRelayEmulator( &_emulator, numOfFrames, nowPulseTimer() + _FRAME_TIMEOUT_NS ) < numOfFrames )
+   {
+      _result.failedRuns++;
+      clearRelayEmulator( &_emulator );
+      return false;
+   }
+   for( int impulse = 0; impulse < numOfImpulses; impulse++ )
+   {
+      eventRelayEmulator( &_emulator, (size_t)impulse * 2, &on );
+      eventRelayEmulator( &_emulator, (size_t)impulse * 2 + 1, &off );
+      if( impulse == 0 && _result.numOfLatencies < _MAX_RUNS )
+      {
+         _result.latencyNs[_result.numOfLatencies++] = (int64_t)( on.timeNs - requestNs );
+      }
+      if( _result.numOfErrors < _MAX_RUNS * 2 )
+      {
+         _result.errorNs[_result.numOfErrors++] = (int64_t)( off.timeNs - on.timeNs ) -
+                                                  (int64_t)( _openTime * NS_PER_MS );
+      }
+   }
+   if( _result.numOfOverheads < _MAX_RUNS )
+   {
+      _result.overheadNs[_result.numOfOverheads++] =
+         ( (int64_t)( off.timeNs - requestNs ) - (int64_t)( numOfImpulses * _openTime * NS_PER_MS ) ) / numOfImpulses;
+   }
+   clearRelayEmulator( &_emulator );
+   return true;
+}
+// END f_recordPulses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printResult( .. )
+ * @brief: Function to print the samples of the current mode
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _printResult( void )
+{
+   fprintf( stdout, "%-8s latency_us     ", _result.mode );
+   _printPercentiles( "latency", _result.latencyNs, _result.numOfLatencies );
+   fprintf( stdout, "%-8s pulse_error_us ", _result.mode );
+   _printPercentiles( "pulse error", _result.errorNs, _result.numOfErrors );
+   fprintf( stdout, "%-8s overhead_us    ", _result.mode );
+   _printPercentiles( "overhead", _result.overheadNs, _result.numOfOverheads );
+   if( _result.failedRuns > 0 )
+   {
+      fprintf( stdout, "%s %s: %d run/s lost frames\n", LOG_WARNING, _result.mode, _result.failedRuns );
+   }
+}
+// END f_printResult( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printPercentiles( .. )
+ * @brief: Function to print p50/p90/p99/max of a list of samples, sorting it
+ * @param1 <const char*> name : Name of the samples, for the empty case
+ * @param2 <int64_t*> samples : Samples in ns
+ * @param3 <int> numOfSamples : Number of samples
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _printPercentiles( const char* name, int64_t* samples, const int numOfSamples )
+{
+   if( numOfSamples == 0 )
+   {
+      fprintf( stdout, "no %s samples\n", name );
+      return;
+   }
+   qsort( samples, (size_t)numOfSamples, sizeof( samples[0] ), _compareSamples );
+   fprintf( stdout, "p50=%.1f p90=%.1f p99=%.1f max=%.1f (n=%d)\n",
+            (double)samples[( numOfSamples - 1 ) * 50 / 100] / NS_PER_US,
+            (double)samples[( numOfSamples - 1 ) * 90 / 100] / NS_PER_US,
+            (double)samples[( numOfSamples - 1 ) * 99 / 100] / NS_PER_US,
+            (double)samples[numOfSamples - 1] / NS_PER_US, numOfSamples );
+}
+// END f_printPercentiles( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_compareSamples( .. )
+ * @brief: qsort() comparator of int64_t samples
+ * @param1 <const void*> a : First sample
+ * @param2 <const void*> b : Second sample
+ * @return: <int> <0, 0 or >0
+ **********************************************************************************************************************/
+static int _compareSamples( const void* a, const void* b )
+{
+   int64_t first = *(const int64_t*)a;
+   int64_t second = *(const int64_t*)b;
+   return ( first > second ) - ( first < second );
+}
+// END f_compareSamples( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printThroughput( .. )
+ * @brief: Function to print the frames per second from a request to its last frame. A pty takes the bytes as fast as
+ *         they are written, so this is the cost of relayManager itself, not of the wire
+ * @param1 <const char*> mode : Name of the mode
+ * @param2 <uint64_t> requestNs : When the frames were requested
+ * @param3 <int> numOfFrames : Frames expected
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _printThroughput( const char* mode, const uint64_t requestNs, const int numOfFrames )
+{
+   relayEmulatorEvent_t last;
+   size_t received = waitRelayEmulator( &_emulator, (size_t)numOfFrames, nowPulseTimer() + _FRAME_TIMEOUT_NS );
+
+   if( received < (size_t)numOfFrames || !eventRelayEmulator( &_emulator, received - 1, &last ) )
+   {
+      fprintf( stdout, "%-8s throughput     %zu of %d frames received\n", mode, received, numOfFrames );
+   }
+   else
+   {
+      fprintf( stdout, "%-8s throughput     %.0f frames/s (%d frames in %.3f ms)\n", mode,
+               (double)numOfFrames * NS_PER_SEC / (double)( last.timeNs - requestNs ), numOfFrames,
+               (double)( last.timeNs - requestNs ) / NS_PER_MS );
+   }
+   clearRelayEmulator( &_emulator );
+}
+// END f_printThroughput( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runOneShot( .. )
+ * @brief: Function to measure the default mode, a process per pulse that opens and closes the port around every phase
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _runOneShot( void )
+{
+   char openTime[16];
+   snprintf( openTime, sizeof( openTime ), "%u", _openTime );
+   const char* pulseArgs[] = { ARG_DEVICE, _emulator.slaveName, ARG_RELAY_NUM, "1", ARG_OPEN_TIME, openTime, NULL };
+   const char* onArgs[] = { ARG_DEVICE, _emulator.slaveName, ARG_RELAY_NUM, "1:120", ARG_RELAY_STATE, "on", NULL };
+   const char* offArgs[] = { ARG_DEVICE, _emulator.slaveName, ARG_RELAY_NUM, "1:120", ARG_RELAY_STATE, "off", NULL };
+
+   _resetResult( "oneshot" );
+   for( int run = 0; run < _runs; run++ )
+   {
+      uint64_t requestNs = nowPulseTimer();
+      pid_t    pid = _spawn( pulseArgs );
+      if( pid < 0 )
+      {
+         return;
+      }
+      _recordPulses( requestNs, 1 );
+      _waitExit( pid );
+   }
+   _printResult();
+
+   uint64_t requestNs = nowPulseTimer();
+   _waitExit( _spawn( onArgs ) );
+   _printThroughput( "oneshot", requestNs, MAX_RELAYS_IN_RS485_CHAIN );
+   _waitExit( _spawn( offArgs ) );
+   clearRelayEmulator( &_emulator );
+}
+// END f_runOneShot( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runSession( .. )
+ * @brief: Function to measure the session mode, every impulse of a process streamed over one open port
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _runSession( void )
+{
+   char openTime[16];
+   char impulses[16];
+   snprintf( openTime, sizeof( openTime ), "%u", _openTime );
+   snprintf( impulses, sizeof( impulses ), "%d", _impulses );
+   const char* args[] = { ARG_DEVICE, _emulator.slaveName, ARG_RELAY_NUM, "1", ARG_OPEN_TIME, openTime,
+                          ARG_IMPULSES, impulses, ARG_SESSION, NULL };
+
+   _resetResult( "session" );
+   for( int run = 0; run < _runs; run += _impulses )
+   {
+      uint64_t requestNs = nowPulseTimer();
+      pid_t    pid = _spawn( args );
+      if( pid < 0 )
+      {
+         return;
+      }
+      _recordPulses( requestNs, _impulses );
+      _waitExit( pid );
+   }
+   _printResult();
+}
+// END f_runSession( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runDaemon( .. )
+ * @brief: Function to measure the resident mode, a pulse command per run through the socket
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _runDaemon( void )
+{
+   char socketPath[MAX_PATH];
+   char command[64];
+   char reply[256];
+   snprintf( socketPath, sizeof( socketPath ), "/tmp/relayBench.%d.sock", (int)getpid() );
+   const char* args[] = { ARG_DAEMON, ARG_SOCKET, socketPath, ARG_DEVICE, _emulator.slaveName, NULL };
+
+   unlink( socketPath );
+   pid_t pid = _spawn( args );
+   if( pid < 0 )
+   {
+      return;
+   }
+   int fd = _connect( socketPath );
+   if( fd < 0 )
+   {
+      kill( pid, SIGTERM );
+      _waitExit( pid );
+      return;
+   }
+
+   _resetResult( "daemon" );
+   snprintf( command, sizeof( command ), "pulse 1 %u\n", _openTime );
+   for( int run = 0; run < _runs; run++ )
+   {
+      uint64_t requestNs = nowPulseTimer();
+      if( !_command( fd, command, reply, sizeof( reply ) ) )
+      {
+         fprintf( stderr, "%s Daemon replied \"%s\"\n", LOG_ERROR, reply );
+         break;
+      }
+      _recordPulses( requestNs, 1 );
+   }
+   _printResult();
+
+   for( int run = 0; run < _runs; run++ )
+   {
+      // Only the last batch is reported, the earlier ones warm up the daemon
+      clearRelayEmulator( &_emulator );
+      uint64_t requestNs = nowPulseTimer();
+      _command( fd, "set 1:120 on force\n", reply, sizeof( reply ) );
+      if( run == _runs - 1 )
+      {
+         _printThroughput( "daemon", requestNs, MAX_RELAYS_IN_RS485_CHAIN );
+      }
+      waitRelayEmulator( &_emulator, MAX_RELAYS_IN_RS485_CHAIN, nowPulseTimer() + _FRAME_TIMEOUT_NS );
+      clearRelayEmulator( &_emulator );
+      _command( fd, "set 1:120 off force\n", reply, sizeof( reply ) );
+      waitRelayEmulator( &_emulator, MAX_RELAYS_IN_RS485_CHAIN, nowPulseTimer() + _FRAME_TIMEOUT_NS );
+   }
+
+   _command( fd, "shutdown\n", reply, sizeof( reply ) );
+   close( fd );
+   _waitExit( pid );
+   clearRelayEmulator( &_emulator );
+}
+// END f_runDaemon( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runEmulate( .. )
+ * @brief: Function to print every frame the emulated boards get, until Ctrl+C
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _runEmulate( void )
+{
+   relayEmulatorEvent_t event;
+   size_t               printed = 0;
+   uint64_t             startNs = nowPulseTimer();
+
+   signal( SIGINT, _onSignal );
+   fprintf( stdout, "%s Run relayManager with \"%s %s\", Ctrl+C to end\n", LOG_INFO, ARG_DEVICE,
+            _emulator.slaveName );
+   while( !_stopRequested )
+   {
+      waitRelayEmulator( &_emulator, printed + 1, nowPulseTimer() + 100 * NS_PER_MS );
+      while( eventRelayEmulator( &_emulator, printed, &event ) )
+      {
+         fprintf( stdout, "%12.3f ms  relay %3u %s\n", (double)( event.timeNs - startNs ) / NS_PER_MS, event.relay,
+                  ( event.state == RELAY_FRAME_ON ) ? "ON" : "OFF" );
+         printed++;
+      }
+      if( printed >= RELAY_EMULATOR_MAX_EVENTS )
+      {
+         clearRelayEmulator( &_emulator );
+         printed = 0;
+      }
+   }
+}
+// END f_runEmulate( .. ) ...
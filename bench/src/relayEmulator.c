@@ -0,0 +1,320 @@
+/***********************************************************************************************************************
+ * relayEmulator.c
+ * @brief:  KMTronic RS485 boards emulated on a pseudo terminal (POSIX only)
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+#define _GNU_SOURCE     // posix_openpt(), ptsname_r()
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fprintf()
+#include <stdlib.h>     // posix_openpt(), grantpt(), unlockpt(), ptsname_r()
+#include <string.h>     // memset(), strerror()
+#include <errno.h>      // errno, EINTR, EAGAIN
+#include <fcntl.h>      // open(), O_RDWR, O_NOCTTY
+#include <poll.h>       // poll()
+#include <termios.h>    // tcgetattr(), cfmakeraw(), tcsetattr()
+#include <time.h>       // struct timespec
+#include <unistd.h>     // read(), write(), close()
+#include "pulseTimer.h"
+#include "relayEmulator.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _POLL_MS              100   // Max time the thread takes to see a stop request
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void* _run( void* arg );
+static void  _decode( relayEmulator_t* emulator, const uint8_t byte, const uint64_t nowNs );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_startRelayEmulator( relayEmulator_t* emulator )                                                      //
+//   void      f_stopRelayEmulator( relayEmulator_t* emulator )                                                       //
+//   void      f_clearRelayEmulator( relayEmulator_t* emulator )                                                      //
+//   size_t    f_waitRelayEmulator( relayEmulator_t* emulator, size_t numOfEvents, uint64_t deadlineNs )              //
+//   bool      f_eventRelayEmulator( relayEmulator_t* emulator, size_t index, relayEmulatorEvent_t* event )           //
+//   bool      f_isOnRelayEmulator( relayEmulator_t* emulator, uint8_t relay )                                        //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_startRelayEmulator( .. )
+ * @brief:  Function to create the pseudo terminal, with every relay OFF, and start the thread reading it
+ * @param1: <relayEmulator_t*> emulator: The emulator, slaveName is the device to give to relayManager
+ * @return: <bool> TRUE if success FALSE otherwise
+ **********************************************************************************************************************/
+bool startRelayEmulator( relayEmulator_t* emulator )
+{
+   struct termios     tty;
+   pthread_condattr_t condAttr;
+
+   memset( emulator->states, RELAY_FRAME_OFF, sizeof( emulator->states ) );
+   emulator->numOfEvents = 0;
+   emulator->lostEvents = 0;
+   emulator->statusFrames = 0;
+   emulator->badBytes = 0;
+   emulator->frameLength = 0;
+   emulator->stopRequested = true;             // No thread to stop until it is started
+   emulator->slaveFd = -1;
+
+   emulator->masterFd = posix_openpt( O_RDWR | O_NOCTTY | O_CLOEXEC );
+   if( emulator->masterFd < 0 || grantpt( emulator->masterFd ) != 0 || unlockpt( emulator->masterFd ) != 0 ||
+       ptsname_r( emulator->masterFd, emulator->slaveName, sizeof( emulator->slaveName ) ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Could not create the pseudo terminal: %s\n", LOG_ERROR, __func__, strerror( errno ) );
+      if( emulator->masterFd >= 0 )
+      {
+         close( emulator->masterFd );
+      }
+      return false;
+   }
+   // Raw from the start, relayManager sets its own attributes when it opens the device
+   emulator->slaveFd = open( emulator->slaveName, O_RDWR | O_NOCTTY | O_CLOEXEC );
+   if( emulator->slaveFd < 0 || tcgetattr( emulator->slaveFd, &tty ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Could not open %s: %s\n", LOG_ERROR, __func__, emulator->slaveName,
+               strerror( errno ) );
+      stopRelayEmulator( emulator );
+      return false;
+   }
+   cfmakeraw( &tty );
+   tcsetattr( emulator->slaveFd, TCSANOW, &tty );
+
+   pthread_condattr_init( &condAttr );
+   pthread_condattr_setclock( &condAttr, CLOCK_MONOTONIC );      // Deadlines come from nowPulseTimer()
+   pthread_cond_init( &emulator->newEvent, &condAttr );
+   pthread_condattr_destroy( &condAttr );
+   pthread_mutex_init( &emulator->lock, NULL );
+   emulator->stopRequested = false;
+   if( pthread_create( &emulator->thread, NULL, _run, emulator ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Could not start the emulator thread\n", LOG_ERROR, __func__ );
+      emulator->stopRequested = true;
+      pthread_cond_destroy( &emulator->newEvent );
+      pthread_mutex_destroy( &emulator->lock );
+      stopRelayEmulator( emulator );
+      return false;
+   }
+   return true;
+}
+// END f_startRelayEmulator( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_stopRelayEmulator( .. )
+ * @brief:  Function to stop the thread and close the pseudo terminal
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @return: <void> None
+ **********************************************************************************************************************/
+void stopRelayEmulator( relayEmulator_t* emulator )
+{
+   if( !emulator->stopRequested )
+   {
+      emulator->stopRequested = true;
+      pthread_join( emulator->thread, NULL );
+      pthread_cond_destroy( &emulator->newEvent );
+      pthread_mutex_destroy( &emulator->lock );
+   }
+   emulator->stopRequested = true;
+   if( emulator->slaveFd >= 0 )
+   {
+      close( emulator->slaveFd );
+      emulator->slaveFd = -1;
+   }
+   if( emulator->masterFd >= 0 )
+   {
+      close( emulator->masterFd );
+      emulator->masterFd = -1;
+   }
+}
+// END f_stopRelayEmulator( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_clearRelayEmulator( .. )
+ * @brief:  Function to forget the frames received so far. Relay states are kept
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @return: <void> None
+ **********************************************************************************************************************/
+void clearRelayEmulator( relayEmulator_t* emulator )
+{
+   pthread_mutex_lock( &emulator->lock );
+   emulator->numOfEvents = 0;
+   emulator->lostEvents = 0;
+   pthread_mutex_unlock( &emulator->lock );
+}
+// END f_clearRelayEmulator( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_waitRelayEmulator( .. )
+ * @brief:  Function to wait until a number of frames have been received since the last clearRelayEmulator()
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @param2: <size_t> numOfEvents: Frames to wait for
+ * @param3: <uint64_t> deadlineNs: Absolute time to give up (nowPulseTimer() clock)
+ * @return: <size_t> Frames received, less than numOfEvents if the deadline passed
+ **********************************************************************************************************************/
+size_t waitRelayEmulator( relayEmulator_t* emulator, const size_t numOfEvents, const uint64_t deadlineNs )
+{
+   struct timespec deadline;
+   size_t          received;
+
+   deadline.tv_sec = (time_t)( deadlineNs / NS_PER_SEC );
+   deadline.tv_nsec = (long)( deadlineNs % NS_PER_SEC );
+   pthread_mutex_lock( &emulator->lock );
+   while( emulator->numOfEvents + emulator->lostEvents < numOfEvents &&
+          pthread_cond_timedwait( &emulator->newEvent, &emulator->lock, &deadline ) == 0 )
+   {
+   }
+   received = emulator->numOfEvents + emulator->lostEvents;
+   pthread_mutex_unlock( &emulator->lock );
+   return received;
+}
+// END f_waitRelayEmulator( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_eventRelayEmulator( .. )
+ * @brief:  Function to get a frame received since the last clearRelayEmulator()
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @param2: <size_t> index: 0 is the first frame received
+ * @param3: <relayEmulatorEvent_t*> event: Where to copy it
+ * @return: <bool> TRUE if the frame exists
+ **********************************************************************************************************************/
+bool eventRelayEmulator( relayEmulator_t* emulator, const size_t index, relayEmulatorEvent_t* event )
+{
+   bool exists;
+
+   pthread_mutex_lock( &emulator->lock );
+   exists = ( index < emulator->numOfEvents );
+   if( exists )
+   {
+      *event = emulator->events[index];
+   }
+   pthread_mutex_unlock( &emulator->lock );
+   return exists;
+}
+// END f_eventRelayEmulator( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isOnRelayEmulator( .. )
+ * @brief:  Function to know the emulated state of a relay
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <bool> TRUE if the relay is ON
+ **********************************************************************************************************************/
+bool isOnRelayEmulator( relayEmulator_t* emulator, const uint8_t relay )
+{
+   bool isOn;
+
+   pthread_mutex_lock( &emulator->lock );
+   isOn = ( relay <= MAX_RELAYS_IN_RS485_CHAIN && emulator->states[relay] == RELAY_FRAME_ON );
+   pthread_mutex_unlock( &emulator->lock );
+   return isOn;
+}
+// END f_isOnRelayEmulator( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void*     f_run( void* arg )                                                                                     //
+//   void      f_decode( relayEmulator_t* emulator, uint8_t byte, uint64_t nowNs )                                    //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_run( .. )
+ * @brief:  Emulator thread, reads the master side until a stop is requested
+ * @param1: <void*> arg: The emulator
+ * @return: <void*> NULL
+ **********************************************************************************************************************/
+static void* _run( void* arg )
+{
+   relayEmulator_t* emulator = (relayEmulator_t*)arg;
+   uint8_t          buffer[256];
+
+   while( !emulator->stopRequested )
+   {
+      struct pollfd pfd = { .fd = emulator->masterFd, .events = POLLIN };
+      if( poll( &pfd, 1, _POLL_MS ) <= 0 || !( pfd.revents & POLLIN ) )
+      {
+         continue;
+      }
+      ssize_t bytes = read( emulator->masterFd, buffer, sizeof( buffer ) );
+      uint64_t nowNs = nowPulseTimer();
+      if( bytes <= 0 )
+      {
+         continue;
+      }
+      pthread_mutex_lock( &emulator->lock );
+      for( ssize_t i = 0; i < bytes; i++ )
+      {
+         _decode( emulator, buffer[i], nowNs );
+      }
+      pthread_cond_broadcast( &emulator->newEvent );
+      pthread_mutex_unlock( &emulator->lock );
+   }
+   return NULL;
+}
+// END f_run( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_decode( .. )
+ * @brief:  Function to feed a byte to the frame decoder. Called with the lock held
+ * @param1: <relayEmulator_t*> emulator: The emulator
+ * @param2: <uint8_t> byte: Byte received
+ * @param3: <uint64_t> nowNs: When it was read
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _decode( relayEmulator_t* emulator, const uint8_t byte, const uint64_t nowNs )
+{
+   // Frames start with 0xFF, anything before it is noise
+   if( emulator->frameLength == 0 && byte != RELAY_FRAME_SOH )
+   {
+      emulator->badBytes++;
+      return;
+   }
+   emulator->frame[emulator->frameLength++] = byte;
+   if( emulator->frameLength < RELAY_FRAME_LENGTH )
+   {
+      return;
+   }
+   emulator->frameLength = 0;
+
+   uint8_t address = emulator->frame[1];
+   uint8_t value = emulator->frame[2];
+   if( address > RELAY_FRAME_STATUS && address <= RELAY_FRAME_STATUS + MAX_BOARDS_IN_RS485_CHAIN )
+   {
+      uint8_t board = (uint8_t)( address - RELAY_FRAME_STATUS );
+      ssize_t written = write( emulator->masterFd, &emulator->states[( board - 1 ) * MAX_RELAYS_PER_BOARD + 1],
+                               RELAY_STATUS_LENGTH );
+      (void)written;               // A benchmark that does not read the reply does not care
+      emulator->statusFrames++;
+      return;
+   }
+   if( address < MIN_RELAY_NUMBER || address > MAX_RELAYS_IN_RS485_CHAIN ||
+       ( value != RELAY_FRAME_ON && value != RELAY_FRAME_OFF ) )
+   {
+      emulator->badBytes += RELAY_FRAME_LENGTH;
+      return;
+   }
+   emulator->states[address] = value;
+   if( emulator->numOfEvents >= RELAY_EMULATOR_MAX_EVENTS )
+   {
+      emulator->lostEvents++;
+      return;
+   }
+   emulator->events[emulator->numOfEvents].timeNs = nowNs;
+   emulator->events[emulator->numOfEvents].relay = address;
+   emulator->events[emulator->numOfEvents].state = value;
+   emulator->numOfEvents++;
+}
+// END f_decode( .. ) ...
+
+#endif // _WIN32
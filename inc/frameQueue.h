@@ -0,0 +1,102 @@
+/**********************************************************************************************************************
+ * frameQueue.h
+ * @brief:  Bounded lock free queue of frame batches between the producers of commands (socket clients, API callers,
+ *          any thread) and the single thread that owns a bus and its serialWriter (POSIX only).
+ *          Producers claim a slot with one compare and swap and never wait for the UART. The owner moves whole
+ *          batches to its serialWriter when it has room, in the order they were pushed, and is woken up through a
+ *          pipe it polls for reading. Batches are pre-encoded: the buffers point into relayFrameTable, nothing is
+ *          built on the owner side.
+ *          Urgent batches (emergency off) have a lane of their own, drained first: they go in front of the writer
+ *          queue at the next frame boundary and the ON frames of their relays still waiting in either queue are
+ *          removed, so nothing queued before can switch them back on.
+ *          With a coalescing window the normal lane is held from the first batch waiting until the window ends, so
+ *          commands arriving close together leave in a single write; a relay commanded by several of them only gets
+ *          the frame of the last one. The window is cut short by flushFrameQueue() (a train starting, a pulse edge or
+ *          a reply that can not wait) and when the lane fills up: the batches held always reach the writer before
+ *          the edges of the trains that come after them.
+ *          The depth (current and highest) is kept by the queue and the time from push to the first byte on the
+ *          wire is recorded in the METRIC_QUEUE_TO_WIRE (METRIC_URGENT_TO_WIRE) histogram, the window included.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef FRAME_QUEUE_H_INCLUDED
+#define FRAME_QUEUE_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>    // uint32_t, uint64_t
+#include <stdbool.h>   // bool
+#include <stdatomic.h> // atomic_uint, atomic_bool
+#include "main.h"
+#include "virtualComPort.h"
+#include "serialWriter.h"
+#include "relaySet.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define FRAME_QUEUE_LENGTH         64                                 // Batches waiting, power of two
+#define FRAME_QUEUE_BATCH_FRAMES   ( MAX_RELAYS_IN_RS485_CHAIN / 2 )  // Every other relay, worst buildRelayFrames()
+#define FRAME_QUEUE_NOT_COALESCED  0                                  // coalesceNs of a queue moving batches at once
+#define FRAME_QUEUE_MAX_COALESCE_NS ( 100ULL * 1000000ULL )           // Longest coalescing window accepted
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// Frames that must reach the wire together. sequence == position: free for the producer of that position,
+// sequence == position + 1: pushed, ready for the owner
+typedef struct frameBatch_type frameBatch_t;
+struct frameBatch_type
+{
+   atomic_uint sequence;
+   int         numOfFrames;
+   uint64_t    pushedNs;                               // When the producer pushed it (monotonic ns)
+   relaySet_t  cancel;                                 // Urgent lane: relays whose ON frames waiting are removed
+   vcpIovec_t  frames[FRAME_QUEUE_BATCH_FRAMES];
+};
+
+typedef enum
+{
+   FRAME_LANE_NORMAL = 0,
+   FRAME_LANE_URGENT,
+   NUM_OF_FRAME_LANES
+} frameLane_t;
+
+typedef struct frameRing_type frameRing_t;
+struct frameRing_type
+{
+   frameBatch_t batches[FRAME_QUEUE_LENGTH];
+   atomic_uint  tail;                                  // Next position a producer takes (free running)
+   unsigned     head;                                  // Next position the owner reads, only the owner uses it
+};
+
+typedef struct frameQueue_type frameQueue_t;
+struct frameQueue_type
+{
+   frameRing_t  lanes[NUM_OF_FRAME_LANES];
+   atomic_uint  depth;                                 // Batches pushed and not moved to the writer yet
+   atomic_uint  maxDepth;                              // Highest depth seen
+   atomic_uint  rejected;                              // Batches refused because the queue was full
+   atomic_bool  signaled;                              // A wake up byte is already in the pipe
+   int          wakeFds[2];                            // Pipe, the owner polls wakeFds[0]
+   // Only the owner uses the rest
+   uint64_t     coalesceNs;                            // Window the normal lane is held, FRAME_QUEUE_NOT_COALESCED
+   uint64_t     holdUntilNs;                           // End of the window of the batches held, UINT64_MAX for none
+   uint32_t     flushes;                               // Times normal batches were moved to the writer
+   uint32_t     coalesced;                             // Batches moved together with an older one
+   uint32_t     collapsed;                             // Frames dropped, a later batch commanded the same relay
+   bool         lostFrames;                            // A batch was dropped whole, cleared by the owner
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool     initFrameQueue( frameQueue_t* /* queue */, const uint64_t /* coalesceNs */ );
+void     closeFrameQueue( frameQueue_t* /* queue */ );
+bool     pushFrameQueue( frameQueue_t* /* queue */, const vcpIovec_t* /* frames */, const int /* numOfFrames */ );
+bool     pushUrgentFrameQueue( frameQueue_t* /* queue */, const vcpIovec_t* /* frames */, const int /* numOfFrames */,
+                               const relaySet_t* /* cancel */ );
+int      drainFrameQueue( frameQueue_t* /* queue */, serialWriter_t* /* writer */, const uint64_t /* nowNs */ );
+int      flushFrameQueue( frameQueue_t* /* queue */, serialWriter_t* /* writer */, const uint64_t /* nowNs */ );
+uint64_t nextFrameQueue( const frameQueue_t* /* queue */ );
+bool     isPendingFrameQueue( const frameQueue_t* /* queue */ );
+int      wakeFdFrameQueue( const frameQueue_t* /* queue */ );
+
+#endif // FRAME_QUEUE_H_INCLUDED
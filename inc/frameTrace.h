@@ -0,0 +1,104 @@
+/**********************************************************************************************************************
+ * frameTrace.h
+ * @brief:  Binary trace of every frame written to the ports, and its replay.
+ *          Each [0xFF, relay, state] frame the OS takes is stored as a fixed size record: monotonic time since the
+ *          trace started, bus, relay byte and state byte (status requests are kept too, relay byte 0xA0 + board).
+ *          Records are buffered and appended by whoever writes (several threads may), nothing is formatted.
+ *          A trace is read memory mapped: millions of frames are replayed or summarised without loading them, the
+ *          system pages them in as they are reached. Replay sends the frames to the ports of the buses again, at the
+ *          original timing (absolute deadlines from the start of the replay) or as fast as the ports take them.
+ *          File: one frameTraceHeader_t then frameTraceRecord_t up to the end, native byte order.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef FRAME_TRACE_H_INCLUDED
+#define FRAME_TRACE_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#ifdef _WIN32
+   #include <windows.h> // HANDLE
+#endif
+#include "main.h"
+#include "virtualComPort.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define FRAME_TRACE_MAGIC          "RMTRACE"   // 8 bytes with the '\0'
+#define FRAME_TRACE_VERSION        1
+#define FRAME_TRACE_BUFFER_LENGTH  ( 64 * 1024 )  // Bytes of records buffered before they are appended to the file
+
+// Trace check in front of the call, nothing is done while no trace is recorded
+#define TRACE_FRAMES( bus, frames, numOfFrames, skip, bytes )                                                          \
+   do { if( frameTraceOn ) recordFrameTrace( (bus), (frames), (numOfFrames), (skip), (bytes) ); } while( 0 )
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct frameTraceHeader_type frameTraceHeader_t;
+struct frameTraceHeader_type
+{
+   char     magic[8];                // FRAME_TRACE_MAGIC
+   uint32_t version;                 // FRAME_TRACE_VERSION
+   uint32_t recordSize;              // sizeof( frameTraceRecord_t )
+   uint64_t startNs;                 // Monotonic time the trace started, the records are relative to it
+   uint64_t reserved;
+};
+
+typedef struct frameTraceRecord_type frameTraceRecord_t;
+struct frameTraceRecord_type
+{
+   uint64_t timeNs;                  // When the OS took the frame, ns since the trace started
+   uint8_t  bus;
+   uint8_t  relay;                   // Second byte of the frame
+   uint8_t  state;                   // Third byte of the frame
+   uint8_t  reserved[5];
+};
+
+// A trace mapped for reading
+typedef struct frameTraceMap_type frameTraceMap_t;
+struct frameTraceMap_type
+{
+   const frameTraceHeader_t* header;
+   const frameTraceRecord_t* records;
+   size_t                    numOfRecords;
+   size_t                    size;                // Bytes mapped
+#ifdef _WIN32
+   HANDLE                    hFile;
+   HANDLE                    hMapping;
+#else
+   int                       fd;
+#endif
+};
+
+// What a trace holds
+typedef struct frameTraceSummary_type frameTraceSummary_t;
+struct frameTraceSummary_type
+{
+   size_t   frames[MAX_RS485_BUSES];              // Frames of every bus
+   size_t   onFrames;
+   size_t   offFrames;
+   size_t   otherFrames;                          // Status requests, unknown states or buses
+   uint64_t durationNs;                           // First to last frame
+   uint64_t maxGapNs;                             // Longest time without frames
+};
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+extern bool frameTraceOn;           // A trace is being recorded
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool startFrameTrace( const char* /* path */ );
+void stopFrameTrace( void );
+void recordFrameTrace( const int /* bus */, const vcpIovec_t* /* frames */, const int /* numOfFrames */,
+                       const size_t /* skip */, const size_t /* bytes */ );
+bool mapFrameTrace( frameTraceMap_t* /* map */, const char* /* path */ );
+void unmapFrameTrace( frameTraceMap_t* /* map */ );
+void summarizeFrameTrace( const frameTraceMap_t* /* map */, frameTraceSummary_t* /* summary */ );
+bool replayFrameTrace( const frameTraceMap_t* /* map */, vcp_t* /* vcps */, const int /* numOfBuses */,
+                       const bool /* fast */ );
+
+#endif // FRAME_TRACE_H_INCLUDED
@@ -0,0 +1,65 @@
+/**********************************************************************************************************************
+ * logger.h
+ * @brief:  Leveled asynchronous logger for the timing critical paths.
+ *          A message is copied into a slot of a lock free ring (bounded multi producer queue, one sequence number per
+ *          slot) and a background thread writes it, so the thread sending frames never waits for a slow console or
+ *          a redirected file. Frame dumps are queued as raw bytes and only turned into text by the logger thread.
+ *          A full ring drops the message instead of blocking, the drops are reported by stopLogger().
+ *          Before startLogger() and after stopLogger() messages are written synchronously.
+ *          LOG_FRAMES() dumps are debug only and compiled out when NDEBUG is defined (Release target).
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef LOGGER_H_INCLUDED
+#define LOGGER_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include "main.h"
+#include "virtualComPort.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define LOGGER_SLOTS            256   // Messages waiting to be written, power of two
+#define LOGGER_SLOT_LENGTH      480   // Text (or frame bytes) per message, longer ones are cut
+#define LOGGER_IDLE_MS          2     // Logger thread sleep when the ring is empty
+
+// Level filter in front of the call, nothing is evaluated for a level that is not written
+#define LOG_PRINT( level, ... )                                                                                        \
+   do { if( (level) >= loggerLevel ) logPrint( (level), __VA_ARGS__ ); } while( 0 )
+
+#ifdef NDEBUG
+   #define LOG_FRAMES( label, frames, numOfFrames )  do { } while( 0 )
+#else
+   #define LOG_FRAMES( label, frames, numOfFrames )                                                                    \
+      do { if( LOG_LEVEL_DEBUG >= loggerLevel ) logFrames( (label), (frames), (numOfFrames) ); } while( 0 )
+#endif
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef enum
+{
+   LOG_LEVEL_DEBUG = 0,             // LOG_DEBUG tag
+   LOG_LEVEL_INFO,                  // LOG_INFO tag
+   LOG_LEVEL_WARNING,               // LOG_WARNING tag, to stderr
+   LOG_LEVEL_ERROR,                 // LOG_ERROR tag, to stderr
+   LOG_LEVEL_NONE                   // Filter only, nothing is written
+} logLevel_t;
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+extern logLevel_t loggerLevel;      // Messages below this level are not written (LOG_LEVEL_INFO by default)
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool startLogger( const logLevel_t /* level */ );
+void stopLogger( void );
+void flushLogger( void );
+bool parseLevelLogger( const char* /* name */, logLevel_t* /* level */ );
+void logPrint( const logLevel_t /* level */, const char* /* format */, ... ) __attribute__(( format( printf, 2, 3 ) ));
+void logFrames( const char* /* label */, const vcpIovec_t* /* frames */, const int /* numOfFrames */ );
+
+#endif // LOGGER_H_INCLUDED
@@ -13,7 +13,11 @@
 
 
 /* Includes ----------------------------------------------------------------------------------------------------------*/
-
+#ifdef _WIN32
+   #include <windows.h>             // Sleep()
+#else
+   #include <unistd.h>              // usleep()
+#endif
 
 
 /* Public/Global defines ---------------------------------------------------------------------------------------------*/
@@ -29,6 +33,14 @@
 #define MAX_BOARDS_IN_RS485_CHAIN	15
 #define MAX_RELAYS_IN_RS485_CHAIN	( MAX_RELAYS_PER_BOARD * MAX_BOARDS_IN_RS485_CHAIN )
 #define MIN_RELAY_NUMBER            1
+#define MAX_RS485_BUSES             8     // RS485 chains (USB adapters) driven by a single process
+
+// Portable millisecond sleep
+#ifdef _WIN32
+   #define SLEEP_MS( ms )           Sleep( ms )
+#else
+   #define SLEEP_MS( ms )           usleep( (useconds_t)( ms ) * 1000 )
+#endif
 
 // Log defines
 #define LOG_WARNING                 "[WARN]"
@@ -37,17 +49,41 @@
 #define LOG_DEBUG                   "[DBUG]"
 
 // Default values
-#define COM_PORT_DEFAULT            7
+#ifdef _WIN32
+   #define COM_PORT_DEFAULT         7     // COM7
+#else
+   #define COM_PORT_DEFAULT         0     // /dev/ttyUSB0
+#endif
 #define RELAY_STATE_DEFAULT         "off"
 
 // Main Program arguments
 #define ARG_RELAY_NUM               "-relay"
 #define ARG_OPEN_TIME               "-openTime"
 #define ARG_IMPULSES                "-impulses"
+#define ARG_OFF_TIME                "-offTime"
 #define ARG_RELAY_STATE             "-state"
+#define ARG_SESSION                 "-session"
+#define ARG_SCHEDULE                "-schedule"
+#define ARG_STATUS                  "-status"
+#define ARG_VERIFY                  "-verify"
 
 #define ARG_BAUD_RATE               "-baudRate"
+#define ARG_PROBE_BAUD              "-probeBaud"
 #define ARG_COM_PORT                "-comPort"
+#define ARG_DEVICE                  "-device"
+#define ARG_DISCOVER                "-discover"
+
+#define ARG_DAEMON                  "--daemon"
+#define ARG_STDIN                   "--stdin"
+#define ARG_SOCKET                  "-socket"
+#define ARG_COALESCE                "-coalesce"
+#define ARG_METRICS                 "-metrics"
+#define ARG_METRICS_PROM            "-metricsProm"
+#define ARG_LOG_LEVEL               "-logLevel"
+#define ARG_RETRY                   "-retry"
+#define ARG_TRACE                   "-trace"
+#define ARG_REPLAY                  "-replay"
+#define ARG_REPLAY_FAST             "-replayFast"
 
 
 #endif // MAIN_H_INCLUDED
@@ -0,0 +1,76 @@
+/**********************************************************************************************************************
+ * metrics.h
+ * @brief:  Latency histograms of every phase of an actuation (port open, configure, write, drain, close) and of the
+ *          pulse width error, plus counters of retries and failures.
+ *          Histograms are HDR style: exact below 2 * METRICS_SUB_BUCKETS ns, then METRICS_SUB_BUCKETS buckets per
+ *          power of two (about 3% resolution) up to the full uint64_t range, with no allocation.
+ *          Exported as JSON and as a Prometheus text file (summaries with quantiles), written to a temporary file
+ *          and renamed so readers never see half a file. Both are written at exit, the daemon refreshes them every
+ *          METRICS_EXPORT_PERIOD_NS.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define METRICS_PRECISION_BITS     5                                          // 2^5 sub-buckets per power of two
+#define METRICS_SUB_BUCKETS        ( 1 << METRICS_PRECISION_BITS )
+#define METRICS_BUCKETS            ( ( 65 - METRICS_PRECISION_BITS ) * METRICS_SUB_BUCKETS )
+#define METRICS_EXPORT_PERIOD_NS   ( 10ULL * 1000000000ULL )                  // Daemon refresh of the exported files
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// Histograms, in nanoseconds
+typedef enum
+{
+   METRIC_OPEN = 0,                 // Port open (CreateFile / open)
+   METRIC_CONFIGURE,                // Line settings (SetCommState / tcsetattr)
+   METRIC_WRITE,                    // Frames handed to the port (WriteFile / write)
+   METRIC_DRAIN,                    // Wait for the bytes to leave (FlushFileBuffers / tcdrain)
+   METRIC_CLOSE,                    // Port close (CloseHandle / close)
+   METRIC_PULSE_ERROR,              // | achieved - requested | ON width
+   METRIC_QUEUE_TO_WIRE,            // Batch pushed to a frameQueue until its first byte is on the wire (estimated)
+   METRIC_URGENT_TO_WIRE,           // Same for the urgent lane (emergency off)
+   NUM_OF_METRICS
+} metric_t;
+
+// Counters
+typedef enum
+{
+   METRIC_OPEN_RETRIES = 0,         // Opens tried again
+   METRIC_CLOSE_RETRIES,            // Closes tried again
+   METRIC_OPEN_FAILURES,            // Opens given up
+   METRIC_WRITE_FAILURES,           // Writes that failed or were dropped
+   METRIC_RETRY_DEADLINES,          // Port operations given up because their retry deadline passed
+   METRIC_RETRY_EXHAUSTED,          // Port operations given up because they ran out of tries
+   METRIC_COALESCED_BATCHES,        // Batches written together with an older one by a coalescing window
+   NUM_OF_METRIC_COUNTERS
+} metricCounter_t;
+
+typedef struct metricHistogram_type metricHistogram_t;
+struct metricHistogram_type
+{
+   uint64_t count;
+   uint64_t sumNs;
+   uint64_t minNs;
+   uint64_t maxNs;
+   uint32_t buckets[METRICS_BUCKETS];
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void     initMetrics( const char* /* jsonPath */, const char* /* prometheusPath */ );
+void     recordMetrics( const metric_t /* metric */, const uint64_t /* valueNs */ );
+void     countMetrics( const metricCounter_t /* counter */ );
+uint64_t percentileMetrics( const metric_t /* metric */, const double /* percentile */ );
+bool     exportMetrics( void );
+
+#endif // METRICS_H_INCLUDED
@@ -0,0 +1,30 @@
+/**********************************************************************************************************************
+ * portDiscovery.h
+ * @brief:  Startup search of the RS485 adapter the relay boards hang from (POSIX only).
+ *          The last device that answered is cached in a small state file and tried first. If it does not answer every
+ *          candidate is probed at the same time, stable /dev/serial/by-id paths first, and the first one whose boards
+ *          reply to a status request wins and is cached for the next start.
+ *          A device used by another relayManager process, or queued for, is not probed: its port lock is taken first.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef PORT_DISCOVERY_H_INCLUDED
+#define PORT_DISCOVERY_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include "main.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define PORT_DISCOVERY_MAX_CANDIDATES  32                       // Devices probed at the same time
+#define PORT_DISCOVERY_CACHE_NAME      ".relayManager.port"     // State file, in $HOME ( /tmp without it )
+#define PORT_DISCOVERY_PATTERNS        { "/dev/serial/by-id/*", "/dev/ttyUSB*", "/dev/ttyACM*" }  // Priority order
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool discoverPort( char* /* device */, const size_t /* deviceSize */, int* /* baudRate */, const bool /* useCache */ );
+
+#endif // PORT_DISCOVERY_H_INCLUDED
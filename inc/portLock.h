@@ -0,0 +1,81 @@
+/**********************************************************************************************************************
+ * portLock.h
+ * @brief:  Arbitration of a port between the relayManager processes that want it at the same time.
+ *          Instead of hammering the device with failed opens, every process takes a ticket and waits for its turn in a
+ *          small shared segment (a file mapped by all of them, one per device, in the temporary directory), first come
+ *          first served. The process being served also holds an exclusive lock on the file, released by the system if
+ *          it dies; a waiter that finds the ticket being served belongs to a process that no longer exists skips it.
+ *          Waiting does not touch the device, only the segment is read. A process that gives up at its deadline leaves
+ *          its ticket to be skipped the same way.
+ *          The segment also keeps the last known state of the relays of the port, so the next process does not start
+ *          from nothing. It is only read and written by the process being served.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef PORT_LOCK_H_INCLUDED
+#define PORT_LOCK_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint8_t, uint32_t, uint64_t
+#include <stdbool.h>    // bool
+#include <stdatomic.h>  // atomic_uint, atomic_long
+#ifdef _WIN32
+   #include <windows.h> // HANDLE, MAX_PATH
+#endif
+#include "main.h"
+#include "relaySet.h"
+#include "relayShadow.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define PORT_LOCK_MAGIC            0x524d4c4bU  // "RMLK"
+#define PORT_LOCK_VERSION          1
+#define PORT_LOCK_MAX_WAITERS      64           // Processes queued on the same port at once
+#define PORT_LOCK_POLL_NS          ( 2 * NS_PER_MS )  // Time between two looks at the queue while waiting
+#define PORT_LOCK_FILE_PREFIX      "relayManager"
+#define PORT_LOCK_NO_DEADLINE      UINT64_MAX   // deadlineNs of a process waiting for its turn as long as it takes
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// Shared segment of a port, mapped by every process using it
+typedef struct portLockSegment_type portLockSegment_t;
+struct portLockSegment_type
+{
+   uint32_t      magic;                              // PORT_LOCK_MAGIC once initialised
+   uint32_t      version;                            // PORT_LOCK_VERSION
+   atomic_uint   nextTicket;                         // Ticket the next process takes
+   atomic_uint   serving;                            // Ticket allowed to use the port
+   atomic_long   pids[PORT_LOCK_MAX_WAITERS];        // Process of every ticket queued or served, 0 = free slot,
+                                                     // -1 = ticket given up, the slot is freed when it is skipped
+   uint64_t      updates;                            // Times the relay states were written
+   relayShadow_t shadow;                             // Last known state of the relays of the port
+};
+
+// Port of a process
+typedef struct portLock_type portLock_t;
+struct portLock_type
+{
+   char               path[MAX_PATH];                // File holding the segment
+   portLockSegment_t* segment;                       // NULL while not acquired
+   unsigned           ticket;
+#ifdef _WIN32
+   HANDLE             hFile;
+   HANDLE             hMapping;
+#else
+   int                fd;
+#endif
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool acquirePortLock( portLock_t* /* lock */, const char* /* device */, const uint64_t /* deadlineNs */ );
+bool tryAcquirePortLock( portLock_t* /* lock */, const char* /* device */ );
+void releasePortLock( portLock_t* /* lock */ );
+bool pathPortLock( char* /* path */, const size_t /* size */, const char* /* device */ );
+void loadPortLock( const portLock_t* /* lock */, relayShadow_t* /* shadow */ );
+void storePortLock( portLock_t* /* lock */, const relayShadow_t* /* shadow */ );
+void applyPortLock( portLock_t* /* lock */, const relaySet_t* /* relays */, const uint8_t /* state */ );
+
+#endif // PORT_LOCK_H_INCLUDED
@@ -0,0 +1,44 @@
+/**********************************************************************************************************************
+ * pulseTimer.h
+ * @brief:  Monotonic clock and absolute deadline sleeps used to time the relay pulses
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef PULSE_TIMER_H_INCLUDED
+#define PULSE_TIMER_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint64_t, int64_t
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define NS_PER_US                1000ULL
+#define NS_PER_MS                1000000ULL
+#define NS_PER_SEC               1000000000ULL
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// Requested vs achieved pulse widths
+typedef struct pulseStats_type pulseStats_t;
+struct pulseStats_type
+{
+   uint32_t count;                  // Number of pulses recorded
+   int64_t  minErrorNs;             // Smallest (achieved - requested)
+   int64_t  maxErrorNs;             // Biggest (achieved - requested)
+   int64_t  sumErrorNs;             // To compute the mean error
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void     initPulseTimer( void );
+uint64_t nowPulseTimer( void );
+void     sleepUntilPulseTimer( const uint64_t /* deadlineNs */ );
+
+void     resetPulseStats( pulseStats_t* /* stats */ );
+int64_t  recordPulseStats( pulseStats_t* /* stats */, const uint64_t /* requestedNs */, const uint64_t /* achievedNs */ );
+void     mergePulseStats( pulseStats_t* /* stats */, const pulseStats_t* /* other */ );
+void     printPulseStats( const pulseStats_t* /* stats */ );
+void     printCyclePulseStats( const pulseStats_t* /* stats */ );
+
+#endif // PULSE_TIMER_H_INCLUDED
@@ -0,0 +1,53 @@
+/**********************************************************************************************************************
+ * relayDaemon.h
+ * @brief:  Resident mode. Owns the Virtual COM ports (one per RS485 bus) and serves relay commands through a unix
+ *          domain socket. Commands push their frames to a lock free queue per bus (frameQueue), the loop moves them
+ *          to the writer of the bus, so any other producer thread can feed the same ports.
+ *          One command per line, one reply per command:
+ *             set <relays> <on|off> [force]    -> OK frames=<n> (only relays changing state get a frame unless forced)
+ *             pulse <relays> <ms> [impulses]   -> OK (runs in background, no OFF time between impulses)
+ *                                                 <ms> can not be shorter than the wire time of the ON frames
+ *             cycle <relays> <openMs> <periodMs> [cycles]  -> OK (runs in background, 1 cycle by default,
+ *                                                             0 cycles = until stopped)
+ *             stop <relays>                    -> OK frames=<n> (cancels the trains and switches the relays off)
+ *             estop <relays|all>               -> OK frames=<n> (same as stop, ahead of every frame queued: on the
+ *                                                 wire within the in-flight limit of the writer plus one frame)
+ *             query <relays>                   -> OK [<bus>/]<relay>=<on|off|unknown> ...
+ *             status [<bus>/]<board>           -> OK mask=0x<hex> (read back from the board, bit 0 = first relay)
+ *                                                 ERR busy if the frames queued on the bus take more than 1 s
+ *             timing                           -> OK pulses=.. active=.. queued=<bytes> wire_ms=<time to send them>
+ *                                                 batches=<waiting> max_batches=<most ever waiting>
+ *                                                 flushes=<writes of queued batches> coalesced=<batches written
+ *                                                 with an older one> collapsed=<frames superseded>
+ *                                                 error_us min=.. mean=.. max=..
+ *             shutdown                         -> OK (the daemon ends)
+ *          <relays> uses the same syntax than '-relay', "bus/" selects the bus of the relays after it ( 1:8,1/1:8 ).
+ *          Errors are replied as "ERR <reason>". Commands may be pipelined, but a client that does not read its
+ *          replies is dropped once RELAY_DAEMON_OUTPUT_LENGTH bytes of them are waiting: nobody can stall the loop.
+ *          With a coalescing window, commands of a bus arriving within it leave in a single write, and a relay
+ *          commanded several times only gets the frame of the last command (see frameQueue.h).
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_DAEMON_H_INCLUDED
+#define RELAY_DAEMON_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint64_t
+#include "virtualComPort.h"
+#include "relayShadow.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_DAEMON_SOCKET_DEFAULT    "/tmp/relayManager.sock"
+#define RELAY_DAEMON_MAX_CLIENTS       16    // Simultaneous connections
+#define RELAY_DAEMON_LINE_LENGTH       256   // Longest accepted command line
+#define RELAY_DAEMON_OUTPUT_LENGTH     8192  // Replies a client may leave unread, it is dropped past them
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+int runRelayDaemon( vcp_t* /* vcps */, const int /* numOfBuses */, const char* /* socketPath */,
+                    relayShadow_t* /* shadows */, const uint64_t /* coalesceNs */ );
+
+#endif // RELAY_DAEMON_H_INCLUDED
@@ -0,0 +1,50 @@
+/**********************************************************************************************************************
+ * relayFrame.h
+ * @brief:  Builders for the KMTronic RS485 relay frames [0xFF, relay address, state]
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_FRAME_H_INCLUDED
+#define RELAY_FRAME_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t
+#include <stddef.h>  // size_t
+#include <stdbool.h> // bool
+#include "main.h"
+#include "relaySet.h"
+#include "virtualComPort.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_FRAME_SOH          0xff  // First byte of the frame
+#define RELAY_FRAME_ON           0x01  // Value to set a relay ON
+#define RELAY_FRAME_OFF          0x00  // Value to set a relay OFF
+#define RELAY_FRAME_LENGTH       3     // Length of the frame
+#define RELAY_FRAME_TABLE_SIZE   128   // Frames per state in relayFrameTable, covers every relay of a relaySet_t
+#define RELAY_FRAME_STATUS       0xa0  // Address asking a board for the state of its relays ( 0xa0 + board )
+#define RELAY_STATUS_LENGTH      MAX_RELAYS_PER_BOARD  // Reply to a status frame, one byte per relay (0x00 or 0x01)
+
+#if ( MAX_RELAYS_IN_RS485_CHAIN >= RELAY_FRAME_TABLE_SIZE )
+   #error "relayFrameTable is too small for MAX_RELAYS_IN_RS485_CHAIN"
+#endif
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+// Every frame, built at compile time: relayFrameTable[state][relay]. Frames of consecutive relays are contiguous
+extern const char relayFrameTable[2][RELAY_FRAME_TABLE_SIZE][RELAY_FRAME_LENGTH];
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+const char* relayFrame( const uint8_t /* relay */, const uint8_t /* state */ );
+int         buildRelayFrames( vcpIovec_t* /* frames */, const relaySet_t* /* relays */, const uint8_t /* state */ );
+size_t      lengthRelayFrames( const vcpIovec_t* /* frames */, const int /* numOfFrames */ );
+int         filterRelayFrames( vcpIovec_t* /* kept */, const int /* maxKept */, const vcpIovec_t* /* frames */,
+                               const int /* numOfFrames */, const relaySet_t* /* relays */, const uint8_t /* state */ );
+void        collectRelayFrames( const vcpIovec_t* /* frames */, const int /* numOfFrames */,
+                                relaySet_t* /* relays */ );
+void        buildRelayStatusFrame( char* /* frame */, const uint8_t /* board */ );
+bool        isRelayStatusReply( const char* /* reply */ );
+
+#endif // RELAY_FRAME_H_INCLUDED
@@ -0,0 +1,70 @@
+/**********************************************************************************************************************
+ * relayLib.h
+ * @brief:  Relay commands callable in process (librelay), without the command line.
+ *          Everything a run needs (ports of every RS485 bus, frames, writers, pulse statistics, options) lives in a
+ *          context created by openRelayLib(), so a program can drive several sets of ports at once, one context per
+ *          thread. A context is not shared between threads. The process wide parts (metrics, logger, timer) are
+ *          thread safe.
+ *          Every call opens the ports, sends and closes them again, unless a session is open (beginRelayLib()), then
+ *          the ports stay open until endRelayLib(). No call ends the program: errors are returned.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_LIB_H_INCLUDED
+#define RELAY_LIB_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+#include "virtualComPort.h"
+#include "relaySet.h"
+#include "relayShadow.h"
+#include "pulseTimer.h"
+#include "retryPolicy.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_LIB_OPTIONS_DEFAULT   { .baudRate = BAUD_RATE_DEFAULT, .retry = RETRY_POLICY_DEFAULT, .verify = false,   \
+                                      .arbitrate = false }
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct relayLibOptions_type relayLibOptions_t;
+struct relayLibOptions_type
+{
+   int           baudRate;          // Of every bus, one of BAUD_RATE_*
+   retryPolicy_t retry;             // How the ports are created, opened and closed again
+   bool          verify;            // Relays read back after every message, the wrong ones are sent again
+   bool          arbitrate;         // Wait for the turn of the process on the ports (portLock.h), up to the deadline
+                                    // of retry, the other processes using them queue behind until closeRelayLib();
+                                    // the relay states are shared
+};
+
+// Opaque, created by openRelayLib() and released by closeRelayLib()
+typedef struct relayLib_type relayLib_t;
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+relayLib_t*         openRelayLib( const char* const /* devices */[], const int /* numOfBuses */,
+                                  const relayLibOptions_t* /* options */ );
+void                closeRelayLib( relayLib_t* /* lib */ );
+vcp_t*              portsRelayLib( relayLib_t* /* lib */, int* /* numOfBuses */ );
+bool                beginRelayLib( relayLib_t* /* lib */ );
+bool                endRelayLib( relayLib_t* /* lib */ );
+bool                setRelayLib( relayLib_t* /* lib */, const relayBusSet_t* /* relays */,
+                                 const uint8_t /* state */ );
+bool                pulseRelayLib( relayLib_t* /* lib */, const relayBusSet_t* /* relays */,
+                                   const uint32_t /* widthMs */, const uint32_t /* offMs */,
+                                   const uint32_t /* count */ );
+bool                queryRelayLib( relayLib_t* /* lib */, const int /* bus */, const uint8_t /* board */,
+                                   uint8_t* /* mask */ );
+uint64_t            wireTimeRelayLib( relayLib_t* /* lib */, const relayBusSet_t* /* relays */,
+                                      const uint8_t /* state */ );
+const pulseStats_t* statsRelayLib( const relayLib_t* /* lib */ );
+const pulseStats_t* cycleStatsRelayLib( const relayLib_t* /* lib */ );
+bool                loadStatesRelayLib( const relayLib_t* /* lib */, relayShadow_t /* shadows */[] );
+void                storeStatesRelayLib( relayLib_t* /* lib */, const relayShadow_t /* shadows */[] );
+
+#endif // RELAY_LIB_H_INCLUDED
@@ -0,0 +1,73 @@
+/**********************************************************************************************************************
+ * relayScheduler.h
+ * @brief:  Independent pulse trains per relay, driven by a timer wheel from a single thread.
+ *          Every relay has its own open time, period and number of cycles. Cycles are scheduled on absolute deadlines
+ *          ( start + n * period ) and all the frames due at the same tick are sent as a single batch.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_SCHEDULER_H_INCLUDED
+#define RELAY_SCHEDULER_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+#include "virtualComPort.h"
+#include "relayFrame.h"
+#include "pulseTimer.h"
+#include "timerWheel.h"
+#include "relayShadow.h"
+#include "serialWriter.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_SCHEDULER_FOREVER  0     // Number of cycles meaning "until stopped"
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// Pulse train of a single relay
+typedef struct relayJob_type relayJob_t;
+struct relayJob_type
+{
+   wheelTimer_t timer;              // Next ON or OFF edge
+   uint8_t      relay;              // Relay address
+   uint8_t      nextState;          // RELAY_FRAME_ON or RELAY_FRAME_OFF, edge the timer is armed for
+   bool         active;
+   uint32_t     cyclesLeft;         // RELAY_SCHEDULER_FOREVER for endless trains
+   uint64_t     openNs;             // ON time of every cycle
+   uint64_t     periodNs;           // Time between two ON edges
+   uint64_t     cycleStartNs;       // Deadline of the ON edge of the current cycle
+   uint64_t     onSentNs;           // When the ON frame of the current cycle was actually sent
+   void*        scheduler;          // Owner
+};
+
+// Scheduler
+typedef struct relayScheduler_type relayScheduler_t;
+struct relayScheduler_type
+{
+   timerWheel_t wheel;
+   relayJob_t   jobs[MAX_RELAYS_IN_RS485_CHAIN + 1];                        // Indexed by relay address
+   vcp_t*       vcp;                                                         // Port the frames are sent to
+   relayShadow_t* shadow;                                                    // Optional, updated on every frame sent
+   serialWriter_t* writer;                                                   // Optional, batches are queued on it
+   vcpIovec_t   batch[2 * MAX_RELAYS_IN_RS485_CHAIN];                         // Frames due at the current tick
+   int          batchLength;                                                 // Buffers used in batch[]
+   uint32_t     activeJobs;
+   bool         writeError;
+   uint64_t     runNowNs;                                                    // Time of the run being processed
+   pulseStats_t stats;                                                       // Achieved vs requested ON widths
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void     initRelayScheduler( relayScheduler_t* /* scheduler */, vcp_t* /* vcp */, relayShadow_t* /* shadow */,
+                             serialWriter_t* /* writer */ );
+bool     startRelayScheduler( relayScheduler_t* /* scheduler */, const uint8_t /* relay */, const uint64_t /* openNs */,
+                              const uint64_t /* periodNs */, const uint32_t /* cycles */, const uint64_t /* startNs */ );
+void     stopRelayScheduler( relayScheduler_t* /* scheduler */, const uint8_t /* relay */ );
+uint64_t nextRelayScheduler( const relayScheduler_t* /* scheduler */ );
+bool     runRelayScheduler( relayScheduler_t* /* scheduler */, const uint64_t /* nowNs */ );
+
+#endif // RELAY_SCHEDULER_H_INCLUDED
@@ -0,0 +1,66 @@
+/**********************************************************************************************************************
+ * relaySet.h
+ * @brief:  Fixed size set of relays of a RS485 chain, one bit per relay (bit n is relay n).
+ *          No allocation, duplicates are impossible, union/range insert are a few word operations and iteration
+ *          jumps from one selected relay to the next.
+ *          A relayBusSet_t holds one set per RS485 chain, relays of a chain other than the first one are written
+ *          "bus/relays" (Ex. "1:8,1/1:8,12" = relays 1..8 of bus 0 and 1..8,12 of bus 1).
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_SET_H_INCLUDED
+#define RELAY_SET_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_SET_WORDS          2                       // 128 bits
+#define RELAY_SET_END            0                       // Returned by the iteration functions after the last relay
+#define RELAY_BUS_SEPARATOR      '/'                     // "bus/relays", ':' is already the range separator
+
+#if ( MAX_RELAYS_IN_RS485_CHAIN >= RELAY_SET_WORDS * 64 )
+   #error "relaySet_t is too small for MAX_RELAYS_IN_RS485_CHAIN"
+#endif
+
+// Loop over every relay of a set, in ascending order
+#define FOR_EACH_RELAY_SET( relay, set )  \
+   for( uint8_t relay = firstRelaySet( set ); relay != RELAY_SET_END; relay = nextRelaySet( set, relay ) )
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct relaySet_type relaySet_t;
+struct relaySet_type
+{
+   uint64_t bits[RELAY_SET_WORDS];
+};
+
+// One set of relays per RS485 chain
+typedef struct relayBusSet_type relayBusSet_t;
+struct relayBusSet_type
+{
+   relaySet_t buses[MAX_RS485_BUSES];
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void    clearRelaySet( relaySet_t* /* set */ );
+void    addRelaySet( relaySet_t* /* set */, const uint8_t /* relay */ );
+void    removeRelaySet( relaySet_t* /* set */, const uint8_t /* relay */ );
+void    addRangeRelaySet( relaySet_t* /* set */, const uint8_t /* first */, const uint8_t /* last */ );
+void    unionRelaySet( relaySet_t* /* set */, const relaySet_t* /* other */ );
+void    subtractRelaySet( relaySet_t* /* set */, const relaySet_t* /* other */ );
+bool    containsRelaySet( const relaySet_t* /* set */, const uint8_t /* relay */ );
+bool    isEmptyRelaySet( const relaySet_t* /* set */ );
+uint8_t countRelaySet( const relaySet_t* /* set */ );
+uint8_t firstRelaySet( const relaySet_t* /* set */ );
+uint8_t nextRelaySet( const relaySet_t* /* set */, const uint8_t /* relay */ );
+int     parseRelaySet( const char* /* argument */, relaySet_t* /* set */, const char** /* error */ );
+int     parseRelayBusSet( const char* /* argument */, relayBusSet_t* /* set */, const uint8_t /* numOfBuses */,
+                          const char** /* error */ );
+
+#endif // RELAY_SET_H_INCLUDED
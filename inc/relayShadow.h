@@ -0,0 +1,38 @@
+/**********************************************************************************************************************
+ * relayShadow.h
+ * @brief:  Shadow copy of the last state commanded to every relay of the chain, one bit per relay.
+ *          Used to send frames only for the relays whose state actually changes.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_SHADOW_H_INCLUDED
+#define RELAY_SHADOW_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint32_t
+#include <stdbool.h> // bool
+#include "main.h"
+#include "relaySet.h"
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct relayShadow_type relayShadow_t;
+struct relayShadow_type
+{
+   relaySet_t on;                   // Last commanded state, in the set = ON
+   relaySet_t known;                // Relays commanded at least once, unknown relays always get a frame
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void    initRelayShadow( relayShadow_t* /* shadow */ );
+void    setRelayShadow( relayShadow_t* /* shadow */, const uint8_t /* relay */, const uint8_t /* state */ );
+void    applyRelayShadow( relayShadow_t* /* shadow */, const relaySet_t* /* relays */, const uint8_t /* state */ );
+bool    isKnownRelayShadow( const relayShadow_t* /* shadow */, const uint8_t /* relay */ );
+bool    isOnRelayShadow( const relayShadow_t* /* shadow */, const uint8_t /* relay */ );
+bool    changesRelayShadow( const relayShadow_t* /* shadow */, const uint8_t /* relay */, const uint8_t /* state */ );
+void    filterRelayShadow( const relayShadow_t* /* shadow */, const relaySet_t* /* relays */, const uint8_t /* state */,
+                           relaySet_t* /* changedRelays */ );
+
+#endif // RELAY_SHADOW_H_INCLUDED
@@ -0,0 +1,35 @@
+/**********************************************************************************************************************
+ * relayStatus.h
+ * @brief:  Read back of the real state of the relays. Every board answers a status frame with the state of its relays,
+ *          which are kept as a bitmask (bit n is relay n+1 of the board).
+ *          Used to verify a write and send again only the relays that did not reach the commanded state.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RELAY_STATUS_H_INCLUDED
+#define RELAY_STATUS_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+#include "virtualComPort.h"
+#include "relaySet.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RELAY_STATUS_TURNAROUND_MS  50    // Time a board may take to start its reply
+
+// Board of a relay address and position of the relay in it
+#define RELAY_STATUS_BOARD( relay )  ( (uint8_t)( ( ( relay ) - 1 ) / MAX_RELAYS_PER_BOARD + 1 ) )
+#define RELAY_STATUS_BIT( relay )    ( (uint8_t)( ( ( relay ) - 1 ) % MAX_RELAYS_PER_BOARD ) )
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool readRelayStatus( const vcp_t* /* vcp */, const uint8_t /* board */, uint8_t* /* mask */,
+                      const uint64_t /* backlogNs */ );
+int  checkRelayStatus( const vcp_t* /* vcp */, const relaySet_t* /* relays */, const uint8_t /* state */,
+                       relaySet_t* /* wrong */, const uint64_t /* backlogNs */ );
+
+#endif // RELAY_STATUS_H_INCLUDED
@@ -0,0 +1,68 @@
+/**********************************************************************************************************************
+ * retryPolicy.h
+ * @brief:  Shared policy to retry an operation on the port (create, open, close).
+ *          The wait between tries grows exponentially from firstDelayMs up to maxDelayMs, and a random part of it
+ *          (jitterPercent) is removed so several processes fighting for the same adapter do not retry in lockstep.
+ *          An operation ends when it succeeds, when maxTries is reached or when deadlineMs has passed since its first
+ *          try, whatever comes first. The outcome tells the caller which one so it can fail fast.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef RETRY_POLICY_H_INCLUDED
+#define RETRY_POLICY_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include "main.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define RETRY_POLICY_SEPARATOR   ':'    // -retry tries[:firstMs[:maxMs[:deadlineMs[:jitter%]]]]
+
+// 5, 10, 20 .. 160, 200, 200 ms (minus up to a half of jitter), never more than 1 s per operation
+#define RETRY_POLICY_DEFAULT     { .maxTries = 20, .firstDelayMs = 5, .maxDelayMs = 200, .deadlineMs = 1000,      \
+                                   .jitterPercent = 50 }
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct retryPolicy_type retryPolicy_t;
+struct retryPolicy_type
+{
+   uint32_t maxTries;               // Tries, the first one included (0 = only the deadline ends the operation)
+   uint32_t firstDelayMs;           // Wait after the first failed try, doubled after every other one
+   uint32_t maxDelayMs;             // Longest wait between two tries
+   uint32_t deadlineMs;             // Time for the whole operation (0 = no deadline)
+   uint32_t jitterPercent;          // Up to this part of every wait is randomly removed, 0 to 100
+};
+
+typedef enum
+{
+   RETRY_SUCCEEDED = 0,             // At the first try
+   RETRY_RECOVERED,                 // After one or more failed tries
+   RETRY_OUT_OF_TRIES,              // maxTries failed
+   RETRY_DEADLINE,                  // deadlineMs passed
+   NUM_OF_RETRY_OUTCOMES
+} retryOutcome_t;
+
+// One operation being retried
+typedef struct retry_type retry_t;
+struct retry_type
+{
+   const retryPolicy_t* policy;
+   uint32_t       tries;            // Tries done
+   uint64_t       startNs;          // First try (monotonic ns)
+   uint64_t       delayNs;          // Next wait, before jitter
+   retryOutcome_t outcome;
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void           startRetry( retry_t* /* retry */, const retryPolicy_t* /* policy */ );
+bool           waitRetry( retry_t* /* retry */ );
+retryOutcome_t endRetry( retry_t* /* retry */, const bool /* succeeded */ );
+const char*    nameRetryOutcome( const retryOutcome_t /* outcome */ );
+bool           parseRetryPolicy( const char* /* text */, retryPolicy_t* /* policy */ );
+
+#endif // RETRY_POLICY_H_INCLUDED
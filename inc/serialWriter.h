@@ -0,0 +1,71 @@
+/**********************************************************************************************************************
+ * serialWriter.h
+ * @brief:  Non blocking writer for a Virtual COM port, driven from a poll() loop (POSIX only).
+ *          Frames are queued in a bounded ring of buffers and written when the port can take them. A partial write is
+ *          resumed where it stopped, and a port that takes no byte for too long has its queue dropped so the loop
+ *          never hangs on a stuck UART. Queued buffers are not copied, they must stay valid until written
+ *          (relayFrameTable frames always do), and are made of whole frames of RELAY_FRAME_LENGTH bytes.
+ *          A paced writer hands the UART no more than inFlightNs of wire time ahead of the line, the rest waits in the
+ *          queue where preemptSerialWriter() can still put an urgent batch in front of it, at the next frame boundary.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef SERIAL_WRITER_H_INCLUDED
+#define SERIAL_WRITER_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include "virtualComPort.h"
+#include "relaySet.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define SERIAL_WRITER_QUEUE_LENGTH         512                      // Buffers in the ring, power of two
+#define SERIAL_WRITER_STUCK_NS_DEFAULT     ( 1000ULL * 1000000ULL ) // No byte taken for this long drops the queue
+#define SERIAL_WRITER_IN_FLIGHT_NS_DEFAULT ( 5ULL * 1000000ULL )    // Wire time handed to the UART ahead of the line
+#define SERIAL_WRITER_NOT_PACED            0                        // inFlightNs of a writer handing the UART all
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct serialWriter_type serialWriter_t;
+struct serialWriter_type
+{
+   vcp_t*     vcp;                                 // Port, switched to non blocking mode
+   vcpIovec_t queue[SERIAL_WRITER_QUEUE_LENGTH];   // Buffers waiting, the first one is trimmed on partial writes
+   uint32_t   head;                                // Index of the first buffer waiting (free running)
+   uint32_t   tail;                                // Index after the last buffer waiting (free running)
+   uint32_t   urgentEnd;                           // Index after the last urgent buffer, stale once head passes it
+   uint32_t   frameOffset;                         // Bytes of the frame being written the UART already took
+   size_t     pendingBytes;
+   uint64_t   stuckNs;                             // Max time without progress
+   uint64_t   inFlightNs;                          // Max wire time handed to the UART ahead of the line
+   uint64_t   progressNs;                          // Last time a byte was taken, or the queue went from empty
+   uint64_t   wireIdleNs;                          // When the UART will have sent every byte taken so far
+   uint32_t   rejected;                            // Batches refused because the queue was full
+   uint32_t   timeouts;                            // Queues dropped because the port was stuck
+   uint32_t   canceled;                            // Frames removed from the queue by preemptSerialWriter()
+   bool       blocked;                             // The last write found the UART full, wait for POLLOUT
+   bool       writeError;                          // A write failed, the queue was dropped
+   bool       lostFrames;                          // Frames queued were dropped before the UART took them, the
+                                                   // owner clears it once the states it assumed are forgotten
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+bool     initSerialWriter( serialWriter_t* /* writer */, vcp_t* /* vcp */, const uint64_t /* stuckNs */,
+                           const uint64_t /* inFlightNs */ );
+bool     queueSerialWriter( serialWriter_t* /* writer */, const vcpIovec_t* /* frames */, const int /* numOfFrames */,
+                            const uint64_t /* nowNs */ );
+bool     preemptSerialWriter( serialWriter_t* /* writer */, const vcpIovec_t* /* frames */, const int /* numOfFrames */,
+                              const relaySet_t* /* cancel */, const uint64_t /* nowNs */ );
+bool     runSerialWriter( serialWriter_t* /* writer */, const uint64_t /* nowNs */ );
+bool     isPendingSerialWriter( const serialWriter_t* /* writer */ );
+bool     isReadySerialWriter( const serialWriter_t* /* writer */, const uint64_t /* nowNs */ );
+uint64_t nextSerialWriter( const serialWriter_t* /* writer */ );
+uint64_t wireBacklogSerialWriter( const serialWriter_t* /* writer */, const uint64_t /* nowNs */ );
+bool     drainSerialWriters( serialWriter_t* /* writers */, const int /* numOfWriters */, const uint64_t /* deadlineNs */ );
+
+#endif // SERIAL_WRITER_H_INCLUDED
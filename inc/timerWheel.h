@@ -0,0 +1,60 @@
+/**********************************************************************************************************************
+ * timerWheel.h
+ * @brief:  Hierarchical timer wheel. Timers are intrusive (no allocation), add/cancel/expire are O(1) and thousands of
+ *          outstanding timers cost nothing while they are not due.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ *********************************************************************************************************************/
+#ifndef TIMER_WHEEL_H_INCLUDED
+#define TIMER_WHEEL_H_INCLUDED
+
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // bool
+#include "pulseTimer.h"
+
+
+/* Public/Global defines ---------------------------------------------------------------------------------------------*/
+#define TIMER_WHEEL_TICK_NS      ( 100 * NS_PER_US )  // Resolution of the wheel
+#define TIMER_WHEEL_LEVELS       4                    // 256^4 ticks of 100us, about 5 days
+#define TIMER_WHEEL_SLOT_BITS    8
+#define TIMER_WHEEL_SLOTS        ( 1 << TIMER_WHEEL_SLOT_BITS )
+#define TIMER_WHEEL_NEVER        UINT64_MAX           // No timer pending
+
+
+/* Public typedefs ---------------------------------------------------------------------------------------------------*/
+typedef struct wheelTimer_type wheelTimer_t;
+typedef void ( *wheelCallback_t )( wheelTimer_t* /* timer */, void* /* context */ );
+
+// Timer, embedded in the object that owns it
+struct wheelTimer_type
+{
+   wheelTimer_t*   next;            // Slot list links (NULL when not pending)
+   wheelTimer_t*   prev;
+   uint64_t        expiryTick;      // Absolute tick it expires on
+   wheelCallback_t callback;        // Called once when it expires
+   void*           context;         // Passed to the callback
+};
+
+// Wheel
+typedef struct timerWheel_type timerWheel_t;
+struct timerWheel_type
+{
+   uint64_t     currentTick;                                              // Next tick to be processed
+   uint32_t     pending;                                                  // Timers in the wheel
+   wheelTimer_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];             // List heads
+   uint64_t     occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS / 64];     // Non empty slots bitmap
+};
+
+
+/* Public functions declaration --------------------------------------------------------------------------------------*/
+void     initTimerWheel( timerWheel_t* /* wheel */, const uint64_t /* nowNs */ );
+void     initWheelTimer( wheelTimer_t* /* timer */, wheelCallback_t /* callback */, void* /* context */ );
+void     addTimerWheel( timerWheel_t* /* wheel */, wheelTimer_t* /* timer */, const uint64_t /* expiryNs */ );
+void     cancelTimerWheel( timerWheel_t* /* wheel */, wheelTimer_t* /* timer */ );
+bool     isPendingWheelTimer( const wheelTimer_t* /* timer */ );
+uint64_t nextExpiryTimerWheel( const timerWheel_t* /* wheel */ );
+uint32_t advanceTimerWheel( timerWheel_t* /* wheel */, const uint64_t /* nowNs */ );
+
+#endif // TIMER_WHEEL_H_INCLUDED
@@ -9,9 +9,17 @@
 #define VIRTUAL_COM_PORT_H_INCLUDED
 
 /* Includes ----------------------------------------------------------------------------------------------------------*/
-#include <windows.h> // HANDLE
+#ifdef _WIN32
+   #include <windows.h> // HANDLE
+#else
+   #include <termios.h> // struct termios
+   #include <sys/uio.h> // struct iovec
+   #include <limits.h>  // IOV_MAX
+#endif
 #include <stdbool.h> // bool
-#include <stdint.h>  // uint8_t
+#include <stdint.h>  // uint8_t, uint32_t, uint64_t
+#include <stddef.h>  // size_t
+#include "retryPolicy.h"
 
 
 /* Public/Global defines ---------------------------------------------------------------------------------------------*/
@@ -33,29 +41,85 @@
 
 #define BAUD_RATE_DEFAULT        BAUD_RATE_9600
 
-#define MAX_TRIES_TO_CREATE_VCP  50
+// Every rate above, highest first. Not all of them are available on every transport ( isValidBaudRateVCP() )
+#define BAUD_RATES_HIGHEST_FIRST { BAUD_RATE_256000, BAUD_RATE_128000, BAUD_RATE_115200, BAUD_RATE_57600,   \
+                                   BAUD_RATE_38400, BAUD_RATE_19200, BAUD_RATE_14400, BAUD_RATE_9600,       \
+                                   BAUD_RATE_4800, BAUD_RATE_2400, BAUD_RATE_1200, BAUD_RATE_600,           \
+                                   BAUD_RATE_300, BAUD_RATE_110 }
+
+#define VCP_BITS_PER_BYTE        10    // 8N1 on the wire: start bit, 8 data bits and stop bit
+
+#ifndef MAX_PATH                 // MAX_PATH is normally defined by the system
+   #define MAX_PATH              256
+#endif
+
+// Device name built from a port number ( -comPort n )
+#ifdef _WIN32
+   #define VCP_DEVICE_NAME_FORMAT   "\\\\.\\COM%d"
+#else
+   #define VCP_DEVICE_NAME_FORMAT   "/dev/ttyUSB%d"
+#endif
+
+// Max number of buffers sendFramesVCP() hands to the system in a single call
+#if defined( IOV_MAX ) && ( IOV_MAX < 1024 )
+   #define VCP_MAX_IOVECS        IOV_MAX
+#else
+   #define VCP_MAX_IOVECS        1024
+#endif
 
 /* Public typedefs ---------------------------------------------------------------------------------------------------*/
+// One buffer of a vectored write, same fields as the POSIX struct iovec
+#ifdef _WIN32
+typedef struct vcpIovec_type vcpIovec_t;
+struct vcpIovec_type
+{
+   void*        iov_base;           // First byte
+   size_t       iov_len;            // Number of bytes
+};
+#else
+typedef struct iovec vcpIovec_t;
+#endif
+
 // Virtual Port COM Class
 typedef struct virtualComPort_type vcp_t;
 struct virtualComPort_type
 {
+#ifdef _WIN32
    HANDLE       hSerial;            // Object's handler
-   int          number;             // Port number
+#else
+   int          fd;                 // Object's file descriptor. Kept open for the life of the process (-1 if none)
+#endif
+   int          number;             // Port number (-1 when the port was given by name)
+   int          bus;                // RS485 bus it drives, its frames are traced with it
+   int          baudRate;           // Bits per second on the wire
    char         name[MAX_PATH];     // Port name
+#ifdef _WIN32
    DCB          dcbSerialParams;    // Connection parameters
    COMMTIMEOUTS timeouts;
+#else
+   struct termios tty;              // Connection parameters
+#endif
 };
 
 
 
 /* Public functions declaration --------------------------------------------------------------------------------------*/
-vcp_t createVCP( const int /* num */ );
+vcp_t createVCP( const int /* num */, const int /* baudRate */, const retryPolicy_t* /* retry */ );
+vcp_t createVCPByName( const char* /* name */, const int /* baudRate */, const retryPolicy_t* /* retry */ );
+bool  initVCPByName( vcp_t* /* vcp */, const char* /* name */, const int /* baudRate */,
+                     const retryPolicy_t* /* retry */ );
 bool  openVCP( vcp_t* /* vcp */ );
 bool  closeVCP( const vcp_t* /* vcp */ );
+void  destroyVCP( vcp_t* /* vcp */ );
+bool  setNonBlockingVCP( vcp_t* /* vcp */, const bool /* nonBlocking */ );
 bool  sendFrameVCP( const vcp_t* /* vcp */, const char * /* message */, const size_t /* frameLength */ );
+bool  sendFramesVCP( const vcp_t* /* vcp */, const vcpIovec_t* /* frames */, const int /* numOfFrames */ );
+int   readVCP( const vcp_t* /* vcp */, char* /* buffer */, const size_t /* length */, const uint32_t /* timeoutMs */ );
+bool  isValidBaudRateVCP( const int /* baudRate */ );
+bool  setBaudRateVCP( vcp_t* /* vcp */, const int /* baudRate */ );
+uint64_t wireTimeVCP( const vcp_t* /* vcp */, const size_t /* bytes */ );
 
-bool  tryOpenVCP( vcp_t* /* _vcp */, uint8_t /* maxNtries */ );
-bool  tryCloseVCP( const vcp_t* /* _vcp */, uint8_t /* maxNtries */ );
+bool  tryOpenVCP( vcp_t* /* _vcp */, const retryPolicy_t* /* retry */, retryOutcome_t* /* outcome */ );
+bool  tryCloseVCP( const vcp_t* /* _vcp */, const retryPolicy_t* /* retry */, retryOutcome_t* /* outcome */ );
 
 #endif // VIRTUAL_COM_PORT_H_INCLUDED
@@ -0,0 +1,502 @@
+/***********************************************************************************************************************
+ * frameQueue.c
+ * @brief:  Bounded lock free multi producer / single consumer queue of frame batches (POSIX only)
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+#define _GNU_SOURCE     // pipe2()
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <string.h>     // memcpy()
+#include <fcntl.h>      // O_NONBLOCK, O_CLOEXEC
+#include <unistd.h>     // pipe2(), read(), write(), close()
+#include "main.h"
+#include "pulseTimer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "relayFrame.h"
+#include "frameQueue.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _QUEUE_MASK           ( FRAME_QUEUE_LENGTH - 1 )
+#define _WRITER_MASK          ( SERIAL_WRITER_QUEUE_LENGTH - 1 )
+
+#if ( FRAME_QUEUE_LENGTH & _QUEUE_MASK ) != 0
+   #error "FRAME_QUEUE_LENGTH must be a power of two"
+#endif
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static int           _drain( frameQueue_t* queue, serialWriter_t* writer, const uint64_t nowNs, const bool force );
+static bool          _push( frameQueue_t* queue, const frameLane_t lane, const vcpIovec_t* frames,
+                            const int numOfFrames, const relaySet_t* cancel );
+static frameBatch_t* _first( frameRing_t* ring );
+static void          _pop( frameQueue_t* queue, frameRing_t* ring );
+static void          _cancel( frameQueue_t* queue, frameRing_t* ring, const relaySet_t* cancel );
+static void          _collapse( frameQueue_t* queue, frameRing_t* ring );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_initFrameQueue( frameQueue_t* queue, uint64_t coalesceNs )                                           //
+//   void      f_closeFrameQueue( frameQueue_t* queue )                                                               //
+//   bool      f_pushFrameQueue( frameQueue_t* queue, const vcpIovec_t* frames, int numOfFrames )                     //
+//   bool      f_pushUrgentFrameQueue( frameQueue_t* queue, const vcpIovec_t* frames, int numOfFrames, .. )           //
+//   int       f_drainFrameQueue( frameQueue_t* queue, serialWriter_t* writer, uint64_t nowNs )                       //
+//   int       f_flushFrameQueue( frameQueue_t* queue, serialWriter_t* writer, uint64_t nowNs )                       //
+//   uint64_t  f_nextFrameQueue( const frameQueue_t* queue )                                                          //
+//   bool      f_isPendingFrameQueue( const frameQueue_t* queue )                                                     //
+//   int       f_wakeFdFrameQueue( const frameQueue_t* queue )                                                        //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initFrameQueue( .. )
+ * @brief:  Function to set up an empty queue and its wake up pipe. Call it before any producer starts
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <uint64_t> coalesceNs: Window the normal batches are held to leave together, FRAME_QUEUE_NOT_COALESCED
+ *          to move them as soon as the owner looks
+ * @return: <bool> TRUE if success FALSE if the pipe could not be created
+ **********************************************************************************************************************/
+bool initFrameQueue( frameQueue_t* queue, const uint64_t coalesceNs )
+{
+   for( int lane = 0; lane < NUM_OF_FRAME_LANES; lane++ )
+   {
+      frameRing_t* ring = &queue->lanes[lane];
+      for( unsigned position = 0; position < FRAME_QUEUE_LENGTH; position++ )
+      {
+         atomic_init( &ring->batches[position].sequence, position );
+      }
+      atomic_init( &ring->tail, 0 );
+      ring->head = 0;
+   }
+   atomic_init( &queue->depth, 0 );
+   atomic_init( &queue->maxDepth, 0 );
+   atomic_init( &queue->rejected, 0 );
+   atomic_init( &queue->signaled, false );
+   queue->coalesceNs = ( coalesceNs < FRAME_QUEUE_MAX_COALESCE_NS ) ? coalesceNs : FRAME_QUEUE_MAX_COALESCE_NS;
+   queue->holdUntilNs = UINT64_MAX;
+   queue->flushes = 0;
+   queue->coalesced = 0;
+   queue->collapsed = 0;
+   queue->lostFrames = false;
+   return pipe2( queue->wakeFds, O_NONBLOCK | O_CLOEXEC ) == 0;
+}
+// END f_initFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_closeFrameQueue( .. )
+ * @brief:  Function to release the wake up pipe. The batches still waiting are lost
+ * @param1: <frameQueue_t*> queue: The queue
+ * @return: <void> None
+ **********************************************************************************************************************/
+void closeFrameQueue( frameQueue_t* queue )
+{
+   close( queue->wakeFds[0] );
+   close( queue->wakeFds[1] );
+   queue->wakeFds[0] = -1;
+   queue->wakeFds[1] = -1;
+}
+// END f_closeFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pushFrameQueue( .. )
+ * @brief:  Function to push a batch, from any thread. It never waits: a full queue refuses the batch
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order. Must stay valid until written (relayFrameTable)
+ * @param3: <int> numOfFrames: Number of buffers, up to FRAME_QUEUE_BATCH_FRAMES
+ * @return: <bool> TRUE if pushed, FALSE if the queue is full or the batch too long
+ **********************************************************************************************************************/
+bool pushFrameQueue( frameQueue_t* queue, const vcpIovec_t* frames, const int numOfFrames )
+{
+   return _push( queue, FRAME_LANE_NORMAL, frames, numOfFrames, NULL );
+}
+// END f_pushFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pushUrgentFrameQueue( .. )
+ * @brief:  Function to push an urgent batch (emergency off), from any thread. The owner sends it before any batch of
+ *          the normal lane, at the next frame boundary of its writer, and removes the ON frames of cancel still
+ *          waiting in the queue and in the writer
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order. Must stay valid until written (relayFrameTable)
+ * @param3: <int> numOfFrames: Number of buffers, up to FRAME_QUEUE_BATCH_FRAMES
+ * @param4: <const relaySet_t*> cancel: Relays that must not be switched on by anything queued before
+ * @return: <bool> TRUE if pushed, FALSE if the urgent lane is full or the batch too long
+ **********************************************************************************************************************/
+bool pushUrgentFrameQueue( frameQueue_t* queue, const vcpIovec_t* frames, const int numOfFrames,
+                           const relaySet_t* cancel )
+{
+   return _push( queue, FRAME_LANE_URGENT, frames, numOfFrames, cancel );
+}
+// END f_pushUrgentFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_drainFrameQueue( .. )
+ * @brief:  Function for the owner thread to move the batches waiting to its writer, urgent lane first, in order, until
+ *          one does not fit. That one stays first in its lane for the next call. The normal lane stays held while the
+ *          coalescing window of its first batch is open (nextFrameQueue() tells until when)
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <serialWriter_t*> writer: Writer of the bus, nothing is written here (call runSerialWriter())
+ * @param3: <uint64_t> nowNs: Current time
+ * @return: <int> Number of batches moved
+ **********************************************************************************************************************/
+int drainFrameQueue( frameQueue_t* queue, serialWriter_t* writer, const uint64_t nowNs )
+{
+   return _drain( queue, writer, nowNs, false );
+}
+// END f_drainFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_flushFrameQueue( .. )
+ * @brief:  Function for the owner thread to move the batches waiting to its writer without waiting for the end of the
+ *          coalescing window: a deadline comes first (pulse edge, status request, shutdown)
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <serialWriter_t*> writer: Writer of the bus, nothing is written here (call runSerialWriter())
+ * @param3: <uint64_t> nowNs: Current time
+ * @return: <int> Number of batches moved
+ **********************************************************************************************************************/
+int flushFrameQueue( frameQueue_t* queue, serialWriter_t* writer, const uint64_t nowNs )
+{
+   return _drain( queue, writer, nowNs, true );
+}
+// END f_flushFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nextFrameQueue( .. )
+ * @brief:  Function to know when the poll() loop has to wake up to move the batches held by the coalescing window
+ * @param1: <const frameQueue_t*> queue: The queue
+ * @return: <uint64_t> Absolute time in ns, UINT64_MAX if nothing is held
+ **********************************************************************************************************************/
+uint64_t nextFrameQueue( const frameQueue_t* queue )
+{
+   return queue->holdUntilNs;
+}
+// END f_nextFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isPendingFrameQueue( .. )
+ * @brief:  Function for the owner thread to know if a batch of the normal lane is still waiting (held by the window or
+ *          without room in the writer). Frames written to the writer directly must not overtake it
+ * @param1: <const frameQueue_t*> queue: The queue
+ * @return: <bool> TRUE if the normal lane is not empty
+ **********************************************************************************************************************/
+bool isPendingFrameQueue( const frameQueue_t* queue )
+{
+   const frameRing_t* ring = &queue->lanes[FRAME_LANE_NORMAL];
+   return atomic_load_explicit( &ring->batches[ring->head & _QUEUE_MASK].sequence, memory_order_acquire ) ==
+          ring->head + 1;
+}
+// END f_isPendingFrameQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wakeFdFrameQueue( .. )
+ * @brief:  Function to get the descriptor the owner polls (POLLIN) to know batches were pushed
+ * @param1: <const frameQueue_t*> queue: The queue
+ * @return: <int> The descriptor
+ **********************************************************************************************************************/
+int wakeFdFrameQueue( const frameQueue_t* queue )
+{
+   return queue->wakeFds[0];
+}
+// END f_wakeFdFrameQueue( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   int           f_drain( frameQueue_t* queue, serialWriter_t* writer, uint64_t nowNs, bool force )                 //
+//   bool          f_push( frameQueue_t* queue, frameLane_t lane, const vcpIovec_t* frames, int numOfFrames, .. )     //
+//   frameBatch_t* f_first( frameRing_t* ring )                                                                       //
+//   void          f_pop( frameQueue_t* queue, frameRing_t* ring )                                                    //
+//   void          f_cancel( frameQueue_t* queue, frameRing_t* ring, const relaySet_t* cancel )                       //
+//   void          f_collapse( frameQueue_t* queue, frameRing_t* ring )                                               //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_drain( .. )
+ * @brief:  Function to move the batches waiting to the writer, see drainFrameQueue()
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <serialWriter_t*> writer: Writer of the bus
+ * @param3: <uint64_t> nowNs: Current time
+ * @param4: <bool> force: TRUE to ignore the coalescing window
+ * @return: <int> Number of batches moved
+ **********************************************************************************************************************/
+static int _drain( frameQueue_t* queue, serialWriter_t* writer, const uint64_t nowNs, const bool force )
+{
+   frameRing_t*  urgent = &queue->lanes[FRAME_LANE_URGENT];
+   frameRing_t*  normal = &queue->lanes[FRAME_LANE_NORMAL];
+   frameBatch_t* batch;
+   char          discard[64];
+   int           moved = 0;
+
+   // Cleared before looking, a push after this point writes a new wake up byte
+   atomic_store( &queue->signaled, false );
+   while( read( queue->wakeFds[0], discard, sizeof( discard ) ) > 0 )
+   {
+   }
+
+   while( ( batch = _first( urgent ) ) != NULL )
+   {
+      _cancel( queue, normal, &batch->cancel );
+      if( !preemptSerialWriter( writer, batch->frames, batch->numOfFrames, &batch->cancel, nowNs ) )
+      {
+         break;                           // Waits here until the urgent batches before it are written
+      }
+      // First byte of the batch leaves when the UART is done with what it has and what stays in front of it
+      size_t ahead = 0;
+      for( uint32_t i = writer->head; i != writer->urgentEnd - (uint32_t)batch->numOfFrames; i++ )
+      {
+         ahead += writer->queue[i & _WRITER_MASK].iov_len;
+      }
+      uint64_t wireNs = ( ( writer->wireIdleNs > nowNs ) ? writer->wireIdleNs : nowNs ) +
+                        wireTimeVCP( writer->vcp, ahead );
+      recordMetrics( METRIC_URGENT_TO_WIRE, ( wireNs > batch->pushedNs ) ? wireNs - batch->pushedNs : 0 );
+      _pop( queue, urgent );
+      moved++;
+   }
+
+   // Window open since the first batch waiting, unless it must go now or the lane is filling up
+   batch = _first( normal );
+   if( batch != NULL && queue->coalesceNs != FRAME_QUEUE_NOT_COALESCED )
+   {
+      if( !force && batch->pushedNs + queue->coalesceNs > nowNs &&
+          atomic_load( &queue->depth ) < FRAME_QUEUE_LENGTH / 2 )
+      {
+         queue->holdUntilNs = batch->pushedNs + queue->coalesceNs;
+         return moved;
+      }
+      _collapse( queue, normal );
+   }
+   queue->holdUntilNs = UINT64_MAX;
+
+   int numOfNormal = 0;
+   while( ( batch = _first( normal ) ) != NULL )
+   {
+      if( (uint32_t)batch->numOfFrames > SERIAL_WRITER_QUEUE_LENGTH - ( writer->tail - writer->head ) )
+      {
+         break;                           // Waits here until the writer has room, not counted as rejected
+      }
+      if( batch->numOfFrames > 0 )        // Not emptied by an urgent batch
+      {
+         // First byte of the batch leaves when the UART is done with what it has and what is queued before it
+         uint64_t wireNs = ( ( writer->wireIdleNs > nowNs ) ? writer->wireIdleNs : nowNs ) +
+                           wireTimeVCP( writer->vcp, writer->pendingBytes );
+         queueSerialWriter( writer, batch->frames, batch->numOfFrames, nowNs );
+         recordMetrics( METRIC_QUEUE_TO_WIRE, ( wireNs > batch->pushedNs ) ? wireNs - batch->pushedNs : 0 );
+      }
+      if( numOfNormal > 0 )
+      {
+         countMetrics( METRIC_COALESCED_BATCHES );
+      }
+      _pop( queue, normal );
+      moved++;
+      numOfNormal++;
+   }
+   if( numOfNormal > 0 )
+   {
+      queue->flushes++;
+      queue->coalesced += (uint32_t)( numOfNormal - 1 );
+   }
+   return moved;
+}
+// END f_drain( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_push( .. )
+ * @brief:  Function to push a batch to a lane, from any thread, and wake the owner up
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <frameLane_t> lane: FRAME_LANE_*
+ * @param3: <const vcpIovec_t*> frames: Buffers to send, in order
+ * @param4: <int> numOfFrames: Number of buffers, up to FRAME_QUEUE_BATCH_FRAMES
+ * @param5: <const relaySet_t*> cancel: Relays whose ON frames waiting are removed, NULL for none
+ * @return: <bool> TRUE if pushed, FALSE if the lane is full or the batch too long
+ **********************************************************************************************************************/
+static bool _push( frameQueue_t* queue, const frameLane_t lane, const vcpIovec_t* frames, const int numOfFrames,
+                   const relaySet_t* cancel )
+{
+   frameRing_t*  ring = &queue->lanes[lane];
+   frameBatch_t* batch;
+   unsigned      position = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+
+   if( numOfFrames <= 0 || numOfFrames > FRAME_QUEUE_BATCH_FRAMES )
+   {
+      return false;
+   }
+   for( ;; )
+   {
+      batch = &ring->batches[position & _QUEUE_MASK];
+      int difference = (int)( atomic_load_explicit( &batch->sequence, memory_order_acquire ) - position );
+      if( difference == 0 )
+      {
+         if( atomic_compare_exchange_weak_explicit( &ring->tail, &position, position + 1, memory_order_relaxed,
+                                                    memory_order_relaxed ) )
+         {
+            break;
+         }
+      }
+      else if( difference < 0 )
+      {
+         atomic_fetch_add( &queue->rejected, 1 );
+         return false;
+      }
+      else
+      {
+         position = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+      }
+   }
+   memcpy( batch->frames, frames, (size_t)numOfFrames * sizeof( frames[0] ) );
+   batch->numOfFrames = numOfFrames;
+   if( cancel != NULL )
+   {
+      batch->cancel = *cancel;
+   }
+   else
+   {
+      clearRelaySet( &batch->cancel );
+   }
+   batch->pushedNs = nowPulseTimer();
+   atomic_store_explicit( &batch->sequence, position + 1, memory_order_release );
+
+   unsigned depth = atomic_fetch_add( &queue->depth, 1 ) + 1;
+   unsigned maxDepth = atomic_load( &queue->maxDepth );
+   while( depth > maxDepth && !atomic_compare_exchange_weak( &queue->maxDepth, &maxDepth, depth ) )
+   {
+   }
+
+   // Only the first push after the owner looked needs to wake it up
+   if( !atomic_exchange( &queue->signaled, true ) )
+   {
+      (void)!write( queue->wakeFds[1], "", 1 );
+   }
+   return true;
+}
+// END f_push( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_first( .. )
+ * @brief:  Function for the owner to get the first batch of a lane
+ * @param1: <frameRing_t*> ring: The lane
+ * @return: <frameBatch_t*> The batch, NULL if the lane is empty or its producer is still copying it
+ **********************************************************************************************************************/
+static frameBatch_t* _first( frameRing_t* ring )
+{
+   frameBatch_t* batch = &ring->batches[ring->head & _QUEUE_MASK];
+   return ( atomic_load_explicit( &batch->sequence, memory_order_acquire ) == ring->head + 1 ) ? batch : NULL;
+}
+// END f_first( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pop( .. )
+ * @brief:  Function for the owner to release the first batch of a lane to the producers
+ * @param1: <frameQueue_t*> queue: The queue
+ * @param2: <frameRing_t*> ring: The lane, its first batch is ready
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _pop( frameQueue_t* queue, frameRing_t* ring )
+{
+   atomic_store_explicit( &ring->batches[ring->head & _QUEUE_MASK].sequence, ring->head + FRAME_QUEUE_LENGTH,
+                          memory_order_release );
+   ring->head++;
+   atomic_fetch_sub( &queue->depth, 1 );
+}
+// END f_pop( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_cancel( .. )
+ * @brief:  Function for the owner to remove the ON frames of some relays from the batches ready in a lane. A batch
+ *          whose split frames do not fit any more is dropped whole: nothing it holds may reach the wire
+ * @param1: <frameQueue_t*> queue: The queue, told when a batch is dropped
+ * @param2: <frameRing_t*> ring: The lane
+ * @param3: <const relaySet_t*> cancel: The relays
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _cancel( frameQueue_t* queue, frameRing_t* ring, const relaySet_t* cancel )
+{
+   for( unsigned position = ring->head; ; position++ )
+   {
+      frameBatch_t* batch = &ring->batches[position & _QUEUE_MASK];
+      if( atomic_load_explicit( &batch->sequence, memory_order_acquire ) != position + 1 )
+      {
+         break;
+      }
+      vcpIovec_t kept[FRAME_QUEUE_BATCH_FRAMES];
+      int        numOfKept = filterRelayFrames( kept, FRAME_QUEUE_BATCH_FRAMES, batch->frames, batch->numOfFrames,
+                                                cancel, RELAY_FRAME_ON );
+      if( numOfKept < 0 )
+      {
+         LOG_PRINT( LOG_LEVEL_WARNING, "%s()::No room to split a batch of %d frames, dropped", __func__,
+                    batch->numOfFrames );
+         countMetrics( METRIC_WRITE_FAILURES );
+         queue->lostFrames = true;
+         numOfKept = 0;
+      }
+      memcpy( batch->frames, kept, (size_t)numOfKept * sizeof( kept[0] ) );
+      batch->numOfFrames = numOfKept;
+   }
+}
+// END f_cancel( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_collapse( .. )
+ * @brief:  Function for the owner to keep, among the batches ready in a lane, only the last frame of every relay: a
+ *          relay switched on by a batch and off by a later one only gets the OFF frame. A batch whose split frames do
+ *          not fit any more is left whole, the later frame still reaches the wire after it
+ * @param1: <frameQueue_t*> queue: The queue, its collapsed counter is updated
+ * @param2: <frameRing_t*> ring: The lane
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _collapse( frameQueue_t* queue, frameRing_t* ring )
+{
+   unsigned   end = ring->head;
+   relaySet_t later;                                   // Relays commanded by the batches after the one looked at
+
+   while( end - ring->head < FRAME_QUEUE_LENGTH &&
+          atomic_load_explicit( &ring->batches[end & _QUEUE_MASK].sequence, memory_order_acquire ) == end + 1 )
+   {
+      end++;
+   }
+   clearRelaySet( &later );
+   for( unsigned position = end; position-- != ring->head; )
+   {
+      frameBatch_t* batch = &ring->batches[position & _QUEUE_MASK];
+      if( batch->numOfFrames > 0 && !isEmptyRelaySet( &later ) )
+      {
+         vcpIovec_t withoutOn[FRAME_QUEUE_BATCH_FRAMES];
+         vcpIovec_t kept[FRAME_QUEUE_BATCH_FRAMES];
+         int        numOfKept = filterRelayFrames( withoutOn, FRAME_QUEUE_BATCH_FRAMES, batch->frames,
+                                                   batch->numOfFrames, &later, RELAY_FRAME_ON );
+         if( numOfKept >= 0 )
+         {
+            numOfKept = filterRelayFrames( kept, FRAME_QUEUE_BATCH_FRAMES, withoutOn, numOfKept, &later,
+                                           RELAY_FRAME_OFF );
+         }
+         if( numOfKept >= 0 )
+         {
+            queue->collapsed += (uint32_t)( ( lengthRelayFrames( batch->frames, batch->numOfFrames ) -
+                                              lengthRelayFrames( kept, numOfKept ) ) / RELAY_FRAME_LENGTH );
+            memcpy( batch->frames, kept, (size_t)numOfKept * sizeof( kept[0] ) );
+            batch->numOfFrames = numOfKept;
+         }
+      }
+      collectRelayFrames( batch->frames, batch->numOfFrames, &later );
+   }
+}
+// END f_collapse( .. ) ...
+
+#endif // !_WIN32
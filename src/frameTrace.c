@@ -0,0 +1,376 @@
+/***********************************************************************************************************************
+ * frameTrace.c
+ * @brief:  Binary trace of every frame written to the ports, memory mapped reading and replay
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fopen(), fwrite(), fclose(), setvbuf(), fprintf()
+#include <stdlib.h>     // atexit()
+#include <string.h>     // memcmp(), memset(), strncpy()
+#ifndef _WIN32
+   #include <fcntl.h>    // open(), O_RDONLY
+   #include <unistd.h>   // close()
+   #include <sys/mman.h> // mmap(), munmap(), madvise()
+   #include <sys/stat.h> // fstat()
+#endif
+#include "main.h"
+#include "pulseTimer.h"
+#include "logger.h"
+#include "relayFrame.h"
+#include "frameTrace.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _RECORDS_PER_WRITE    64    // Records gathered on the stack before every fwrite()
+#define _REPLAY_BATCH_FRAMES  128   // Frames taken together by the OS sent again with a single write
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+bool frameTraceOn = false;
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static FILE*    _file = NULL;
+static uint64_t _startNs = 0;
+static char     _buffer[FRAME_TRACE_BUFFER_LENGTH];
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void _atExit( void );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_startFrameTrace( const char* path )                                                                  //
+//   void      f_stopFrameTrace( void )                                                                               //
+//   void      f_recordFrameTrace( int bus, const vcpIovec_t* frames, int numOfFrames, size_t skip, size_t bytes )    //
+//   bool      f_mapFrameTrace( frameTraceMap_t* map, const char* path )                                              //
+//   void      f_unmapFrameTrace( frameTraceMap_t* map )                                                              //
+//   void      f_summarizeFrameTrace( const frameTraceMap_t* map, frameTraceSummary_t* summary )                      //
+//   bool      f_replayFrameTrace( const frameTraceMap_t* map, vcp_t* vcps, int numOfBuses, bool fast )               //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_startFrameTrace( .. )
+ * @brief:  Function to create the trace file and start recording. Call it before any thread writes to the ports, the
+ *          trace is closed at exit
+ * @param1: <const char*> path: Trace file, overwritten
+ * @return: <bool> TRUE if the file was created
+ **********************************************************************************************************************/
+bool startFrameTrace( const char* path )
+{
+   static bool        atExit = false;
+   frameTraceHeader_t header;
+
+   stopFrameTrace();
+   _file = fopen( path, "wb" );
+   if( _file == NULL )
+   {
+      return false;
+   }
+   setvbuf( _file, _buffer, _IOFBF, sizeof( _buffer ) );
+   _startNs = nowPulseTimer();
+   memset( &header, 0, sizeof( header ) );
+   strncpy( header.magic, FRAME_TRACE_MAGIC, sizeof( header.magic ) );
+   header.version = FRAME_TRACE_VERSION;
+   header.recordSize = sizeof( frameTraceRecord_t );
+   header.startNs = _startNs;
+   if( fwrite( &header, sizeof( header ), 1, _file ) != 1 )
+   {
+      fclose( _file );
+      _file = NULL;
+      return false;
+   }
+   if( !atExit )
+   {
+      atExit = ( atexit( _atExit ) == 0 );
+   }
+   frameTraceOn = true;
+   return true;
+}
+// END f_startFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_stopFrameTrace( .. )
+ * @brief:  Function to stop recording and write the records still buffered. Call it once no thread writes any more
+ * @return: <void> None
+ **********************************************************************************************************************/
+void stopFrameTrace( void )
+{
+   frameTraceOn = false;
+   if( _file != NULL )
+   {
+      fclose( _file );
+      _file = NULL;
+   }
+}
+// END f_stopFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_recordFrameTrace( .. )
+ * @brief:  Function to record the frames of a write, call it through TRACE_FRAMES() right after the OS took the bytes.
+ *          Buffers must hold whole frames, a frame is recorded when its first byte is among the ones written. Safe
+ *          from several threads (the stream is locked by fwrite())
+ * @param1: <int> bus: Bus of the port
+ * @param2: <const vcpIovec_t*> frames: Buffers given to the write, in order
+ * @param3: <int> numOfFrames: Number of buffers
+ * @param4: <size_t> skip: Bytes at the start that end a frame already recorded (a write resumed inside a frame)
+ * @param5: <size_t> bytes: Bytes the OS took from the buffers
+ * @return: <void> None
+ **********************************************************************************************************************/
+void recordFrameTrace( const int bus, const vcpIovec_t* frames, const int numOfFrames, const size_t skip,
+                       const size_t bytes )
+{
+   frameTraceRecord_t records[_RECORDS_PER_WRITE];
+   int                numOfRecords = 0;
+   uint64_t           timeNs = nowPulseTimer() - _startNs;
+   size_t             position = 0;                         // Byte of the write where frames[i] starts
+   FILE*              file = _file;
+
+   if( file == NULL )
+   {
+      return;
+   }
+   memset( records, 0, sizeof( records ) );
+   for( int i = 0; i < numOfFrames && position < bytes; i++ )
+   {
+      const uint8_t* data = (const uint8_t*)frames[i].iov_base;
+      size_t         at = ( position < skip ) ? skip - position :
+                          ( RELAY_FRAME_LENGTH - ( position - skip ) % RELAY_FRAME_LENGTH ) % RELAY_FRAME_LENGTH;
+      for( ; at + RELAY_FRAME_LENGTH <= frames[i].iov_len && position + at < bytes; at += RELAY_FRAME_LENGTH )
+      {
+         records[numOfRecords].timeNs = timeNs;
+         records[numOfRecords].bus = (uint8_t)bus;
+         records[numOfRecords].relay = data[at + 1];
+         records[numOfRecords].state = data[at + 2];
+         if( ++numOfRecords == _RECORDS_PER_WRITE )
+         {
+            fwrite( records, sizeof( records[0] ), (size_t)numOfRecords, file );
+            numOfRecords = 0;
+         }
+      }
+      position += frames[i].iov_len;
+   }
+   if( numOfRecords > 0 )
+   {
+      fwrite( records, sizeof( records[0] ), (size_t)numOfRecords, file );
+   }
+}
+// END f_recordFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_mapFrameTrace( .. )
+ * @brief:  Function to map a trace for reading. Nothing is read here, the pages are loaded as the records are reached
+ * @param1: <frameTraceMap_t*> map: Mapping to fill
+ * @param2: <const char*> path: Trace file
+ * @return: <bool> TRUE if the file is a trace of this version and could be mapped
+ **********************************************************************************************************************/
+bool mapFrameTrace( frameTraceMap_t* map, const char* path )
+{
+   const void* view;
+
+   memset( map, 0, sizeof( *map ) );
+#ifdef _WIN32
+   LARGE_INTEGER size;
+   map->hFile = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                             NULL );
+   if( map->hFile == INVALID_HANDLE_VALUE )
+   {
+      return false;
+   }
+   if( !GetFileSizeEx( map->hFile, &size ) || (uint64_t)size.QuadPart < sizeof( frameTraceHeader_t ) ||
+       ( map->hMapping = CreateFileMappingA( map->hFile, NULL, PAGE_READONLY, 0, 0, NULL ) ) == NULL )
+   {
+      CloseHandle( map->hFile );
+      return false;
+   }
+   map->size = (size_t)size.QuadPart;
+   view = MapViewOfFile( map->hMapping, FILE_MAP_READ, 0, 0, 0 );
+   if( view == NULL )
+   {
+      CloseHandle( map->hMapping );
+      CloseHandle( map->hFile );
+      return false;
+   }
+#else
+   struct stat status;
+   map->fd = open( path, O_RDONLY | O_CLOEXEC );
+   if( map->fd < 0 )
+   {
+      return false;
+   }
+   if( fstat( map->fd, &status ) != 0 || (size_t)status.st_size < sizeof( frameTraceHeader_t ) )
+   {
+      close( map->fd );
+      return false;
+   }
+   map->size = (size_t)status.st_size;
+   view = mmap( NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0 );
+   if( view == MAP_FAILED )
+   {
+      close( map->fd );
+      return false;
+   }
+   madvise( (void*)view, map->size, MADV_SEQUENTIAL );
+#endif
+   map->header = (const frameTraceHeader_t*)view;
+   map->records = (const frameTraceRecord_t*)( map->header + 1 );
+   map->numOfRecords = ( map->size - sizeof( frameTraceHeader_t ) ) / sizeof( frameTraceRecord_t );
+   if( memcmp( map->header->magic, FRAME_TRACE_MAGIC, sizeof( FRAME_TRACE_MAGIC ) ) != 0 ||
+       map->header->version != FRAME_TRACE_VERSION || map->header->recordSize != sizeof( frameTraceRecord_t ) )
+   {
+      unmapFrameTrace( map );
+      return false;
+   }
+   return true;
+}
+// END f_mapFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_unmapFrameTrace( .. )
+ * @brief:  Function to release a mapped trace
+ * @param1: <frameTraceMap_t*> map: The mapping, its records can not be used any more
+ * @return: <void> None
+ **********************************************************************************************************************/
+void unmapFrameTrace( frameTraceMap_t* map )
+{
+   if( map->header == NULL )
+   {
+      return;
+   }
+#ifdef _WIN32
+   UnmapViewOfFile( map->header );
+   CloseHandle( map->hMapping );
+   CloseHandle( map->hFile );
+#else
+   munmap( (void*)map->header, map->size );
+   close( map->fd );
+#endif
+   map->header = NULL;
+   map->records = NULL;
+   map->numOfRecords = 0;
+}
+// END f_unmapFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_summarizeFrameTrace( .. )
+ * @brief:  Function to count what a trace holds, in one pass over the mapping
+ * @param1: <const frameTraceMap_t*> map: The trace
+ * @param2: <frameTraceSummary_t*> summary: Counts
+ * @return: <void> None
+ **********************************************************************************************************************/
+void summarizeFrameTrace( const frameTraceMap_t* map, frameTraceSummary_t* summary )
+{
+   uint64_t oldestNs = UINT64_MAX;                    // Threads append at the same time, records are not in time order
+   uint64_t newestNs = 0;
+
+   memset( summary, 0, sizeof( *summary ) );
+   for( size_t index = 0; index < map->numOfRecords; index++ )
+   {
+      const frameTraceRecord_t* record = &map->records[index];
+      bool                      isRelay = ( record->bus < MAX_RS485_BUSES && record->relay >= 1 &&
+                                            record->relay <= MAX_RELAYS_IN_RS485_CHAIN );
+      if( record->bus < MAX_RS485_BUSES )
+      {
+         summary->frames[record->bus]++;
+      }
+      if( isRelay && record->state == RELAY_FRAME_ON )       summary->onFrames++;
+      else if( isRelay && record->state == RELAY_FRAME_OFF ) summary->offFrames++;
+      else                                                   summary->otherFrames++;
+      if( index > 0 && record->timeNs > map->records[index - 1].timeNs &&
+          record->timeNs - map->records[index - 1].timeNs > summary->maxGapNs )
+      {
+         summary->maxGapNs = record->timeNs - map->records[index - 1].timeNs;
+      }
+      if( record->timeNs < oldestNs ) oldestNs = record->timeNs;
+      if( record->timeNs > newestNs ) newestNs = record->timeNs;
+   }
+   if( map->numOfRecords > 0 )
+   {
+      summary->durationNs = newestNs - oldestNs;
+   }
+}
+// END f_summarizeFrameTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_replayFrameTrace( .. )
+ * @brief:  Function to send the frames of a trace again. The frames the OS took together on a bus are sent with one
+ *          write. At the original timing every write waits for its absolute deadline from the start of the replay, a
+ *          late one does not delay the next ones
+ * @param1: <const frameTraceMap_t*> map: The trace
+ * @param2: <vcp_t*> vcps: Port of every bus, open
+ * @param3: <int> numOfBuses: Number of ports, frames of other buses are skipped
+ * @param4: <bool> fast: TRUE to send as fast as the ports take them, FALSE for the original timing
+ * @return: <bool> TRUE if every frame was sent
+ **********************************************************************************************************************/
+bool replayFrameTrace( const frameTraceMap_t* map, vcp_t* vcps, const int numOfBuses, const bool fast )
+{
+   char     batch[_REPLAY_BATCH_FRAMES * RELAY_FRAME_LENGTH];
+   size_t   skipped = 0;
+   uint64_t startNs = nowPulseTimer();
+   uint64_t firstNs = ( map->numOfRecords > 0 ) ? map->records[0].timeNs : 0;
+   uint64_t latestNs = firstNs;                  // Latest record time reached, an older record is not waited for
+   bool     sent = true;
+
+   for( size_t index = 0; index < map->numOfRecords; )
+   {
+      const frameTraceRecord_t* first = &map->records[index];
+      size_t                    used = 0;
+      while( index < map->numOfRecords && used < sizeof( batch ) && map->records[index].timeNs == first->timeNs &&
+             map->records[index].bus == first->bus )
+      {
+         batch[used++] = (char)RELAY_FRAME_SOH;
+         batch[used++] = (char)map->records[index].relay;
+         batch[used++] = (char)map->records[index].state;
+         index++;
+      }
+      if( first->bus >= numOfBuses )
+      {
+         skipped += used / RELAY_FRAME_LENGTH;
+         continue;
+      }
+      if( !fast )
+      {
+         // Threads recording at the same time may leave records out of time order, they go out at once
+         if( first->timeNs > latestNs )
+         {
+            latestNs = first->timeNs;
+         }
+         sleepUntilPulseTimer( startNs + ( latestNs - firstNs ) );
+      }
+      sent = sendFrameVCP( &vcps[first->bus], batch, used ) && sent;
+   }
+   if( skipped > 0 )
+   {
+      LOG_PRINT( LOG_LEVEL_WARNING, "%s()::%zu frames of buses without a port skipped", __func__, skipped );
+   }
+   return sent;
+}
+// END f_replayFrameTrace( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_atExit( void )                                                                                       //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_atExit( .. )
+ * @brief:  Function registered with atexit(), the records still buffered are written whatever the way the program ends
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _atExit( void )
+{
+   stopFrameTrace();
+}
+// END f_atExit( .. ) ...
@@ -0,0 +1,448 @@
+/***********************************************************************************************************************
+ * logger.c
+ * @brief:  Leveled asynchronous logger, lock free ring drained by a background thread
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fprintf(), vsnprintf(), fwrite(), fflush()
+#include <stdlib.h>     // atexit()
+#include <stdarg.h>     // va_list, va_start(), va_end()
+#include <string.h>     // strcmp(), strlen(), memcpy()
+#include <stdatomic.h>  // atomic_size_t, atomic_bool, atomic_load_explicit(), ...
+#ifdef _WIN32
+   #include <windows.h> // CreateThread(), WaitForSingleObject(), CloseHandle()
+#else
+   #include <unistd.h>  // usleep()
+   #include <pthread.h> // pthread_create(), pthread_join()
+#endif
+#include "logger.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _SLOT_MASK            ( LOGGER_SLOTS - 1 )
+#define _FRAMES_LINE_LENGTH   ( 64 + LOGGER_SLOT_LENGTH * 5 )   // "0x.. " per byte, plus tag and label
+
+#if ( LOGGER_SLOTS & _SLOT_MASK ) != 0
+   #error "LOGGER_SLOTS must be a power of two"
+#endif
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+// A message waiting in the ring. sequence == position: free for the producer of that position,
+// sequence == position + 1: filled, ready for the logger thread
+typedef struct loggerSlot_type loggerSlot_t;
+struct loggerSlot_type
+{
+   atomic_size_t sequence;
+   uint8_t       level;
+   bool          isFrames;                  // data is "label\0" followed by raw frame bytes
+   bool          isCut;                     // Did not fit in data
+   uint16_t      length;                    // Bytes used in data
+   char          data[LOGGER_SLOT_LENGTH];
+};
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+logLevel_t loggerLevel = LOG_LEVEL_INFO;
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static loggerSlot_t  _ring[LOGGER_SLOTS];
+static atomic_size_t _tail;                 // Next position a producer takes
+static atomic_size_t _head;                 // Next position the logger thread reads
+static atomic_size_t _written;              // Positions already written and flushed
+static atomic_size_t _dropped;              // Messages lost because the ring was full
+static atomic_bool   _running;
+static atomic_bool   _stopRequested;
+#ifdef _WIN32
+static HANDLE        _thread;
+#else
+static pthread_t     _thread;
+#endif
+
+static const char* const _tags[LOG_LEVEL_NONE] = { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR };
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+#ifdef _WIN32
+static DWORD WINAPI _run( LPVOID arg );
+#else
+static void* _run( void* arg );
+#endif
+static void          _drain( void );
+static void          _write( const loggerSlot_t* slot );
+static loggerSlot_t* _takeSlot( size_t* position );
+static void          _atExit( void );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_startLogger( logLevel_t level )                                                                      //
+//   void      f_stopLogger( void )                                                                                   //
+//   void      f_flushLogger( void )                                                                                  //
+//   bool      f_parseLevelLogger( const char* name, logLevel_t* level )                                              //
+//   void      f_logPrint( logLevel_t level, const char* format, ... )                                                //
+//   void      f_logFrames( const char* label, const vcpIovec_t* frames, int numOfFrames )                            //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_startLogger( .. )
+ * @brief:  Function to set the level and start the logger thread. The ring is drained at exit
+ * @param1: <logLevel_t> level: Messages below this level are not written
+ * @return: <bool> TRUE if the thread runs, FALSE if messages keep being written synchronously
+ **********************************************************************************************************************/
+bool startLogger( const logLevel_t level )
+{
+   static bool atExit = false;
+
+   loggerLevel = level;
+   if( atomic_load( &_running ) )
+   {
+      return true;
+   }
+   for( size_t position = 0; position < LOGGER_SLOTS; position++ )
+   {
+      atomic_init( &_ring[position].sequence, position );
+   }
+   atomic_store( &_tail, 0 );
+   atomic_store( &_head, 0 );
+   atomic_store( &_written, 0 );
+   atomic_store( &_stopRequested, false );
+#ifdef _WIN32
+   _thread = CreateThread( NULL, 0, _run, NULL, 0, NULL );
+   if( _thread == NULL )
+#else
+   if( pthread_create( &_thread, NULL, _run, NULL ) != 0 )
+#endif
+   {
+      fprintf( stderr, "%s Could not start the logger thread, logging synchronously\n", LOG_WARNING );
+      return false;
+   }
+   atomic_store( &_running, true );
+   if( !atExit )
+   {
+      atExit = ( atexit( _atExit ) == 0 );
+   }
+   return true;
+}
+// END f_startLogger( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_stopLogger( .. )
+ * @brief:  Function to write every message waiting and stop the logger thread
+ * @return: <void> None
+ **********************************************************************************************************************/
+void stopLogger( void )
+{
+   if( !atomic_load( &_running ) )
+   {
+      return;
+   }
+   atomic_store( &_stopRequested, true );
+#ifdef _WIN32
+   WaitForSingleObject( _thread, INFINITE );
+   CloseHandle( _thread );
+#else
+   pthread_join( _thread, NULL );
+#endif
+   atomic_store( &_running, false );
+   if( atomic_load( &_dropped ) > 0 )
+   {
+      fprintf( stderr, "%s %zu log message/s dropped, the ring was full\n", LOG_WARNING,
+               (size_t)atomic_load( &_dropped ) );
+   }
+}
+// END f_stopLogger( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_flushLogger( .. )
+ * @brief:  Function to wait until every message queued so far is written. Call it before writing synchronously to
+ *          the same streams, so the lines keep their order
+ * @return: <void> None
+ **********************************************************************************************************************/
+void flushLogger( void )
+{
+   size_t tail = atomic_load( &_tail );
+
+   while( atomic_load( &_running ) && atomic_load( &_written ) < tail )
+   {
+      SLEEP_MS( 1 );
+   }
+}
+// END f_flushLogger( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseLevelLogger( .. )
+ * @brief:  Function to get a level from its name
+ * @param1: <const char*> name: "debug", "info", "warn", "error" or "none"
+ * @param2: <logLevel_t*> level: Where to store it
+ * @return: <bool> TRUE if the name is valid
+ **********************************************************************************************************************/
+bool parseLevelLogger( const char* name, logLevel_t* level )
+{
+   static const char* const names[] = { "debug", "info", "warn", "error", "none" };
+
+   for( int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_NONE; i++ )
+   {
+      if( strcmp( name, names[i] ) == 0 )
+      {
+         *level = (logLevel_t)i;
+         return true;
+      }
+   }
+   return false;
+}
+// END f_parseLevelLogger( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_logPrint( .. )
+ * @brief:  Function to queue a message. The tag of the level and the end of line are added by the logger
+ * @param1: <logLevel_t> level: Level of the message, use LOG_PRINT() to skip the call for filtered levels
+ * @param2: <const char*> format: printf() format
+ * @return: <void> None
+ **********************************************************************************************************************/
+void logPrint( const logLevel_t level, const char* format, ... )
+{
+   loggerSlot_t* slot;
+   size_t        position;
+   va_list       args;
+
+   if( level < loggerLevel || level >= LOG_LEVEL_NONE )
+   {
+      return;
+   }
+   if( !atomic_load( &_running ) )
+   {
+      FILE* stream = ( level >= LOG_LEVEL_WARNING ) ? stderr : stdout;
+      fprintf( stream, "%s ", _tags[level] );
+      va_start( args, format );
+      vfprintf( stream, format, args );
+      va_end( args );
+      fprintf( stream, "\n" );
+      return;
+   }
+   if( ( slot = _takeSlot( &position ) ) == NULL )
+   {
+      return;                             // Ring full, counted as dropped
+   }
+   va_start( args, format );
+   int length = vsnprintf( slot->data, sizeof( slot->data ), format, args );
+   va_end( args );
+   slot->level = (uint8_t)level;
+   slot->isFrames = false;
+   slot->isCut = ( length >= (int)sizeof( slot->data ) );
+   slot->length = (uint16_t)( ( length < 0 ) ? 0 : slot->isCut ? sizeof( slot->data ) - 1 : (size_t)length );
+   atomic_store_explicit( &slot->sequence, position + 1, memory_order_release );
+}
+// END f_logPrint( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_logFrames( .. )
+ * @brief:  Function to queue a dump of the bytes of a message at debug level. Only the bytes are copied, the logger
+ *          thread formats them
+ * @param1: <const char*> label: Name of the message
+ * @param2: <const vcpIovec_t*> frames: Buffers of the message
+ * @param3: <int> numOfFrames: Number of buffers
+ * @return: <void> None
+ **********************************************************************************************************************/
+void logFrames( const char* label, const vcpIovec_t* frames, const int numOfFrames )
+{
+   loggerSlot_t  local;
+   loggerSlot_t* slot = &local;
+   size_t        position = 0;
+   size_t        used;
+
+   if( LOG_LEVEL_DEBUG < loggerLevel )
+   {
+      return;
+   }
+   if( atomic_load( &_running ) && ( slot = _takeSlot( &position ) ) == NULL )
+   {
+      return;
+   }
+   used = strlen( label ) + 1;
+   if( used > sizeof( slot->data ) / 2 )
+   {
+      used = sizeof( slot->data ) / 2;
+   }
+   memcpy( slot->data, label, used - 1 );
+   slot->data[used - 1] = '\0';
+   slot->isCut = false;
+   for( int i = 0; i < numOfFrames && !slot->isCut; i++ )
+   {
+      size_t length = frames[i].iov_len;
+      if( length > sizeof( slot->data ) - used )
+      {
+         length = sizeof( slot->data ) - used;
+         slot->isCut = true;
+      }
+      memcpy( slot->data + used, frames[i].iov_base, length );
+      used += length;
+   }
+   slot->level = LOG_LEVEL_DEBUG;
+   slot->isFrames = true;
+   slot->length = (uint16_t)used;
+   if( slot == &local )
+   {
+      _write( slot );                     // No thread, synchronous
+      return;
+   }
+   atomic_store_explicit( &slot->sequence, position + 1, memory_order_release );
+}
+// END f_logFrames( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void*     f_run( void* arg )                                                                                     //
+//   void      f_drain( void )                                                                                        //
+//   void      f_write( const loggerSlot_t* slot )                                                                    //
+//   loggerSlot_t* f_takeSlot( size_t* position )                                                                     //
+//   void      f_atExit( void )                                                                                       //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_run( .. )
+ * @brief:  Logger thread, writes the messages until a stop is requested and the ring is empty
+ * @param1: <void*> arg: Not used
+ * @return: <void*> NULL
+ **********************************************************************************************************************/
+#ifdef _WIN32
+static DWORD WINAPI _run( LPVOID arg )
+#else
+static void* _run( void* arg )
+#endif
+{
+   (void)arg;
+   while( !atomic_load( &_stopRequested ) )
+   {
+      _drain();
+      SLEEP_MS( LOGGER_IDLE_MS );
+   }
+   _drain();
+#ifdef _WIN32
+   return 0;
+#else
+   return NULL;
+#endif
+}
+// END f_run( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_drain( .. )
+ * @brief:  Function to write every filled slot, in order, and give them back to the producers
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _drain( void )
+{
+   size_t head = atomic_load_explicit( &_head, memory_order_relaxed );
+   bool   wrote = false;
+
+   for( ;; )
+   {
+      loggerSlot_t* slot = &_ring[head & _SLOT_MASK];
+      if( atomic_load_explicit( &slot->sequence, memory_order_acquire ) != head + 1 )
+      {
+         break;                           // Empty, or the producer of this position is still filling it
+      }
+      _write( slot );
+      atomic_store_explicit( &slot->sequence, head + LOGGER_SLOTS, memory_order_release );
+      head++;
+      wrote = true;
+   }
+   atomic_store_explicit( &_head, head, memory_order_relaxed );
+   if( wrote )
+   {
+      fflush( stdout );
+      fflush( stderr );
+   }
+   atomic_store( &_written, head );
+}
+// END f_drain( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_write( .. )
+ * @brief:  Function to write a message with the tag of its level, frame dumps are formatted here
+ * @param1: <const loggerSlot_t*> slot: The message
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _write( const loggerSlot_t* slot )
+{
+   FILE* stream = ( slot->level >= LOG_LEVEL_WARNING ) ? stderr : stdout;
+
+   if( !slot->isFrames )
+   {
+      fprintf( stream, "%s %.*s%s\n", _tags[slot->level], (int)slot->length, slot->data, slot->isCut ? "..." : "" );
+      return;
+   }
+   char   line[_FRAMES_LINE_LENGTH];
+   size_t labelLength = strlen( slot->data );
+   int    used = snprintf( line, sizeof( line ), "%s %s: [ ", _tags[slot->level], slot->data );
+   for( size_t byte = labelLength + 1; byte < slot->length && used < (int)sizeof( line ); byte++ )
+   {
+      used += snprintf( line + used, sizeof( line ) - (size_t)used, "0x%.2x ", (uint8_t)slot->data[byte] );
+   }
+   fprintf( stream, "%s%s]\n", line, slot->isCut ? "... " : "" );
+}
+// END f_write( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_takeSlot( .. )
+ * @brief:  Function to reserve the next free slot. Several threads may call it at the same time
+ * @param1: <size_t*> position: Where to store the position taken, publish the slot with sequence = position + 1
+ * @return: <loggerSlot_t*> The slot, NULL if the ring is full (the message is counted as dropped)
+ **********************************************************************************************************************/
+static loggerSlot_t* _takeSlot( size_t* position )
+{
+   size_t tail = atomic_load_explicit( &_tail, memory_order_relaxed );
+
+   for( ;; )
+   {
+      loggerSlot_t* slot = &_ring[tail & _SLOT_MASK];
+      size_t        sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+      intptr_t      difference = (intptr_t)sequence - (intptr_t)tail;
+      if( difference == 0 )
+      {
+         if( atomic_compare_exchange_weak_explicit( &_tail, &tail, tail + 1, memory_order_relaxed,
+                                                    memory_order_relaxed ) )
+         {
+            *position = tail;
+            return slot;
+         }
+      }
+      else if( difference < 0 )
+      {
+         atomic_fetch_add( &_dropped, 1 );
+         return NULL;
+      }
+      else
+      {
+         tail = atomic_load_explicit( &_tail, memory_order_relaxed );
+      }
+   }
+}
+// END f_takeSlot( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_atExit( .. )
+ * @brief:  atexit() handler, writes what is left in the ring
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _atExit( void )
+{
+   stopLogger();
+}
+// END f_atExit( .. ) ...
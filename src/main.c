@@ -8,30 +8,58 @@
  *
  *********************************************************************************************************************/
 /* Includes ----------------------------------------------------------------------------------------------------------*/
-#include <windows.h> // MAX_PATH, HANDLE, DCB, COMMTIMEOUTS, CreateFile()
+#ifdef _WIN32
+   #include <windows.h> // MAX_PATH, HANDLE, DCB, COMMTIMEOUTS, CreateFile()
+#endif
 #include <stdio.h>   // fprintf(), stderr
 #include <string.h>  // strcmp(), strcpy(), strlen()
 #include <stdlib.h>  // atoi(), strtol()
-#include <stdint.h>  // uint8_t
-#include <ctype.h>   //
-#include <time.h>    //
+#include <stdint.h>  // uint8_t, uint32_t, UINT32_MAX
 
 #include "main.h"
 #include "virtualComPort.h"
+#include "relayFrame.h"
+#include "relayDaemon.h"
+#include "pulseTimer.h"
+#include "relaySet.h"
+#include "relayScheduler.h"
+#include "serialWriter.h"
+#include "frameQueue.h"
+#include "portDiscovery.h"
+#include "relayStatus.h"
+#include "metrics.h"
+#include "logger.h"
+#include "retryPolicy.h"
+#include "relayLib.h"
+#include "frameTrace.h"
 
 
 
 /* Private defines ---------------------------------------------------------------------------------------------------*/
-#define _FRAME_SOH            0xff  // First byte of the frame
-#define _FRAME_RELAY_ON       0x01  // Value to set a relay ON
-#define _FRAME_RELAY_OFF      0x00  // Value to set a relay OFFLINE_STATUS_INCOMPLETE
-#define _FRAME_LENGTH         3     // Length of the frame
+#define _FRAME_LENGTH         RELAY_FRAME_LENGTH
 
-#define _SLEEP_TIME           5
-#define _MAX_OPEN_VCP_TRIES   50    // Max number of retries to open the COM port in case it fails
-#define _MAX_CLOSE_VCP_TRIES  50    // Max number of retries to close the COM port in case it fails
+#define _MAX_SCHEDULES        16    // Max number of '-schedule' arguments
 
-#define _MAX_RELAY_RANGE      7
+#define _PROBE_BOARD          1     // Board asked for its status by '-probeBaud'
+
+#define _LINE_LENGTH          256   // Longest command line read by '--stdin', the '\n' included
+#define _MAX_LINE_TOKENS      16    // Arguments of a command line
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+// Command of a '--stdin' line
+typedef struct lineCommand_type lineCommand_t;
+struct lineCommand_type
+{
+   relayBusSet_t relays;
+   int           numOfRelays;
+   bool          pulse;                            // '-openTime' given, '-state' otherwise
+   uint8_t       state;                            // RELAY_FRAME_ON or RELAY_FRAME_OFF
+   uint32_t      openTime;
+   uint32_t      offTime;
+   uint32_t      impulses;
+   int           statusBoard;                      // '-status', 0 = none
+};
 
 
 
@@ -39,44 +67,59 @@
 // Virtual COM port settings
 static int  _baudrate         = BAUD_RATE_DEFAULT; // Variable to set the baudrate of the UART connection
 static int  _comPortNumber    = COM_PORT_DEFAULT;  // Variable to set the COM port of the UART connection
+static bool _baudRateFlag     = false;             // When true '-baudRate' argument was called
+static bool _comPortFlag      = false;             // When true '-comPort' argument was called, no discovery
+static bool _discoverFlag     = false;             // When true the cached device is ignored by the discovery
+static char _deviceNames[MAX_RS485_BUSES][MAX_PATH]; // Full device path of every bus, overrides _comPortNumber
+static int  _numOfDevices     = 0;                 // Number of '-device' arguments
+static int  _numOfBuses       = 1;                 // RS485 chains driven, one per device (or the COM port alone)
 
 // Relay settings
-static uint8_t  _relayBegin   = 0;                 // The first relay in a range of relays
-static uint8_t  _relayEnd     = 0;                 // The last relay in a range of relays
-static uint8_t  _numOfRelays  = 0;                 // Number of relays affected into the query. MAX 120!!!
+static relayBusSet_t _relays;                      // Relays affected into the query, one bit per relay and bus
+static uint16_t _numOfRelays  = 0;                 // Number of relays affected into the query. MAX 120 per bus!!!
 
 // State & time settings
-static uint16_t _openTime     = 0;                 // Time the relay must be open
-static uint8_t  _impulses     = 1;                 // Number of impulses to give
+static uint32_t _openTime     = 0;                 // Time the relay must be open
+static uint32_t _offTime      = 0;                 // Time the relay stays off between impulses
+static uint32_t _impulses     = 1;                 // Number of impulses to give
 static char     _relayState[_FRAME_LENGTH+1];      // Only 2 states valid "on" or "off"
 
 // Main arguments flags
-static bool _singleRelayFlag = false;              // When true means a single relay was choosen (Ex. 4)
-static bool _rangeRelayFlag  = false;              // When true means a range of relays was choosem (Ex. 2:8)
-static bool _multiRelayFlag  = false;              // When true means a group of different relays was choosen (Ex. 2,6,8)
 static bool _stateFlag       = false;              // When true '-state' argument was called
 static bool _openTimeFlag    = false;              // When true '-openTime' argument was called
 static bool _impulsesFlag    = false;              // When true '-impulses' argument was called
-
-// Dynamic allocate
-uint8_t* _relays        = NULL; // Pointer to set dynamic array depending on the number of relays affected
-char*    _rs485OpenMsg  = NULL; // Pointer to allocate dynamic array to send the instructions to open relays
-char*    _rs485CloseMsg = NULL; // Pointer to allocate dynamic array to send the instructions to open relays
-
-
-/* Private typedefs --------------------------------------------------------------------------------------------------*/
-typedef enum eRelayModality_type {
-   _errorRelay  = -1,
-   _singleRelay = 1,
-   _rangeRelays = 2,
-   _groupRelays = 3
-} relayModality_t;
+static bool _offTimeFlag     = false;              // When true '-offTime' argument was called
+static bool _sessionFlag     = false;              // When true the port is opened once and kept open for all frames
+static bool _daemonFlag      = false;              // When true the program stays resident serving socket commands
+static bool _stdinFlag       = false;              // When true the commands are read from stdin, one per line
+static bool _probeBaudFlag   = false;              // When true the baud rate of the boards is searched first
+static bool _verifyFlag      = false;              // When true the state of the relays is read back after sending
+static int  _statusBoard     = 0;                  // Board asked for the state of its relays by '-status', 0 = none
+static char _socketPath[MAX_PATH] = RELAY_DAEMON_SOCKET_DEFAULT; // Command socket of the daemon
+static uint32_t _coalesceUs  = 0;                  // Coalescing window of the daemon writes, 0 = none
+static bool _coalesceFlag    = false;              // When true '-coalesce' argument was called
+static char _metricsPath[MAX_PATH];                // JSON metrics written at exit, empty = none
+static char _metricsPromPath[MAX_PATH];            // Prometheus metrics written at exit (and periodically by the daemon)
+static char _tracePath[MAX_PATH];                  // Binary trace of every frame written, empty = none
+static char _replayPath[MAX_PATH];                 // Trace sent again instead of a command, empty = none
+static bool _replayFastFlag  = false;              // When true the trace is replayed as fast as the ports take it
+static logLevel_t _logLevel = LOG_LEVEL_INFO;      // '-logLevel', messages of the hot paths below it are not written
+static retryPolicy_t _retryPolicy = RETRY_POLICY_DEFAULT; // '-retry', how the port is created, opened and closed again
+static char* _schedules[_MAX_SCHEDULES];           // '-schedule' values, one pulse train per relay
+static int   _numOfSchedules = 0;
 
 
 /* Private functions declaration -------------------------------------------------------------------------------------*/
 static int parseArgs( int argc, char *argv[] );
-static relayModality_t relayModality( char* relayArgument, uint8_t* numberOfRelays );
-static void _fillRelaysGroup( char* relayArgument, uint8_t* array, const uint8_t size );
+static bool _parseUint32( const char* text, uint32_t* value );
+static bool _parseSchedule( const char* schedule, relayBusSet_t* relays, uint32_t* openTime, uint32_t* period,
+                            uint32_t* cycles );
+static int  runSchedules( relayLib_t* lib );
+static int  _probeBaudRate( vcp_t* vcp );
+static bool _printStatusBuses( relayLib_t* lib, const uint8_t board );
+static int  _replayTrace( relayLib_t* lib );
+static int  _runLines( relayLib_t* lib );
+static bool _parseLine( char* line, lineCommand_t* command, const uint8_t numOfBuses, const char** error );
 
 
 /* Main function -----------------------------------------------------------------------------------------------------*/
@@ -88,14 +131,10 @@ int main( int argc, char *argv[] )
    fprintf( stdout, SOFTWARE_VERSION  );
    fprintf( stdout, "\n" );
 
-   // Set frames for open/close messages
-   char openRelayMess[_FRAME_LENGTH+1];            // Create an array to hold a single openRelay message  [0xFF,0xXX,0x01]
-   memset( openRelayMess, 0, _FRAME_LENGTH + 1 );  // Fill it with 0 values
-   char closeRelayMess[_FRAME_LENGTH+1];           // Create an array to hold a single closeRelay message [0xFF,0xXX,0x00]
-   memset( closeRelayMess, 0, _FRAME_LENGTH + 1 ); // Fill it with 0 values
-
    // Parse command line arguments
-   if( parseArgs( argc, argv ) < 4 )
+   int parsedArgs = parseArgs( argc, argv );
+   if( parsedArgs < 4 && !( ( _daemonFlag || _stdinFlag || _numOfSchedules > 0 || _probeBaudFlag ||
+                              _statusBoard > 0 || _replayPath[0] != '\0' ) && parsedArgs > 0 ) )
    {
       if( argc == 1 )
       {
@@ -105,120 +144,162 @@ int main( int argc, char *argv[] )
       fprintf( stdout, "%s %s()::Closing %s.\r\n", LOG_INFO, __func__, __FILE__ );
       return -1;
    }
+   // Before the port is created, so its first open is already measured
+   initPulseTimer();
+   initMetrics( _metricsPath, _metricsPromPath );
+   startLogger( _logLevel );
+   if( _tracePath[0] != '\0' && !startFrameTrace( _tracePath ) )
+   {
+      fprintf( stderr, "%s %s()::Unable to create the trace %s\n", LOG_ERROR, __func__, _tracePath );
+      return -1;
+   }
 
-   // Create a pointer and allocate dynamic memory for the Virtual Com Port object
-   vcp_t* vcp;
-   vcp = (vcp_t*)malloc( sizeof( vcp_t ) );
-
-   fprintf( stdout, "%s %s()::Creating VCP...\n" , LOG_INFO, __func__ );
-   // Find and set the Virtual COM Port for Serial communication
-   *vcp = createVCP( _comPortNumber );
-
-   // Build Open/Close messages and set size
-   sprintf( openRelayMess, "%c%c%c", 0xff, 0x00, _FRAME_RELAY_ON );
-   sprintf( closeRelayMess, "%c%c%c", 0xff, 0x00, _FRAME_RELAY_OFF );
-
+   // Concurrent invocations queue for the ports instead of failing to open them
+   relayLibOptions_t options = { .baudRate = _baudrate, .retry = _retryPolicy, .verify = _verifyFlag,
+                                 .arbitrate = true };
+   const char*       devices[MAX_RS485_BUSES];
 
-   if( _openTimeFlag || ( _stateFlag && ( strcmp( _relayState, "on" ) == 0 ) ) )
+   // Every bus is one device: the '-device' ones, the adapter discovered or the '-comPort' one
+   for( int bus = 0; bus < _numOfBuses; bus++ )
    {
-      _rs485OpenMsg = malloc( sizeof(char) * ( _FRAME_LENGTH * _numOfRelays )  );
-      memset( _rs485OpenMsg, 0, _FRAME_LENGTH * _numOfRelays );
-      fprintf( stdout, "%s %s()::OpenRelaysMessage: [ " , LOG_INFO, __func__ );
-      for( uint8_t i = 0; i < _numOfRelays; i++ )
-      {
-         openRelayMess[1] = _relays[i];
-         fprintf( stdout, "0x%.2x 0x%.2x 0x%.2x " , (uint8_t)openRelayMess[0], (uint8_t)openRelayMess[1], (uint8_t)openRelayMess[2] );
-         strncpy( ( _rs485OpenMsg + ( i * _FRAME_LENGTH ) ) , openRelayMess, _FRAME_LENGTH );
-      }
-      fprintf( stdout, "]\n" );
+      devices[bus] = _deviceNames[bus];
    }
-
-   if( _openTimeFlag || ( _stateFlag && ( strcmp( _relayState, "off" ) == 0 ) ) )
+   if( _numOfDevices == 0 )
    {
-      _rs485CloseMsg = malloc( sizeof(char) * ( _FRAME_LENGTH * _numOfRelays )  );
-      memset( _rs485CloseMsg, 0, ( _FRAME_LENGTH * _numOfRelays ) );
-      fprintf( stdout, "%s %s()::CloseRelaysMessage: [ " , LOG_INFO, __func__ );
-      for( uint8_t i = 0; i < _numOfRelays; i++ )
+      bool discovered = false;
+#ifndef _WIN32
+      // Neither '-device' nor '-comPort': search the adapter the boards answer on, the last one found is tried first
+      int discoveredBaudRate = _baudrate;
+      discovered = !_comPortFlag && discoverPort( _deviceNames[0], sizeof( _deviceNames[0] ), &discoveredBaudRate,
+                                                  !_discoverFlag );
+      if( discovered && !_baudRateFlag )
+      {
+         options.baudRate = discoveredBaudRate;
+      }
+#endif
+      if( !discovered )
       {
-         closeRelayMess[1] = _relays[i];
-         fprintf( stdout, "0x%.2x 0x%.2x 0x%.2x " , (uint8_t)closeRelayMess[0], (uint8_t)closeRelayMess[1], (uint8_t)closeRelayMess[2] );
-         strncpy( ( _rs485CloseMsg + ( i * _FRAME_LENGTH ) ) , closeRelayMess, _FRAME_LENGTH );
+         snprintf( _deviceNames[0], sizeof( _deviceNames[0] ), VCP_DEVICE_NAME_FORMAT, _comPortNumber );
       }
-      fprintf( stdout, "]\n" );
    }
 
-   clock_t startTime;
+   fprintf( stdout, "%s %s()::Creating VCP...\n" , LOG_INFO, __func__ );
+   relayLib_t* lib = openRelayLib( devices, _numOfBuses, &options );
+   if( lib == NULL )
+   {
+      fprintf( stderr, "%s %s()::Impossible to create the VCP of every bus. Ending program...\n", LOG_ERROR,
+               __func__ );
+      return -1;
+   }
+   int    numOfBuses;
+   vcp_t* vcp = portsRelayLib( lib, &numOfBuses );
 
-   while( _impulses > 0 )
+   // PROBE: find the fastest baud rate the boards of every bus answer to, and keep using it
+   if( _probeBaudFlag )
    {
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-       // OPEN RELAY/S //////////////////////////////////////////////////////////////////////////////////////////////////
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-      // OPEN COM PORT
-      if( _openTimeFlag || ( _stateFlag && ( strcmp( _relayState, "on" ) == 0 ) ) )
+      for( int bus = 0; bus < numOfBuses; bus++ )
       {
-         if( !tryOpenVCP( vcp, _MAX_OPEN_VCP_TRIES ) )
+         if( _probeBaudRate( &vcp[bus] ) < 0 )
          {
-            fprintf( stdout, "%s Could not open Port BEFORE send OPEN relay message\n", LOG_ERROR );
-            free( vcp );   // Free allocated memory
-            return -1;
-         }
-         //fprintf( stdout, "%s %s()::Sending message to open relays\n", LOG_INFO, __func__ );
-         sendFrameVCP( vcp, _rs485OpenMsg, _numOfRelays * 3 );
-         startTime = clock();
-
-         // CLOSE COM PORT
-         if( !tryCloseVCP( vcp, _MAX_CLOSE_VCP_TRIES ) )
-         {
-            fprintf( stdout, "%s Could not close Port AFTER send OPEN relay message\n", LOG_ERROR );
-            free( vcp );   // Free allocated memory
+            fprintf( stderr, "%s No board answered on %s at any baud rate\n", LOG_ERROR, vcp[bus].name );
+            closeRelayLib( lib );
             return -1;
          }
       }
-
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-      // WAIT UNTIL OPENING TIME HAS PASSED (SLEEP) ////////////////////////////////////////////////////////////////////
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-      if( _openTimeFlag )
+      if( !_daemonFlag && !_stdinFlag && _numOfSchedules == 0 && !_openTimeFlag && !_stateFlag &&
+          _statusBoard == 0 )
       {
-         while( clock() - startTime < _openTime )
-         {
-            Sleep( _SLEEP_TIME );   // Allow other processes to resume, avoids to colapse the CPU
-         }
+         closeRelayLib( lib );
+         return 0;
       }
+   }
 
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-      // CLOSE RELAY/S /////////////////////////////////////////////////////////////////////////////////////////////////
-      //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-      // OPEN COM PORT
-      if( _openTimeFlag || ( _stateFlag && ( strcmp( _relayState, "off" ) == 0 ) ) )
+   // STATUS: real state of the relays of a board, read back from every bus
+   if( _statusBoard > 0 )
+   {
+      bool answered = _printStatusBuses( lib, (uint8_t)_statusBoard );
+      if( !_daemonFlag && !_stdinFlag && _numOfSchedules == 0 && !_openTimeFlag && !_stateFlag )
       {
+         closeRelayLib( lib );
+         return answered ? 0 : -1;
+      }
+   }
 
-         if( !tryOpenVCP( vcp, _MAX_OPEN_VCP_TRIES ) )
-         {
-            fprintf( stdout, "%s Could not open Port BEFORE send CLOSE relay message\n", LOG_ERROR );
-            free( vcp );   // Free allocated memory
-            return -1;
-         }
-         //fprintf( stdout, "%s %s()::Sending message to close relays\n", LOG_INFO, __func__ );
-         sendFrameVCP( vcp, _rs485CloseMsg, ( _numOfRelays * 3 ) );
+#ifndef _WIN32
+   // DAEMON MODE: keep the ports and serve commands until asked to stop
+   if( _daemonFlag )
+   {
+      relayShadow_t shadows[MAX_RS485_BUSES];
+      loadStatesRelayLib( lib, shadows );               // Relays left by the invocations before
+      int retValue = runRelayDaemon( vcp, numOfBuses, _socketPath, shadows, (uint64_t)_coalesceUs * NS_PER_US );
+      storeStatesRelayLib( lib, shadows );
+      closeRelayLib( lib );
+      return retValue;
+   }
+#endif
 
-         // CLOSE COM PORT
-         if( !tryCloseVCP( vcp, _MAX_CLOSE_VCP_TRIES ) )
-         {
-            fprintf( stdout, "%s Could not close Port AFTER send CLOSE relay message\n", LOG_ERROR );
-            free( vcp );   // Free allocated memory
-            return -1;
-         }
-      }
+   // REPLAY MODE: the frames of a trace are sent again, at their original timing or as fast as possible
+   if( _replayPath[0] != '\0' )
+   {
+      int retValue = _replayTrace( lib );
+      closeRelayLib( lib );
+      return retValue;
+   }
+
+   // LINE MODE: the ports stay open and every command read from stdin is run as soon as its line arrives
+   if( _stdinFlag )
+   {
+      int retValue = _runLines( lib );
+      closeRelayLib( lib );
+      return retValue;
+   }
 
-      _impulses--;
+   // SCHEDULE MODE: every relay runs its own pulse train
+   if( _numOfSchedules > 0 )
+   {
+      int retValue = runSchedules( lib );
+      closeRelayLib( lib );
+      return retValue;
    }
-   free( _relays );
-   free( _rs485OpenMsg );
-   free( _rs485CloseMsg );
-   free( vcp );   // Free allocated memory
-   return 0;      // Everything right
+
+   // Time the slowest bus needs to put every message on the wire, a shorter pulse can not be honored
+   uint64_t openWireTime = wireTimeRelayLib( lib, &_relays, RELAY_FRAME_ON );
+   uint64_t closeWireTime = wireTimeRelayLib( lib, &_relays, RELAY_FRAME_OFF );
+   fprintf( stdout, "%s Wire time at %d baud: open %.2f ms, close %.2f ms\n", LOG_INFO, vcp->baudRate,
+            (double)openWireTime / NS_PER_MS, (double)closeWireTime / NS_PER_MS );
+   if( _openTimeFlag && (uint64_t)_openTime * NS_PER_MS < openWireTime )
+   {
+      fprintf( stdout, "%s %u ms open time is shorter than the open message on the wire, pulses will be longer\n",
+               LOG_WARNING, _openTime );
+   }
+
+   // SESSION MODE: open the port once, every impulse is streamed over the same handle
+   if( _sessionFlag && !beginRelayLib( lib ) )
+   {
+      closeRelayLib( lib );
+      return -1;
+   }
+
+   bool done;
+   if( _openTimeFlag )
+   {
+      done = pulseRelayLib( lib, &_relays, _openTime, _offTime, _impulses );
+   }
+   else if( _stateFlag )
+   {
+      done = setRelayLib( lib, &_relays, ( strcmp( _relayState, "on" ) == 0 ) ? RELAY_FRAME_ON : RELAY_FRAME_OFF );
+   }
+   else
+   {
+      done = true;                                     // Neither '-state' nor '-openTime': nothing to send
+   }
+
+   flushLogger();   // Pulse lines before the summary
+   printPulseStats( statsRelayLib( lib ) );
+   printCyclePulseStats( cycleStatsRelayLib( lib ) );
+
+   closeRelayLib( lib );   // Closes the session port too
+   return done ? 0 : -1;
 }
 // END main( .. ) ...
 
@@ -246,14 +327,71 @@ static int parseArgs( int argc, char *argv[] )
                ARG_RELAY_NUM );
       fprintf( stdout, " [%s n,n...] (s=Seveal numbers \',\' separated) Indicates a group of relays. Ex: -relay 2,7,11\n",
                ARG_RELAY_NUM );
+      fprintf( stdout, " [%s n:n,n]  (s=Ranges and numbers can be combined, repeated relays are sent once). "
+                       "Ex: -relay 1:8,12,40:48\n", ARG_RELAY_NUM );
+      fprintf( stdout, " [%s b/n...] (b=Bus, the relays after it are in the chain of the b-th '%s', 0 by default). "
+                       "Ex: -relay 1:8,1/1:8\n", ARG_RELAY_NUM, ARG_DEVICE );
       fprintf( stdout, "It is also mandatory to pass '-openTime' or '-state' but not both at the same time:\n" );
       fprintf( stdout, " [%s m]   (m=number of milliseconds)\n", ARG_OPEN_TIME );
       fprintf( stdout, " [%s b]      (b=State \"on\" \"off\". It is set \"%s\" by default)\n\n", ARG_RELAY_STATE, RELAY_STATE_DEFAULT );
       fprintf( stdout, "There is another aditional argument that can be used with '-openTime':\n" );
-      fprintf( stdout, " [%s n]   (OPTIONAL, n=number of impulses. 1 by default.)\n\n", ARG_IMPULSES );
+      fprintf( stdout, " [%s n]   (OPTIONAL, n=number of impulses, up to %u. 1 by default.)\n", ARG_IMPULSES,
+               UINT32_MAX );
+      fprintf( stdout, " [%s m]    (OPTIONAL, m=milliseconds off between impulses. 0 by default. Every impulse "
+                       "starts on a\n                   fixed grid of '-openTime' + m, late ones do not shift the "
+                       "next)\n", ARG_OFF_TIME );
+      fprintf( stdout, " [%s]      (OPTIONAL, open the port once for all the impulses instead of once per frame)\n",
+               ARG_SESSION );
+      fprintf( stdout, " [%s]       (OPTIONAL, read the relays back and send again only the ones not in the "
+                       "commanded state)\n", ARG_VERIFY );
+      fprintf( stdout, " [%s n]     (OPTIONAL, n=board. Print the real state of its relays as a bitmask)\n\n",
+               ARG_STATUS );
       fprintf( stdout, "There are other optional arguments related to the virtual UART communication port:\n" );
       fprintf( stdout, " [%s x]   (OPTIONAL, x=Baudrate for uart communication. It is set %d by default)\n", ARG_BAUD_RATE, BAUD_RATE_DEFAULT );
-      fprintf( stdout, " [%s n]    (OPTIONAL, n=COM port number. It is set %d by default)\n\n", ARG_COM_PORT, COM_PORT_DEFAULT );
+      fprintf( stdout, " [%s]  (OPTIONAL, search the fastest baud rate the boards answer to. Alone it only "
+                       "reports it)\n", ARG_PROBE_BAUD );
+      fprintf( stdout, " [%s n]    (OPTIONAL, n=COM port number. It is set %d by default)\n", ARG_COM_PORT, COM_PORT_DEFAULT );
+      fprintf( stdout, " [%s p]     (OPTIONAL, p=Full device path. Ex: /dev/ttyUSB1, a pty. Overrides %s.\n"
+                       "                   Repeat it to drive up to %d RS485 buses at the same time)\n",
+               ARG_DEVICE, ARG_COM_PORT, MAX_RS485_BUSES );
+      fprintf( stdout, " [%s]   (OPTIONAL, POSIX only. Without %s nor %s the adapter is searched, the last one "
+                       "found is\n                   tried first. This ignores it and searches again)\n\n",
+               ARG_DISCOVER, ARG_DEVICE, ARG_COM_PORT );
+      fprintf( stdout, "Relays can also run independent pulse trains at the same time:\n" );
+      fprintf( stdout, " [%s r@o/p xc] (r=relays, o=open ms, p=period ms (2*o by default), c=cycles (1 by default).\n"
+                       "                   Can be repeated. Ex: -schedule 1:4@100/1000x10 -schedule 7@20)\n\n",
+               ARG_SCHEDULE );
+      fprintf( stdout, "The program can also stay resident owning the port (POSIX only):\n" );
+      fprintf( stdout, " [%s]     (Serve \"set\", \"pulse\" and \"query\" commands through a unix socket)\n", ARG_DAEMON );
+      fprintf( stdout, " [%s p]     (OPTIONAL, p=Socket path. It is %s by default)\n", ARG_SOCKET,
+               RELAY_DAEMON_SOCKET_DEFAULT );
+      fprintf( stdout, " [%s u]   (OPTIONAL, u=microseconds the commands of a bus are held to leave in one write, "
+                       "the last\n                   one of a relay wins. 0 (none) by default, a pulse edge due "
+                       "sends them at once)\n", ARG_COALESCE );
+      fprintf( stdout, " [%s]      (Run the commands read from stdin, one per line with the syntax of '%s', '%s',\n"
+                       "                   '%s', '%s', '%s' and '%s'. Answers \"OK <line>\" or \"ERR <line> "
+                       "<reason>\")\n\n", ARG_STDIN, ARG_RELAY_NUM, ARG_RELAY_STATE, ARG_OPEN_TIME, ARG_IMPULSES,
+               ARG_OFF_TIME, ARG_STATUS );
+      fprintf( stdout, "Latency histograms of every phase (open, configure, write, drain, close, pulse error):\n" );
+      fprintf( stdout, " [%s f]    (OPTIONAL, f=JSON file written at exit)\n", ARG_METRICS );
+      fprintf( stdout, " [%s f] (OPTIONAL, f=Prometheus text file written at exit, and every %llu s by the daemon)"
+                       "\n\n", ARG_METRICS_PROM, METRICS_EXPORT_PERIOD_NS / NS_PER_SEC );
+      fprintf( stdout, "Every frame written can be recorded in a binary trace and sent again later:\n" );
+      fprintf( stdout, " [%s f]      (OPTIONAL, f=Trace file, time, bus, relay and state of every frame)\n",
+               ARG_TRACE );
+      fprintf( stdout, " [%s f]     (f=Trace file replayed on the '%s' ports at its original timing, instead of "
+                       "a command)\n", ARG_REPLAY, ARG_DEVICE );
+      fprintf( stdout, " [%s]   (OPTIONAL, replay as fast as the ports take the frames)\n\n", ARG_REPLAY_FAST );
+      fprintf( stdout, "A port that can not be created, opened or closed is tried again with a growing wait:\n" );
+      fprintf( stdout, " [%s t:f:m:d:j] (OPTIONAL, t=tries (0=no limit), f=first wait ms, doubled up to m ms, d=deadline "
+                       "ms of the\n                   whole operation (0=none), the wait for a port another "
+                       "relayManager is using\n                   included, j=%% of every wait removed at random. "
+                       "Trailing fields can be\n                   left out. It is %u:%u:%u:%u:%u by default)\n\n",
+               ARG_RETRY, _retryPolicy.maxTries, _retryPolicy.firstDelayMs, _retryPolicy.maxDelayMs,
+               _retryPolicy.deadlineMs, _retryPolicy.jitterPercent );
+      fprintf( stdout, "Messages of the timing critical paths are written by a background thread:\n" );
+      fprintf( stdout, " [%s l]   (OPTIONAL, l=\"debug\" (frame dumps), \"info\", \"warn\", \"error\" or \"none\". "
+                       "It is \"info\" by default)\n\n", ARG_LOG_LEVEL );
       return 1;
    }
 
@@ -266,39 +404,15 @@ static int parseArgs( int argc, char *argv[] )
          // Parse relay number we pretend to use
          if( ++argn < argc )
          {
-            int8_t modality = relayModality( argv[argn], &_numOfRelays );
-            switch( modality )
+            const char* error = NULL;
+            int         numOfRelays = parseRelayBusSet( argv[argn], &_relays, MAX_RS485_BUSES, &error );
+            if( numOfRelays <= 0 )
             {
-               case _errorRelay:
-                  return -1;
-                  break;
-               case _singleRelay:
-                  _singleRelayFlag = true;
-                  _relayEnd = _relayBegin;
-                  _relays = malloc( sizeof( uint8_t ) * _numOfRelays );
-                  _relays[0] = _relayEnd;
-                  break;
-               case _rangeRelays:
-                  if( _relayEnd <= _relayBegin )
-                  {
-                     fprintf( stderr, "Wrong range order, final relay number (%d) must higher than beginner relay (%d)\n",
-                                      _relayEnd, _relayBegin );
-                     return -1;
-                  }
-                  else
-                  {
-                     _numOfRelays =  _relayEnd - _relayBegin + 1 ;
-                     _relays = malloc( sizeof( uint8_t ) * _numOfRelays );
-                     for( uint8_t i = _relayBegin; i <= _relayEnd; i++ )
-                     {
-                        _relays[i-_relayBegin] = i;
-                     }
-                  }
-                  break;
-               case _groupRelays:
-                  _relays = malloc( sizeof( uint8_t ) * _numOfRelays );
-                  _fillRelaysGroup( argv[argn], _relays, _numOfRelays );
+               fprintf( stderr, "%s \'%s %s\': %s. Valid relay numbers are %d to %d\n", LOG_ERROR, ARG_RELAY_NUM,
+                        argv[argn], error, MIN_RELAY_NUMBER, MAX_RELAYS_IN_RS485_CHAIN );
+               return -1;
             }
+            _numOfRelays = (uint16_t)numOfRelays;
          }
          else
          {
@@ -319,8 +433,12 @@ static int parseArgs( int argc, char *argv[] )
          // Parse time we pretend to open selected relay
          if( ++argn < argc )
          {
-            _openTime = atoi( argv[argn] );
-            fprintf( stdout, "%s Relay asked to be opened %d milliseconds\n", LOG_INFO, _openTime );
+            if( !_parseUint32( argv[argn], &_openTime ) )
+            {
+               fprintf( stderr, "%s Open time \'%s\' is not a number of milliseconds\n", LOG_ERROR, argv[argn] );
+               return -1;
+            }
+            fprintf( stdout, "%s Relay asked to be opened %u milliseconds\n", LOG_INFO, _openTime );
             _openTimeFlag = true;
          }
          else
@@ -335,14 +453,13 @@ static int parseArgs( int argc, char *argv[] )
          // Parse number of times we pretend to open selected relay
          if( ++argn < argc )
          {
-            _impulses = atoi( argv[argn] );
-            if( _impulses < 0 )
+            if( !_parseUint32( argv[argn], &_impulses ) )
             {
-               fprintf( stderr, "%s Not accepted a negative number of impulses\n", LOG_ERROR );
+               fprintf( stderr, "%s Not accepted \'%s\' as a number of impulses\n", LOG_ERROR, argv[argn] );
                return 1;   // Get out of main function
             }
             _impulsesFlag = true;
-            fprintf( stdout, "%s Give %d impulses \n", LOG_INFO, _impulses );
+            fprintf( stdout, "%s Give %u impulses \n", LOG_INFO, _impulses );
          }
          else
          {
@@ -350,20 +467,228 @@ static int parseArgs( int argc, char *argv[] )
             return 1;   // Get out of main function
          }
       }
+      // OFF TIME argument found ( ARGUMENT OPTINAL [ 0 by DEFAULT ] )
+      else if( strcmp( argv[argn], ARG_OFF_TIME ) == 0 )
+      {
+         // Parse time the relays stay off between impulses
+         if( ++argn < argc )
+         {
+            if( !_parseUint32( argv[argn], &_offTime ) )
+            {
+               fprintf( stderr, "%s Off time \'%s\' is not a number of milliseconds\n", LOG_ERROR, argv[argn] );
+               return -1;
+            }
+            _offTimeFlag = true;
+            fprintf( stdout, "%s Relay asked to stay off %u milliseconds between impulses\n", LOG_INFO, _offTime );
+         }
+         else
+         {
+            fprintf( stderr, "%s Time unknown\n", LOG_ERROR );
+            return -1;   // Get out of main function
+         }
+      }
+      // SCHEDULE argument found ( ARGUMENT OPTIONAL, CAN BE REPEATED )
+      else if( strcmp( argv[argn], ARG_SCHEDULE ) == 0 )
+      {
+         relayBusSet_t relays;
+         uint32_t      openTime, period, cycles;
+         if( ++argn < argc && _numOfSchedules < _MAX_SCHEDULES &&
+             _parseSchedule( argv[argn], &relays, &openTime, &period, &cycles ) )
+         {
+            int numOfRelays = 0;
+            for( int bus = 0; bus < MAX_RS485_BUSES; bus++ )
+            {
+               numOfRelays += countRelaySet( &relays.buses[bus] );
+            }
+            _schedules[_numOfSchedules++] = argv[argn];
+            fprintf( stdout, "%s %d relay/s open %u ms every %u ms, %u cycles\n", LOG_INFO, numOfRelays, openTime,
+                     period, cycles );
+         }
+         else
+         {
+            fprintf( stderr, "%s \'%s\' expects <relays>@<openMs>[/<periodMs>][x<cycles>] (max %d times)\n",
+                     LOG_ERROR, ARG_SCHEDULE, _MAX_SCHEDULES );
+            return -1;
+         }
+      }
+      // SESSION argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_SESSION ) == 0 )
+      {
+         _sessionFlag = true;
+         fprintf( stdout, "%s Session mode, port kept open for all the impulses\n", LOG_INFO );
+      }
+      // DAEMON argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_DAEMON ) == 0 )
+      {
+#ifdef _WIN32
+         fprintf( stderr, "%s \'%s\' is only available on POSIX hosts\n", LOG_ERROR, ARG_DAEMON );
+         return -1;
+#else
+         _daemonFlag = true;
+         fprintf( stdout, "%s Daemon mode\n", LOG_INFO );
+#endif
+      }
+      // COALESCE argument found ( ARGUMENT OPTIONAL, ONLY WITH DAEMON )
+      else if( strcmp( argv[argn], ARG_COALESCE ) == 0 )
+      {
+         if( ++argn < argc && _parseUint32( argv[argn], &_coalesceUs ) &&
+             (uint64_t)_coalesceUs * NS_PER_US <= FRAME_QUEUE_MAX_COALESCE_NS )
+         {
+            _coalesceFlag = true;
+            fprintf( stdout, "%s Commands arriving within %u us are written together\n", LOG_INFO, _coalesceUs );
+         }
+         else
+         {
+            fprintf( stderr, "%s '%s' expects microseconds, up to %llu\n", LOG_ERROR, ARG_COALESCE,
+                     FRAME_QUEUE_MAX_COALESCE_NS / NS_PER_US );
+            return -1;
+         }
+      }
+      // STDIN argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_STDIN ) == 0 )
+      {
+         _stdinFlag = true;
+         fprintf( stdout, "%s Line mode, commands read from stdin\n", LOG_INFO );
+      }
+      // SOCKET argument found ( ARGUMENT OPTIONAL, ONLY WITH DAEMON )
+      else if( strcmp( argv[argn], ARG_SOCKET ) == 0 )
+      {
+         if( ++argn < argc )
+         {
+            snprintf( _socketPath, sizeof( _socketPath ), "%s", argv[argn] );
+            fprintf( stdout, "%s Command socket %s specified\n", LOG_INFO, _socketPath );
+         }
+         else
+         {
+            fprintf( stderr, "%s Socket path error\n", LOG_ERROR );
+            return -1;
+         }
+      }
+      // METRICS arguments found ( ARGUMENTS OPTIONAL )
+      else if( strcmp( argv[argn], ARG_METRICS ) == 0 || strcmp( argv[argn], ARG_METRICS_PROM ) == 0 )
+      {
+         bool isJson = ( strcmp( argv[argn], ARG_METRICS ) == 0 );
+         if( ++argn < argc && strlen( argv[argn] ) < MAX_PATH )
+         {
+            snprintf( isJson ? _metricsPath : _metricsPromPath, MAX_PATH, "%s", argv[argn] );
+            fprintf( stdout, "%s %s metrics will be written to %s\n", LOG_INFO, isJson ? "JSON" : "Prometheus",
+                     argv[argn] );
+         }
+         else
+         {
+            fprintf( stderr, "%s Metrics file error\n", LOG_ERROR );
+            return -1;
+         }
+      }
+      // TRACE / REPLAY arguments found ( ARGUMENT OPTIONAL )
+      else if( strcmp( argv[argn], ARG_TRACE ) == 0 || strcmp( argv[argn], ARG_REPLAY ) == 0 )
+      {
+         bool isTrace = ( strcmp( argv[argn], ARG_TRACE ) == 0 );
+         if( ++argn < argc && strlen( argv[argn] ) < MAX_PATH )
+         {
+            snprintf( isTrace ? _tracePath : _replayPath, MAX_PATH, "%s", argv[argn] );
+            fprintf( stdout, "%s Frames will be %s %s\n", LOG_INFO, isTrace ? "traced to" : "replayed from",
+                     argv[argn] );
+         }
+         else
+         {
+            fprintf( stderr, "%s Trace file error\n", LOG_ERROR );
+            return -1;
+         }
+      }
+      // REPLAY FAST argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_REPLAY_FAST ) == 0 )
+      {
+         _replayFastFlag = true;
+      }
+      // RETRY POLICY argument found ( ARGUMENT OPTIONAL )
+      else if( strcmp( argv[argn], ARG_RETRY ) == 0 )
+      {
+         if( ++argn < argc && parseRetryPolicy( argv[argn], &_retryPolicy ) )
+         {
+            fprintf( stdout, "%s Port tried up to %u times (0 = no limit), wait %u to %u ms, deadline %u ms, "
+                     "jitter %u%%\n", LOG_INFO, _retryPolicy.maxTries, _retryPolicy.firstDelayMs,
+                     _retryPolicy.maxDelayMs, _retryPolicy.deadlineMs, _retryPolicy.jitterPercent );
+         }
+         else
+         {
+            fprintf( stderr, "%s \'%s\' expects <tries>[:<firstMs>[:<maxMs>[:<deadlineMs>[:<jitter%%>]]]], "
+                     "with a limit of tries or time\n", LOG_ERROR, ARG_RETRY );
+            return -1;
+         }
+      }
+      // LOG LEVEL argument found ( ARGUMENT OPTIONAL )
+      else if( strcmp( argv[argn], ARG_LOG_LEVEL ) == 0 )
+      {
+         if( ++argn < argc && parseLevelLogger( argv[argn], &_logLevel ) )
+         {
+            fprintf( stdout, "%s Log level \"%s\"\n", LOG_INFO, argv[argn] );
+         }
+         else
+         {
+            fprintf( stderr, "%s \'%s\' only valid values are \"debug\", \"info\", \"warn\", \"error\" or \"none\"\n",
+                     LOG_ERROR, ARG_LOG_LEVEL );
+            return -1;
+         }
+      }
       // BAUD RATE argument found ( NOT REQUIERED, THERE'S A DEFAULT BAUDRATE OF 9600 )
       else if( strcmp( argv[argn], ARG_BAUD_RATE ) == 0)
       {
-         // Parse baud rate
-         if ( ++argn < argc && ( ( _baudrate = atoi( argv[argn] ) ) > 0) )
+         // Parse baud rate, it must be one of the BAUD_RATE_* the port can be set to
+         if ( ++argn < argc && isValidBaudRateVCP( _baudrate = atoi( argv[argn] ) ) )
          {
             fprintf( stdout, "%s %d baud rate specified\n", LOG_INFO, _baudrate );
+            _baudRateFlag = true;
          }
          else
          {
-            fprintf( stderr, "%s Baud rate error\n", LOG_WARNING );
-            return 1;
+            static const int baudRates[] = BAUD_RATES_HIGHEST_FIRST;
+            fprintf( stderr, "%s Baud rate error, valid rates are:", LOG_ERROR );
+            for( size_t i = 0; i < sizeof( baudRates ) / sizeof( baudRates[0] ); i++ )
+            {
+               if( isValidBaudRateVCP( baudRates[i] ) )
+               {
+                  fprintf( stderr, " %d", baudRates[i] );
+               }
+            }
+            fprintf( stderr, "\n" );
+            return -1;
          }
-         // TODO: function that found if _baudrate is an acceptable value
+      }
+      // DISCOVER argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_DISCOVER ) == 0 )
+      {
+#ifdef _WIN32
+         fprintf( stderr, "%s \'%s\' is only available on POSIX hosts\n", LOG_ERROR, ARG_DISCOVER );
+         return -1;
+#else
+         _discoverFlag = true;
+#endif
+      }
+      // STATUS argument found ( ARGUMENT OPTIONAL )
+      else if( strcmp( argv[argn], ARG_STATUS ) == 0 )
+      {
+         if( ++argn < argc && ( _statusBoard = atoi( argv[argn] ) ) >= 1 && _statusBoard <= MAX_BOARDS_IN_RS485_CHAIN )
+         {
+            fprintf( stdout, "%s Board %d asked for its status\n", LOG_INFO, _statusBoard );
+         }
+         else
+         {
+            fprintf( stderr, "%s \'%s\' expects a board number from 1 to %d\n", LOG_ERROR, ARG_STATUS,
+                     MAX_BOARDS_IN_RS485_CHAIN );
+            return -1;
+         }
+      }
+      // VERIFY argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_VERIFY ) == 0 )
+      {
+         _verifyFlag = true;
+         fprintf( stdout, "%s Relay states are read back after sending\n", LOG_INFO );
+      }
+      // PROBE BAUD argument found ( ARGUMENT OPTIONAL, NO VALUE )
+      else if( strcmp( argv[argn], ARG_PROBE_BAUD ) == 0 )
+      {
+         _probeBaudFlag = true;
       }
       // COM PORT argument found ( NOT REQUIERED, BETTER TO HARDCODE IT TO AVOID CONFUSIONS )
       else if( strcmp( argv[argn], ARG_COM_PORT ) == 0 )
@@ -373,6 +698,7 @@ static int parseArgs( int argc, char *argv[] )
          if( ++argn < argc )
          {
             _comPortNumber = atoi( argv[argn] );
+            _comPortFlag = true;
             fprintf( stdout, "%s Virtual port COM%d specified\n", LOG_INFO, _comPortNumber );
          }
          else
@@ -381,6 +707,22 @@ static int parseArgs( int argc, char *argv[] )
             return 1;   // Get out of main function
          }
       }
+      // DEVICE argument found ( NOT REQUIERED, FULL PATH OF THE SERIAL DEVICE )
+      else if( strcmp( argv[argn], ARG_DEVICE ) == 0 )
+      {
+         if( ++argn < argc && _numOfDevices < MAX_RS485_BUSES )
+         {
+            snprintf( _deviceNames[_numOfDevices], sizeof( _deviceNames[0] ), "%s", argv[argn] );
+            fprintf( stdout, "%s Device %s specified for bus %d\n", LOG_INFO, _deviceNames[_numOfDevices],
+                     _numOfDevices );
+            _numOfDevices++;
+         }
+         else
+         {
+            fprintf( stderr, "%s Device name error\n", LOG_WARNING );
+            return 1;   // Get out of main function
+         }
+      }
       // RELAY STATE argument found
       else if( strcmp( argv[argn], ARG_RELAY_STATE ) == 0 )
       {
@@ -426,12 +768,81 @@ static int parseArgs( int argc, char *argv[] )
       argn++;
    }
 
+   if( _numOfSchedules > 0 && ( _openTimeFlag || _stateFlag || _daemonFlag ) )
+   {
+      fprintf( stderr, "%s \'%s\' can't be mixed with \'-openTime\', \'-state\' nor \'%s\'\n", LOG_ERROR,
+               ARG_SCHEDULE, ARG_DAEMON );
+      return -1;
+   }
+
+   if( _replayPath[0] != '\0' && ( _openTimeFlag || _stateFlag || _daemonFlag || _numOfSchedules > 0 ) )
+   {
+      fprintf( stderr, "%s \'%s\' can't be mixed with \'-openTime\', \'-state\', \'%s\' nor \'%s\'\n", LOG_ERROR,
+               ARG_REPLAY, ARG_SCHEDULE, ARG_DAEMON );
+      return -1;
+   }
+
+   if( _stdinFlag && ( _numOfRelays > 0 || _openTimeFlag || _stateFlag || _daemonFlag || _numOfSchedules > 0 ||
+                       _replayPath[0] != '\0' ) )
+   {
+      fprintf( stderr, "%s '%s' reads the commands, it can't be mixed with '%s', '-openTime', '-state', "
+               "'%s', '%s' nor '%s'\n", LOG_ERROR, ARG_STDIN, ARG_RELAY_NUM, ARG_SCHEDULE, ARG_DAEMON,
+               ARG_REPLAY );
+      return -1;
+   }
+
+   if( _coalesceFlag && !_daemonFlag )
+   {
+      fprintf( stderr, "%s '%s' only works with '%s'\n", LOG_ERROR, ARG_COALESCE, ARG_DAEMON );
+      return -1;
+   }
+
+   if( _replayFastFlag && _replayPath[0] == '\0' )
+   {
+      fprintf( stderr, "%s \'%s\' only works with \'%s\'\n", LOG_ERROR, ARG_REPLAY_FAST, ARG_REPLAY );
+      return -1;
+   }
+
+   if( _daemonFlag && ( _openTimeFlag || _stateFlag ) )
+   {
+      fprintf( stderr, "%s \'%s\' does not accept \'-openTime\' nor \'-state\', send them as commands\n",
+               LOG_ERROR, ARG_DAEMON );
+      return -1;
+   }
+
    if( _impulsesFlag && !_openTimeFlag )
    {
       fprintf( stderr, "%s \'-impulses\' only works with \'-openTime\'\n", LOG_ERROR );
       return -1;
    }
 
+   if( _offTimeFlag && !_openTimeFlag )
+   {
+      fprintf( stderr, "%s \'%s\' only works with \'-openTime\'\n", LOG_ERROR, ARG_OFF_TIME );
+      return -1;
+   }
+
+   // Every bus used by '-relay' or '-schedule' needs its own '-device'
+   _numOfBuses = ( _numOfDevices > 0 ) ? _numOfDevices : 1;
+   for( int i = -1; i < _numOfSchedules; i++ )
+   {
+      relayBusSet_t relays = _relays;
+      uint32_t      openTime, period, cycles;
+      if( i >= 0 )
+      {
+         _parseSchedule( _schedules[i], &relays, &openTime, &period, &cycles );
+      }
+      for( int bus = _numOfBuses; bus < MAX_RS485_BUSES; bus++ )
+      {
+         if( !isEmptyRelaySet( &relays.buses[bus] ) )
+         {
+            fprintf( stderr, "%s Relays of bus %d used but only %d \'%s\' given\n", LOG_ERROR, bus, _numOfBuses,
+                     ARG_DEVICE );
+            return -1;
+         }
+      }
+   }
+
    fprintf( stdout, "%s Number of arguments: %d\n", LOG_INFO, ( argn - 1 ) );
    return ( argn - 1 );
 }
@@ -439,133 +850,531 @@ static int parseArgs( int argc, char *argv[] )
 
 
 /***********************************************************************************************************************
- * f_relayModality( .. )
- * @brief: Function parse the relay modality choosen
- * @param1: <char*> relayArgument : Value for main argument '-relay'
- * @param2: <uint8_t*> argv : Array containing the arguments
- * @return: <relayModality_t> The modality selected 'singleRelay', 'range of relays' or 'group of relays'
+ * f_parseUint32( .. )
+ * @brief: Function to parse a whole unsigned decimal argument, milliseconds or counts
+ * @param1: <const char*> text: The argument
+ * @param2: <uint32_t*> value: Value found, left untouched if text is not valid
+ * @return: <bool> TRUE if text is a number from 0 to UINT32_MAX and nothing else
+ **********************************************************************************************************************/
+static bool _parseUint32( const char* text, uint32_t* value )
+{
+   char*         end;
+   unsigned long parsed = strtoul( text, &end, 10 );
+
+   if( end == text || *end != '\0' || *text == '-' || parsed > UINT32_MAX )
+   {
+      return false;
+   }
+   *value = (uint32_t)parsed;
+   return true;
+}
+// END f_parseUint32( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseSchedule( .. )
+ * @brief: Function to parse a '-schedule' value: <relays>@<openMs>[/<periodMs>][x<cycles>]
+ * @param1: <const char*> schedule: The value
+ * @param2: <relayBusSet_t*> relays: Relays found, of every bus
+ * @param3: <uint32_t*> openTime: ON time in ms
+ * @param4: <uint32_t*> period: Time between ON edges in ms, 2 * openTime if not given (at most UINT32_MAX)
+ * @param5: <uint32_t*> cycles: Number of cycles, 1 if not given, 0 means until the program is killed
+ * @return: <bool> TRUE if the value is valid
+ **********************************************************************************************************************/
+static bool _parseSchedule( const char* schedule, relayBusSet_t* relays, uint32_t* openTime, uint32_t* period,
+                            uint32_t* cycles )
+{
+   char  relayArgument[MAX_PATH];
+   char  timing[MAX_PATH];
+   const char* at = strchr( schedule, '@' );
+
+   if( at == NULL || (size_t)( at - schedule ) >= sizeof( relayArgument ) )
+   {
+      return false;
+   }
+   memcpy( relayArgument, schedule, (size_t)( at - schedule ) );
+   relayArgument[at - schedule] = '\0';
+   if( parseRelayBusSet( relayArgument, relays, MAX_RS485_BUSES, NULL ) <= 0 )
+   {
+      return false;
+   }
+
+   // <openMs>[/<periodMs>][x<cycles>], every field a whole number on its own
+   if( strlen( at + 1 ) >= sizeof( timing ) )
+   {
+      return false;
+   }
+   strcpy( timing, at + 1 );
+   char* cyclesArgument = strchr( timing, 'x' );
+   if( cyclesArgument != NULL )
+   {
+      *cyclesArgument++ = '\0';
+   }
+   char* periodArgument = strchr( timing, '/' );
+   if( periodArgument != NULL )
+   {
+      *periodArgument++ = '\0';
+   }
+   if( !_parseUint32( timing, openTime ) )
+   {
+      return false;
+   }
+   uint64_t defaultPeriod = 2 * (uint64_t)*openTime;
+   *period = ( defaultPeriod > UINT32_MAX ) ? UINT32_MAX : (uint32_t)defaultPeriod;
+   *cycles = 1;
+   if( ( periodArgument != NULL && !_parseUint32( periodArgument, period ) ) ||
+       ( cyclesArgument != NULL && !_parseUint32( cyclesArgument, cycles ) ) )
+   {
+      return false;
+   }
+   return ( *period >= *openTime && !( *cycles == RELAY_SCHEDULER_FOREVER && *period == 0 ) );
+}
+// END f_parseSchedule( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runSchedules( .. )
+ * @brief: Function to run every '-schedule' at the same time from this thread, until all the trains end. Every bus
+ *         has its own scheduler, all of them share the same start deadline
+ * @param1 <relayLib_t*> lib : The context owning the Virtual COM ports, one per bus
+ * @return: <int> 0 if every frame could be sent, -1 if not
  **********************************************************************************************************************/
-static relayModality_t relayModality( char* relayArgument, uint8_t* numberOfRelays )
+static int runSchedules( relayLib_t* lib )
 {
-   relayModality_t returnValue = _singleRelay;
-   uint32_t numberFound = 0;
-   bool     newNumberFlag = false;
-   while( *relayArgument != '\0' )
+   static relayScheduler_t schedulers[MAX_RS485_BUSES];    // Big, keep them out of the stack
+#ifndef _WIN32
+   static serialWriter_t   writers[MAX_RS485_BUSES];       // Edges of a bus never wait for the frames of another one
+#endif
+   relayBusSet_t relays;
+   uint32_t      openTime, period, cycles;
+   uint32_t      activeJobs;
+   pulseStats_t  stats;
+   int           retValue = 0;
+   int           numOfBuses;
+   vcp_t*        vcps = portsRelayLib( lib, &numOfBuses );
+
+   if( !beginRelayLib( lib ) )
    {
-      if( !( isdigit( *relayArgument ) || *relayArgument == ':' || *relayArgument == ',' ) )
+      fprintf( stdout, "%s Could not open Port BEFORE starting the schedules\n", LOG_ERROR );
+      return -1;
+   }
+   for( int bus = 0; bus < numOfBuses; bus++ )
+   {
+#ifndef _WIN32
+      if( numOfBuses > 1 && initSerialWriter( &writers[bus], &vcps[bus], SERIAL_WRITER_STUCK_NS_DEFAULT,
+                                                  SERIAL_WRITER_NOT_PACED ) )
       {
-         fprintf( stderr, "%s Can't use \'-state\' if  \'-openTime\' argument has been passed before\n",
-                  LOG_ERROR );
-         return _errorRelay;
+         initRelayScheduler( &schedulers[bus], &vcps[bus], NULL, &writers[bus] );
+         continue;
       }
-      // If a colon is detected can be a range of relays
-      else if( *relayArgument == ':' )
+#endif
+      initRelayScheduler( &schedulers[bus], &vcps[bus], NULL, NULL );
+   }
+
+   // Every train starts on the same deadline
+   uint64_t startTime = nowPulseTimer();
+   for( int i = 0; i < _numOfSchedules; i++ )
+   {
+      _parseSchedule( _schedules[i], &relays, &openTime, &period, &cycles );
+      for( int bus = 0; bus < numOfBuses; bus++ )
       {
-         if( *numberOfRelays == 0 )
-         {
-            fprintf( stderr, "%s A range of relays must start with a number.\n", LOG_ERROR );
-            return _errorRelay;
-         }
-         else if( _rangeRelayFlag )
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
          {
-            fprintf( stderr, "%s A range of relays can only be composed of two numbers begin and end.\n",
-                     LOG_ERROR );
-            return _errorRelay;
+            startRelayScheduler( &schedulers[bus], relay, openTime * NS_PER_MS, period * NS_PER_MS, cycles,
+                                 startTime );
          }
-         else if( _multiRelayFlag )
+      }
+   }
+
+   do
+   {
+      uint64_t nextEdge = TIMER_WHEEL_NEVER;
+      activeJobs = 0;
+      for( int bus = 0; bus < numOfBuses; bus++ )
+      {
+         activeJobs += schedulers[bus].activeJobs;
+         if( nextRelayScheduler( &schedulers[bus] ) < nextEdge )
          {
-            fprintf( stderr, "%s A group of relays is only separated by \',\'.\n",
-                     LOG_ERROR );
-            return _errorRelay;
+            nextEdge = nextRelayScheduler( &schedulers[bus] );
          }
-         else
+      }
+      if( activeJobs == 0 )
+      {
+         break;
+      }
+#ifndef _WIN32
+      // Keep writing the frames still queued while waiting for the next edge
+      if( numOfBuses > 1 && !drainSerialWriters( writers, numOfBuses, nextEdge ) )
+      {
+         retValue = -1;
+      }
+#endif
+      sleepUntilPulseTimer( nextEdge );
+      uint64_t now = nowPulseTimer();
+      for( int bus = 0; bus < numOfBuses; bus++ )
+      {
+         if( !runRelayScheduler( &schedulers[bus], now ) )
          {
-            newNumberFlag   = false;
-            _rangeRelayFlag = true;
-            returnValue = _rangeRelays;
+            retValue = -1;
          }
       }
-      // If a comma is detected can be a group of specific relays
-      else if( *relayArgument == ',' )
+   } while( activeJobs > 0 );
+
+#ifndef _WIN32
+   if( numOfBuses > 1 )
+   {
+      if( !drainSerialWriters( writers, numOfBuses, UINT64_MAX ) )
+      {
+         retValue = -1;
+      }
+      for( int bus = 0; bus < numOfBuses; bus++ )
+      {
+         setNonBlockingVCP( &vcps[bus], false );
+      }
+   }
+#endif
+
+   resetPulseStats( &stats );
+   for( int bus = 0; bus < numOfBuses; bus++ )
+   {
+      mergePulseStats( &stats, &schedulers[bus].stats );
+   }
+   printPulseStats( &stats );
+
+   if( !endRelayLib( lib ) )
+   {
+      fprintf( stdout, "%s Could not close Port AFTER ending the schedules\n", LOG_ERROR );
+   }
+   return retValue;
+}
+// END f_runSchedules( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_probeBaudRate( .. )
+ * @brief: Function to find the fastest baud rate the boards answer to. Every rate the port accepts is tried, highest
+ *         first, asking the first board for its status. The port keeps the rate found
+ * @param1 <vcp_t*> vcp : The Virtual COM port
+ * @return: <int> Baud rate found, -1 if no board answered (the port goes back to its previous rate)
+ **********************************************************************************************************************/
+static int _probeBaudRate( vcp_t* vcp )
+{
+   static const int baudRates[] = BAUD_RATES_HIGHEST_FIRST;
+   uint8_t mask;
+   int     oldBaudRate = vcp->baudRate;
+
+   if( !tryOpenVCP( vcp, &_retryPolicy, NULL ) )
+   {
+      return -1;
+   }
+   for( size_t i = 0; i < sizeof( baudRates ) / sizeof( baudRates[0] ); i++ )
+   {
+      if( !isValidBaudRateVCP( baudRates[i] ) || !setBaudRateVCP( vcp, baudRates[i] ) )
+      {
+         continue;
+      }
+      if( readRelayStatus( vcp, _PROBE_BOARD, &mask, 0 ) )
       {
-         if( numberOfRelays == 0 )
+         fprintf( stdout, "%s Boards on %s answer at %d baud\n", LOG_INFO, vcp->name, baudRates[i] );
+         tryCloseVCP( vcp, &_retryPolicy, NULL );
+         return baudRates[i];
+      }
+      fprintf( stdout, "%s No answer on %s at %d baud\n", LOG_INFO, vcp->name, baudRates[i] );
+   }
+   setBaudRateVCP( vcp, oldBaudRate );
+   tryCloseVCP( vcp, &_retryPolicy, NULL );
+   return -1;
+}
+// END f_probeBaudRate( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printStatusBuses( .. )
+ * @brief: Function to print the real state of the relays of a board of every bus
+ * @param1 <relayLib_t*> lib : The context owning the Virtual COM ports, one per bus
+ * @param2 <uint8_t> board : Board of the chains
+ * @return: <bool> TRUE if the board of every bus answered
+ **********************************************************************************************************************/
+static bool _printStatusBuses( relayLib_t* lib, const uint8_t board )
+{
+   int    numOfBuses;
+   vcp_t* vcps = portsRelayLib( lib, &numOfBuses );
+   bool   answered = beginRelayLib( lib );
+
+   for( int bus = 0; bus < numOfBuses && answered; bus++ )
+   {
+      uint8_t mask;
+      if( !queryRelayLib( lib, bus, board, &mask ) )
+      {
+         fprintf( stderr, "%s Board %d of %s did not answer\n", LOG_ERROR, board, vcps[bus].name );
+         answered = false;
+         continue;
+      }
+      fprintf( stdout, "%s Board %d of %s: 0x%02x (relays %d to %d, bit 0 first)\n", LOG_INFO, board,
+               vcps[bus].name, mask, ( board - 1 ) * MAX_RELAYS_PER_BOARD + 1, board * MAX_RELAYS_PER_BOARD );
+   }
+   endRelayLib( lib );
+   return answered;
+}
+// END f_printStatusBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_replayTrace( .. )
+ * @brief: Function to summarise the trace given by '-replay' and send its frames again on the ports of its buses
+ * @param1 <relayLib_t*> lib : The context owning the Virtual COM ports, one per bus
+ * @return: <int> 0 if every frame was sent, -1 if not or the trace could not be read
+ **********************************************************************************************************************/
+static int _replayTrace( relayLib_t* lib )
+{
+   frameTraceMap_t     map;
+   frameTraceSummary_t summary;
+   int                 numOfBuses;
+   vcp_t*              vcps = portsRelayLib( lib, &numOfBuses );
+
+   if( !mapFrameTrace( &map, _replayPath ) )
+   {
+      fprintf( stderr, "%s %s is not a frame trace\n", LOG_ERROR, _replayPath );
+      return -1;
+   }
+   summarizeFrameTrace( &map, &summary );
+   fprintf( stdout, "%s Trace %s: %zu frames (%zu on, %zu off, %zu other) over %.3f s, longest gap %.3f ms\n",
+            LOG_INFO, _replayPath, map.numOfRecords, summary.onFrames, summary.offFrames, summary.otherFrames,
+            (double)summary.durationNs / NS_PER_SEC, (double)summary.maxGapNs / NS_PER_MS );
+   for( int bus = 0; bus < MAX_RS485_BUSES; bus++ )
+   {
+      if( summary.frames[bus] > 0 )
+      {
+         fprintf( stdout, "%s    bus %d: %zu frames%s\n", LOG_INFO, bus, summary.frames[bus],
+                  ( bus < numOfBuses ) ? "" : " (no port, skipped)" );
+      }
+   }
+
+   bool     sent = beginRelayLib( lib );
+   uint64_t startNs = nowPulseTimer();
+   if( sent )
+   {
+      sent = replayFrameTrace( &map, vcps, numOfBuses, _replayFastFlag );
+      fprintf( stdout, "%s Replayed in %.3f s%s\n", LOG_INFO, (double)( nowPulseTimer() - startNs ) / NS_PER_SEC,
+               _replayFastFlag ? " (fast)" : "" );
+   }
+   sent = endRelayLib( lib ) && sent;
+   unmapFrameTrace( &map );
+   return sent ? 0 : -1;
+}
+// END f_replayTrace( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runLines( .. )
+ * @brief: Function to run the commands read from stdin by '--stdin' until it ends. The ports are opened once and the
+ *         line buffer and the command are reused by every line, nothing is allocated per line. Every line is answered
+ *         on stdout once it is done, so a script can wait for it: "OK <line>" or "ERR <line> <reason>"
+ * @param1 <relayLib_t*> lib : The context owning the Virtual COM ports, one per bus
+ * @return: <int> 0 if every command was done, -1 if any failed or the ports could not be opened
+ **********************************************************************************************************************/
+static int _runLines( relayLib_t* lib )
+{
+   static char          line[_LINE_LENGTH];
+   static lineCommand_t command;
+   unsigned             lineNumber = 0;
+   unsigned             numOfFailed = 0;
+   int                  numOfBuses;
+   vcp_t*               vcps = portsRelayLib( lib, &numOfBuses );
+
+   if( !beginRelayLib( lib ) )
+   {
+      return -1;
+   }
+   fprintf( stdout, "%s Waiting for commands on stdin\n", LOG_INFO );
+   fflush( stdout );
+   while( fgets( line, sizeof( line ), stdin ) != NULL )
+   {
+      const char* error = NULL;
+      bool        done = false;
+      size_t      length = strlen( line );
+
+      lineNumber++;
+      if( length == sizeof( line ) - 1 && line[length - 1] != '\n' )
+      {
+         int character;
+         while( ( character = getchar() ) != EOF && character != '\n' )
          {
-            fprintf( stderr, "%s A group of relays must start with a number.\n", LOG_ERROR );
-            return _errorRelay;
+            ;                                          // Rest of the line dropped
          }
-         else if( _rangeRelayFlag )
+         error = "line too long";
+      }
+      else if( !_parseLine( line, &command, (uint8_t)numOfBuses, &error ) )
+      {
+         if( error == NULL )
          {
-            fprintf( stderr, "%s A range of relays can only be composed of two numbers begin and end.\n",
-                     LOG_ERROR );
-            return _errorRelay;
+            continue;                                  // Blank or comment
          }
-         else
+      }
+      else if( command.statusBoard > 0 )
+      {
+         done = true;
+         for( int bus = 0; bus < numOfBuses; bus++ )
          {
-            newNumberFlag = false;
-            if( !_multiRelayFlag )
+            uint8_t mask;
+            if( queryRelayLib( lib, bus, (uint8_t)command.statusBoard, &mask ) )
+            {
+               fprintf( stdout, "%s Board %d of %s: 0x%02x\n", LOG_INFO, command.statusBoard, vcps[bus].name, mask );
+            }
+            else
             {
-               _multiRelayFlag = true;
-               returnValue = _groupRelays;
+               error = "board did not answer";
+               done = false;
             }
          }
       }
+      else if( command.pulse )
+      {
+         done = pulseRelayLib( lib, &command.relays, command.openTime, command.offTime, command.impulses );
+      }
       else
       {
-         if( !newNumberFlag )
-         {
-            (*numberOfRelays)++;
-            newNumberFlag = true;
-            numberFound = 0;
-         }
-         numberFound = 10 * numberFound + (*relayArgument - '0' );
+         done = setRelayLib( lib, &command.relays, command.state );
+      }
 
-         if( *numberOfRelays == 1 ) _relayBegin = numberFound;
-         else _relayEnd = numberFound;
+      flushLogger();   // Pulse lines before the answer
+      if( done )
+      {
+         fprintf( stdout, "OK %u\n", lineNumber );
+      }
+      else
+      {
+         fprintf( stdout, "ERR %u %s\n", lineNumber, ( error != NULL ) ? error : "frames not sent" );
+         numOfFailed++;
       }
-      relayArgument++;
+      fflush( stdout );
    }
-   return returnValue;
+
+   printPulseStats( statsRelayLib( lib ) );
+   printCyclePulseStats( cycleStatsRelayLib( lib ) );
+   fprintf( stdout, "%s %u lines read, %u failed\n", LOG_INFO, lineNumber, numOfFailed );
+   return ( endRelayLib( lib ) && numOfFailed == 0 ) ? 0 : -1;
 }
-// END f_relayModality( .. ) ...
+// END f_runLines( .. ) ...
 
 
 /***********************************************************************************************************************
- * f_fillRelaysGroup( .. )
- * @brief: Function parse the relay modality chosen
- * @param1: <char*> relayArgument: The main argument containing the relays
- * @param2: <uint8_t*> array: Dynamic array to contain the relays selected
- * @param3: <uint8_t> size: Size of the dynamic array
- * @return: <void> None
+ * f_parseLine( .. )
+ * @brief: Function to parse a '--stdin' line, split in place. Ex: "-relay 1:4 -openTime 100 -impulses 3",
+ *         "-relay 1/2 -state on", "-status 1". Empty lines and lines starting with '#' are skipped
+ * @param1 <char*> line : The line, modified
+ * @param2 <lineCommand_t*> command : Command to fill, valid only when TRUE is returned
+ * @param3 <uint8_t> numOfBuses : Number of ports, relays of other buses are refused
+ * @param4 <const char**> error : Set to the reason when the line is not valid, NULL when it is skipped
+ * @return: <bool> TRUE if the line is a valid command
  **********************************************************************************************************************/
-static void _fillRelaysGroup( char* relayArgument, uint8_t* array, const uint8_t size )
+static bool _parseLine( char* line, lineCommand_t* command, const uint8_t numOfBuses, const char** error )
 {
-   uint8_t  arrayIndex = 0;
-   uint32_t numberFound = 0;
-   bool     newNumberFlag = false;
+   char* tokens[_MAX_LINE_TOKENS];
+   int   numOfTokens = 0;
+   bool  stateGiven = false;
+   bool  impulsesGiven = false;
+   bool  offTimeGiven = false;
 
-   while( *relayArgument != '\0' )
+   *error = NULL;
+   for( char* cursor = line; *cursor != '\0'; )
    {
-      if( *relayArgument == ',' )
+      while( *cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n' )
       {
-         newNumberFlag = false;
+         *cursor++ = '\0';
       }
-      else
+      if( *cursor == '\0' || ( numOfTokens == 0 && *cursor == '#' ) )
       {
-         if( !newNumberFlag )
-         {
-            arrayIndex++;
-            newNumberFlag = true;
-            numberFound = 0;
-         }
-         numberFound = 10 * numberFound + (*relayArgument - '0' );
-         if( numberFound > MAX_RELAYS_IN_RS485_CHAIN || numberFound < MIN_RELAY_NUMBER )
+         break;
+      }
+      if( numOfTokens == _MAX_LINE_TOKENS )
+      {
+         *error = "too many arguments";
+         return false;
+      }
+      tokens[numOfTokens++] = cursor;
+      while( *cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n' )
+      {
+         cursor++;
+      }
+   }
+   if( numOfTokens == 0 )
+   {
+      return false;
+   }
+
+   command->numOfRelays = 0;
+   command->pulse = false;
+   command->state = RELAY_FRAME_OFF;
+   command->offTime = 0;
+   command->impulses = 1;
+   command->statusBoard = 0;
+   for( int token = 0; token < numOfTokens; token += 2 )
+   {
+      const char* name = tokens[token];
+      const char* value = ( token + 1 < numOfTokens ) ? tokens[token + 1] : NULL;
+      if( value == NULL )
+      {
+         *error = "argument without value";
+         return false;
+      }
+      if( strcmp( name, ARG_RELAY_NUM ) == 0 )
+      {
+         command->numOfRelays = parseRelayBusSet( value, &command->relays, numOfBuses, error );
+         if( command->numOfRelays <= 0 )
          {
-            fprintf( stderr, "%s Valid relay numbers must be between %d and %d both included\n",
-                             LOG_ERROR,MIN_RELAY_NUMBER, MAX_RELAYS_IN_RS485_CHAIN );
+            return false;
          }
-         array[arrayIndex-1] = numberFound;
       }
-      relayArgument++;
+      else if( strcmp( name, ARG_RELAY_STATE ) == 0 && !command->pulse &&
+               ( strcmp( value, "on" ) == 0 || strcmp( value, "off" ) == 0 ) )
+      {
+         command->state = ( strcmp( value, "on" ) == 0 ) ? RELAY_FRAME_ON : RELAY_FRAME_OFF;
+         stateGiven = true;
+      }
+      else if( strcmp( name, ARG_OPEN_TIME ) == 0 && !stateGiven && _parseUint32( value, &command->openTime ) )
+      {
+         command->pulse = true;
+      }
+      else if( strcmp( name, ARG_IMPULSES ) == 0 && _parseUint32( value, &command->impulses ) )
+      {
+         impulsesGiven = true;
+      }
+      else if( strcmp( name, ARG_OFF_TIME ) == 0 && _parseUint32( value, &command->offTime ) )
+      {
+         offTimeGiven = true;
+      }
+      else if( strcmp( name, ARG_STATUS ) == 0 && ( command->statusBoard = atoi( value ) ) >= 1 &&
+               command->statusBoard <= MAX_BOARDS_IN_RS485_CHAIN )
+      {
+         ;
+      }
+      else
+      {
+         *error = "unknown argument, bad value or '-state' with '-openTime'";
+         return false;
+      }
+   }
+
+   if( command->statusBoard > 0 )
+   {
+      if( command->numOfRelays > 0 || stateGiven || command->pulse )
+      {
+         *error = "'-status' goes alone";
+         return false;
+      }
+      return true;
+   }
+   if( command->numOfRelays == 0 || ( !stateGiven && !command->pulse ) )
+   {
+      *error = "'-relay' and '-state' or '-openTime' expected";
+      return false;
+   }
+   if( ( impulsesGiven || offTimeGiven ) && !command->pulse )
+   {
+      *error = "'-impulses' and '-offTime' only work with '-openTime'";
+      return false;
    }
+   return true;
 }
-// END f_relayModality( .. ) ...
+// END f_parseLine( .. ) ...
@@ -0,0 +1,348 @@
+/***********************************************************************************************************************
+ * metrics.c
+ * @brief:  Latency histograms and counters of the actuation phases, exported as JSON and Prometheus text
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>   // fopen(), fprintf(), fclose(), rename(), remove(), snprintf()
+#include <stdlib.h>  // atexit()
+#include <string.h>  // memset()
+#include "pulseTimer.h"
+#include "metrics.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _TMP_SUFFIX           ".tmp"   // Exported files are written here first, then renamed
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static metricHistogram_t _histograms[NUM_OF_METRICS];
+static uint64_t          _counters[NUM_OF_METRIC_COUNTERS];
+static char              _jsonPath[MAX_PATH];       // Empty = not exported
+static char              _prometheusPath[MAX_PATH]; // Empty = not exported
+
+// Names of the exports, same order than metric_t / metricCounter_t
+static const char* const _metricNames[NUM_OF_METRICS] =
+   { "open", "configure", "write", "drain", "close", "pulse_error", "queue_to_wire",
+     "urgent_to_wire" };
+static const char* const _counterNames[NUM_OF_METRIC_COUNTERS] =
+   { "open_retries", "close_retries", "open_failures", "write_failures", "retry_deadlines", "retry_exhausted",
+     "coalesced_batches" };
+static const double      _quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static int      _bucket( const uint64_t valueNs );
+static uint64_t _bucketTop( const int bucket );
+static bool     _writeJson( const char* path );
+static bool     _writePrometheus( const char* path );
+static void     _exportAtExit( void );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_initMetrics( const char* jsonPath, const char* prometheusPath )                                      //
+//   void      f_recordMetrics( metric_t metric, uint64_t valueNs )                                                   //
+//   void      f_countMetrics( metricCounter_t counter )                                                              //
+//   uint64_t  f_percentileMetrics( metric_t metric, double percentile )                                              //
+//   bool      f_exportMetrics( void )                                                                                //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initMetrics( .. )
+ * @brief:  Function to clear every histogram and counter and set where they are exported. When a path is given the
+ *          files are also written at exit, whatever the way the program ends
+ * @param1: <const char*> jsonPath: JSON file, NULL to not export it
+ * @param2: <const char*> prometheusPath: Prometheus text file, NULL to not export it
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initMetrics( const char* jsonPath, const char* prometheusPath )
+{
+   static bool atExit = false;
+
+   for( int metric = 0; metric < NUM_OF_METRICS; metric++ )
+   {
+      memset( &_histograms[metric], 0, sizeof( _histograms[metric] ) );
+      _histograms[metric].minNs = UINT64_MAX;
+   }
+   memset( _counters, 0, sizeof( _counters ) );
+   snprintf( _jsonPath, sizeof( _jsonPath ), "%s", ( jsonPath != NULL ) ? jsonPath : "" );
+   snprintf( _prometheusPath, sizeof( _prometheusPath ), "%s", ( prometheusPath != NULL ) ? prometheusPath : "" );
+   if( !atExit && ( _jsonPath[0] != '\0' || _prometheusPath[0] != '\0' ) )
+   {
+      atExit = ( atexit( _exportAtExit ) == 0 );
+   }
+}
+// END f_initMetrics( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_recordMetrics( .. )
+ * @brief:  Function to add a value to a histogram. Safe from several threads (relayLib contexts), every field is
+ *          updated atomically
+ * @param1: <metric_t> metric: Histogram
+ * @param2: <uint64_t> valueNs: Value, nanoseconds
+ * @return: <void> None
+ **********************************************************************************************************************/
+void recordMetrics( const metric_t metric, const uint64_t valueNs )
+{
+   metricHistogram_t* histogram = &_histograms[metric];
+
+   uint64_t           seen;
+
+   __atomic_fetch_add( &histogram->count, 1, __ATOMIC_RELAXED );
+   __atomic_fetch_add( &histogram->sumNs, valueNs, __ATOMIC_RELAXED );
+   __atomic_fetch_add( &histogram->buckets[_bucket( valueNs )], 1, __ATOMIC_RELAXED );
+   seen = __atomic_load_n( &histogram->minNs, __ATOMIC_RELAXED );
+   while( valueNs < seen &&
+          !__atomic_compare_exchange_n( &histogram->minNs, &seen, valueNs, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+   {
+   }
+   seen = __atomic_load_n( &histogram->maxNs, __ATOMIC_RELAXED );
+   while( valueNs > seen &&
+          !__atomic_compare_exchange_n( &histogram->maxNs, &seen, valueNs, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+   {
+   }
+}
+// END f_recordMetrics( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_countMetrics( .. )
+ * @brief:  Function to add one to a counter, safe from several threads
+ * @param1: <metricCounter_t> counter: Counter
+ * @return: <void> None
+ **********************************************************************************************************************/
+void countMetrics( const metricCounter_t counter )
+{
+   __atomic_fetch_add( &_counters[counter], 1, __ATOMIC_RELAXED );
+}
+// END f_countMetrics( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_percentileMetrics( .. )
+ * @brief:  Function to get a percentile of a histogram, as the top of the bucket it falls in (clamped to min/max)
+ * @param1: <metric_t> metric: Histogram
+ * @param2: <double> percentile: 0 to 100
+ * @return: <uint64_t> Value in nanoseconds, 0 if the histogram is empty
+ **********************************************************************************************************************/
+uint64_t percentileMetrics( const metric_t metric, const double percentile )
+{
+   const metricHistogram_t* histogram = &_histograms[metric];
+   uint64_t                 target;
+   uint64_t                 seen = 0;
+
+   if( histogram->count == 0 )
+   {
+      return 0;
+   }
+   target = (uint64_t)( percentile / 100.0 * (double)histogram->count + 0.5 );
+   if( target < 1 ) target = 1;
+   for( int bucket = 0; bucket < METRICS_BUCKETS; bucket++ )
+   {
+      seen += histogram->buckets[bucket];
+      if( seen >= target )
+      {
+         uint64_t top = _bucketTop( bucket );
+         if( top > histogram->maxNs ) top = histogram->maxNs;
+         if( top < histogram->minNs ) top = histogram->minNs;
+         return top;
+      }
+   }
+   return histogram->maxNs;
+}
+// END f_percentileMetrics( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_exportMetrics( .. )
+ * @brief:  Function to write the files set by initMetrics()
+ * @return: <bool> TRUE if every file was written (or none was asked for)
+ **********************************************************************************************************************/
+bool exportMetrics( void )
+{
+   bool exported = true;
+
+   if( _jsonPath[0] != '\0' )
+   {
+      exported = _writeJson( _jsonPath ) && exported;
+   }
+   if( _prometheusPath[0] != '\0' )
+   {
+      exported = _writePrometheus( _prometheusPath ) && exported;
+   }
+   return exported;
+}
+// END f_exportMetrics( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   int       f_bucket( uint64_t valueNs )                                                                           //
+//   uint64_t  f_bucketTop( int bucket )                                                                              //
+//   bool      f_writeJson( const char* path )                                                                        //
+//   bool      f_writePrometheus( const char* path )                                                                  //
+//   void      f_exportAtExit( void )                                                                                 //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_bucket( .. )
+ * @brief:  Function to get the bucket of a value. Values under 2 * METRICS_SUB_BUCKETS have their own bucket, bigger
+ *          ones keep their METRICS_PRECISION_BITS + 1 most significant bits
+ * @param1: <uint64_t> valueNs: Value
+ * @return: <int> Bucket index
+ **********************************************************************************************************************/
+static int _bucket( const uint64_t valueNs )
+{
+   if( valueNs < 2 * METRICS_SUB_BUCKETS )
+   {
+      return (int)valueNs;
+   }
+   int msb = 63 - __builtin_clzll( valueNs );
+   int shift = msb - METRICS_PRECISION_BITS;
+   return ( shift + 1 ) * METRICS_SUB_BUCKETS + (int)( valueNs >> shift ) - METRICS_SUB_BUCKETS;
+}
+// END f_bucket( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_bucketTop( .. )
+ * @brief:  Function to get the biggest value of a bucket
+ * @param1: <int> bucket: Bucket index
+ * @return: <uint64_t> Value
+ **********************************************************************************************************************/
+static uint64_t _bucketTop( const int bucket )
+{
+   if( bucket < 2 * METRICS_SUB_BUCKETS )
+   {
+      return (uint64_t)bucket;
+   }
+   int      shift = bucket / METRICS_SUB_BUCKETS - 1;
+   uint64_t bottom = (uint64_t)( bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS ) << shift;
+   return bottom + ( ( 1ULL << shift ) - 1 );
+}
+// END f_bucketTop( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_writeJson( .. )
+ * @brief:  Function to write every histogram (microseconds) and counter as a JSON object
+ * @param1: <const char*> path: File to write
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+static bool _writeJson( const char* path )
+{
+   char  tmpPath[MAX_PATH + sizeof( _TMP_SUFFIX )];
+   FILE* file;
+
+   snprintf( tmpPath, sizeof( tmpPath ), "%s%s", path, _TMP_SUFFIX );
+   file = fopen( tmpPath, "w" );
+   if( file == NULL )
+   {
+      fprintf( stderr, "%s Could not write the metrics to %s\n", LOG_ERROR, tmpPath );
+      return false;
+   }
+   fprintf( file, "{\n  \"histograms_us\": {\n" );
+   for( int metric = 0; metric < NUM_OF_METRICS; metric++ )
+   {
+      const metricHistogram_t* histogram = &_histograms[metric];
+      fprintf( file, "    \"%s\": { \"count\": %llu", _metricNames[metric], (unsigned long long)histogram->count );
+      if( histogram->count > 0 )
+      {
+         fprintf( file, ", \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+                  "\"p999\": %.3f, \"max\": %.3f", (double)histogram->minNs / NS_PER_US,
+                  (double)histogram->sumNs / (double)histogram->count / NS_PER_US,
+                  (double)percentileMetrics( (metric_t)metric, 50.0 ) / NS_PER_US,
+                  (double)percentileMetrics( (metric_t)metric, 90.0 ) / NS_PER_US,
+                  (double)percentileMetrics( (metric_t)metric, 99.0 ) / NS_PER_US,
+                  (double)percentileMetrics( (metric_t)metric, 99.9 ) / NS_PER_US,
+                  (double)histogram->maxNs / NS_PER_US );
+      }
+      fprintf( file, " }%s\n", ( metric < NUM_OF_METRICS - 1 ) ? "," : "" );
+   }
+   fprintf( file, "  },\n  \"counters\": {\n" );
+   for( int counter = 0; counter < NUM_OF_METRIC_COUNTERS; counter++ )
+   {
+      fprintf( file, "    \"%s\": %llu%s\n", _counterNames[counter], (unsigned long long)_counters[counter],
+               ( counter < NUM_OF_METRIC_COUNTERS - 1 ) ? "," : "" );
+   }
+   fprintf( file, "  }\n}\n" );
+   if( fclose( file ) != 0 )
+   {
+      remove( tmpPath );
+      return false;
+   }
+#ifdef _WIN32
+   remove( path );                  // Win32 rename() does not replace an existing file
+#endif
+   return ( rename( tmpPath, path ) == 0 );
+}
+// END f_writeJson( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_writePrometheus( .. )
+ * @brief:  Function to write every histogram (seconds, as a summary) and counter in the Prometheus text format, for
+ *          the node_exporter textfile collector
+ * @param1: <const char*> path: File to write
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+static bool _writePrometheus( const char* path )
+{
+   char  tmpPath[MAX_PATH + sizeof( _TMP_SUFFIX )];
+   FILE* file;
+
+   snprintf( tmpPath, sizeof( tmpPath ), "%s%s", path, _TMP_SUFFIX );
+   file = fopen( tmpPath, "w" );
+   if( file == NULL )
+   {
+      fprintf( stderr, "%s Could not write the metrics to %s\n", LOG_ERROR, tmpPath );
+      return false;
+   }
+   for( int metric = 0; metric < NUM_OF_METRICS; metric++ )
+   {
+      const metricHistogram_t* histogram = &_histograms[metric];
+      fprintf( file, "# TYPE relaymanager_%s_seconds summary\n", _metricNames[metric] );
+      for( size_t q = 0; q < sizeof( _quantiles ) / sizeof( _quantiles[0] ); q++ )
+      {
+         fprintf( file, "relaymanager_%s_seconds{quantile=\"%g\"} %.9f\n", _metricNames[metric], _quantiles[q],
+                  (double)percentileMetrics( (metric_t)metric, _quantiles[q] * 100.0 ) / NS_PER_SEC );
+      }
+      fprintf( file, "relaymanager_%s_seconds_sum %.9f\n", _metricNames[metric],
+               (double)histogram->sumNs / NS_PER_SEC );
+      fprintf( file, "relaymanager_%s_seconds_count %llu\n", _metricNames[metric],
+               (unsigned long long)histogram->count );
+   }
+   for( int counter = 0; counter < NUM_OF_METRIC_COUNTERS; counter++ )
+   {
+      fprintf( file, "# TYPE relaymanager_%s_total counter\n", _counterNames[counter] );
+      fprintf( file, "relaymanager_%s_total %llu\n", _counterNames[counter], (unsigned long long)_counters[counter] );
+   }
+   if( fclose( file ) != 0 )
+   {
+      remove( tmpPath );
+      return false;
+   }
+#ifdef _WIN32
+   remove( path );                  // Win32 rename() does not replace an existing file
+#endif
+   return ( rename( tmpPath, path ) == 0 );
+}
+// END f_writePrometheus( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_exportAtExit( .. )
+ * @brief:  atexit() handler, last export of the files
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _exportAtExit( void )
+{
+   exportMetrics();
+}
+// END f_exportAtExit( .. ) ...
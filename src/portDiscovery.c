@@ -0,0 +1,392 @@
+/***********************************************************************************************************************
+ * portDiscovery.c
+ * @brief:  Startup search of the RS485 adapter the relay boards hang from (POSIX only)
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>   // fprintf(), snprintf(), fdopen(), rename()
+#include <stdlib.h>  // getenv(), realpath(), mkstemp()
+#include <string.h>  // strcmp(), strlen(), memcpy()
+#include <errno.h>   // errno, EINTR
+#include <glob.h>    // glob(), globfree()
+#include <poll.h>    // poll()
+#include <fcntl.h>   // open(), O_NOFOLLOW
+#include <unistd.h>  // access(), close(), unlink(), geteuid()
+#include <sys/stat.h> // fstat(), S_ISREG()
+#include "main.h"
+#include "pulseTimer.h"
+#include "virtualComPort.h"
+#include "relayFrame.h"
+#include "portLock.h"
+#include "portDiscovery.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _PROBE_BOARD          1     // Board asked for its status
+#define _PROBE_TURNAROUND_MS  50    // Time a board may take to start its reply
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+// Device being probed
+typedef struct portCandidate_type
+{
+   vcp_t      vcp;
+   portLock_t lock;                           // Held while probing, a port in use by another process is not touched
+   char       realName[MAX_PATH];             // Symlinks resolved, the same adapter is only probed once
+   char       reply[RELAY_STATUS_LENGTH];
+   size_t     replyLength;
+} portCandidate_t;
+
+
+/* Private objects/variables -----------------------------------------------------------------------------------------*/
+static portCandidate_t _candidates[PORT_DISCOVERY_MAX_CANDIDATES];
+static int             _numOfCandidates = 0;
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void _addCandidate( const char* name, const int baudRate );
+static int  _probeCandidates( const int first );
+static void _cachePath( char* path, const size_t size );
+static bool _readCache( char* device, const size_t deviceSize, int* baudRate );
+static void _writeCache( const char* device, const int baudRate );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_discoverPort( char* device, size_t deviceSize, int* baudRate, bool useCache )                        //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_discoverPort( .. )
+ * @brief:  Function to find the device of the relay boards. The cached device is probed alone first, then every other
+ *          candidate at the same time. When no board answers (boards without status replies) the cached device, or
+ *          else the most stable name found, is returned without being cached
+ * @param1: <char*> device: Where to store the device path
+ * @param2: <size_t> deviceSize: Size of device
+ * @param3: <int*> baudRate: In, baud rate to probe new devices at. Out, baud rate of the device found
+ * @param4: <bool> useCache: FALSE to ignore the cached device (it is rewritten if a board answers)
+ * @return: <bool> TRUE if a device was found
+ **********************************************************************************************************************/
+bool discoverPort( char* device, const size_t deviceSize, int* baudRate, const bool useCache )
+{
+   static const char* patterns[] = PORT_DISCOVERY_PATTERNS;
+   char cachedDevice[MAX_PATH];
+   int  cachedBaudRate = *baudRate;
+   int  first = 0;
+   int  winner;
+
+   _numOfCandidates = 0;
+
+   // The last known good device alone first, the same adapter connects on the first try
+   bool cached = useCache && _readCache( cachedDevice, sizeof( cachedDevice ), &cachedBaudRate ) &&
+                 access( cachedDevice, F_OK ) == 0;
+   if( cached )
+   {
+      _addCandidate( cachedDevice, cachedBaudRate );
+      if( _probeCandidates( 0 ) == 0 )
+      {
+         snprintf( device, deviceSize, "%s", cachedDevice );
+         *baudRate = cachedBaudRate;
+         fprintf( stdout, "%s %s()::Boards answer on cached %s\n", LOG_INFO, __func__, device );
+         return true;
+      }
+      fprintf( stdout, "%s %s()::No answer on cached %s, searching\n", LOG_INFO, __func__, cachedDevice );
+      first = _numOfCandidates;
+   }
+
+   // Every other candidate at the same time, stable names first
+   for( size_t i = 0; i < sizeof( patterns ) / sizeof( patterns[0] ); i++ )
+   {
+      glob_t found;
+      if( glob( patterns[i], 0, NULL, &found ) == 0 )
+      {
+         for( size_t n = 0; n < found.gl_pathc; n++ )
+         {
+            _addCandidate( found.gl_pathv[n], *baudRate );
+         }
+      }
+      globfree( &found );
+   }
+   winner = _probeCandidates( first );
+   if( winner >= 0 )
+   {
+      snprintf( device, deviceSize, "%s", _candidates[winner].vcp.name );
+      *baudRate = _candidates[winner].vcp.baudRate;
+      fprintf( stdout, "%s %s()::Boards answer on %s\n", LOG_INFO, __func__, device );
+      _writeCache( device, *baudRate );
+      return true;
+   }
+
+   // Nobody answered, best guess
+   if( cached )
+   {
+      snprintf( device, deviceSize, "%s", cachedDevice );
+      *baudRate = cachedBaudRate;
+   }
+   else if( _numOfCandidates > 0 )
+   {
+      snprintf( device, deviceSize, "%s", _candidates[0].vcp.name );
+   }
+   else
+   {
+      return false;
+   }
+   fprintf( stdout, "%s %s()::No board answered, using %s\n", LOG_WARNING, __func__, device );
+   return true;
+}
+// END f_discoverPort( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_addCandidate( .. )
+ * @brief:  Function to add a device to the list of candidates, unless it is already there under another name
+ * @param1: <const char*> name: Device path
+ * @param2: <int> baudRate: Baud rate to probe it at
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _addCandidate( const char* name, const int baudRate )
+{
+   char realName[MAX_PATH];
+
+   if( _numOfCandidates >= PORT_DISCOVERY_MAX_CANDIDATES || realpath( name, realName ) == NULL )
+   {
+      return;
+   }
+   for( int i = 0; i < _numOfCandidates; i++ )
+   {
+      if( strcmp( _candidates[i].realName, realName ) == 0 )
+      {
+         return;
+      }
+   }
+   portCandidate_t* candidate = &_candidates[_numOfCandidates++];
+   snprintf( candidate->vcp.name, sizeof( candidate->vcp.name ), "%s", name );
+   snprintf( candidate->realName, sizeof( candidate->realName ), "%s", realName );
+   candidate->vcp.fd = -1;
+   candidate->vcp.number = -1;
+   candidate->vcp.baudRate = baudRate;
+   candidate->lock.segment = NULL;
+   candidate->replyLength = 0;
+}
+// END f_addCandidate( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_probeCandidates( .. )
+ * @brief:  Function to ask the first board behind every candidate for its status, all of them at the same time, and
+ *          wait for the first well formed reply. Candidates another process uses or waits for are skipped: nothing is
+ *          written to them nor read from them. Every candidate is closed and its port lock released again
+ * @param1: <int> first: First candidate to probe, the ones before it were already probed
+ * @return: <int> Index of the candidate that answered first, -1 if none did
+ **********************************************************************************************************************/
+static int _probeCandidates( const int first )
+{
+   struct pollfd fds[PORT_DISCOVERY_MAX_CANDIDATES];
+   char          request[RELAY_FRAME_LENGTH];
+   uint64_t      timeoutNs = 0;
+   int           winner = -1;
+   nfds_t        nfds = 0;
+
+   buildRelayStatusFrame( request, _PROBE_BOARD );
+   for( int i = first; i < _numOfCandidates; i++ )
+   {
+      portCandidate_t* candidate = &_candidates[i];
+      fds[nfds].fd = -1;
+      fds[nfds].events = POLLIN;
+      nfds++;
+      if( !tryAcquirePortLock( &candidate->lock, candidate->vcp.name ) )
+      {
+         fprintf( stdout, "%s %s()::%s is in use, not probed\n", LOG_INFO, __func__, candidate->vcp.name );
+         continue;
+      }
+      if( !openVCP( &candidate->vcp ) )
+      {
+         releasePortLock( &candidate->lock );
+         continue;      // Busy, gone or not a tty
+      }
+      // Bytes left by somebody else are thrown away before asking
+      while( readVCP( &candidate->vcp, candidate->reply, sizeof( candidate->reply ), 0 ) > 0 )
+      {
+      }
+      candidate->replyLength = 0;
+      if( !sendFrameVCP( &candidate->vcp, request, sizeof( request ) ) )
+      {
+         destroyVCP( &candidate->vcp );
+         releasePortLock( &candidate->lock );
+         continue;
+      }
+      fds[nfds - 1].fd = candidate->vcp.fd;
+      uint64_t candidateTimeoutNs = wireTimeVCP( &candidate->vcp, sizeof( request ) + sizeof( candidate->reply ) ) +
+                                    _PROBE_TURNAROUND_MS * NS_PER_MS;
+      if( candidateTimeoutNs > timeoutNs )
+      {
+         timeoutNs = candidateTimeoutNs;
+      }
+   }
+
+   uint64_t deadline = nowPulseTimer() + timeoutNs;
+   while( winner < 0 )
+   {
+      uint64_t now = nowPulseTimer();
+      if( now >= deadline )
+      {
+         break;
+      }
+      int ready = poll( fds, nfds, (int)( ( deadline - now + NS_PER_MS - 1 ) / NS_PER_MS ) );
+      if( ready < 0 && errno != EINTR )
+      {
+         break;
+      }
+      for( nfds_t n = 0; n < nfds && ready > 0 && winner < 0; n++ )
+      {
+         portCandidate_t* candidate = &_candidates[first + (int)n];
+         if( fds[n].fd < 0 || fds[n].revents == 0 )
+         {
+            continue;
+         }
+         int bytesRead = readVCP( &candidate->vcp, candidate->reply + candidate->replyLength,
+                                  sizeof( candidate->reply ) - candidate->replyLength, 0 );
+         if( bytesRead <= 0 )
+         {
+            fds[n].fd = -1;       // Hung up or failing, nothing else will come
+            continue;
+         }
+         candidate->replyLength += (size_t)bytesRead;
+         if( candidate->replyLength == sizeof( candidate->reply ) )
+         {
+            if( isRelayStatusReply( candidate->reply ) )
+            {
+               winner = first + (int)n;
+            }
+            fds[n].fd = -1;
+         }
+      }
+   }
+
+   for( int i = first; i < _numOfCandidates; i++ )
+   {
+      destroyVCP( &_candidates[i].vcp );
+      releasePortLock( &_candidates[i].lock );
+   }
+   return winner;
+}
+// END f_probeCandidates( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_cachePath( .. )
+ * @brief:  Function to get the path of the state file
+ * @param1: <char*> path: Where to store it
+ * @param2: <size_t> size: Size of path
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _cachePath( char* path, const size_t size )
+{
+   const char* home = getenv( "HOME" );
+
+   snprintf( path, size, "%s/%s", ( home != NULL && home[0] != '\0' ) ? home : "/tmp", PORT_DISCOVERY_CACHE_NAME );
+}
+// END f_cachePath( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_readCache( .. )
+ * @brief:  Function to read the last known good device: "device <path>" and "baudRate <n>" lines
+ * @param1: <char*> device: Where to store the device path
+ * @param2: <size_t> deviceSize: Size of device
+ * @param3: <int*> baudRate: Where to store the baud rate, untouched if not cached or not valid
+ * @return: <bool> TRUE if a device was cached
+ **********************************************************************************************************************/
+static bool _readCache( char* device, const size_t deviceSize, int* baudRate )
+{
+   char  path[MAX_PATH];
+   char  line[MAX_PATH + 16];
+   bool  found = false;
+
+   // Without $HOME the file is in a directory everybody writes: only a file of this user may choose the device
+   _cachePath( path, sizeof( path ) );
+   struct stat status;
+   int         fd = open( path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC );
+   if( fd < 0 )
+   {
+      return false;
+   }
+   if( fstat( fd, &status ) != 0 || !S_ISREG( status.st_mode ) || status.st_uid != geteuid() )
+   {
+      fprintf( stderr, "%s %s()::%s is not a file of this user, ignored\n", LOG_WARNING, __func__, path );
+      close( fd );
+      return false;
+   }
+   FILE* file = fdopen( fd, "r" );
+   if( file == NULL )
+   {
+      close( fd );
+      return false;
+   }
+   while( fgets( line, sizeof( line ), file ) != NULL )
+   {
+      int value;
+      line[strcspn( line, "\r\n" )] = '\0';
+      if( strncmp( line, "device ", 7 ) == 0 && line[7] != '\0' )
+      {
+         size_t length = strlen( line + 7 );
+         if( length < deviceSize )                      // A cut name would be another device
+         {
+            memcpy( device, line + 7, length + 1 );
+            found = true;
+         }
+      }
+      else if( sscanf( line, "baudRate %d", &value ) == 1 && isValidBaudRateVCP( value ) )
+      {
+         *baudRate = value;
+      }
+   }
+   fclose( file );
+   return found;
+}
+// END f_readCache( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_writeCache( .. )
+ * @brief:  Function to store the device that answered. Written aside and renamed, a reader never sees half a file.
+ *          The file aside is a new one of this user only (mkstemp()), never a name planted in a shared directory
+ * @param1: <const char*> device: Device path
+ * @param2: <int> baudRate: Baud rate the boards answered at
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _writeCache( const char* device, const int baudRate )
+{
+   char path[MAX_PATH];
+   char tmpPath[MAX_PATH + 8];
+
+   _cachePath( path, sizeof( path ) );
+   snprintf( tmpPath, sizeof( tmpPath ), "%s.XXXXXX", path );
+   int fd = mkstemp( tmpPath );
+   if( fd < 0 )
+   {
+      return;
+   }
+   FILE* file = fdopen( fd, "w" );
+   if( file == NULL )
+   {
+      close( fd );
+      unlink( tmpPath );
+      return;
+   }
+   fprintf( file, "device %s\nbaudRate %d\n", device, baudRate );
+   if( fclose( file ) != 0 || rename( tmpPath, path ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Unable to write %s\n", LOG_WARNING, __func__, path );
+      remove( tmpPath );
+   }
+}
+// END f_writeCache( .. ) ...
+
+#endif // !_WIN32
@@ -0,0 +1,673 @@
+/***********************************************************************************************************************
+ * portLock.c
+ * @brief:  First come first served arbitration of a port between processes, and the relay states they share
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+#define _GNU_SOURCE     // F_OFD_SETLK
+#endif
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fprintf(), snprintf()
+#include <stdlib.h>     // getenv(), realpath()
+#include <string.h>     // memset()
+#include <ctype.h>      // isalnum()
+#ifndef _WIN32
+   #include <errno.h>    // errno, EINTR, EPERM
+   #include <limits.h>   // PATH_MAX
+   #include <fcntl.h>    // open(), fcntl(), struct flock, O_NOFOLLOW
+   #include <signal.h>   // kill()
+   #include <unistd.h>   // close(), ftruncate(), getpid(), geteuid()
+   #include <sys/mman.h> // mmap(), munmap()
+   #include <sys/stat.h> // fstat(), fchmod(), S_ISREG()
+#endif
+#include "main.h"
+#include "pulseTimer.h"
+#include "relayShadow.h"
+#include "portLock.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+// Byte ranges locked in the file, past the segment (Windows locks are mandatory, they must not cover mapped data)
+#define _OWNER_OFFSET         0x40000000UL   // Held by the process being served, released by the system if it dies
+#define _DESK_OFFSET          ( _OWNER_OFFSET + 1 )   // Held for a moment to take a ticket or skip a dead one
+#define _STALE_NS             ( 500 * NS_PER_MS )     // Ticket served without its owner lock taken: pid reused
+#define _LEFT_PID             ( -1L )                 // Slot of a ticket given up, taken until serving passes it
+// Locks of the open file, not of the process: two contexts of a process on the same device exclude each other too, and
+// closing one does not drop the locks of the other (only the process is known where there is no such lock)
+#ifdef F_OFD_SETLK
+   #define _SETLK             F_OFD_SETLK
+   #define _SETLKW            F_OFD_SETLKW
+#elif !defined( _WIN32 )
+   #define _SETLK             F_SETLK
+   #define _SETLKW            F_SETLKW
+#endif
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static bool _openSegment( portLock_t* lock, const char* device );
+static void _closeSegment( portLock_t* lock );
+static bool _path( char* path, const size_t size, const char* device );
+static bool _lockRange( portLock_t* lock, const unsigned long offset, const bool wait );
+static void _unlockRange( portLock_t* lock, const unsigned long offset );
+static long _pid( void );
+static bool _isAlive( const long pid );
+static void _skip( portLock_t* lock, const unsigned ticket );
+static bool _leave( portLock_t* lock );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_acquirePortLock( portLock_t* lock, const char* device, uint64_t deadlineNs )                         //
+//   bool      f_tryAcquirePortLock( portLock_t* lock, const char* device )                                           //
+//   void      f_releasePortLock( portLock_t* lock )                                                                  //
+//   bool      f_pathPortLock( char* path, size_t size, const char* device )                                          //
+//   void      f_loadPortLock( const portLock_t* lock, relayShadow_t* shadow )                                        //
+//   void      f_storePortLock( portLock_t* lock, const relayShadow_t* shadow )                                       //
+//   void      f_applyPortLock( portLock_t* lock, const relaySet_t* relays, uint8_t state )                           //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_acquirePortLock( .. )
+ * @brief:  Function to queue for a port and wait for the turn of the process. The device is not touched while waiting,
+ *          the processes ahead are served in the order they came. Processes that died in the queue are skipped
+ * @param1: <portLock_t*> lock: Lock to fill, released with releasePortLock()
+ * @param2: <const char*> device: Device of the port, the names reaching the same device share the lock (POSIX)
+ * @param3: <uint64_t> deadlineNs: Time to give up waiting (nowPulseTimer() time base), PORT_LOCK_NO_DEADLINE
+ * @return: <bool> TRUE once the port is the process's, FALSE if the shared segment could not be created or the
+ *          deadline passed first
+ **********************************************************************************************************************/
+bool acquirePortLock( portLock_t* lock, const char* device, const uint64_t deadlineNs )
+{
+   long     pid = _pid();
+   bool     logged = false;
+   uint64_t freeSinceNs = 0;                           // Owner lock of the ticket being served seen free since then
+   unsigned watched = 0;                               // Ticket freeSinceNs is about
+
+   if( !_openSegment( lock, device ) )
+   {
+      fprintf( stderr, "%s %s()::Unable to share %s with the other processes (%s)\n", LOG_ERROR, __func__, device,
+               lock->path );
+      return false;
+   }
+   portLockSegment_t* segment = lock->segment;
+
+   // Ticket, only while its slot is free (more than PORT_LOCK_MAX_WAITERS processes queued otherwise)
+   for( ;; )
+   {
+      _lockRange( lock, _DESK_OFFSET, true );
+      unsigned ticket = atomic_load( &segment->nextTicket );
+      if( atomic_load( &segment->pids[ticket % PORT_LOCK_MAX_WAITERS] ) == 0 )
+      {
+         atomic_store( &segment->pids[ticket % PORT_LOCK_MAX_WAITERS], pid );
+         atomic_store( &segment->nextTicket, ticket + 1 );
+         _unlockRange( lock, _DESK_OFFSET );
+         lock->ticket = ticket;
+         break;
+      }
+      _unlockRange( lock, _DESK_OFFSET );
+      if( nowPulseTimer() >= deadlineNs )
+      {
+         fprintf( stderr, "%s %s()::%d processes still queued on %s, gave up waiting\n", LOG_ERROR, __func__,
+                  PORT_LOCK_MAX_WAITERS, device );
+         _closeSegment( lock );
+         return false;
+      }
+      if( !logged )
+      {
+         fprintf( stdout, "%s %s()::%d processes queued on %s, waiting for a place\n", LOG_WARNING, __func__,
+                  PORT_LOCK_MAX_WAITERS, device );
+         logged = true;
+      }
+      sleepUntilPulseTimer( nowPulseTimer() + PORT_LOCK_POLL_NS );
+   }
+
+   // Turn: the ticket being served moves on when its process releases the port or is found dead
+   logged = false;
+   for( ;; )
+   {
+      unsigned serving = atomic_load( &segment->serving );
+      if( serving == lock->ticket )
+      {
+         break;
+      }
+      long holder = atomic_load( &segment->pids[serving % PORT_LOCK_MAX_WAITERS] );
+      bool stale = !_isAlive( holder );
+      if( !stale && _lockRange( lock, _OWNER_OFFSET, false ) )
+      {
+         // Served but the port is not held: it is being handed over, or the pid belongs to another process now
+         _unlockRange( lock, _OWNER_OFFSET );
+         uint64_t now = nowPulseTimer();
+         if( freeSinceNs == 0 || watched != serving )
+         {
+            freeSinceNs = now;
+            watched = serving;
+         }
+         stale = ( now - freeSinceNs >= _STALE_NS );
+      }
+      else
+      {
+         freeSinceNs = 0;
+      }
+      if( stale )
+      {
+         _skip( lock, serving );
+         continue;
+      }
+      if( nowPulseTimer() >= deadlineNs && _leave( lock ) )
+      {
+         fprintf( stderr, "%s %s()::%s still used by process %ld, gave up waiting\n", LOG_ERROR, __func__, device,
+                  holder );
+         _closeSegment( lock );
+         return false;
+      }
+      if( !logged )
+      {
+         fprintf( stdout, "%s %s()::%s is used by process %ld, %u ahead in the queue\n", LOG_INFO, __func__, device,
+                  holder, lock->ticket - serving );
+         fflush( stdout );
+         logged = true;
+      }
+      sleepUntilPulseTimer( nowPulseTimer() + PORT_LOCK_POLL_NS );
+   }
+
+   // The process served before may still be letting the lock go
+   _lockRange( lock, _OWNER_OFFSET, true );
+   return true;
+}
+// END f_acquirePortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_tryAcquirePortLock( .. )
+ * @brief:  Function to take a port only if nobody is using it or queued for it. Processes that died holding it are
+ *          skipped first. For a look at a port that may not be the right one, without waiting
+ * @param1: <portLock_t*> lock: Lock to fill, released with releasePortLock()
+ * @param2: <const char*> device: Device of the port
+ * @return: <bool> TRUE if the port is the process's, FALSE if it is busy or the shared segment could not be created
+ **********************************************************************************************************************/
+bool tryAcquirePortLock( portLock_t* lock, const char* device )
+{
+   long pid = _pid();
+   bool taken = false;
+
+   if( !_openSegment( lock, device ) )
+   {
+      return false;
+   }
+   portLockSegment_t* segment = lock->segment;
+
+   for( ;; )
+   {
+      unsigned serving = atomic_load( &segment->serving );
+      if( serving == atomic_load( &segment->nextTicket ) ||
+          _isAlive( atomic_load( &segment->pids[serving % PORT_LOCK_MAX_WAITERS] ) ) )
+      {
+         break;
+      }
+      _skip( lock, serving );
+   }
+   _lockRange( lock, _DESK_OFFSET, true );
+   unsigned ticket = atomic_load( &segment->nextTicket );
+   if( atomic_load( &segment->serving ) == ticket && _lockRange( lock, _OWNER_OFFSET, false ) )
+   {
+      atomic_store( &segment->pids[ticket % PORT_LOCK_MAX_WAITERS], pid );
+      atomic_store( &segment->nextTicket, ticket + 1 );
+      lock->ticket = ticket;
+      taken = true;
+   }
+   _unlockRange( lock, _DESK_OFFSET );
+   if( !taken )
+   {
+      _closeSegment( lock );
+   }
+   return taken;
+}
+// END f_tryAcquirePortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_releasePortLock( .. )
+ * @brief:  Function to hand the port over to the next process in the queue. Call it once the port is closed
+ * @param1: <portLock_t*> lock: The lock, not acquired does nothing
+ * @return: <void> None
+ **********************************************************************************************************************/
+void releasePortLock( portLock_t* lock )
+{
+   if( lock->segment == NULL )
+   {
+      return;
+   }
+   _lockRange( lock, _DESK_OFFSET, true );
+   atomic_store( &lock->segment->pids[lock->ticket % PORT_LOCK_MAX_WAITERS], 0 );
+   atomic_store( &lock->segment->serving, lock->ticket + 1 );
+   _unlockRange( lock, _DESK_OFFSET );
+   _unlockRange( lock, _OWNER_OFFSET );
+   _closeSegment( lock );
+}
+// END f_releasePortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pathPortLock( .. )
+ * @brief:  Function to get the file that arbitrates a device. Every name reaching the same device (links included)
+ *          gives the same file, a process taking several ports must take them in the order of these names
+ * @param1: <char*> path: The file
+ * @param2: <size_t> size: Size of path
+ * @param3: <const char*> device: Device of the port
+ * @return: <bool> TRUE if the whole name fits in path
+ **********************************************************************************************************************/
+bool pathPortLock( char* path, const size_t size, const char* device )
+{
+   return _path( path, size, device );
+}
+// END f_pathPortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_loadPortLock( .. )
+ * @brief:  Function to read the last known state of the relays of the port
+ * @param1: <const portLock_t*> lock: The lock, acquired
+ * @param2: <relayShadow_t*> shadow: Copy of the states, nothing known if the lock is not acquired
+ * @return: <void> None
+ **********************************************************************************************************************/
+void loadPortLock( const portLock_t* lock, relayShadow_t* shadow )
+{
+   if( lock->segment == NULL )
+   {
+      initRelayShadow( shadow );
+      return;
+   }
+   *shadow = lock->segment->shadow;
+}
+// END f_loadPortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_storePortLock( .. )
+ * @brief:  Function to replace the last known state of the relays of the port
+ * @param1: <portLock_t*> lock: The lock, not acquired does nothing
+ * @param2: <const relayShadow_t*> shadow: The states
+ * @return: <void> None
+ **********************************************************************************************************************/
+void storePortLock( portLock_t* lock, const relayShadow_t* shadow )
+{
+   if( lock->segment == NULL )
+   {
+      return;
+   }
+   lock->segment->shadow = *shadow;
+   lock->segment->updates++;
+}
+// END f_storePortLock( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_applyPortLock( .. )
+ * @brief:  Function to record relays of the port commanded to a state
+ * @param1: <portLock_t*> lock: The lock, not acquired does nothing
+ * @param2: <const relaySet_t*> relays: Relays sent
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+void applyPortLock( portLock_t* lock, const relaySet_t* relays, const uint8_t state )
+{
+   if( lock->segment == NULL )
+   {
+      return;
+   }
+   applyRelayShadow( &lock->segment->shadow, relays, state );
+   lock->segment->updates++;
+}
+// END f_applyPortLock( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_openSegment( portLock_t* lock, const char* device )                                                  //
+//   void      f_closeSegment( portLock_t* lock )                                                                     //
+//   bool      f_path( char* path, size_t size, const char* device )                                                  //
+//   bool      f_lockRange( portLock_t* lock, unsigned long offset, bool wait )                                       //
+//   void      f_unlockRange( portLock_t* lock, unsigned long offset )                                                //
+//   long      f_pid( void )                                                                                          //
+//   bool      f_isAlive( long pid )                                                                                  //
+//   void      f_skip( portLock_t* lock, unsigned ticket )                                                            //
+//   bool      f_leave( portLock_t* lock )                                                                            //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_openSegment( .. )
+ * @brief:  Function to open (create the first time) and map the file shared by the processes using a device
+ * @param1: <portLock_t*> lock: Lock to fill
+ * @param2: <const char*> device: Device of the port
+ * @return: <bool> TRUE if the segment is mapped and initialised
+ **********************************************************************************************************************/
+static bool _openSegment( portLock_t* lock, const char* device )
+{
+   lock->segment = NULL;
+   if( !_path( lock->path, sizeof( lock->path ), device ) )
+   {
+      return false;                                    // A cut name could be the file of another device
+   }
+#ifdef _WIN32
+   lock->hMapping = NULL;
+   lock->hFile = CreateFileA( lock->path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+   if( lock->hFile == INVALID_HANDLE_VALUE )
+   {
+      return false;
+   }
+   _lockRange( lock, _DESK_OFFSET, true );
+   lock->hMapping = CreateFileMappingA( lock->hFile, NULL, PAGE_READWRITE, 0, sizeof( portLockSegment_t ), NULL );
+   if( lock->hMapping != NULL )
+   {
+      lock->segment = (portLockSegment_t*)MapViewOfFile( lock->hMapping, FILE_MAP_ALL_ACCESS, 0, 0,
+                                                         sizeof( portLockSegment_t ) );
+   }
+#else
+   struct stat status;
+   void*       address = MAP_FAILED;
+
+   // The name is known in a directory everybody writes: a link or a file that is not a segment planted there must not
+   // be resized nor cleared with the rights of this process. A segment of another user is shared with everybody
+   lock->fd = open( lock->path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0666 );
+   if( lock->fd < 0 )
+   {
+      return false;
+   }
+   if( fstat( lock->fd, &status ) != 0 || !S_ISREG( status.st_mode ) || status.st_nlink != 1 ||
+       ( status.st_uid != geteuid() && ( status.st_mode & 0777 ) != 0666 ) )
+   {
+      fprintf( stderr, "%s %s()::%s is not a lock file of relayManager, not used\n", LOG_ERROR, __func__,
+               lock->path );
+      close( lock->fd );
+      return false;
+   }
+   if( status.st_uid == geteuid() )
+   {
+      fchmod( lock->fd, 0666 );                        // Whoever created it, every user may queue
+   }
+   _lockRange( lock, _DESK_OFFSET, true );
+   if( fstat( lock->fd, &status ) == 0 &&
+       ( status.st_size >= (off_t)sizeof( portLockSegment_t ) ||
+         ftruncate( lock->fd, sizeof( portLockSegment_t ) ) == 0 ) )
+   {
+      address = mmap( NULL, sizeof( portLockSegment_t ), PROT_READ | PROT_WRITE, MAP_SHARED, lock->fd, 0 );
+   }
+   lock->segment = ( address != MAP_FAILED ) ? (portLockSegment_t*)address : NULL;
+#endif
+   if( lock->segment == NULL )
+   {
+      _unlockRange( lock, _DESK_OFFSET );
+      _closeSegment( lock );
+      return false;
+   }
+
+   // New file (zeroed) or left by another version: nobody queued on it can be understood
+   portLockSegment_t* segment = lock->segment;
+   if( segment->magic != PORT_LOCK_MAGIC || segment->version != PORT_LOCK_VERSION )
+   {
+      memset( segment, 0, sizeof( portLockSegment_t ) );
+      atomic_init( &segment->nextTicket, 0 );
+      atomic_init( &segment->serving, 0 );
+      for( int slot = 0; slot < PORT_LOCK_MAX_WAITERS; slot++ )
+      {
+         atomic_init( &segment->pids[slot], 0 );
+      }
+      initRelayShadow( &segment->shadow );
+      segment->version = PORT_LOCK_VERSION;
+      segment->magic = PORT_LOCK_MAGIC;
+   }
+   _unlockRange( lock, _DESK_OFFSET );
+   return true;
+}
+// END f_openSegment( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_closeSegment( .. )
+ * @brief:  Function to unmap and close the shared file, its locks go with it
+ * @param1: <portLock_t*> lock: The lock
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _closeSegment( portLock_t* lock )
+{
+#ifdef _WIN32
+   if( lock->segment != NULL )
+   {
+      UnmapViewOfFile( lock->segment );
+   }
+   if( lock->hMapping != NULL )
+   {
+      CloseHandle( lock->hMapping );
+   }
+   CloseHandle( lock->hFile );
+#else
+   if( lock->segment != NULL )
+   {
+      munmap( lock->segment, sizeof( portLockSegment_t ) );
+   }
+   close( lock->fd );
+#endif
+   lock->segment = NULL;
+}
+// END f_closeSegment( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_path( .. )
+ * @brief:  Function to name the shared file of a device, in the temporary directory. Ex. "/dev/ttyUSB0" ->
+ *          "/tmp/relayManager.dev.ttyUSB0.lock", "\\\\.\\COM12" -> "%TEMP%\\relayManager.COM12.lock"
+ * @param1: <char*> path: The file
+ * @param2: <size_t> size: Size of path
+ * @param3: <const char*> device: Device of the port
+ * @return: <bool> TRUE if the whole name fits in path
+ **********************************************************************************************************************/
+static bool _path( char* path, const size_t size, const char* device )
+{
+   char        directory[MAX_PATH];
+   char        name[MAX_PATH];
+   size_t      length = 0;
+#ifdef _WIN32
+   DWORD       directoryLength = GetTempPathA( sizeof( directory ), directory );
+   if( directoryLength == 0 || directoryLength >= sizeof( directory ) )
+   {
+      snprintf( directory, sizeof( directory ), ".\\" );
+   }
+   const char* separator = "";                         // GetTempPath() ends with '\'
+#else
+   char        real[PATH_MAX];
+   const char* temporary = getenv( "TMPDIR" );
+   snprintf( directory, sizeof( directory ), "%s", ( temporary != NULL && temporary[0] != '\0' ) ? temporary : "/tmp" );
+   const char* separator = "/";
+   if( realpath( device, real ) != NULL )              // Links to the adapter (/dev/serial/by-id/..) share its lock
+   {
+      device = real;
+   }
+#endif
+
+   // Letters and digits kept, every run of anything else becomes a single '.'
+   const char* cursor = device;
+   name[length++] = '.';
+   for( ; *cursor != '\0' && length < sizeof( name ) - 1; cursor++ )
+   {
+      if( isalnum( (unsigned char)*cursor ) || *cursor == '-' || *cursor == '_' )
+      {
+         name[length++] = *cursor;
+      }
+      else if( name[length - 1] != '.' )
+      {
+         name[length++] = '.';
+      }
+   }
+   name[length] = '\0';
+   if( *cursor != '\0' )
+   {
+      return false;
+   }
+   int written = snprintf( path, size, "%s%s" PORT_LOCK_FILE_PREFIX "%s%slock", directory, separator, name,
+                           ( name[length - 1] == '.' ) ? "" : "." );
+   return ( written > 0 && (size_t)written < size );
+}
+// END f_path( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_lockRange( .. )
+ * @brief:  Function to lock one byte of the shared file for this open file (for the process if no OFD locks)
+ * @param1: <portLock_t*> lock: The lock
+ * @param2: <unsigned long> offset: _OWNER_OFFSET or _DESK_OFFSET
+ * @param3: <bool> wait: TRUE to wait for it, FALSE to give up if another process holds it
+ * @return: <bool> TRUE if it is locked
+ **********************************************************************************************************************/
+static bool _lockRange( portLock_t* lock, const unsigned long offset, const bool wait )
+{
+#ifdef _WIN32
+   OVERLAPPED overlapped;
+   memset( &overlapped, 0, sizeof( overlapped ) );
+   overlapped.Offset = (DWORD)offset;
+   return LockFileEx( lock->hFile, LOCKFILE_EXCLUSIVE_LOCK | ( wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY ), 0, 1, 0,
+                      &overlapped ) != 0;
+#else
+   struct flock range;
+   memset( &range, 0, sizeof( range ) );
+   range.l_type = F_WRLCK;
+   range.l_whence = SEEK_SET;
+   range.l_start = (off_t)offset;
+   range.l_len = 1;
+   int retValue;
+   do
+   {
+      retValue = fcntl( lock->fd, wait ? _SETLKW : _SETLK, &range );
+   } while( retValue < 0 && errno == EINTR );
+   return retValue == 0;
+#endif
+}
+// END f_lockRange( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_unlockRange( .. )
+ * @brief:  Function to unlock a byte locked with _lockRange()
+ * @param1: <portLock_t*> lock: The lock
+ * @param2: <unsigned long> offset: _OWNER_OFFSET or _DESK_OFFSET
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _unlockRange( portLock_t* lock, const unsigned long offset )
+{
+#ifdef _WIN32
+   OVERLAPPED overlapped;
+   memset( &overlapped, 0, sizeof( overlapped ) );
+   overlapped.Offset = (DWORD)offset;
+   UnlockFileEx( lock->hFile, 0, 1, 0, &overlapped );
+#else
+   struct flock range;
+   memset( &range, 0, sizeof( range ) );
+   range.l_type = F_UNLCK;
+   range.l_whence = SEEK_SET;
+   range.l_start = (off_t)offset;
+   range.l_len = 1;
+   fcntl( lock->fd, _SETLK, &range );
+#endif
+}
+// END f_unlockRange( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pid( .. )
+ * @brief:  Function to get the id of the process
+ * @return: <long> The id, never 0
+ **********************************************************************************************************************/
+static long _pid( void )
+{
+#ifdef _WIN32
+   return (long)GetCurrentProcessId();
+#else
+   return (long)getpid();
+#endif
+}
+// END f_pid( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isAlive( .. )
+ * @brief:  Function to know if a process still exists
+ * @param1: <long> pid: The process, 0 for none, _LEFT_PID for a ticket given up
+ * @return: <bool> TRUE if it exists (it may belong to another user)
+ **********************************************************************************************************************/
+static bool _isAlive( const long pid )
+{
+   if( pid <= 0 )
+   {
+      return false;                                    // Free, or left by its process
+   }
+#ifdef _WIN32
+   HANDLE process = OpenProcess( SYNCHRONIZE, FALSE, (DWORD)pid );
+   if( process == NULL )
+   {
+      return GetLastError() == ERROR_ACCESS_DENIED;
+   }
+   bool alive = ( WaitForSingleObject( process, 0 ) == WAIT_TIMEOUT );
+   CloseHandle( process );
+   return alive;
+#else
+   return kill( (pid_t)pid, 0 ) == 0 || errno == EPERM;
+#endif
+}
+// END f_isAlive( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_skip( .. )
+ * @brief:  Function to move the queue past a ticket whose process is gone, unless another waiter already did
+ * @param1: <portLock_t*> lock: The lock of the waiter
+ * @param2: <unsigned> ticket: Ticket being served
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _skip( portLock_t* lock, const unsigned ticket )
+{
+   portLockSegment_t* segment = lock->segment;
+
+   _lockRange( lock, _DESK_OFFSET, true );
+   if( atomic_load( &segment->serving ) == ticket )
+   {
+      long pid = atomic_load( &segment->pids[ticket % PORT_LOCK_MAX_WAITERS] );
+      if( pid != _LEFT_PID )                           // Gave up waiting, nothing to tell
+      {
+         fprintf( stdout, "%s %s()::Process %ld left the queue of the port without releasing it, skipped\n",
+                  LOG_WARNING, __func__, pid );
+      }
+      atomic_store( &segment->pids[ticket % PORT_LOCK_MAX_WAITERS], 0 );
+      atomic_store( &segment->serving, ticket + 1 );
+   }
+   _unlockRange( lock, _DESK_OFFSET );
+}
+// END f_skip( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_leave( .. )
+ * @brief:  Function for a waiter to give its ticket up. Its slot is marked as left, not freed: a ticket taken later
+ *          must not land on it before serving passes it. The waiters behind skip the ticket as the one of a process
+ *          that is gone, and free the slot then
+ * @param1: <portLock_t*> lock: The lock of the waiter
+ * @return: <bool> TRUE if the ticket was given up, FALSE if its turn came first (the port is the process's)
+ **********************************************************************************************************************/
+static bool _leave( portLock_t* lock )
+{
+   portLockSegment_t* segment = lock->segment;
+   bool               left = false;
+
+   _lockRange( lock, _DESK_OFFSET, true );
+   if( atomic_load( &segment->serving ) != lock->ticket )
+   {
+      atomic_store( &segment->pids[lock->ticket % PORT_LOCK_MAX_WAITERS], _LEFT_PID );
+      left = true;
+   }
+   _unlockRange( lock, _DESK_OFFSET );
+   return left;
+}
+// END f_leave( .. ) ...
@@ -0,0 +1,258 @@
+/***********************************************************************************************************************
+ * pulseTimer.c
+ * @brief:  Monotonic clock and absolute deadline sleeps used to time the relay pulses.
+ *          Deadlines are absolute so the time spent writing frames or opening the port is not added to the pulse.
+ *          POSIX uses CLOCK_MONOTONIC + clock_nanosleep( TIMER_ABSTIME ), Win32 uses QueryPerformanceCounter and a
+ *          high resolution waitable timer.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>   // fprintf()
+#include <stdint.h>  // uint64_t
+#include <errno.h>   // EINTR
+#ifdef _WIN32
+   #include <windows.h>      // QueryPerformanceCounter(), CreateWaitableTimerExW()
+#else
+   #include <time.h>         // clock_gettime(), clock_nanosleep()
+   #ifdef __linux__
+      #include <sys/prctl.h> // prctl(), PR_SET_TIMERSLACK
+   #endif
+#endif
+#include "main.h"
+#include "pulseTimer.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#ifdef _WIN32
+   #ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+      #define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION   0x00000002
+   #endif
+#endif
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+#ifdef _WIN32
+static LARGE_INTEGER        _frequency;                   // Performance counter ticks per second
+static _Thread_local HANDLE _waitableTimer = NULL;        // One per thread, several threads may sleep at once
+#endif
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+#ifdef _WIN32
+static HANDLE _threadTimer( void );
+#endif
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_initPulseTimer( void )                                                                               //
+//   uint64_t  f_nowPulseTimer( void )                                                                                //
+//   void      f_sleepUntilPulseTimer( uint64_t deadlineNs )                                                          //
+//   void      f_resetPulseStats( pulseStats_t* stats )                                                               //
+//   int64_t   f_recordPulseStats( pulseStats_t* stats, uint64_t requestedNs, uint64_t achievedNs )                   //
+//   void      f_mergePulseStats( pulseStats_t* stats, const pulseStats_t* other )                                    //
+//   void      f_printPulseStats( const pulseStats_t* stats )                                                         //
+//   void      f_printCyclePulseStats( const pulseStats_t* stats )                                                    //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initPulseTimer( .. )
+ * @brief:  Function to prepare the timer. Must be called before any other pulseTimer function, calling it again
+ *          does nothing
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initPulseTimer( void )
+{
+#ifdef _WIN32
+   if( _frequency.QuadPart == 0 )
+   {
+      QueryPerformanceFrequency( &_frequency );
+   }
+   _threadTimer();
+#elif defined( __linux__ )
+   // Default timer slack is 50us, ask the kernel to wake us as close to the deadline as it can
+   prctl( PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL );
+#endif
+}
+// END f_initPulseTimer( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nowPulseTimer( .. )
+ * @brief:  Function to read the monotonic clock
+ * @return: <uint64_t> Nanoseconds from an arbitrary fixed point
+ **********************************************************************************************************************/
+uint64_t nowPulseTimer( void )
+{
+#ifdef _WIN32
+   LARGE_INTEGER counter;
+   QueryPerformanceCounter( &counter );
+   return (uint64_t)( counter.QuadPart / _frequency.QuadPart ) * NS_PER_SEC +
+          (uint64_t)( counter.QuadPart % _frequency.QuadPart ) * NS_PER_SEC / (uint64_t)_frequency.QuadPart;
+#else
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   return (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+#endif
+}
+// END f_nowPulseTimer( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sleepUntilPulseTimer( .. )
+ * @brief:  Function to block until the monotonic clock reaches the deadline, without spinning the CPU
+ * @param1: <uint64_t> deadlineNs: Absolute deadline, same time base than nowPulseTimer()
+ * @return: <void> None
+ **********************************************************************************************************************/
+void sleepUntilPulseTimer( const uint64_t deadlineNs )
+{
+#ifdef _WIN32
+   uint64_t now;
+   while( ( now = nowPulseTimer() ) < deadlineNs )
+   {
+      LARGE_INTEGER dueTime;
+      dueTime.QuadPart = -(LONGLONG)( ( deadlineNs - now ) / 100 );   // Relative, 100ns units
+      if( dueTime.QuadPart == 0 || _threadTimer() == NULL ||
+          !SetWaitableTimer( _waitableTimer, &dueTime, 0, NULL, NULL, FALSE ) )
+      {
+         Sleep( 0 );
+         continue;
+      }
+      WaitForSingleObject( _waitableTimer, INFINITE );
+   }
+#else
+   struct timespec deadline;
+   deadline.tv_sec  = (time_t)( deadlineNs / NS_PER_SEC );
+   deadline.tv_nsec = (long)( deadlineNs % NS_PER_SEC );
+   while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL ) == EINTR )
+   {
+      // Interrupted by a signal, the deadline is absolute so just wait again
+   }
+#endif
+}
+// END f_sleepUntilPulseTimer( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_resetPulseStats( .. )
+ * @brief:  Function to clear the pulse width statistics
+ * @param1: <pulseStats_t*> stats: Statistics to clear
+ * @return: <void> None
+ **********************************************************************************************************************/
+void resetPulseStats( pulseStats_t* stats )
+{
+   stats->count = 0;
+   stats->minErrorNs = INT64_MAX;
+   stats->maxErrorNs = INT64_MIN;
+   stats->sumErrorNs = 0;
+}
+// END f_resetPulseStats( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_recordPulseStats( .. )
+ * @brief:  Function to add a pulse to the statistics
+ * @param1: <pulseStats_t*> stats: Statistics to update
+ * @param2: <uint64_t> requestedNs: Requested width
+ * @param3: <uint64_t> achievedNs: Measured width
+ * @return: <int64_t> Error of this pulse (achieved - requested) in nanoseconds
+ **********************************************************************************************************************/
+int64_t recordPulseStats( pulseStats_t* stats, const uint64_t requestedNs, const uint64_t achievedNs )
+{
+   int64_t errorNs = (int64_t)achievedNs - (int64_t)requestedNs;
+
+   stats->count++;
+   stats->sumErrorNs += errorNs;
+   if( errorNs < stats->minErrorNs ) stats->minErrorNs = errorNs;
+   if( errorNs > stats->maxErrorNs ) stats->maxErrorNs = errorNs;
+   return errorNs;
+}
+// END f_recordPulseStats( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_mergePulseStats( .. )
+ * @brief:  Function to add the pulses of other statistics (Ex. of another bus)
+ * @param1: <pulseStats_t*> stats: Statistics to update
+ * @param2: <const pulseStats_t*> other: Statistics to add
+ * @return: <void> None
+ **********************************************************************************************************************/
+void mergePulseStats( pulseStats_t* stats, const pulseStats_t* other )
+{
+   stats->count += other->count;
+   stats->sumErrorNs += other->sumErrorNs;
+   if( other->minErrorNs < stats->minErrorNs ) stats->minErrorNs = other->minErrorNs;
+   if( other->maxErrorNs > stats->maxErrorNs ) stats->maxErrorNs = other->maxErrorNs;
+}
+// END f_mergePulseStats( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printPulseStats( .. )
+ * @brief:  Function to print the summary of the achieved vs requested widths
+ * @param1: <const pulseStats_t*> stats: Statistics to print
+ * @return: <void> None
+ **********************************************************************************************************************/
+void printPulseStats( const pulseStats_t* stats )
+{
+   if( stats->count == 0 )
+   {
+      return;
+   }
+   fprintf( stdout, "%s Pulse width error over %u pulses: min %+.3f ms, mean %+.3f ms, max %+.3f ms\n", LOG_INFO,
+            stats->count, (double)stats->minErrorNs / NS_PER_MS,
+            (double)stats->sumErrorNs / stats->count / NS_PER_MS, (double)stats->maxErrorNs / NS_PER_MS );
+}
+// END f_printPulseStats( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_printCyclePulseStats( .. )
+ * @brief:  Function to print the summary of the start of every cycle vs its absolute deadline (requested 0). The
+ *          deadlines do not move with the lateness of the cycles before, so this is the drift of the train
+ * @param1: <const pulseStats_t*> stats: Statistics to print
+ * @return: <void> None
+ **********************************************************************************************************************/
+void printCyclePulseStats( const pulseStats_t* stats )
+{
+   if( stats->count == 0 )
+   {
+      return;
+   }
+   fprintf( stdout, "%s Cycle start error over %u cycles: min %+.3f ms, mean %+.3f ms, max %+.3f ms\n", LOG_INFO,
+            stats->count, (double)stats->minErrorNs / NS_PER_MS,
+            (double)stats->sumErrorNs / stats->count / NS_PER_MS, (double)stats->maxErrorNs / NS_PER_MS );
+}
+// END f_printCyclePulseStats( .. ) ...
+
+
+
+#ifdef _WIN32
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   HANDLE    f_threadTimer( void )                                                                                  //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_threadTimer( .. )
+ * @brief:  Function to get the waitable timer of the calling thread, created the first time
+ * @return: <HANDLE> The timer, NULL if it could not be created (sleeps fall back to Sleep( 0 ) polling)
+ **********************************************************************************************************************/
+static HANDLE _threadTimer( void )
+{
+   if( _waitableTimer == NULL )
+   {
+      _waitableTimer = CreateWaitableTimerExW( NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+      if( _waitableTimer == NULL )
+      {
+         // Older than Windows 10 1803, fall back to the regular waitable timer
+         _waitableTimer = CreateWaitableTimer( NULL, TRUE, NULL );
+      }
+   }
+   return _waitableTimer;
+}
+// END f_threadTimer( .. ) ...
+#endif
@@ -0,0 +1,920 @@
+/***********************************************************************************************************************
+ * relayDaemon.c
+ * @brief:  Resident mode. Owns the Virtual COM port and serves relay commands through a unix domain socket
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+#define _GNU_SOURCE     // ppoll(), accept4()
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>      // fprintf(), snprintf()
+#include <stdlib.h>     // strtoul()
+#include <string.h>     // strcmp(), strtok_r(), memmove()
+#include <errno.h>      // errno, EINTR, ERANGE
+#include <signal.h>     // sigaction(), SIGINT, SIGTERM, SIGPIPE
+#include <poll.h>       // ppoll()
+#include <time.h>       // struct timespec
+#include <unistd.h>     // read(), write(), close(), unlink()
+#include <sys/socket.h> // socket(), bind(), listen(), accept4()
+#include <sys/un.h>     // struct sockaddr_un
+#include "main.h"
+#include "virtualComPort.h"
+#include "relayFrame.h"
+#include "relaySet.h"
+#include "relayDaemon.h"
+#include "pulseTimer.h"
+#include "relayScheduler.h"
+#include "relayShadow.h"
+#include "relayStatus.h"
+#include "metrics.h"
+#include "logger.h"
+#include "serialWriter.h"
+#include "frameQueue.h"
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+typedef struct daemonClient_type
+{
+   int    fd;                                  // Connection descriptor, non blocking (-1 if the slot is free)
+   size_t used;                                // Bytes waiting in line[]
+   char   line[RELAY_DAEMON_LINE_LENGTH];      // Partial command line
+   size_t pending;                             // Bytes waiting in output[]
+   char   output[RELAY_DAEMON_OUTPUT_LENGTH];  // Replies the socket did not take yet, sent on POLLOUT
+} daemonClient_t;
+
+// RS485 chain, every one has its own port, relay states and pulse trains
+typedef struct daemonBus_type
+{
+   vcp_t*           vcp;
+   relayShadow_t    shadow;                    // Last commanded state of every relay
+   relayScheduler_t scheduler;                 // Pulse trains running on the relays
+} daemonBus_t;
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static volatile sig_atomic_t _stopRequested = 0;                     // Set by SIGINT/SIGTERM or "shutdown"
+static daemonClient_t _clients[RELAY_DAEMON_MAX_CLIENTS];
+static daemonBus_t    _buses[MAX_RS485_BUSES];
+static serialWriter_t _writers[MAX_RS485_BUSES];                     // Frames waiting for room in every UART
+static frameQueue_t   _queues[MAX_RS485_BUSES];                      // Command batches waiting for this thread
+static int            _numOfBuses = 0;
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void _onSignal( int signum );
+static int  _openSocket( const char* socketPath );
+static void _serveClient( daemonClient_t* client );
+static void _replyClient( daemonClient_t* client, const char* reply );
+static void _flushClient( daemonClient_t* client );
+static void _dropClient( daemonClient_t* client );
+static void _runCommand( char* line, char* reply, size_t replySize );
+static int  _sendState( const int bus, const relaySet_t* relays, uint8_t state, bool force );
+static int  _sendEmergencyOff( const int bus, const relaySet_t* relays );
+static void _forgetLost( const int bus, const bool written );
+static bool _parseNumber( const char* text, uint32_t* value );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   int       f_runRelayDaemon( vcp_t* vcps, int numOfBuses, const char* socketPath, relayShadow_t* shadows, .. )   //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_runRelayDaemon( .. )
+ * @brief:  Function to serve commands until "shutdown", SIGINT or SIGTERM. The ports stay open the whole time and
+ *          all of them are written at the same time from this thread
+ * @param1: <vcp_t*> vcps: The Virtual COM ports, already created, one per bus
+ * @param2: <int> numOfBuses: Number of ports, up to MAX_RS485_BUSES
+ * @param3: <const char*> socketPath: Path of the unix domain socket to listen on
+ * @param4: <relayShadow_t*> shadows: Last known state of the relays of every bus, the daemon starts from it and leaves
+ *          its own there when it stops. NULL to start with every relay unknown
+ * @param5: <uint64_t> coalesceNs: Window the commands of a bus are held to leave in a single write (a pulse edge
+ *          due sends them at once), FRAME_QUEUE_NOT_COALESCED to write every command as soon as it arrives
+ * @return: <int> 0 if the daemon ended normally, -1 if it could not start
+ **********************************************************************************************************************/
+int runRelayDaemon( vcp_t* vcps, const int numOfBuses, const char* socketPath, relayShadow_t* shadows,
+                    const uint64_t coalesceNs )
+{
+   struct pollfd    fds[1 + 2 * MAX_RS485_BUSES + RELAY_DAEMON_MAX_CLIENTS];
+   struct sigaction action;
+
+   memset( &action, 0, sizeof( action ) );
+   action.sa_handler = _onSignal;          // No SA_RESTART, poll() must return on signals
+   sigaction( SIGINT, &action, NULL );
+   sigaction( SIGTERM, &action, NULL );
+   signal( SIGPIPE, SIG_IGN );             // A client leaving must not kill the daemon
+
+   _numOfBuses = ( numOfBuses < MAX_RS485_BUSES ) ? numOfBuses : MAX_RS485_BUSES;
+   for( int bus = 0; bus < _numOfBuses; bus++ )
+   {
+      if( !openVCP( &vcps[bus] ) )
+      {
+         fprintf( stderr, "%s %s()::Unable to open port %s\n", LOG_ERROR, __func__, vcps[bus].name );
+         return -1;
+      }
+   }
+
+   int listenFd = _openSocket( socketPath );
+   if( listenFd < 0 )
+   {
+      return -1;
+   }
+   for( int i = 0; i < RELAY_DAEMON_MAX_CLIENTS; i++ )
+   {
+      _clients[i].fd = -1;
+   }
+   initPulseTimer();
+   for( int bus = 0; bus < _numOfBuses; bus++ )
+   {
+      daemonBus_t* daemonBus = &_buses[bus];
+      daemonBus->vcp = &vcps[bus];
+      if( shadows != NULL )
+      {
+         daemonBus->shadow = shadows[bus];
+      }
+      else
+      {
+         initRelayShadow( &daemonBus->shadow );
+      }
+      if( !initSerialWriter( &_writers[bus], daemonBus->vcp, SERIAL_WRITER_STUCK_NS_DEFAULT,
+                             SERIAL_WRITER_IN_FLIGHT_NS_DEFAULT ) ||
+          !initFrameQueue( &_queues[bus], coalesceNs ) )
+      {
+         fprintf( stderr, "%s %s()::Unable to set up the writer of %s\n", LOG_ERROR, __func__, daemonBus->vcp->name );
+         while( --bus >= 0 )
+         {
+            closeFrameQueue( &_queues[bus] );
+         }
+         close( listenFd );
+         unlink( socketPath );
+         return -1;
+      }
+      initRelayScheduler( &daemonBus->scheduler, daemonBus->vcp, &daemonBus->shadow, &_writers[bus] );
+   }
+   fprintf( stdout, "%s %s()::Listening on %s\n", LOG_INFO, __func__, socketPath );
+   fflush( stdout );
+   uint64_t nextExport = nowPulseTimer() + METRICS_EXPORT_PERIOD_NS;
+
+   while( !_stopRequested )
+   {
+      // Listening socket always first, then every port (only while frames are waiting and the UART may take them)
+      // and its queue, then every connected client
+      uint64_t pollNs = nowPulseTimer();
+      nfds_t   nfds = 0;
+      fds[nfds].fd = listenFd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         fds[nfds].fd = isReadySerialWriter( &_writers[bus], pollNs ) ? _buses[bus].vcp->fd : -1;
+         fds[nfds].events = POLLOUT;
+         nfds++;
+         fds[nfds].fd = wakeFdFrameQueue( &_queues[bus] );
+         fds[nfds].events = POLLIN;
+         nfds++;
+      }
+      for( int i = 0; i < RELAY_DAEMON_MAX_CLIENTS; i++ )
+      {
+         if( _clients[i].fd >= 0 )
+         {
+            fds[nfds].fd = _clients[i].fd;
+            fds[nfds].events = POLLIN | ( ( _clients[i].pending > 0 ) ? POLLOUT : 0 );
+            nfds++;
+         }
+      }
+
+      // Sleep until a command or a batch arrives, the port takes more bytes or the next pulse edge (or write
+      // deadline, end of a coalescing window, or metrics export) is due
+      struct timespec  timeout;
+      struct timespec* timeoutPtr = NULL;
+      uint64_t nextEdge = nextExport;
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         // An edge already due behind a batch the writer has no room for waits for POLLOUT, not for a timeout
+         if( nextRelayScheduler( &_buses[bus].scheduler ) < nextEdge &&
+             ( nextRelayScheduler( &_buses[bus].scheduler ) > pollNs || !isPendingFrameQueue( &_queues[bus] ) ) )
+         {
+            nextEdge = nextRelayScheduler( &_buses[bus].scheduler );
+         }
+         if( nextSerialWriter( &_writers[bus] ) < nextEdge )
+         {
+            nextEdge = nextSerialWriter( &_writers[bus] );
+         }
+         if( nextFrameQueue( &_queues[bus] ) < nextEdge )
+         {
+            nextEdge = nextFrameQueue( &_queues[bus] );
+         }
+      }
+      if( nextEdge != TIMER_WHEEL_NEVER )
+      {
+         uint64_t now = nowPulseTimer();
+         uint64_t wait = ( nextEdge > now ) ? nextEdge - now : 0;
+         timeout.tv_sec = (time_t)( wait / NS_PER_SEC );
+         timeout.tv_nsec = (long)( wait % NS_PER_SEC );
+         timeoutPtr = &timeout;
+      }
+      int ready = ppoll( fds, nfds, timeoutPtr, NULL );
+      if( ready < 0 && errno != EINTR )
+      {
+         fprintf( stderr, "%s %s()::poll() failed (%s)\n", LOG_ERROR, __func__, strerror( errno ) );
+         break;
+      }
+      uint64_t now = nowPulseTimer();
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         // Commands reach the wire in the order they were accepted: the batches queued go to the writer before the
+         // pulse edges due, and a pulse edge is written now anyway, the commands held go ahead of it instead of
+         // making it wait
+         bool edgeDue = ( nextRelayScheduler( &_buses[bus].scheduler ) <= now );
+         if( edgeDue )
+         {
+            flushFrameQueue( &_queues[bus], &_writers[bus], now );
+         }
+         else
+         {
+            drainFrameQueue( &_queues[bus], &_writers[bus], now );
+         }
+         // A batch still without room in the writer keeps the edges behind it until the UART takes more bytes
+         bool written = true;
+         if( !isPendingFrameQueue( &_queues[bus] ) && !runRelayScheduler( &_buses[bus].scheduler, now ) )
+         {
+            LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Unable to write pulse edges to %s", __func__,
+                       _buses[bus].vcp->name );
+            written = false;
+         }
+         written = runSerialWriter( &_writers[bus], now ) && written;
+         _forgetLost( bus, written );
+      }
+      if( now >= nextExport )
+      {
+         exportMetrics();
+         nextExport = now + METRICS_EXPORT_PERIOD_NS;
+      }
+      if( ready <= 0 )
+      {
+         continue;
+      }
+
+      // New connection
+      if( fds[0].revents & POLLIN )
+      {
+         int clientFd = accept4( listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+         if( clientFd >= 0 )
+         {
+            int slot = 0;
+            while( slot < RELAY_DAEMON_MAX_CLIENTS && _clients[slot].fd >= 0 )
+            {
+               slot++;
+            }
+            if( slot == RELAY_DAEMON_MAX_CLIENTS )
+            {
+               static const char busy[] = "ERR too many clients\n";
+               (void)!write( clientFd, busy, sizeof( busy ) - 1 );
+               close( clientFd );
+            }
+            else
+            {
+               _clients[slot].fd = clientFd;
+               _clients[slot].used = 0;
+               _clients[slot].pending = 0;
+            }
+         }
+      }
+
+      // Replies the clients can take now, then pending commands
+      for( nfds_t n = 1 + 2 * (nfds_t)_numOfBuses; n < nfds; n++ )
+      {
+         if( fds[n].revents & ( POLLIN | POLLOUT | POLLHUP | POLLERR ) )
+         {
+            for( int i = 0; i < RELAY_DAEMON_MAX_CLIENTS; i++ )
+            {
+               if( _clients[i].fd == fds[n].fd )
+               {
+                  if( fds[n].revents & POLLOUT )
+                  {
+                     _flushClient( &_clients[i] );
+                  }
+                  if( _clients[i].fd >= 0 && ( fds[n].revents & ( POLLIN | POLLHUP | POLLERR ) ) )
+                  {
+                     _serveClient( &_clients[i] );
+                  }
+                  break;
+               }
+            }
+         }
+      }
+   }
+
+   for( int i = 0; i < RELAY_DAEMON_MAX_CLIENTS; i++ )
+   {
+      if( _clients[i].fd >= 0 )
+      {
+         _flushClient( &_clients[i] );                 // The reply to "shutdown" among them, as much as fits now
+         _dropClient( &_clients[i] );
+      }
+   }
+   close( listenFd );
+   unlink( socketPath );
+   for( int bus = 0; bus < _numOfBuses; bus++ )
+   {
+      flushFrameQueue( &_queues[bus], &_writers[bus], nowPulseTimer() );   // Commands replied OK must go out
+   }
+   drainSerialWriters( _writers, _numOfBuses, UINT64_MAX );
+   for( int bus = 0; bus < _numOfBuses; bus++ )
+   {
+      _forgetLost( bus, true );
+      closeFrameQueue( &_queues[bus] );
+      setNonBlockingVCP( _buses[bus].vcp, false );
+      closeVCP( _buses[bus].vcp );
+      if( shadows != NULL )
+      {
+         shadows[bus] = _buses[bus].shadow;
+      }
+   }
+   fprintf( stdout, "%s %s()::Daemon stopped\n", LOG_INFO, __func__ );
+   return 0;
+}
+// END f_runRelayDaemon( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_onSignal( .. )
+ * @brief:  Signal handler, asks the main loop to end
+ * @param1: <int> signum: Signal received
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _onSignal( int signum )
+{
+   (void)signum;
+   _stopRequested = 1;
+}
+// END f_onSignal( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_openSocket( .. )
+ * @brief:  Function to create the listening unix domain socket. A stale socket file is replaced
+ * @param1: <const char*> socketPath: Path of the socket
+ * @return: <int> The listening descriptor, -1 on error
+ **********************************************************************************************************************/
+static int _openSocket( const char* socketPath )
+{
+   struct sockaddr_un address;
+
+   if( strlen( socketPath ) >= sizeof( address.sun_path ) )
+   {
+      fprintf( stderr, "%s %s()::Socket path too long %s\n", LOG_ERROR, __func__, socketPath );
+      return -1;
+   }
+   int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+   if( fd < 0 )
+   {
+      fprintf( stderr, "%s %s()::socket() failed (%s)\n", LOG_ERROR, __func__, strerror( errno ) );
+      return -1;
+   }
+   memset( &address, 0, sizeof( address ) );
+   address.sun_family = AF_UNIX;
+   strcpy( address.sun_path, socketPath );
+   unlink( socketPath );
+   if( bind( fd, (struct sockaddr*)&address, sizeof( address ) ) != 0 || listen( fd, RELAY_DAEMON_MAX_CLIENTS ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Unable to listen on %s (%s)\n", LOG_ERROR, __func__, socketPath, strerror( errno ) );
+      close( fd );
+      return -1;
+   }
+   return fd;
+}
+// END f_openSocket( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_serveClient( .. )
+ * @brief:  Function to read what a client sent and run every complete command line
+ * @param1: <daemonClient_t*> client: The client with pending data
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _serveClient( daemonClient_t* client )
+{
+   char reply[RELAY_DAEMON_LINE_LENGTH * 4];
+
+   ssize_t bytesRead = read( client->fd, client->line + client->used, sizeof( client->line ) - client->used );
+   if( bytesRead <= 0 )
+   {
+      if( bytesRead < 0 && ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) )
+      {
+         return;
+      }
+      _dropClient( client );
+      return;
+   }
+   client->used += (size_t)bytesRead;
+
+   // Run every complete line
+   char* newLine;
+   while( ( newLine = memchr( client->line, '\n', client->used ) ) != NULL )
+   {
+      size_t lineLength = (size_t)( newLine - client->line );
+      *newLine = '\0';
+      if( lineLength > 0 && client->line[lineLength - 1] == '\r' )
+      {
+         client->line[lineLength - 1] = '\0';
+      }
+      _runCommand( client->line, reply, sizeof( reply ) );
+      _replyClient( client, reply );
+      if( client->fd < 0 )
+      {
+         return;
+      }
+      client->used -= lineLength + 1;
+      memmove( client->line, newLine + 1, client->used );
+   }
+
+   // A full buffer without end of line can't ever become a valid command
+   if( client->used == sizeof( client->line ) )
+   {
+      client->used = 0;
+      _replyClient( client, "ERR line too long\n" );
+   }
+}
+// END f_serveClient( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_replyClient( .. )
+ * @brief:  Function to send a reply without ever waiting for the client: what its socket does not take now waits in
+ *          its output buffer for POLLOUT. A client leaving more than RELAY_DAEMON_OUTPUT_LENGTH bytes unread is dropped
+ * @param1: <daemonClient_t*> client: The client
+ * @param2: <const char*> reply: The reply, ends with '\n'
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _replyClient( daemonClient_t* client, const char* reply )
+{
+   size_t length = strlen( reply );
+
+   if( length > sizeof( client->output ) - client->pending )
+   {
+      LOG_PRINT( LOG_LEVEL_WARNING, "%s()::Client does not read its replies, %zu bytes waiting, dropped", __func__,
+                 client->pending );
+      _dropClient( client );
+      return;
+   }
+   memcpy( client->output + client->pending, reply, length );
+   client->pending += length;
+   _flushClient( client );
+}
+// END f_replyClient( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_flushClient( .. )
+ * @brief:  Function to write as much of the output buffer of a client as its socket takes without blocking
+ * @param1: <daemonClient_t*> client: The client
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _flushClient( daemonClient_t* client )
+{
+   while( client->pending > 0 )
+   {
+      ssize_t bytesWritten = write( client->fd, client->output, client->pending );
+      if( bytesWritten < 0 )
+      {
+         if( errno == EINTR )
+         {
+            continue;
+         }
+         if( errno != EAGAIN && errno != EWOULDBLOCK )
+         {
+            _dropClient( client );
+         }
+         return;
+      }
+      client->pending -= (size_t)bytesWritten;
+      memmove( client->output, client->output + bytesWritten, client->pending );
+   }
+}
+// END f_flushClient( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_dropClient( .. )
+ * @brief:  Function to close a connection and free its slot, the replies still waiting are lost
+ * @param1: <daemonClient_t*> client: The client
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _dropClient( daemonClient_t* client )
+{
+   close( client->fd );
+   client->fd = -1;
+   client->used = 0;
+   client->pending = 0;
+}
+// END f_dropClient( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runCommand( .. )
+ * @brief:  Function to run a single command line and build its reply
+ * @param1: <char*> line: The command line (modified while tokenizing)
+ * @param2: <char*> reply: Buffer for the reply, always ends with '\n'
+ * @param3: <size_t> replySize: Size of the reply buffer
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _runCommand( char* line, char* reply, size_t replySize )
+{
+   relayBusSet_t relays;
+   const char* error = NULL;
+   char*       context = NULL;
+   char*       command = strtok_r( line, " \t", &context );
+   char*       relayArg = strtok_r( NULL, " \t", &context );
+
+   if( command == NULL )
+   {
+      snprintf( reply, replySize, "ERR empty command\n" );
+      return;
+   }
+   if( strcmp( command, "shutdown" ) == 0 )
+   {
+      _stopRequested = 1;
+      snprintf( reply, replySize, "OK\n" );
+      return;
+   }
+   // timing: achieved vs requested ON widths of every pulse sent so far, all the buses together
+   if( strcmp( command, "timing" ) == 0 )
+   {
+      pulseStats_t stats;
+      uint32_t     activeJobs = 0;
+      size_t       queued = 0;
+      unsigned     batches = 0;                    // Batches waiting in the queues, and the most there ever were
+      unsigned     maxBatches = 0;
+      uint32_t     flushes = 0;                    // Times queued batches were moved to the writers
+      uint32_t     coalesced = 0;                  // Batches moved together with an older one
+      uint32_t     collapsed = 0;                  // Frames dropped for a later command of the same relay
+      uint64_t     wireNs = 0;                     // Buses send at the same time, the slowest one sets the backlog
+      uint64_t     now = nowPulseTimer();
+      resetPulseStats( &stats );
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         mergePulseStats( &stats, &_buses[bus].scheduler.stats );
+         activeJobs += _buses[bus].scheduler.activeJobs;
+         queued += _writers[bus].pendingBytes;
+         batches += atomic_load( &_queues[bus].depth );
+         flushes += _queues[bus].flushes;
+         coalesced += _queues[bus].coalesced;
+         collapsed += _queues[bus].collapsed;
+         if( atomic_load( &_queues[bus].maxDepth ) > maxBatches )
+         {
+            maxBatches = atomic_load( &_queues[bus].maxDepth );
+         }
+         if( wireBacklogSerialWriter( &_writers[bus], now ) > wireNs )
+         {
+            wireNs = wireBacklogSerialWriter( &_writers[bus], now );
+         }
+      }
+      if( stats.count == 0 )
+      {
+         snprintf( reply, replySize, "OK pulses=0 active=%u queued=%zu wire_ms=%.1f batches=%u max_batches=%u "
+                   "flushes=%u coalesced=%u collapsed=%u\n", activeJobs, queued, (double)wireNs / NS_PER_MS, batches,
+                   maxBatches, flushes, coalesced, collapsed );
+         return;
+      }
+      snprintf( reply, replySize, "OK pulses=%u active=%u queued=%zu wire_ms=%.1f batches=%u max_batches=%u "
+                "flushes=%u coalesced=%u collapsed=%u error_us min=%.1f mean=%.1f max=%.1f\n", stats.count, activeJobs,
+                queued, (double)wireNs / NS_PER_MS, batches, maxBatches, flushes, coalesced, collapsed,
+                (double)stats.minErrorNs / NS_PER_US,
+                (double)stats.sumErrorNs / stats.count / NS_PER_US, (double)stats.maxErrorNs / NS_PER_US );
+      return;
+   }
+   if( relayArg == NULL )
+   {
+      snprintf( reply, replySize, "ERR relays missing\n" );
+      return;
+   }
+   // status [bus/]<board>: real state of the relays read back from the board. The frames queued on that bus go out
+   // first and the loop is blocked until the reply arrives (a few ms)
+   if( strcmp( command, "status" ) == 0 )
+   {
+      char*    separator = strchr( relayArg, RELAY_BUS_SEPARATOR );
+      uint32_t bus = 0;
+      uint32_t board = 0;
+      if( separator != NULL )
+      {
+         *separator = '\0';
+      }
+      if( ( separator != NULL && !_parseNumber( relayArg, &bus ) ) ||
+          !_parseNumber( ( separator != NULL ) ? separator + 1 : relayArg, &board ) ||
+          bus >= (uint32_t)_numOfBuses || board < 1 || board > MAX_BOARDS_IN_RS485_CHAIN )
+      {
+         if( separator != NULL )
+         {
+            *separator = RELAY_BUS_SEPARATOR;          // Replied as it was sent
+         }
+         snprintf( reply, replySize, "ERR board \"%s\"\n", relayArg );
+         return;
+      }
+      uint8_t  mask;
+      uint64_t now = nowPulseTimer();
+      flushFrameQueue( &_queues[bus], &_writers[bus], now );
+      // The query goes on an idle line only, never behind a backlog the board would answer late
+      bool drained = drainSerialWriters( &_writers[bus], 1, now + NS_PER_SEC );
+      _forgetLost( (int)bus, true );
+      if( !drained || isPendingSerialWriter( &_writers[bus] ) )
+      {
+         snprintf( reply, replySize, "ERR busy\n" );
+         return;
+      }
+      if( !readRelayStatus( _buses[bus].vcp, (uint8_t)board, &mask,
+                            wireBacklogSerialWriter( &_writers[bus], nowPulseTimer() ) ) )
+      {
+         snprintf( reply, replySize, "ERR board %u of bus %u did not answer\n", board, bus );
+         return;
+      }
+      snprintf( reply, replySize, "OK mask=0x%02x\n", mask );
+      return;
+   }
+   if( strcmp( command, "estop" ) == 0 && strcmp( relayArg, "all" ) == 0 )
+   {
+      for( int bus = 0; bus < MAX_RS485_BUSES; bus++ )
+      {
+         clearRelaySet( &relays.buses[bus] );
+         if( bus < _numOfBuses )
+         {
+            addRangeRelaySet( &relays.buses[bus], 1, MAX_RELAYS_IN_RS485_CHAIN );
+         }
+      }
+   }
+   else if( parseRelayBusSet( relayArg, &relays, (uint8_t)_numOfBuses, &error ) <= 0 )
+   {
+      snprintf( reply, replySize, "ERR relays \"%s\": %s\n", relayArg, error );
+      return;
+   }
+
+   // set <relays> <on|off> [force]
+   if( strcmp( command, "set" ) == 0 )
+   {
+      char* state = strtok_r( NULL, " \t", &context );
+      char* force = strtok_r( NULL, " \t", &context );
+      if( state == NULL || ( strcmp( state, "on" ) != 0 && strcmp( state, "off" ) != 0 ) )
+      {
+         snprintf( reply, replySize, "ERR state must be \"on\" or \"off\"\n" );
+         return;
+      }
+      int sent = 0;
+      for( int bus = 0; bus < _numOfBuses && sent >= 0; bus++ )
+      {
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
+         {
+            stopRelayScheduler( &_buses[bus].scheduler, relay );   // An explicit state wins over a running train
+         }
+         int busSent = _sendState( bus, &relays.buses[bus],
+                                   strcmp( state, "on" ) == 0 ? RELAY_FRAME_ON : RELAY_FRAME_OFF,
+                                   force != NULL && strcmp( force, "force" ) == 0 );
+         sent = ( busSent < 0 ) ? -1 : sent + busSent;
+      }
+      if( sent < 0 ) snprintf( reply, replySize, "ERR output queue full\n" );
+      else           snprintf( reply, replySize, "OK frames=%d\n", sent );
+   }
+   // pulse <relays> <ms> [impulses]  ->  cycle <relays> <ms> <ms> [impulses]
+   // cycle <relays> <openMs> <periodMs> [cycles]
+   else if( strcmp( command, "pulse" ) == 0 || strcmp( command, "cycle" ) == 0 )
+   {
+      bool     isPulse = ( strcmp( command, "pulse" ) == 0 );
+      char*    openArg = strtok_r( NULL, " \t", &context );
+      char*    periodArg = isPulse ? openArg : strtok_r( NULL, " \t", &context );
+      char*    cyclesArg = strtok_r( NULL, " \t", &context );
+      uint32_t openTime = 0;
+      uint32_t period = 0;
+      uint32_t cycles = 1;
+      // A missing or malformed number is an error, never a 0 ms pulse nor an endless train: only an explicit 0
+      // cycles runs until stopped
+      if( !_parseNumber( openArg, &openTime ) || !_parseNumber( periodArg, &period ) ||
+          ( cyclesArg != NULL && !_parseNumber( cyclesArg, &cycles ) ) ||
+          period < openTime || ( isPulse && cycles < 1 ) || ( cycles == RELAY_SCHEDULER_FOREVER && period == 0 ) )
+      {
+         snprintf( reply, replySize, isPulse ? "ERR pulse needs <ms> >= 0 and [impulses] >= 1\n"
+                                             : "ERR cycle needs 0 <= <openMs> <= <periodMs> and [cycles] >= 0\n" );
+         return;
+      }
+      // The ON frames of a bus must be on the wire before its OFF frames are due, or every pulse gets stretched
+      for( int bus = 0; bus < _numOfBuses && openTime > 0; bus++ )
+      {
+         uint64_t wireNs = wireTimeVCP( _buses[bus].vcp,
+                                        (size_t)countRelaySet( &relays.buses[bus] ) * RELAY_FRAME_LENGTH );
+         if( (uint64_t)openTime * NS_PER_MS < wireNs )
+         {
+            snprintf( reply, replySize, "ERR %u ms is shorter than the %.1f ms the frames take on bus %d at %d baud\n",
+                      openTime, (double)wireNs / NS_PER_MS, bus, _buses[bus].vcp->baudRate );
+            return;
+         }
+      }
+      // Every relay gets its own train, all of them start on the same deadline. The commands held by the coalescing
+      // window were accepted before, they go to the writer now so the first ON edge can not overtake them
+      uint64_t startNs = nowPulseTimer();
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         if( !isEmptyRelaySet( &relays.buses[bus] ) )
+         {
+            flushFrameQueue( &_queues[bus], &_writers[bus], startNs );
+         }
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
+         {
+            startRelayScheduler( &_buses[bus].scheduler, relay, (uint64_t)openTime * NS_PER_MS,
+                                 (uint64_t)period * NS_PER_MS, cycles, startNs );
+         }
+      }
+      snprintf( reply, replySize, "OK\n" );
+   }
+   // stop <relays>: cancel their trains and switch them off
+   else if( strcmp( command, "stop" ) == 0 )
+   {
+      int sent = 0;
+      for( int bus = 0; bus < _numOfBuses && sent >= 0; bus++ )
+      {
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
+         {
+            stopRelayScheduler( &_buses[bus].scheduler, relay );
+         }
+         int busSent = _sendState( bus, &relays.buses[bus], RELAY_FRAME_OFF, false );
+         sent = ( busSent < 0 ) ? -1 : sent + busSent;
+      }
+      if( sent < 0 ) snprintf( reply, replySize, "ERR output queue full\n" );
+      else           snprintf( reply, replySize, "OK frames=%d\n", sent );
+   }
+   // estop <relays|all>: cancel their trains and switch them off ahead of everything queued, even if already off
+   else if( strcmp( command, "estop" ) == 0 )
+   {
+      int sent = 0;
+      for( int bus = 0; bus < _numOfBuses && sent >= 0; bus++ )
+      {
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
+         {
+            stopRelayScheduler( &_buses[bus].scheduler, relay );
+         }
+         int busSent = _sendEmergencyOff( bus, &relays.buses[bus] );
+         sent = ( busSent < 0 ) ? -1 : sent + busSent;
+      }
+      if( sent < 0 ) snprintf( reply, replySize, "ERR urgent queue full\n" );
+      else           snprintf( reply, replySize, "OK frames=%d\n", sent );
+   }
+   // query <relays>, relays of bus 0 are replied without "bus/" prefix
+   else if( strcmp( command, "query" ) == 0 )
+   {
+      size_t used = (size_t)snprintf( reply, replySize, "OK" );
+      for( int bus = 0; bus < _numOfBuses; bus++ )
+      {
+         const relayShadow_t* shadow = &_buses[bus].shadow;
+         FOR_EACH_RELAY_SET( relay, &relays.buses[bus] )
+         {
+            if( used >= replySize )
+            {
+               break;
+            }
+            if( bus > 0 )
+            {
+               used += (size_t)snprintf( reply + used, replySize - used, " %d%c", bus, RELAY_BUS_SEPARATOR );
+            }
+            else
+            {
+               used += (size_t)snprintf( reply + used, replySize - used, " " );
+            }
+            if( used >= replySize )
+            {
+               break;
+            }
+            used += (size_t)snprintf( reply + used, replySize - used, "%d=%s", relay,
+                                      !isKnownRelayShadow( shadow, relay ) ? "unknown" :
+                                      isOnRelayShadow( shadow, relay ) ? "on" : "off" );
+         }
+      }
+      if( used >= replySize - 1 )
+      {
+         used = replySize - 2;
+      }
+      snprintf( reply + used, replySize - used, "\n" );
+   }
+   else
+   {
+      snprintf( reply, replySize, "ERR unknown command \"%s\"\n", command );
+   }
+}
+// END f_runCommand( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sendState( .. )
+ * @brief:  Function to send the same state to a group of relays as a single batch and remember it. Only the relays
+ *          whose state changes get a frame, unless forced
+ * @param1: <int> bus: Bus of the relays
+ * @param2: <const relaySet_t*> relays: Relays
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @param4: <bool> force: TRUE to send a frame to every relay, even if it is already in that state
+ * @return: <int> Number of frames pushed to the queue of the bus, -1 if there was no room for them
+ **********************************************************************************************************************/
+static int _sendState( const int bus, const relaySet_t* relays, uint8_t state, bool force )
+{
+   vcpIovec_t     frames[MAX_RELAYS_IN_RS485_CHAIN];
+   relaySet_t     changed = *relays;
+   relayShadow_t* shadow = &_buses[bus].shadow;
+
+   if( !force )
+   {
+      filterRelayShadow( shadow, relays, state, &changed );
+   }
+   if( isEmptyRelaySet( &changed ) )
+   {
+      return 0;
+   }
+   int numOfFrames = buildRelayFrames( frames, &changed, state );
+   if( !pushFrameQueue( &_queues[bus], frames, numOfFrames ) )
+   {
+      return -1;
+   }
+   applyRelayShadow( shadow, &changed, state );
+   return (int)( lengthRelayFrames( frames, numOfFrames ) / RELAY_FRAME_LENGTH );
+}
+// END f_sendState( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sendEmergencyOff( .. )
+ * @brief:  Function to switch a group of relays off through the urgent lane of the bus: the frames go in front of
+ *          everything waiting, at the next frame boundary, and the ON frames of these relays still waiting are removed.
+ *          Every relay gets a frame, the shadow may be wrong about the board
+ * @param1: <int> bus: Bus of the relays
+ * @param2: <const relaySet_t*> relays: Relays
+ * @return: <int> Number of frames pushed to the queue of the bus, -1 if there was no room for them
+ **********************************************************************************************************************/
+static int _sendEmergencyOff( const int bus, const relaySet_t* relays )
+{
+   vcpIovec_t frames[MAX_RELAYS_IN_RS485_CHAIN];
+
+   if( isEmptyRelaySet( relays ) )
+   {
+      return 0;
+   }
+   int numOfFrames = buildRelayFrames( frames, relays, RELAY_FRAME_OFF );
+   if( !pushUrgentFrameQueue( &_queues[bus], frames, numOfFrames, relays ) )
+   {
+      return -1;
+   }
+   applyRelayShadow( &_buses[bus].shadow, relays, RELAY_FRAME_OFF );
+   return (int)( lengthRelayFrames( frames, numOfFrames ) / RELAY_FRAME_LENGTH );
+}
+// END f_sendEmergencyOff( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_forgetLost( .. )
+ * @brief:  Function to forget the states of the relays of a bus when frames commanded to them never reached the UART
+ *          (queue dropped, batch refused or cut). The shadow was updated when they were queued and would filter the
+ *          next command out, now every relay of the bus gets its next frame
+ * @param1: <int> bus: The bus
+ * @param2: <bool> written: FALSE if the scheduler or the writer of the bus reported frames not written
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _forgetLost( const int bus, const bool written )
+{
+   if( written && !_writers[bus].lostFrames && !_queues[bus].lostFrames )
+   {
+      return;
+   }
+   LOG_PRINT( LOG_LEVEL_WARNING, "%s()::Frames to %s were lost, the state of its relays is unknown now", __func__,
+              _buses[bus].vcp->name );
+   initRelayShadow( &_buses[bus].shadow );
+   _writers[bus].lostFrames = false;
+   _queues[bus].lostFrames = false;
+}
+// END f_forgetLost( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseNumber( .. )
+ * @brief:  Function to parse a whole unsigned decimal argument of a command, milliseconds or counts
+ * @param1: <const char*> text: The argument, may be NULL
+ * @param2: <uint32_t*> value: Value found, left untouched if text is not valid
+ * @return: <bool> TRUE if text is a number from 0 to UINT32_MAX and nothing else
+ **********************************************************************************************************************/
+static bool _parseNumber( const char* text, uint32_t* value )
+{
+   char*         end;
+   unsigned long parsed;
+
+   if( text == NULL || *text < '0' || *text > '9' )
+   {
+      return false;
+   }
+   errno = 0;
+   parsed = strtoul( text, &end, 10 );           // Clamped to ULONG_MAX (ERANGE) where long is 32 bits wide
+   if( *end != '\0' || errno == ERANGE || parsed > UINT32_MAX )
+   {
+      return false;
+   }
+   *value = (uint32_t)parsed;
+   return true;
+}
+// END f_parseNumber( .. ) ...
+
+#endif // !_WIN32
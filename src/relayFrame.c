@@ -0,0 +1,242 @@
+/***********************************************************************************************************************
+ * relayFrame.c
+ * @brief:  Builders for the KMTronic RS485 relay frames [0xFF, relay address, state]
+ *          Frames are never formatted at run time, they are taken from a table generated by the preprocessor and
+ *          handed to the port as vectored writes pointing straight into it.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdint.h>  // uint8_t
+#include "relayFrame.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _FRAME( state, relay )      { (char)RELAY_FRAME_SOH, (char)( relay ), (char)( state ) }
+#define _FRAMES_8( state, relay )   _FRAME( state, ( relay ) + 0 ), _FRAME( state, ( relay ) + 1 ), \
+                                    _FRAME( state, ( relay ) + 2 ), _FRAME( state, ( relay ) + 3 ), \
+                                    _FRAME( state, ( relay ) + 4 ), _FRAME( state, ( relay ) + 5 ), \
+                                    _FRAME( state, ( relay ) + 6 ), _FRAME( state, ( relay ) + 7 )
+#define _FRAMES_64( state, relay )  _FRAMES_8( state, ( relay ) + 0 ),  _FRAMES_8( state, ( relay ) + 8 ),  \
+                                    _FRAMES_8( state, ( relay ) + 16 ), _FRAMES_8( state, ( relay ) + 24 ), \
+                                    _FRAMES_8( state, ( relay ) + 32 ), _FRAMES_8( state, ( relay ) + 40 ), \
+                                    _FRAMES_8( state, ( relay ) + 48 ), _FRAMES_8( state, ( relay ) + 56 )
+#define _FRAMES_128( state )        _FRAMES_64( state, 0 ), _FRAMES_64( state, 64 )
+
+
+/* Public variables --------------------------------------------------------------------------------------------------*/
+const char relayFrameTable[2][RELAY_FRAME_TABLE_SIZE][RELAY_FRAME_LENGTH] =
+{
+   [RELAY_FRAME_OFF] = { _FRAMES_128( RELAY_FRAME_OFF ) },
+   [RELAY_FRAME_ON]  = { _FRAMES_128( RELAY_FRAME_ON ) }
+};
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   const char* f_relayFrame( uint8_t relay, uint8_t state )                                                         //
+//   int       f_buildRelayFrames( vcpIovec_t* frames, const relaySet_t* relays, uint8_t state )                      //
+//   size_t    f_lengthRelayFrames( const vcpIovec_t* frames, int numOfFrames )                                       //
+//   int       f_filterRelayFrames( vcpIovec_t* kept, int maxKept, const vcpIovec_t* frames, int numOfFrames, .. )    //
+//   void      f_collectRelayFrames( const vcpIovec_t* frames, int numOfFrames, relaySet_t* relays )                  //
+//   void      f_buildRelayStatusFrame( char* frame, uint8_t board )                                                  //
+//   bool      f_isRelayStatusReply( const char* reply )                                                              //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_relayFrame( .. )
+ * @brief:  Function to get the frame of a relay from the table
+ * @param1: <uint8_t> relay: Relay address, < RELAY_FRAME_TABLE_SIZE
+ * @param2: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <const char*> RELAY_FRAME_LENGTH bytes, never to be modified
+ **********************************************************************************************************************/
+const char* relayFrame( const uint8_t relay, const uint8_t state )
+{
+   return relayFrameTable[state == RELAY_FRAME_ON][relay];
+}
+// END f_relayFrame( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_buildRelayFrames( .. )
+ * @brief:  Function to point a vectored write at the frames of a set of relays, all of them with the same state, in
+ *          ascending order. Consecutive relays share a single buffer ( 1:8 is one buffer of 8 frames )
+ * @param1: <vcpIovec_t*> frames: Array of at least countRelaySet( relays ) buffers
+ * @param2: <const relaySet_t*> relays: Relays
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <int> Number of buffers used
+ **********************************************************************************************************************/
+int buildRelayFrames( vcpIovec_t* frames, const relaySet_t* relays, const uint8_t state )
+{
+   int     numOfFrames = 0;
+   uint8_t lastRelay = RELAY_SET_END;
+
+   FOR_EACH_RELAY_SET( relay, relays )
+   {
+      if( numOfFrames > 0 && relay == lastRelay + 1 )
+      {
+         frames[numOfFrames - 1].iov_len += RELAY_FRAME_LENGTH;
+      }
+      else
+      {
+         frames[numOfFrames].iov_base = (void*)relayFrame( relay, state );
+         frames[numOfFrames].iov_len = RELAY_FRAME_LENGTH;
+         numOfFrames++;
+      }
+      lastRelay = relay;
+   }
+   return numOfFrames;
+}
+// END f_buildRelayFrames( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_lengthRelayFrames( .. )
+ * @brief:  Function to know the number of bytes of a vectored write
+ * @param1: <const vcpIovec_t*> frames: The buffers
+ * @param2: <int> numOfFrames: Number of buffers
+ * @return: <size_t> Total number of bytes
+ **********************************************************************************************************************/
+size_t lengthRelayFrames( const vcpIovec_t* frames, const int numOfFrames )
+{
+   size_t length = 0;
+
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      length += frames[i].iov_len;
+   }
+   return length;
+}
+// END f_lengthRelayFrames( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_filterRelayFrames( .. )
+ * @brief:  Function to copy a vectored write without the frames of some relays in a state. A buffer losing frames in
+ *          its middle is split. Buffers that are not whole frames of relayFrameTable are copied as they are
+ * @param1: <vcpIovec_t*> kept: Buffers left, an array other than frames
+ * @param2: <int> maxKept: Size of kept
+ * @param3: <const vcpIovec_t*> frames: The buffers
+ * @param4: <int> numOfFrames: Number of buffers
+ * @param5: <const relaySet_t*> relays: Relays whose frames are removed
+ * @param6: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF, only the frames of this state are removed
+ * @return: <int> Number of buffers in kept, -1 if maxKept is too small
+ **********************************************************************************************************************/
+int filterRelayFrames( vcpIovec_t* kept, const int maxKept, const vcpIovec_t* frames, const int numOfFrames,
+                       const relaySet_t* relays, const uint8_t state )
+{
+   const char* table = relayFrameTable[state == RELAY_FRAME_ON][0];
+   int         numOfKept = 0;
+
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      const char* begin = (const char*)frames[i].iov_base;
+      const char* end = begin + frames[i].iov_len;
+      const char* run = begin;                            // First byte not copied nor removed yet
+
+      if( begin >= table && end <= table + sizeof( relayFrameTable[0] ) &&
+          ( begin - table ) % RELAY_FRAME_LENGTH == 0 && frames[i].iov_len % RELAY_FRAME_LENGTH == 0 )
+      {
+         for( const char* frame = begin; frame < end; frame += RELAY_FRAME_LENGTH )
+         {
+            if( !containsRelaySet( relays, (uint8_t)( ( frame - table ) / RELAY_FRAME_LENGTH ) ) )
+            {
+               continue;
+            }
+            if( frame > run )
+            {
+               if( numOfKept == maxKept )
+               {
+                  return -1;
+               }
+               kept[numOfKept].iov_base = (void*)run;
+               kept[numOfKept].iov_len = (size_t)( frame - run );
+               numOfKept++;
+            }
+            run = frame + RELAY_FRAME_LENGTH;
+         }
+      }
+      if( end > run )
+      {
+         if( numOfKept == maxKept )
+         {
+            return -1;
+         }
+         kept[numOfKept].iov_base = (void*)run;
+         kept[numOfKept].iov_len = (size_t)( end - run );
+         numOfKept++;
+      }
+   }
+   return numOfKept;
+}
+// END f_filterRelayFrames( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_collectRelayFrames( .. )
+ * @brief:  Function to add to a set the relays a vectored write switches, on or off. Buffers that are not whole frames
+ *          of relayFrameTable are ignored
+ * @param1: <const vcpIovec_t*> frames: The buffers
+ * @param2: <int> numOfFrames: Number of buffers
+ * @param3: <relaySet_t*> relays: Set the relays are added to
+ * @return: <void> None
+ **********************************************************************************************************************/
+void collectRelayFrames( const vcpIovec_t* frames, const int numOfFrames, relaySet_t* relays )
+{
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      for( int state = 0; state < 2; state++ )
+      {
+         const char* table = relayFrameTable[state][0];
+         const char* begin = (const char*)frames[i].iov_base;
+         const char* end = begin + frames[i].iov_len;
+         if( begin >= table && end <= table + sizeof( relayFrameTable[0] ) &&
+             ( begin - table ) % RELAY_FRAME_LENGTH == 0 && frames[i].iov_len % RELAY_FRAME_LENGTH == 0 )
+         {
+            for( const char* frame = begin; frame < end; frame += RELAY_FRAME_LENGTH )
+            {
+               addRelaySet( relays, (uint8_t)( ( frame - table ) / RELAY_FRAME_LENGTH ) );
+            }
+         }
+      }
+   }
+}
+// END f_collectRelayFrames( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_buildRelayStatusFrame( .. )
+ * @brief:  Function to build the frame asking a board for the state of its relays
+ * @param1: <char*> frame: RELAY_FRAME_LENGTH bytes
+ * @param2: <uint8_t> board: Board of the chain, 1 to MAX_BOARDS_IN_RS485_CHAIN
+ * @return: <void> None
+ **********************************************************************************************************************/
+void buildRelayStatusFrame( char* frame, const uint8_t board )
+{
+   frame[0] = (char)RELAY_FRAME_SOH;
+   frame[1] = (char)( RELAY_FRAME_STATUS + board );
+   frame[2] = (char)0x00;
+}
+// END f_buildRelayStatusFrame( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isRelayStatusReply( .. )
+ * @brief:  Function to know if some bytes are a well formed reply to a status frame
+ * @param1: <const char*> reply: RELAY_STATUS_LENGTH bytes
+ * @return: <bool> TRUE if every byte is RELAY_FRAME_ON or RELAY_FRAME_OFF
+ **********************************************************************************************************************/
+bool isRelayStatusReply( const char* reply )
+{
+   for( int i = 0; i < RELAY_STATUS_LENGTH; i++ )
+   {
+      if( reply[i] != RELAY_FRAME_ON && reply[i] != RELAY_FRAME_OFF )
+      {
+         return false;
+      }
+   }
+   return true;
+}
+// END f_isRelayStatusReply( .. ) ...
@@ -0,0 +1,713 @@
+/***********************************************************************************************************************
+ * relayLib.c
+ * @brief:  Relay commands callable in process, all the state in a context
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>   // snprintf()
+#include <stdlib.h>  // calloc(), free(), llabs()
+#include <string.h>  // strcmp()
+#include "main.h"
+#include "virtualComPort.h"
+#include "relayFrame.h"
+#include "relayStatus.h"
+#include "serialWriter.h"
+#include "metrics.h"
+#include "logger.h"
+#include "portLock.h"
+#include "relayLib.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _MAX_VERIFY_TRIES     3     // Times the relays not in the commanded state are sent again when verifying
+#define _NUM_OF_STATES        2     // RELAY_FRAME_OFF, RELAY_FRAME_ON
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+struct relayLib_type
+{
+   vcp_t             vcps[MAX_RS485_BUSES];
+   int               numOfBuses;
+   relayLibOptions_t options;
+   portLock_t        locks[MAX_RS485_BUSES];           // Turn of the process on every port, when arbitrated
+   bool              sessionOpen;                      // Ports kept open between calls
+   pulseStats_t      stats;                            // Requested vs achieved widths of every pulseRelayLib()
+   pulseStats_t      cycleStats;                       // Start of every cycle vs its absolute deadline
+#ifndef _WIN32
+   serialWriter_t    writers[MAX_RS485_BUSES];         // Buses written at the same time when there are several
+#endif
+   // Messages of every state and bus, vectored writes pointing into relayFrameTable (nothing is built or allocated per
+   // impulse)
+   vcpIovec_t        frames[_NUM_OF_STATES][MAX_RS485_BUSES][MAX_RELAYS_IN_RS485_CHAIN];
+   int               numOfFrames[_NUM_OF_STATES][MAX_RS485_BUSES];
+};
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static bool     _openBuses( relayLib_t* lib, const char* when );
+static bool     _closeBuses( relayLib_t* lib, const char* when );
+static bool     _lockBuses( relayLib_t* lib, const char* const devices[], const int numOfBuses );
+static void     _unlockBuses( relayLib_t* lib );
+static void     _shareBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state );
+static void     _buildBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state );
+static bool     _sendBuses( relayLib_t* lib, const uint8_t state );
+static uint64_t _wireTimeBuses( const relayLib_t* lib, const uint8_t state );
+static bool     _verifyBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state,
+                              const uint64_t backlogNs );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   relayLib_t*  f_openRelayLib( const char* const devices[], int numOfBuses, const relayLibOptions_t* options )     //
+//   void         f_closeRelayLib( relayLib_t* lib )                                                                  //
+//   vcp_t*       f_portsRelayLib( relayLib_t* lib, int* numOfBuses )                                                 //
+//   bool         f_beginRelayLib( relayLib_t* lib )                                                                  //
+//   bool         f_endRelayLib( relayLib_t* lib )                                                                    //
+//   bool         f_setRelayLib( relayLib_t* lib, const relayBusSet_t* relays, uint8_t state )                        //
+//   bool         f_pulseRelayLib( relayLib_t* lib, const relayBusSet_t* relays, uint32_t widthMs, .. )               //
+//   bool         f_queryRelayLib( relayLib_t* lib, int bus, uint8_t board, uint8_t* mask )                           //
+//   uint64_t     f_wireTimeRelayLib( relayLib_t* lib, const relayBusSet_t* relays, uint8_t state )                   //
+//   const pulseStats_t* f_statsRelayLib( const relayLib_t* lib )                                                     //
+//   const pulseStats_t* f_cycleStatsRelayLib( const relayLib_t* lib )                                                //
+//   bool         f_loadStatesRelayLib( const relayLib_t* lib, relayShadow_t shadows[] )                              //
+//   void         f_storeStatesRelayLib( relayLib_t* lib, const relayShadow_t shadows[] )                             //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_openRelayLib( .. )
+ * @brief:  Function to create a context and the port of every bus. The ports are left closed
+ * @param1: <const char* const[]> devices: Device path of every bus (Ex. "/dev/ttyUSB0", "\\\\.\\COM12")
+ * @param2: <int> numOfBuses: Number of devices, 1 to MAX_RS485_BUSES
+ * @param3: <const relayLibOptions_t*> options: Options of the context, copied. NULL for RELAY_LIB_OPTIONS_DEFAULT
+ * @return: <relayLib_t*> The context, NULL if a device could not be opened within the retry policy
+ **********************************************************************************************************************/
+relayLib_t* openRelayLib( const char* const devices[], const int numOfBuses, const relayLibOptions_t* options )
+{
+   static const relayLibOptions_t defaultOptions = RELAY_LIB_OPTIONS_DEFAULT;
+   relayLib_t*                    lib;
+
+   if( numOfBuses < 1 || numOfBuses > MAX_RS485_BUSES )
+   {
+      return NULL;
+   }
+   lib = (relayLib_t*)calloc( 1, sizeof( relayLib_t ) );   // Big, keep it out of the stack
+   if( lib == NULL )
+   {
+      return NULL;
+   }
+   initPulseTimer();
+   lib->options = ( options != NULL ) ? *options : defaultOptions;
+   resetPulseStats( &lib->stats );
+   resetPulseStats( &lib->cycleStats );
+   if( lib->options.arbitrate && !_lockBuses( lib, devices, numOfBuses ) )
+   {
+      closeRelayLib( lib );
+      return NULL;
+   }
+   for( lib->numOfBuses = 0; lib->numOfBuses < numOfBuses; lib->numOfBuses++ )
+   {
+      if( !initVCPByName( &lib->vcps[lib->numOfBuses], devices[lib->numOfBuses], lib->options.baudRate,
+                          &lib->options.retry ) )
+      {
+         closeRelayLib( lib );
+         return NULL;
+      }
+      lib->vcps[lib->numOfBuses].bus = lib->numOfBuses;
+   }
+   return lib;
+}
+// END f_openRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_closeRelayLib( .. )
+ * @brief:  Function to end the session if any, release the ports and the context
+ * @param1: <relayLib_t*> lib: The context, NULL does nothing
+ * @return: <void> None
+ **********************************************************************************************************************/
+void closeRelayLib( relayLib_t* lib )
+{
+   if( lib == NULL )
+   {
+      return;
+   }
+   endRelayLib( lib );
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      destroyVCP( &lib->vcps[bus] );
+   }
+   _unlockBuses( lib );                                // Once the ports are closed, the next process opens them
+   free( lib );
+}
+// END f_closeRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_portsRelayLib( .. )
+ * @brief:  Function to reach the ports of the context, for the modes built on top of them (daemon, schedules)
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <int*> numOfBuses: Number of ports, can be NULL
+ * @return: <vcp_t*> The port of every bus, owned by the context
+ **********************************************************************************************************************/
+vcp_t* portsRelayLib( relayLib_t* lib, int* numOfBuses )
+{
+   if( numOfBuses != NULL )
+   {
+      *numOfBuses = lib->numOfBuses;
+   }
+   return lib->vcps;
+}
+// END f_portsRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_beginRelayLib( .. )
+ * @brief:  Function to open the ports once for all the next calls, until endRelayLib()
+ * @param1: <relayLib_t*> lib: The context
+ * @return: <bool> TRUE if every port is open
+ **********************************************************************************************************************/
+bool beginRelayLib( relayLib_t* lib )
+{
+   if( !lib->sessionOpen )
+   {
+      lib->sessionOpen = _openBuses( lib, "BEFORE starting the session" );
+   }
+   return lib->sessionOpen;
+}
+// END f_beginRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_endRelayLib( .. )
+ * @brief:  Function to close the ports of the session. Without a session it does nothing
+ * @param1: <relayLib_t*> lib: The context
+ * @return: <bool> TRUE if every port could be closed
+ **********************************************************************************************************************/
+bool endRelayLib( relayLib_t* lib )
+{
+   if( !lib->sessionOpen )
+   {
+      return true;
+   }
+   lib->sessionOpen = false;
+   return _closeBuses( lib, "AFTER ending the session" );
+}
+// END f_endRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setRelayLib( .. )
+ * @brief:  Function to switch relays of every bus on or off, read back when the context verifies
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays of every bus
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <bool> TRUE if every frame was sent (and every relay verified)
+ **********************************************************************************************************************/
+bool setRelayLib( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state )
+{
+   bool done;
+
+   _buildBuses( lib, relays, state );
+   if( !lib->sessionOpen && !_openBuses( lib, ( state == RELAY_FRAME_ON ) ? "BEFORE send OPEN relay message" :
+                                                                              "BEFORE send CLOSE relay message" ) )
+   {
+      return false;
+   }
+   done = _sendBuses( lib, state );
+   _shareBuses( lib, relays, state );
+   if( lib->options.verify )
+   {
+      done = _verifyBuses( lib, relays, state, _wireTimeBuses( lib, state ) ) && done;
+   }
+   if( !lib->sessionOpen && !_closeBuses( lib, ( state == RELAY_FRAME_ON ) ? "AFTER send OPEN relay message" :
+                                                                               "AFTER send CLOSE relay message" ) )
+   {
+      return false;
+   }
+   return done;
+}
+// END f_setRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_pulseRelayLib( .. )
+ * @brief:  Function to switch relays of every bus on for a time and off for another, count times. Every edge has an
+ *          absolute deadline on a grid laid at the first ON (cycle k starts at k * ( width + off )), the time spent
+ *          opening the ports or a late edge is not carried to the next cycles, so long trains do not drift. Every
+ *          achieved width is recorded (statsRelayLib(), METRIC_PULSE_ERROR) and so is the start of every cycle
+ *          against its deadline (cycleStatsRelayLib()). When the context verifies only the OFF state is read back, it
+ *          would stretch the pulse otherwise
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays of every bus
+ * @param3: <uint32_t> widthMs: Time the relays stay on
+ * @param4: <uint32_t> offMs: Time the relays stay off between pulses, 0 for back to back pulses
+ * @param5: <uint32_t> count: Number of pulses
+ * @return: <bool> TRUE if every frame was sent (and every relay verified off). It stops at the first port that can not
+ *          be opened or closed
+ **********************************************************************************************************************/
+bool pulseRelayLib( relayLib_t* lib, const relayBusSet_t* relays, const uint32_t widthMs, const uint32_t offMs,
+                    const uint32_t count )
+{
+   uint64_t closeWireTime;
+   uint64_t widthNs = (uint64_t)widthMs * NS_PER_MS;
+   uint64_t periodNs = widthNs + (uint64_t)offMs * NS_PER_MS;
+   uint64_t firstNs = 0;                               // Deadline of the first ON edge, the grid starts there
+   bool     done = true;
+
+   _buildBuses( lib, relays, RELAY_FRAME_ON );
+   _buildBuses( lib, relays, RELAY_FRAME_OFF );
+   closeWireTime = _wireTimeBuses( lib, RELAY_FRAME_OFF );
+
+   for( uint32_t pulse = 0; pulse < count; pulse++ )
+   {
+      // ON: open the ports (already open in a session), wait for the deadline of the cycle, send, close
+      if( !lib->sessionOpen && !_openBuses( lib, "BEFORE send OPEN relay message" ) )
+      {
+         return false;
+      }
+      uint64_t onDeadline = firstNs + (uint64_t)pulse * periodNs;
+      if( pulse == 0 )
+      {
+         firstNs = nowPulseTimer();
+         onDeadline = firstNs;
+      }
+      sleepUntilPulseTimer( onDeadline );
+      uint64_t startTime = nowPulseTimer();
+      done = _sendBuses( lib, RELAY_FRAME_ON ) && done;
+      if( !lib->sessionOpen && !_closeBuses( lib, "AFTER send OPEN relay message" ) )
+      {
+         return false;
+      }
+      int64_t startErrorNs = ( pulse > 0 ) ? recordPulseStats( &lib->cycleStats, onDeadline, startTime ) : 0;
+      _shareBuses( lib, relays, RELAY_FRAME_ON );
+
+      // Absolute deadline, time spent closing/reopening the port is not added to the pulse
+      sleepUntilPulseTimer( onDeadline + widthNs );
+
+      // OFF: same, the achieved width is taken right before the frames are sent
+      if( !lib->sessionOpen && !_openBuses( lib, "BEFORE send CLOSE relay message" ) )
+      {
+         return false;
+      }
+      uint64_t closeTime = nowPulseTimer();
+      done = _sendBuses( lib, RELAY_FRAME_OFF ) && done;
+      _shareBuses( lib, relays, RELAY_FRAME_OFF );
+      if( lib->options.verify )
+      {
+         done = _verifyBuses( lib, relays, RELAY_FRAME_OFF, closeWireTime ) && done;
+      }
+      int64_t errorNs = recordPulseStats( &lib->stats, widthNs, closeTime - startTime );
+      recordMetrics( METRIC_PULSE_ERROR, (uint64_t)llabs( errorNs ) );
+      LOG_PRINT( LOG_LEVEL_INFO, "Pulse %u: requested %u ms, achieved %.3f ms (%+.3f ms), cycle start %+.3f ms",
+                 lib->stats.count, widthMs, (double)( closeTime - startTime ) / NS_PER_MS,
+                 (double)errorNs / NS_PER_MS, (double)startErrorNs / NS_PER_MS );
+      if( !lib->sessionOpen && !_closeBuses( lib, "AFTER send CLOSE relay message" ) )
+      {
+         return false;
+      }
+   }
+   return done;
+}
+// END f_pulseRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_queryRelayLib( .. )
+ * @brief:  Function to read the real state of the relays of a board
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <int> bus: Bus of the board, 0 to the number of buses - 1
+ * @param3: <uint8_t> board: Board of the chain, 1 to MAX_BOARDS_IN_RS485_CHAIN
+ * @param4: <uint8_t*> mask: State of its relays, bit 0 is the first relay of the board
+ * @return: <bool> TRUE if the board answered
+ **********************************************************************************************************************/
+bool queryRelayLib( relayLib_t* lib, const int bus, const uint8_t board, uint8_t* mask )
+{
+   bool answered;
+
+   if( bus < 0 || bus >= lib->numOfBuses )
+   {
+      return false;
+   }
+   if( !lib->sessionOpen && !tryOpenVCP( &lib->vcps[bus], &lib->options.retry, NULL ) )
+   {
+      return false;
+   }
+   answered = readRelayStatus( &lib->vcps[bus], board, mask, 0 );
+   if( !lib->sessionOpen )
+   {
+      tryCloseVCP( &lib->vcps[bus], &lib->options.retry, NULL );
+   }
+   return answered;
+}
+// END f_queryRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wireTimeRelayLib( .. )
+ * @brief:  Function to know how long switching relays takes on the wire. Buses are written at the same time, so it is
+ *          the time of the slowest one. A pulse can not be shorter than its ON time
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays of every bus
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <uint64_t> Time in ns
+ **********************************************************************************************************************/
+uint64_t wireTimeRelayLib( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state )
+{
+   _buildBuses( lib, relays, state );
+   return _wireTimeBuses( lib, state );
+}
+// END f_wireTimeRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_statsRelayLib( .. )
+ * @brief:  Function to get the requested vs achieved widths of every pulse sent by the context
+ * @param1: <const relayLib_t*> lib: The context
+ * @return: <const pulseStats_t*> The statistics, owned by the context
+ **********************************************************************************************************************/
+const pulseStats_t* statsRelayLib( const relayLib_t* lib )
+{
+   return &lib->stats;
+}
+// END f_statsRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_cycleStatsRelayLib( .. )
+ * @brief:  Function to get the start of every cycle but the first one of the trains sent by the context, against its
+ *          absolute deadline (requested 0)
+ * @param1: <const relayLib_t*> lib: The context
+ * @return: <const pulseStats_t*> The statistics, owned by the context
+ **********************************************************************************************************************/
+const pulseStats_t* cycleStatsRelayLib( const relayLib_t* lib )
+{
+   return &lib->cycleStats;
+}
+// END f_cycleStatsRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_loadStatesRelayLib( .. )
+ * @brief:  Function to read the last known state of the relays of every bus, left by the processes that used the ports
+ *          before (only when the context arbitrates)
+ * @param1: <const relayLib_t*> lib: The context
+ * @param2: <relayShadow_t[]> shadows: State of every bus, nothing known when not shared
+ * @return: <bool> TRUE if the states are shared with the other processes
+ **********************************************************************************************************************/
+bool loadStatesRelayLib( const relayLib_t* lib, relayShadow_t shadows[] )
+{
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      loadPortLock( &lib->locks[bus], &shadows[bus] );
+   }
+   return lib->options.arbitrate;
+}
+// END f_loadStatesRelayLib( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_storeStatesRelayLib( .. )
+ * @brief:  Function to leave the state of the relays of every bus to the next processes (only when the context
+ *          arbitrates). The calls of the context record theirs already, this is for the modes built on the ports
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayShadow_t[]> shadows: State of every bus
+ * @return: <void> None
+ **********************************************************************************************************************/
+void storeStatesRelayLib( relayLib_t* lib, const relayShadow_t shadows[] )
+{
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      storePortLock( &lib->locks[bus], &shadows[bus] );
+   }
+}
+// END f_storeStatesRelayLib( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_openBuses( relayLib_t* lib, const char* when )                                                       //
+//   bool      f_closeBuses( relayLib_t* lib, const char* when )                                                      //
+//   bool      f_lockBuses( relayLib_t* lib, const char* const devices[], int numOfBuses )                            //
+//   void      f_unlockBuses( relayLib_t* lib )                                                                       //
+//   void      f_shareBuses( relayLib_t* lib, const relayBusSet_t* relays, uint8_t state )                            //
+//   void      f_buildBuses( relayLib_t* lib, const relayBusSet_t* relays, uint8_t state )                            //
+//   bool      f_sendBuses( relayLib_t* lib, uint8_t state )                                                          //
+//   uint64_t  f_wireTimeBuses( const relayLib_t* lib, uint8_t state )                                                //
+//   bool      f_verifyBuses( relayLib_t* lib, const relayBusSet_t* relays, uint8_t state, uint64_t backlogNs )       //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_openBuses( .. )
+ * @brief:  Function to open the port of every bus, stops at the first one that can not be opened within the policy
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const char*> when: End of the error message (Ex. "BEFORE send OPEN relay message")
+ * @return: <bool> TRUE if all of them could be opened, the ones already open are closed again if not
+ **********************************************************************************************************************/
+static bool _openBuses( relayLib_t* lib, const char* when )
+{
+   retryOutcome_t outcome;
+
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      if( !tryOpenVCP( &lib->vcps[bus], &lib->options.retry, &outcome ) )
+      {
+         // The buses not tried yet are not worth the wait, the pulse is lost anyway
+         LOG_PRINT( LOG_LEVEL_ERROR, "Port %s given up (%s)", lib->vcps[bus].name, nameRetryOutcome( outcome ) );
+         LOG_PRINT( LOG_LEVEL_ERROR, "Could not open Port %s", when );
+         while( --bus >= 0 )
+         {
+            tryCloseVCP( &lib->vcps[bus], &lib->options.retry, NULL );
+         }
+         return false;
+      }
+   }
+   return true;
+}
+// END f_openBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_closeBuses( .. )
+ * @brief:  Function to close the port of every bus
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const char*> when: End of the error message (Ex. "AFTER send OPEN relay message")
+ * @return: <bool> TRUE if all of them could be closed
+ **********************************************************************************************************************/
+static bool _closeBuses( relayLib_t* lib, const char* when )
+{
+   bool closed = true;
+
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      closed = tryCloseVCP( &lib->vcps[bus], &lib->options.retry, NULL ) && closed;
+   }
+   if( !closed )
+   {
+      LOG_PRINT( LOG_LEVEL_ERROR, "Could not close Port %s", when );
+   }
+   return closed;
+}
+// END f_closeBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_lockBuses( .. )
+ * @brief:  Function to wait for the turn of the process on the port of every bus. The ports are taken in the order of
+ *          their lock files, named after the device the names lead to: two processes wanting the same buses, even
+ *          through different links, can not hold one each and wait for the other forever. The whole wait ends at the
+ *          deadline of the retry policy
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const char* const[]> devices: Device of every bus
+ * @param3: <int> numOfBuses: Number of devices
+ * @return: <bool> TRUE if every port is the process's, the ones taken are released again if not
+ **********************************************************************************************************************/
+static bool _lockBuses( relayLib_t* lib, const char* const devices[], const int numOfBuses )
+{
+   bool     taken[MAX_RS485_BUSES] = { false };
+   char     paths[MAX_RS485_BUSES][MAX_PATH];
+   uint64_t deadlineNs = ( lib->options.retry.deadlineMs == 0 ) ? PORT_LOCK_NO_DEADLINE :
+                         nowPulseTimer() + (uint64_t)lib->options.retry.deadlineMs * NS_PER_MS;
+
+   for( int bus = 0; bus < numOfBuses; bus++ )
+   {
+      if( !pathPortLock( paths[bus], sizeof( paths[bus] ), devices[bus] ) )
+      {
+         snprintf( paths[bus], sizeof( paths[bus] ), "%s", devices[bus] );   // acquirePortLock() fails and tells
+      }
+   }
+   for( int locked = 0; locked < numOfBuses; locked++ )
+   {
+      int next = -1;
+      for( int bus = 0; bus < numOfBuses; bus++ )
+      {
+         if( !taken[bus] && ( next < 0 || strcmp( paths[bus], paths[next] ) < 0 ) )
+         {
+            next = bus;
+         }
+      }
+      taken[next] = true;
+      if( !acquirePortLock( &lib->locks[next], devices[next], deadlineNs ) )
+      {
+         _unlockBuses( lib );
+         return false;
+      }
+   }
+   return true;
+}
+// END f_lockBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_unlockBuses( .. )
+ * @brief:  Function to hand the port of every bus over to the next process queued on it
+ * @param1: <relayLib_t*> lib: The context
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _unlockBuses( relayLib_t* lib )
+{
+   for( int bus = 0; bus < MAX_RS485_BUSES; bus++ )
+   {
+      releasePortLock( &lib->locks[bus] );             // Not acquired does nothing
+   }
+}
+// END f_unlockBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_shareBuses( .. )
+ * @brief:  Function to record the relays just sent in the states shared with the other processes (when arbitrated)
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays of every bus
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _shareBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state )
+{
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      applyPortLock( &lib->locks[bus], &relays->buses[bus], state );
+   }
+}
+// END f_shareBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_buildBuses( .. )
+ * @brief:  Function to point the message of a state of every bus to the frames of its relays
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays of every bus
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _buildBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state )
+{
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      char label[32];
+      lib->numOfFrames[state][bus] = buildRelayFrames( lib->frames[state][bus], &relays->buses[bus], state );
+      snprintf( label, sizeof( label ), ( bus == 0 ) ? "%sRelaysMessage" : "%sRelaysMessage(%d)",
+                ( state == RELAY_FRAME_ON ) ? "Open" : "Close", bus );
+      LOG_FRAMES( label, lib->frames[state][bus], lib->numOfFrames[state][bus] );
+   }
+}
+// END f_buildBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sendBuses( .. )
+ * @brief:  Function to send the message of a state to every bus. On POSIX the buses are written at the same time, each
+ *          one as fast as its UART takes the frames, so the time of a message is the one of the longest bus and not
+ *          the sum
+ * @param1: <relayLib_t*> lib: The context, ports already open
+ * @param2: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF, message built by _buildBuses()
+ * @return: <bool> TRUE if every frame was sent
+ **********************************************************************************************************************/
+static bool _sendBuses( relayLib_t* lib, const uint8_t state )
+{
+   bool sent = true;
+
+#ifndef _WIN32
+   if( lib->numOfBuses > 1 )
+   {
+      uint64_t now = nowPulseTimer();
+      for( int bus = 0; bus < lib->numOfBuses; bus++ )
+      {
+         sent = initSerialWriter( &lib->writers[bus], &lib->vcps[bus], SERIAL_WRITER_STUCK_NS_DEFAULT,
+                                  SERIAL_WRITER_NOT_PACED ) &&
+                queueSerialWriter( &lib->writers[bus], lib->frames[state][bus], lib->numOfFrames[state][bus], now ) &&
+                sent;
+      }
+      sent = drainSerialWriters( lib->writers, lib->numOfBuses, UINT64_MAX ) && sent;
+      for( int bus = 0; bus < lib->numOfBuses; bus++ )
+      {
+         setNonBlockingVCP( &lib->vcps[bus], false );
+      }
+      return sent;
+   }
+#endif
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      sent = ( lib->numOfFrames[state][bus] == 0 ||
+               sendFramesVCP( &lib->vcps[bus], lib->frames[state][bus], lib->numOfFrames[state][bus] ) ) && sent;
+   }
+   return sent;
+}
+// END f_sendBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wireTimeBuses( .. )
+ * @brief:  Function to know how long the message of a state takes on the wire, the one of the slowest bus
+ * @param1: <const relayLib_t*> lib: The context
+ * @param2: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF, message built by _buildBuses()
+ * @return: <uint64_t> Time in ns
+ **********************************************************************************************************************/
+static uint64_t _wireTimeBuses( const relayLib_t* lib, const uint8_t state )
+{
+   uint64_t wireTime = 0;
+
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      uint64_t busWireTime = wireTimeVCP( &lib->vcps[bus], lengthRelayFrames( lib->frames[state][bus],
+                                                                             lib->numOfFrames[state][bus] ) );
+      if( busWireTime > wireTime )
+      {
+         wireTime = busWireTime;
+      }
+   }
+   return wireTime;
+}
+// END f_wireTimeBuses( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_verifyBuses( .. )
+ * @brief:  Function to read the relays back on every bus and send again only the ones that are not in the state
+ *          commanded, up to _MAX_VERIFY_TRIES times. The ports must be open
+ * @param1: <relayLib_t*> lib: The context
+ * @param2: <const relayBusSet_t*> relays: Relays just sent
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF, state just sent
+ * @param4: <uint64_t> backlogNs: Time the message just sent still needs on the wire
+ * @return: <bool> TRUE if every relay reached the state
+ **********************************************************************************************************************/
+static bool _verifyBuses( relayLib_t* lib, const relayBusSet_t* relays, const uint8_t state,
+                          const uint64_t backlogNs )
+{
+   vcpIovec_t frames[MAX_RELAYS_IN_RS485_CHAIN];
+   relaySet_t wrong;
+   bool       verified = true;
+
+   for( int bus = 0; bus < lib->numOfBuses; bus++ )
+   {
+      vcp_t*   vcp = &lib->vcps[bus];
+      uint64_t waitNs = backlogNs;
+      for( int tries = 0; ; tries++ )
+      {
+         int numOfWrong = checkRelayStatus( vcp, &relays->buses[bus], state, &wrong, waitNs );
+         if( numOfWrong == 0 )
+         {
+            LOG_PRINT( LOG_LEVEL_INFO, "Relays of %s verified", vcp->name );
+            break;
+         }
+         if( tries >= _MAX_VERIFY_TRIES )
+         {
+            LOG_PRINT( LOG_LEVEL_ERROR, "%d relay/s of %s not verified after %d tries", countRelaySet( &wrong ),
+                       vcp->name, _MAX_VERIFY_TRIES );
+            verified = false;
+            break;
+         }
+         // Only the relays found wrong go again (all the relays of a board that did not answer)
+         int numOfFrames = buildRelayFrames( frames, &wrong, state );
+         LOG_PRINT( LOG_LEVEL_WARNING, "%d relay/s of %s not in the state sent%s, sending them again",
+                    countRelaySet( &wrong ), vcp->name, ( numOfWrong < 0 ) ? " or not answering" : "" );
+         sendFramesVCP( vcp, frames, numOfFrames );
+         waitNs = wireTimeVCP( vcp, lengthRelayFrames( frames, numOfFrames ) );
+      }
+   }
+   return verified;
+}
+// END f_verifyBuses( .. ) ...
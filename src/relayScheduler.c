@@ -0,0 +1,255 @@
+/***********************************************************************************************************************
+ * relayScheduler.c
+ * @brief:  Independent pulse trains per relay, driven by a timer wheel from a single thread
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stddef.h>  // NULL
+#include <stdlib.h>  // llabs()
+#include "main.h"
+#include "metrics.h"
+#include "relayScheduler.h"
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void _onEdge( wheelTimer_t* timer, void* context );
+static void _queueFrame( relayScheduler_t* scheduler, const uint8_t relay, const uint8_t state );
+static void _flush( relayScheduler_t* scheduler );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_initRelayScheduler( relayScheduler_t* scheduler, vcp_t* vcp, relayShadow_t* shadow, .. )            //
+//   bool      f_startRelayScheduler( relayScheduler_t* scheduler, uint8_t relay, uint64_t openNs, .. )               //
+//   void      f_stopRelayScheduler( relayScheduler_t* scheduler, uint8_t relay )                                     //
+//   uint64_t  f_nextRelayScheduler( const relayScheduler_t* scheduler )                                              //
+//   bool      f_runRelayScheduler( relayScheduler_t* scheduler, uint64_t nowNs )                                     //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initRelayScheduler( .. )
+ * @brief:  Function to set up a scheduler without jobs
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @param2: <vcp_t*> vcp: Port the frames are sent to, must be open while the scheduler runs
+ * @param3: <relayShadow_t*> shadow: Relay states to keep updated, may be NULL
+ * @param4: <serialWriter_t*> writer: Non blocking writer of the port, may be NULL to write the batches directly
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initRelayScheduler( relayScheduler_t* scheduler, vcp_t* vcp, relayShadow_t* shadow, serialWriter_t* writer )
+{
+   initTimerWheel( &scheduler->wheel, nowPulseTimer() );
+   for( int relay = 0; relay <= MAX_RELAYS_IN_RS485_CHAIN; relay++ )
+   {
+      relayJob_t* job = &scheduler->jobs[relay];
+      initWheelTimer( &job->timer, _onEdge, job );
+      job->relay = (uint8_t)relay;
+      job->active = false;
+      job->scheduler = scheduler;
+   }
+   scheduler->vcp = vcp;
+   scheduler->shadow = shadow;
+   scheduler->writer = writer;
+   scheduler->batchLength = 0;
+   scheduler->activeJobs = 0;
+   scheduler->writeError = false;
+   resetPulseStats( &scheduler->stats );
+}
+// END f_initRelayScheduler( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_startRelayScheduler( .. )
+ * @brief:  Function to start the pulse train of a relay. A train already running on the relay is replaced
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @param2: <uint8_t> relay: Relay address
+ * @param3: <uint64_t> openNs: ON time of every cycle
+ * @param4: <uint64_t> periodNs: Time between two ON edges, >= openNs. Equal means no OFF time between cycles
+ * @param5: <uint32_t> cycles: Number of cycles, RELAY_SCHEDULER_FOREVER for an endless train
+ * @param6: <uint64_t> startNs: Deadline of the first ON edge (nowPulseTimer() time base)
+ * @return: <bool> TRUE if the train was accepted
+ **********************************************************************************************************************/
+bool startRelayScheduler( relayScheduler_t* scheduler, const uint8_t relay, const uint64_t openNs,
+                          const uint64_t periodNs, const uint32_t cycles, const uint64_t startNs )
+{
+   if( relay < MIN_RELAY_NUMBER || relay > MAX_RELAYS_IN_RS485_CHAIN || periodNs < openNs ||
+       ( cycles == RELAY_SCHEDULER_FOREVER && periodNs == 0 ) )
+   {
+      return false;
+   }
+   relayJob_t* job = &scheduler->jobs[relay];
+   if( !job->active )
+   {
+      scheduler->activeJobs++;
+   }
+   job->active = true;
+   job->cyclesLeft = cycles;
+   job->openNs = openNs;
+   job->periodNs = periodNs;
+   job->cycleStartNs = startNs;
+   job->nextState = RELAY_FRAME_ON;
+   addTimerWheel( &scheduler->wheel, &job->timer, startNs );
+   return true;
+}
+// END f_startRelayScheduler( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_stopRelayScheduler( .. )
+ * @brief:  Function to cancel the pulse train of a relay. No frame is sent, the relay keeps its current state
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <void> None
+ **********************************************************************************************************************/
+void stopRelayScheduler( relayScheduler_t* scheduler, const uint8_t relay )
+{
+   if( relay > MAX_RELAYS_IN_RS485_CHAIN || !scheduler->jobs[relay].active )
+   {
+      return;
+   }
+   cancelTimerWheel( &scheduler->wheel, &scheduler->jobs[relay].timer );
+   scheduler->jobs[relay].active = false;
+   scheduler->activeJobs--;
+}
+// END f_stopRelayScheduler( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nextRelayScheduler( .. )
+ * @brief:  Function to know when runRelayScheduler() must be called next
+ * @param1: <const relayScheduler_t*> scheduler: The scheduler
+ * @return: <uint64_t> Absolute time in ns, TIMER_WHEEL_NEVER if there is nothing scheduled
+ **********************************************************************************************************************/
+uint64_t nextRelayScheduler( const relayScheduler_t* scheduler )
+{
+   return nextExpiryTimerWheel( &scheduler->wheel );
+}
+// END f_nextRelayScheduler( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runRelayScheduler( .. )
+ * @brief:  Function to send every edge due up to now. All of them go out as one batch
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @param2: <uint64_t> nowNs: Current time
+ * @return: <bool> TRUE if every frame could be written
+ **********************************************************************************************************************/
+bool runRelayScheduler( relayScheduler_t* scheduler, const uint64_t nowNs )
+{
+   scheduler->runNowNs = nowNs;
+   scheduler->writeError = false;
+   advanceTimerWheel( &scheduler->wheel, nowNs );
+   _flush( scheduler );
+   return !scheduler->writeError;
+}
+// END f_runRelayScheduler( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_onEdge( .. )
+ * @brief:  Timer callback. Queues the frame of the edge and arms the next one on its absolute deadline
+ * @param1: <wheelTimer_t*> timer: The job timer
+ * @param2: <void*> context: The job
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _onEdge( wheelTimer_t* timer, void* context )
+{
+   relayJob_t*       job = (relayJob_t*)context;
+   relayScheduler_t* scheduler = (relayScheduler_t*)job->scheduler;
+
+   (void)timer;
+   _queueFrame( scheduler, job->relay, job->nextState );
+   if( job->nextState == RELAY_FRAME_ON )
+   {
+      job->onSentNs = scheduler->runNowNs;
+      job->nextState = RELAY_FRAME_OFF;
+      addTimerWheel( &scheduler->wheel, &job->timer, job->cycleStartNs + job->openNs );
+      return;
+   }
+
+   int64_t errorNs = recordPulseStats( &scheduler->stats, job->openNs, scheduler->runNowNs - job->onSentNs );
+   recordMetrics( METRIC_PULSE_ERROR, (uint64_t)llabs( errorNs ) );
+   if( job->cyclesLeft != RELAY_SCHEDULER_FOREVER && --job->cyclesLeft == 0 )
+   {
+      job->active = false;
+      scheduler->activeJobs--;
+      return;
+   }
+   job->cycleStartNs += job->periodNs;
+   job->nextState = RELAY_FRAME_ON;
+   addTimerWheel( &scheduler->wheel, &job->timer, job->cycleStartNs );
+}
+// END f_onEdge( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_queueFrame( .. )
+ * @brief:  Function to add a frame to the current batch, the batch is sent first if it is full. The frame is not
+ *          copied, the batch points into relayFrameTable and a frame right after the previous one extends its buffer
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @param2: <uint8_t> relay: Relay address
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _queueFrame( relayScheduler_t* scheduler, const uint8_t relay, const uint8_t state )
+{
+   const char* frame = relayFrame( relay, state );
+   vcpIovec_t* last = ( scheduler->batchLength > 0 ) ? &scheduler->batch[scheduler->batchLength - 1] : NULL;
+
+   if( last != NULL && (const char*)last->iov_base + last->iov_len == frame )
+   {
+      last->iov_len += RELAY_FRAME_LENGTH;
+   }
+   else
+   {
+      if( scheduler->batchLength == (int)( sizeof( scheduler->batch ) / sizeof( scheduler->batch[0] ) ) )
+      {
+         _flush( scheduler );
+      }
+      scheduler->batch[scheduler->batchLength].iov_base = (void*)frame;
+      scheduler->batch[scheduler->batchLength].iov_len = RELAY_FRAME_LENGTH;
+      scheduler->batchLength++;
+   }
+   if( scheduler->shadow != NULL )
+   {
+      setRelayShadow( scheduler->shadow, relay, state );
+   }
+}
+// END f_queueFrame( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_flush( .. )
+ * @brief:  Function to send the current batch, or to hand it to the writer without waiting for the port
+ * @param1: <relayScheduler_t*> scheduler: The scheduler
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _flush( relayScheduler_t* scheduler )
+{
+   if( scheduler->batchLength == 0 )
+   {
+      return;
+   }
+#ifndef _WIN32
+   if( scheduler->writer != NULL )
+   {
+      if( !queueSerialWriter( scheduler->writer, scheduler->batch, scheduler->batchLength, scheduler->runNowNs ) ||
+          !runSerialWriter( scheduler->writer, scheduler->runNowNs ) )
+      {
+         scheduler->writeError = true;
+      }
+      scheduler->batchLength = 0;
+      return;
+   }
+#endif
+   if( !sendFramesVCP( scheduler->vcp, scheduler->batch, scheduler->batchLength ) )
+   {
+      scheduler->writeError = true;
+   }
+   scheduler->batchLength = 0;
+}
+// END f_flush( .. ) ...
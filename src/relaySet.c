@@ -0,0 +1,395 @@
+/***********************************************************************************************************************
+ * relaySet.c
+ * @brief:  Fixed size set of relays of a RS485 chain, one bit per relay (bit n is relay n)
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stddef.h>  // NULL
+#include <ctype.h>   // isdigit()
+#include "relaySet.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _WORD( relay )        ( ( relay ) / 64 )
+#define _BIT( relay )         ( 1ULL << ( ( relay ) % 64 ) )
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static int         _parse( const char* argument, relaySet_t* sets, const uint8_t numOfBuses, const char** error );
+static const char* _parseNumber( const char* argument, uint32_t* number );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_clearRelaySet( relaySet_t* set )                                                                     //
+//   void      f_addRelaySet( relaySet_t* set, uint8_t relay )                                                        //
+//   void      f_removeRelaySet( relaySet_t* set, uint8_t relay )                                                     //
+//   void      f_addRangeRelaySet( relaySet_t* set, uint8_t first, uint8_t last )                                     //
+//   void      f_unionRelaySet( relaySet_t* set, const relaySet_t* other )                                            //
+//   void      f_subtractRelaySet( relaySet_t* set, const relaySet_t* other )                                         //
+//   bool      f_containsRelaySet( const relaySet_t* set, uint8_t relay )                                             //
+//   bool      f_isEmptyRelaySet( const relaySet_t* set )                                                             //
+//   uint8_t   f_countRelaySet( const relaySet_t* set )                                                               //
+//   uint8_t   f_firstRelaySet( const relaySet_t* set )                                                               //
+//   uint8_t   f_nextRelaySet( const relaySet_t* set, uint8_t relay )                                                 //
+//   int       f_parseRelaySet( const char* argument, relaySet_t* set, const char** error )                           //
+//   int       f_parseRelayBusSet( const char* argument, relayBusSet_t* set, uint8_t numOfBuses, .. )                 //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_clearRelaySet( .. )
+ * @brief:  Function to empty a set
+ * @param1: <relaySet_t*> set: The set
+ * @return: <void> None
+ **********************************************************************************************************************/
+void clearRelaySet( relaySet_t* set )
+{
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      set->bits[word] = 0;
+   }
+}
+// END f_clearRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_addRelaySet( .. )
+ * @brief:  Function to add a relay to a set
+ * @param1: <relaySet_t*> set: The set
+ * @param2: <uint8_t> relay: Relay address, MIN_RELAY_NUMBER..MAX_RELAYS_IN_RS485_CHAIN
+ * @return: <void> None
+ **********************************************************************************************************************/
+void addRelaySet( relaySet_t* set, const uint8_t relay )
+{
+   set->bits[_WORD( relay )] |= _BIT( relay );
+}
+// END f_addRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_removeRelaySet( .. )
+ * @brief:  Function to take a relay out of a set
+ * @param1: <relaySet_t*> set: The set
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <void> None
+ **********************************************************************************************************************/
+void removeRelaySet( relaySet_t* set, const uint8_t relay )
+{
+   set->bits[_WORD( relay )] &= ~_BIT( relay );
+}
+// END f_removeRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_addRangeRelaySet( .. )
+ * @brief:  Function to add every relay from first to last (both included) with one mask per word
+ * @param1: <relaySet_t*> set: The set
+ * @param2: <uint8_t> first: First relay of the range
+ * @param3: <uint8_t> last: Last relay of the range, >= first
+ * @return: <void> None
+ **********************************************************************************************************************/
+void addRangeRelaySet( relaySet_t* set, const uint8_t first, const uint8_t last )
+{
+   for( int word = _WORD( first ); word <= _WORD( last ); word++ )
+   {
+      uint64_t mask = ~0ULL;
+      if( word == _WORD( first ) )
+      {
+         mask &= ~0ULL << ( first % 64 );
+      }
+      if( word == _WORD( last ) )
+      {
+         mask &= ~0ULL >> ( 63 - ( last % 64 ) );
+      }
+      set->bits[word] |= mask;
+   }
+}
+// END f_addRangeRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_unionRelaySet( .. )
+ * @brief:  Function to add every relay of another set
+ * @param1: <relaySet_t*> set: The set to update
+ * @param2: <const relaySet_t*> other: Relays to add
+ * @return: <void> None
+ **********************************************************************************************************************/
+void unionRelaySet( relaySet_t* set, const relaySet_t* other )
+{
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      set->bits[word] |= other->bits[word];
+   }
+}
+// END f_unionRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_subtractRelaySet( .. )
+ * @brief:  Function to remove every relay of another set
+ * @param1: <relaySet_t*> set: The set to update
+ * @param2: <const relaySet_t*> other: Relays to remove
+ * @return: <void> None
+ **********************************************************************************************************************/
+void subtractRelaySet( relaySet_t* set, const relaySet_t* other )
+{
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      set->bits[word] &= ~other->bits[word];
+   }
+}
+// END f_subtractRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_containsRelaySet( .. )
+ * @brief:  Function to know if a relay is in a set
+ * @param1: <const relaySet_t*> set: The set
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <bool> TRUE if it is in the set
+ **********************************************************************************************************************/
+bool containsRelaySet( const relaySet_t* set, const uint8_t relay )
+{
+   return ( relay < RELAY_SET_WORDS * 64 ) && ( set->bits[_WORD( relay )] & _BIT( relay ) ) != 0;
+}
+// END f_containsRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isEmptyRelaySet( .. )
+ * @brief:  Function to know if a set has no relays
+ * @param1: <const relaySet_t*> set: The set
+ * @return: <bool> TRUE if it is empty
+ **********************************************************************************************************************/
+bool isEmptyRelaySet( const relaySet_t* set )
+{
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      if( set->bits[word] != 0 )
+      {
+         return false;
+      }
+   }
+   return true;
+}
+// END f_isEmptyRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_countRelaySet( .. )
+ * @brief:  Function to count the relays of a set
+ * @param1: <const relaySet_t*> set: The set
+ * @return: <uint8_t> Number of relays
+ **********************************************************************************************************************/
+uint8_t countRelaySet( const relaySet_t* set )
+{
+   uint8_t count = 0;
+
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      count += (uint8_t)__builtin_popcountll( set->bits[word] );
+   }
+   return count;
+}
+// END f_countRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_firstRelaySet( .. )
+ * @brief:  Function to get the lowest relay of a set
+ * @param1: <const relaySet_t*> set: The set
+ * @return: <uint8_t> The relay, RELAY_SET_END if the set is empty
+ **********************************************************************************************************************/
+uint8_t firstRelaySet( const relaySet_t* set )
+{
+   return nextRelaySet( set, 0 );
+}
+// END f_firstRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nextRelaySet( .. )
+ * @brief:  Function to get the lowest relay of a set bigger than a given one
+ * @param1: <const relaySet_t*> set: The set
+ * @param2: <uint8_t> relay: Previous relay
+ * @return: <uint8_t> The relay, RELAY_SET_END if there are no more
+ **********************************************************************************************************************/
+uint8_t nextRelaySet( const relaySet_t* set, const uint8_t relay )
+{
+   unsigned from = (unsigned)relay + 1;
+
+   for( unsigned word = from / 64; word < RELAY_SET_WORDS; word++ )
+   {
+      uint64_t bits = set->bits[word];
+      if( word == from / 64 )
+      {
+         bits &= ~0ULL << ( from % 64 );
+      }
+      if( bits != 0 )
+      {
+         return (uint8_t)( word * 64 + (unsigned)__builtin_ctzll( bits ) );
+      }
+   }
+   return RELAY_SET_END;
+}
+// END f_nextRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseRelaySet( .. )
+ * @brief:  Function to parse a relay argument in a single pass: single relays and ranges, ',' separated, in any
+ *          combination (Ex. "2", "4:10", "2,7,11", "1:8,12,40:48"). Repeated relays are only counted once
+ * @param1: <const char*> argument: The relays argument
+ * @param2: <relaySet_t*> set: Set to fill (cleared first)
+ * @param3: <const char**> error: If not NULL, set to the reason when the argument is not valid
+ * @return: <int> Number of relays in the set, -1 if the argument is not valid
+ **********************************************************************************************************************/
+int parseRelaySet( const char* argument, relaySet_t* set, const char** error )
+{
+   return _parse( argument, set, 1, error );
+}
+// END f_parseRelaySet( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseRelayBusSet( .. )
+ * @brief:  Function to parse a relay argument spanning several RS485 chains. Same syntax than parseRelaySet(), a
+ *          "bus/" prefix selects the chain of that item and the ones after it (Ex. "1:8,2/1:4,7" = relays 1..8 of
+ *          bus 0, 1..4 and 7 of bus 2). Items without prefix before the first one belong to bus 0
+ * @param1: <const char*> argument: The relays argument
+ * @param2: <relayBusSet_t*> set: Sets to fill (all of them cleared first)
+ * @param3: <uint8_t> numOfBuses: Number of chains available, bus numbers go from 0 to numOfBuses - 1
+ * @param4: <const char**> error: If not NULL, set to the reason when the argument is not valid
+ * @return: <int> Number of relays in all the sets, -1 if the argument is not valid
+ **********************************************************************************************************************/
+int parseRelayBusSet( const char* argument, relayBusSet_t* set, const uint8_t numOfBuses, const char** error )
+{
+   for( int bus = 0; bus < MAX_RS485_BUSES; bus++ )
+   {
+      clearRelaySet( &set->buses[bus] );
+   }
+   return _parse( argument, set->buses, ( numOfBuses < MAX_RS485_BUSES ) ? numOfBuses : MAX_RS485_BUSES, error );
+}
+// END f_parseRelayBusSet( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_parse( .. )
+ * @brief:  Function to parse a relay argument in a single pass into one set per bus
+ * @param1: <const char*> argument: The relays argument
+ * @param2: <relaySet_t*> sets: Array of numOfBuses sets to fill (cleared first)
+ * @param3: <uint8_t> numOfBuses: Number of sets, a "bus/" prefix is only valid below it
+ * @param4: <const char**> error: If not NULL, set to the reason when the argument is not valid
+ * @return: <int> Number of relays in all the sets, -1 if the argument is not valid
+ **********************************************************************************************************************/
+static int _parse( const char* argument, relaySet_t* sets, const uint8_t numOfBuses, const char** error )
+{
+   const char* reason = NULL;
+   uint8_t     bus = 0;
+   int         count = 0;
+
+   for( uint8_t i = 0; i < numOfBuses; i++ )
+   {
+      clearRelaySet( &sets[i] );
+   }
+   if( *argument == '\0' )
+   {
+      reason = "A relay argument can not be empty";
+   }
+   while( reason == NULL && *argument != '\0' )
+   {
+      uint32_t first, last;
+      if( ( argument = _parseNumber( argument, &first ) ) == NULL )
+      {
+         reason = "Relays are numbers, ranges 'n:n' and groups ',' separated";
+         break;
+      }
+      if( *argument == RELAY_BUS_SEPARATOR )
+      {
+         if( first >= numOfBuses )
+         {
+            reason = "Bus number out of the buses available";
+            break;
+         }
+         bus = (uint8_t)first;
+         if( ( argument = _parseNumber( argument + 1, &first ) ) == NULL )
+         {
+            reason = "A bus number must be followed by its relays ( bus/relays )";
+            break;
+         }
+      }
+      last = first;
+      if( *argument == ':' && ( argument = _parseNumber( argument + 1, &last ) ) == NULL )
+      {
+         reason = "A range of relays must be composed of two numbers begin and end";
+         break;
+      }
+      if( first < MIN_RELAY_NUMBER || last > MAX_RELAYS_IN_RS485_CHAIN )
+      {
+         reason = "Relay number out of the valid range";
+         break;
+      }
+      if( last < first )
+      {
+         reason = "Wrong range order, final relay number must be higher than beginner relay";
+         break;
+      }
+      addRangeRelaySet( &sets[bus], (uint8_t)first, (uint8_t)last );
+      if( *argument == ',' )
+      {
+         argument++;
+         if( *argument == '\0' )
+         {
+            reason = "A group of relays can not end with ','";
+         }
+      }
+      else if( *argument != '\0' )
+      {
+         reason = "Relays are numbers, ranges 'n:n' and groups ',' separated";
+      }
+   }
+
+   for( uint8_t i = 0; reason == NULL && i < numOfBuses; i++ )
+   {
+      count += countRelaySet( &sets[i] );
+   }
+   if( error != NULL )
+   {
+      *error = reason;
+   }
+   return ( reason == NULL ) ? count : -1;
+}
+// END f_parse( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseNumber( .. )
+ * @brief:  Function to parse a decimal number made only of digits
+ * @param1: <const char*> argument: Where the number begins
+ * @param2: <uint32_t*> number: Value found (saturated, so overflows are caught by the range check)
+ * @return: <const char*> First character after the number, NULL if there was no digit
+ **********************************************************************************************************************/
+static const char* _parseNumber( const char* argument, uint32_t* number )
+{
+   if( !isdigit( (unsigned char)*argument ) )
+   {
+      return NULL;
+   }
+   *number = 0;
+   while( isdigit( (unsigned char)*argument ) )
+   {
+      *number = 10 * *number + (uint32_t)( *argument - '0' );
+      if( *number > 0xffff )
+      {
+         *number = 0xffff;
+      }
+      argument++;
+   }
+   return argument;
+}
+// END f_parseNumber( .. ) ...
@@ -0,0 +1,146 @@
+/***********************************************************************************************************************
+ * relayShadow.c
+ * @brief:  Shadow copy of the last state commanded to every relay of the chain, one bit per relay
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include "relayFrame.h"
+#include "relayShadow.h"
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_initRelayShadow( relayShadow_t* shadow )                                                             //
+//   void      f_setRelayShadow( relayShadow_t* shadow, uint8_t relay, uint8_t state )                                //
+//   void      f_applyRelayShadow( relayShadow_t* shadow, const relaySet_t* relays, uint8_t state )                   //
+//   bool      f_isKnownRelayShadow( const relayShadow_t* shadow, uint8_t relay )                                     //
+//   bool      f_isOnRelayShadow( const relayShadow_t* shadow, uint8_t relay )                                        //
+//   bool      f_changesRelayShadow( const relayShadow_t* shadow, uint8_t relay, uint8_t state )                      //
+//   void      f_filterRelayShadow( const relayShadow_t* shadow, const relaySet_t* relays, uint8_t state, .. )        //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initRelayShadow( .. )
+ * @brief:  Function to forget every state. The next command of every relay will be sent
+ * @param1: <relayShadow_t*> shadow: The shadow
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initRelayShadow( relayShadow_t* shadow )
+{
+   clearRelaySet( &shadow->on );
+   clearRelaySet( &shadow->known );
+}
+// END f_initRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setRelayShadow( .. )
+ * @brief:  Function to remember the state sent to a relay
+ * @param1: <relayShadow_t*> shadow: The shadow
+ * @param2: <uint8_t> relay: Relay address
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+void setRelayShadow( relayShadow_t* shadow, const uint8_t relay, const uint8_t state )
+{
+   addRelaySet( &shadow->known, relay );
+   if( state == RELAY_FRAME_ON )
+   {
+      addRelaySet( &shadow->on, relay );
+   }
+   else
+   {
+      removeRelaySet( &shadow->on, relay );
+   }
+}
+// END f_setRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_applyRelayShadow( .. )
+ * @brief:  Function to remember the state sent to a set of relays
+ * @param1: <relayShadow_t*> shadow: The shadow
+ * @param2: <const relaySet_t*> relays: Relays
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <void> None
+ **********************************************************************************************************************/
+void applyRelayShadow( relayShadow_t* shadow, const relaySet_t* relays, const uint8_t state )
+{
+   unionRelaySet( &shadow->known, relays );
+   if( state == RELAY_FRAME_ON )
+   {
+      unionRelaySet( &shadow->on, relays );
+   }
+   else
+   {
+      subtractRelaySet( &shadow->on, relays );
+   }
+}
+// END f_applyRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isKnownRelayShadow( .. )
+ * @brief:  Function to know if a relay has been commanded at least once
+ * @param1: <const relayShadow_t*> shadow: The shadow
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <bool> TRUE if its state is known
+ **********************************************************************************************************************/
+bool isKnownRelayShadow( const relayShadow_t* shadow, const uint8_t relay )
+{
+   return containsRelaySet( &shadow->known, relay );
+}
+// END f_isKnownRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isOnRelayShadow( .. )
+ * @brief:  Function to know the last state commanded to a relay
+ * @param1: <const relayShadow_t*> shadow: The shadow
+ * @param2: <uint8_t> relay: Relay address
+ * @return: <bool> TRUE if it was switched ON
+ **********************************************************************************************************************/
+bool isOnRelayShadow( const relayShadow_t* shadow, const uint8_t relay )
+{
+   return containsRelaySet( &shadow->on, relay );
+}
+// END f_isOnRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_changesRelayShadow( .. )
+ * @brief:  Function to know if sending a state to a relay would change it
+ * @param1: <const relayShadow_t*> shadow: The shadow
+ * @param2: <uint8_t> relay: Relay address
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @return: <bool> TRUE if the relay state is unknown or different
+ **********************************************************************************************************************/
+bool changesRelayShadow( const relayShadow_t* shadow, const uint8_t relay, const uint8_t state )
+{
+   return !isKnownRelayShadow( shadow, relay ) || ( isOnRelayShadow( shadow, relay ) != ( state == RELAY_FRAME_ON ) );
+}
+// END f_changesRelayShadow( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_filterRelayShadow( .. )
+ * @brief:  Function to keep only the relays whose state would change (unknown or different), word by word
+ * @param1: <const relayShadow_t*> shadow: The shadow
+ * @param2: <const relaySet_t*> relays: Relays to command
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF
+ * @param4: <relaySet_t*> changedRelays: Relays that need a frame, may be the same set than relays
+ * @return: <void> None
+ **********************************************************************************************************************/
+void filterRelayShadow( const relayShadow_t* shadow, const relaySet_t* relays, const uint8_t state,
+                        relaySet_t* changedRelays )
+{
+   for( int word = 0; word < RELAY_SET_WORDS; word++ )
+   {
+      uint64_t differs = ( state == RELAY_FRAME_ON ) ? ~shadow->on.bits[word] : shadow->on.bits[word];
+      changedRelays->bits[word] = relays->bits[word] & ( ~shadow->known.bits[word] | differs );
+   }
+}
+// END f_filterRelayShadow( .. ) ...
@@ -0,0 +1,108 @@
+/***********************************************************************************************************************
+ * relayStatus.c
+ * @brief:  Read back of the real state of the relays
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include "pulseTimer.h"
+#include "relayFrame.h"
+#include "relayStatus.h"
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_readRelayStatus( const vcp_t* vcp, uint8_t board, uint8_t* mask, uint64_t backlogNs )                //
+//   int       f_checkRelayStatus( const vcp_t* vcp, const relaySet_t* relays, uint8_t state, relaySet_t* wrong, .. ) //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_readRelayStatus( .. )
+ * @brief:  Function to ask a board for the state of its relays
+ * @param1: <const vcp_t*> vcp: The Virtual COM port, open
+ * @param2: <uint8_t> board: Board of the chain, 1 to MAX_BOARDS_IN_RS485_CHAIN
+ * @param3: <uint8_t*> mask: Where to store the states, bit n set = relay n+1 of the board ON
+ * @param4: <uint64_t> backlogNs: Time the bytes already written still need on the wire, the request waits behind them
+ * @return: <bool> TRUE if the board answered
+ **********************************************************************************************************************/
+bool readRelayStatus( const vcp_t* vcp, const uint8_t board, uint8_t* mask, const uint64_t backlogNs )
+{
+   char request[RELAY_FRAME_LENGTH];
+   char reply[RELAY_STATUS_LENGTH];
+
+   // Bytes left by an earlier reply would be taken as the start of this one
+   while( readVCP( vcp, reply, sizeof( reply ), 0 ) > 0 )
+   {
+   }
+   buildRelayStatusFrame( request, board );
+   if( !sendFrameVCP( vcp, request, sizeof( request ) ) )
+   {
+      return false;
+   }
+   uint32_t timeoutMs = (uint32_t)( ( backlogNs + wireTimeVCP( vcp, sizeof( request ) + sizeof( reply ) ) ) /
+                                    NS_PER_MS ) + RELAY_STATUS_TURNAROUND_MS;
+   if( readVCP( vcp, reply, sizeof( reply ), timeoutMs ) != (int)sizeof( reply ) || !isRelayStatusReply( reply ) )
+   {
+      return false;
+   }
+   *mask = 0;
+   for( int i = 0; i < RELAY_STATUS_LENGTH; i++ )
+   {
+      if( reply[i] == RELAY_FRAME_ON )
+      {
+         *mask |= (uint8_t)( 1u << i );
+      }
+   }
+   return true;
+}
+// END f_readRelayStatus( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_checkRelayStatus( .. )
+ * @brief:  Function to find the relays of a set that are not in a state. Every board with relays in the set is asked
+ *          once. Relays of a board that does not answer are taken as wrong
+ * @param1: <const vcp_t*> vcp: The Virtual COM port, open
+ * @param2: <const relaySet_t*> relays: Relays to check
+ * @param3: <uint8_t> state: RELAY_FRAME_ON or RELAY_FRAME_OFF, state they should be in
+ * @param4: <relaySet_t*> wrong: Where to store the relays that are not in that state
+ * @param5: <uint64_t> backlogNs: Time the bytes already written still need on the wire
+ * @return: <int> Number of relays in the wrong state, -1 if a board did not answer
+ **********************************************************************************************************************/
+int checkRelayStatus( const vcp_t* vcp, const relaySet_t* relays, const uint8_t state, relaySet_t* wrong,
+                      const uint64_t backlogNs )
+{
+   int      numOfWrong = 0;
+   bool     answered = false;
+   uint8_t  board = 0;
+   uint8_t  mask = 0;
+   uint64_t waitNs = backlogNs;
+
+   clearRelaySet( wrong );
+   FOR_EACH_RELAY_SET( relay, relays )
+   {
+      if( RELAY_STATUS_BOARD( relay ) != board )
+      {
+         board = RELAY_STATUS_BOARD( relay );
+         answered = readRelayStatus( vcp, board, &mask, waitNs );
+         waitNs = 0;                 // Only the first request waits behind the frames written before
+         if( !answered )
+         {
+            numOfWrong = -1;
+         }
+      }
+      bool isOn = ( ( mask >> RELAY_STATUS_BIT( relay ) ) & 1u ) != 0;
+      if( !answered || isOn != ( state == RELAY_FRAME_ON ) )
+      {
+         addRelaySet( wrong, relay );
+         if( numOfWrong >= 0 )
+         {
+            numOfWrong++;
+         }
+      }
+   }
+   return numOfWrong;
+}
+// END f_checkRelayStatus( .. ) ...
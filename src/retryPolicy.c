@@ -0,0 +1,209 @@
+/***********************************************************************************************************************
+ * retryPolicy.c
+ * @brief:  Exponential backoff with jitter and a deadline for the operations on the port
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdlib.h>  // strtoul()
+#include <stdint.h>  // uint32_t, uint64_t, uintptr_t
+#include "main.h"
+#include "pulseTimer.h"
+#include "retryPolicy.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _MAX_FIELDS           5     // tries, firstMs, maxMs, deadlineMs, jitter%
+
+
+/* Private variables -------------------------------------------------------------------------------------------------*/
+static _Thread_local uint64_t _seed = 0;   // xorshift64 state of every thread, 0 until its first wait
+
+static const char* const _outcomeNames[NUM_OF_RETRY_OUTCOMES] =
+   { "succeeded", "recovered", "out of tries", "deadline" };
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static uint64_t _random( void );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void           f_startRetry( retry_t* retry, const retryPolicy_t* policy )                                       //
+//   bool           f_waitRetry( retry_t* retry )                                                                     //
+//   retryOutcome_t f_endRetry( retry_t* retry, bool succeeded )                                                      //
+//   const char*    f_nameRetryOutcome( retryOutcome_t outcome )                                                      //
+//   bool           f_parseRetryPolicy( const char* text, retryPolicy_t* policy )                                     //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_startRetry( .. )
+ * @brief:  Function to start an operation, call it right before its first try
+ * @param1: <retry_t*> retry: The operation
+ * @param2: <const retryPolicy_t*> policy: How it is retried, must outlive the operation
+ * @return: <void> None
+ **********************************************************************************************************************/
+void startRetry( retry_t* retry, const retryPolicy_t* policy )
+{
+   retry->policy = policy;
+   retry->tries = 0;
+   retry->startNs = nowPulseTimer();
+   retry->delayNs = (uint64_t)policy->firstDelayMs * NS_PER_MS;
+   retry->outcome = RETRY_SUCCEEDED;
+}
+// END f_startRetry( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_waitRetry( .. )
+ * @brief:  Function to call after every failed try. It waits before the next one, never beyond the deadline (the last
+ *          try is done right at it)
+ * @param1: <retry_t*> retry: The operation
+ * @return: <bool> TRUE if it has to be tried again, FALSE if it is over (retry->outcome tells why)
+ **********************************************************************************************************************/
+bool waitRetry( retry_t* retry )
+{
+   const retryPolicy_t* policy = retry->policy;
+   uint64_t             now = nowPulseTimer();
+   uint64_t             waitNs = retry->delayNs;
+
+   retry->tries++;
+   if( policy->maxTries > 0 && retry->tries >= policy->maxTries )
+   {
+      retry->outcome = RETRY_OUT_OF_TRIES;
+      return false;
+   }
+   if( policy->deadlineMs > 0 )
+   {
+      uint64_t deadline = retry->startNs + (uint64_t)policy->deadlineMs * NS_PER_MS;
+      if( now >= deadline )
+      {
+         retry->outcome = RETRY_DEADLINE;
+         return false;
+      }
+      if( waitNs > deadline - now )
+      {
+         waitNs = deadline - now;
+      }
+   }
+
+   // Remove a random part of the wait so processes that failed together do not try again together
+   uint64_t jitterNs = waitNs * ( ( policy->jitterPercent > 100 ) ? 100 : policy->jitterPercent ) / 100;
+   if( jitterNs > 0 )
+   {
+      waitNs -= _random() % ( jitterNs + 1 );
+   }
+   sleepUntilPulseTimer( now + waitNs );
+
+   retry->delayNs *= 2;
+   if( retry->delayNs > (uint64_t)policy->maxDelayMs * NS_PER_MS )
+   {
+      retry->delayNs = (uint64_t)policy->maxDelayMs * NS_PER_MS;
+   }
+   return true;
+}
+// END f_waitRetry( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_endRetry( .. )
+ * @brief:  Function to close an operation
+ * @param1: <retry_t*> retry: The operation
+ * @param2: <bool> succeeded: TRUE if the last try succeeded
+ * @return: <retryOutcome_t> How it ended
+ **********************************************************************************************************************/
+retryOutcome_t endRetry( retry_t* retry, const bool succeeded )
+{
+   if( succeeded )
+   {
+      retry->outcome = ( retry->tries == 0 ) ? RETRY_SUCCEEDED : RETRY_RECOVERED;
+   }
+   return retry->outcome;
+}
+// END f_endRetry( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nameRetryOutcome( .. )
+ * @brief:  Function to get the text of an outcome, for the logs
+ * @param1: <retryOutcome_t> outcome: The outcome
+ * @return: <const char*> Its name
+ **********************************************************************************************************************/
+const char* nameRetryOutcome( const retryOutcome_t outcome )
+{
+   return ( outcome < NUM_OF_RETRY_OUTCOMES ) ? _outcomeNames[outcome] : "unknown";
+}
+// END f_nameRetryOutcome( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_parseRetryPolicy( .. )
+ * @brief:  Function to parse "tries[:firstMs[:maxMs[:deadlineMs[:jitter%]]]]", the fields not given keep the value
+ *          they had in policy. Ex: "10", "0:5:100:500", "30:10:250:3000:25"
+ * @param1: <const char*> text: The argument
+ * @param2: <retryPolicy_t*> policy: Policy to update, left untouched if text is not valid
+ * @return: <bool> TRUE if text is valid
+ **********************************************************************************************************************/
+bool parseRetryPolicy( const char* text, retryPolicy_t* policy )
+{
+   retryPolicy_t parsed = *policy;
+   uint32_t*     fields[_MAX_FIELDS] = { &parsed.maxTries, &parsed.firstDelayMs, &parsed.maxDelayMs,
+                                         &parsed.deadlineMs, &parsed.jitterPercent };
+   const char*   cursor = text;
+
+   for( int field = 0; field < _MAX_FIELDS; field++ )
+   {
+      char*         end;
+      unsigned long value = strtoul( cursor, &end, 10 );
+      if( end == cursor || *cursor == '-' || value > UINT32_MAX )
+      {
+         return false;
+      }
+      *fields[field] = (uint32_t)value;
+      if( *end == '\0' )
+      {
+         if( parsed.jitterPercent > 100 || parsed.maxDelayMs < parsed.firstDelayMs ||
+             ( parsed.maxTries == 0 && parsed.deadlineMs == 0 ) )
+         {
+            return false;              // Out of range, or retried forever
+         }
+         *policy = parsed;
+         return true;
+      }
+      if( *end != RETRY_POLICY_SEPARATOR )
+      {
+         return false;
+      }
+      cursor = end + 1;
+   }
+   return false;                       // Too many fields
+}
+// END f_parseRetryPolicy( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   uint64_t  f_random( void )                                                                                       //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_random( .. )
+ * @brief:  xorshift64, seeded with the clock and the stack address so two processes started together differ
+ * @return: <uint64_t> Pseudo random number
+ **********************************************************************************************************************/
+static uint64_t _random( void )
+{
+   if( _seed == 0 )
+   {
+      uint64_t stack = 0;
+      _seed = ( nowPulseTimer() ^ ( (uint64_t)(uintptr_t)&stack << 16 ) ) | 1;
+   }
+   _seed ^= _seed << 13;
+   _seed ^= _seed >> 7;
+   _seed ^= _seed << 17;
+   return _seed;
+}
+// END f_random( .. ) ...
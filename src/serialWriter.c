@@ -0,0 +1,544 @@
+/***********************************************************************************************************************
+ * serialWriter.c
+ * @brief:  Non blocking writer for a Virtual COM port, driven from a poll() loop (POSIX only)
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <string.h>  // strerror()
+#include <stdint.h>  // SIZE_MAX
+#include <errno.h>   // errno, EINTR, EAGAIN, EWOULDBLOCK
+#include <poll.h>    // poll()
+#include <sys/uio.h> // writev()
+#include "main.h"
+#include "pulseTimer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "relayFrame.h"
+#include "frameTrace.h"
+#include "serialWriter.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _QUEUE_MASK           ( SERIAL_WRITER_QUEUE_LENGTH - 1 )
+
+#if ( SERIAL_WRITER_QUEUE_LENGTH & _QUEUE_MASK ) != 0
+   #error "SERIAL_WRITER_QUEUE_LENGTH must be a power of two"
+#endif
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void     _dropQueue( serialWriter_t* writer );
+static uint64_t _stuckTime( const serialWriter_t* writer );
+static size_t   _roomInFlight( const serialWriter_t* writer, const uint64_t nowNs, uint64_t* refillNs );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   bool      f_initSerialWriter( serialWriter_t* writer, vcp_t* vcp, uint64_t stuckNs, uint64_t inFlightNs )        //
+//   bool      f_queueSerialWriter( serialWriter_t* writer, const vcpIovec_t* frames, int numOfFrames, .. )           //
+//   bool      f_preemptSerialWriter( serialWriter_t* writer, const vcpIovec_t* frames, int numOfFrames, .. )         //
+//   bool      f_runSerialWriter( serialWriter_t* writer, uint64_t nowNs )                                            //
+//   bool      f_isPendingSerialWriter( const serialWriter_t* writer )                                                //
+//   bool      f_isReadySerialWriter( const serialWriter_t* writer, uint64_t nowNs )                                  //
+//   uint64_t  f_nextSerialWriter( const serialWriter_t* writer )                                                     //
+//   uint64_t  f_wireBacklogSerialWriter( const serialWriter_t* writer, uint64_t nowNs )                              //
+//   bool      f_drainSerialWriters( serialWriter_t* writers, int numOfWriters, uint64_t deadlineNs )                 //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initSerialWriter( .. )
+ * @brief:  Function to set up an empty writer and switch the port to non blocking writes
+ * @param1: <serialWriter_t*> writer: The writer
+ * @param2: <vcp_t*> vcp: Port to write to, already open
+ * @param3: <uint64_t> stuckNs: Max time the port may take no byte before the queue is dropped
+ * @param4: <uint64_t> inFlightNs: Max wire time handed to the UART ahead of the line (at least one frame), or
+ *          SERIAL_WRITER_NOT_PACED to hand it all it takes
+ * @return: <bool> TRUE if success FALSE if the port can not do non blocking writes
+ **********************************************************************************************************************/
+bool initSerialWriter( serialWriter_t* writer, vcp_t* vcp, const uint64_t stuckNs, const uint64_t inFlightNs )
+{
+   writer->vcp = vcp;
+   writer->head = 0;
+   writer->tail = 0;
+   writer->urgentEnd = 0;
+   writer->frameOffset = 0;
+   writer->pendingBytes = 0;
+   writer->stuckNs = stuckNs;
+   writer->inFlightNs = inFlightNs;
+   writer->progressNs = 0;
+   writer->wireIdleNs = 0;
+   writer->rejected = 0;
+   writer->timeouts = 0;
+   writer->canceled = 0;
+   writer->blocked = false;
+   writer->writeError = false;
+   writer->lostFrames = false;
+   return setNonBlockingVCP( vcp, true );
+}
+// END f_initSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_queueSerialWriter( .. )
+ * @brief:  Function to queue a batch of buffers, all of them or none. A buffer right after the last one queued
+ *          extends it (unless that one is urgent). Nothing is written here, call runSerialWriter()
+ * @param1: <serialWriter_t*> writer: The writer
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order. Must stay valid until written
+ * @param3: <int> numOfFrames: Number of buffers
+ * @param4: <uint64_t> nowNs: Current time
+ * @return: <bool> TRUE if queued, FALSE if there is no room for the whole batch
+ **********************************************************************************************************************/
+bool queueSerialWriter( serialWriter_t* writer, const vcpIovec_t* frames, const int numOfFrames, const uint64_t nowNs )
+{
+   if( (uint32_t)numOfFrames > SERIAL_WRITER_QUEUE_LENGTH - ( writer->tail - writer->head ) )
+   {
+      writer->rejected++;
+      return false;
+   }
+   if( writer->head == writer->tail )
+   {
+      writer->progressNs = nowNs;       // The stuck timer starts when the queue stops being empty
+   }
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      vcpIovec_t* last = &writer->queue[( writer->tail - 1 ) & _QUEUE_MASK];
+      if( writer->tail != writer->head && writer->tail != writer->urgentEnd &&
+          (const char*)last->iov_base + last->iov_len == (const char*)frames[i].iov_base )
+      {
+         last->iov_len += frames[i].iov_len;
+      }
+      else
+      {
+         writer->queue[writer->tail & _QUEUE_MASK] = frames[i];
+         writer->tail++;
+      }
+      writer->pendingBytes += frames[i].iov_len;
+   }
+   return true;
+}
+// END f_queueSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_preemptSerialWriter( .. )
+ * @brief:  Function to queue an urgent batch ahead of everything waiting: right after the urgent batches queued before
+ *          it, or after the rest of the frame the UART is in the middle of. The ON frames of the relays of cancel
+ *          still waiting are removed, so they can not undo the batch. Nothing is written here, call runSerialWriter()
+ * @param1: <serialWriter_t*> writer: The writer
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order. Must stay valid until written
+ * @param3: <int> numOfFrames: Number of buffers
+ * @param4: <const relaySet_t*> cancel: Relays whose ON frames waiting are removed
+ * @param5: <uint64_t> nowNs: Current time
+ * @return: <bool> TRUE if queued, FALSE if the urgent batches already waiting leave no room for it. When the frames
+ *          split by the removal do not fit, the last ones waiting are dropped
+ **********************************************************************************************************************/
+bool preemptSerialWriter( serialWriter_t* writer, const vcpIovec_t* frames, const int numOfFrames,
+                          const relaySet_t* cancel, const uint64_t nowNs )
+{
+   vcpIovec_t rebuilt[SERIAL_WRITER_QUEUE_LENGTH];     // New queue from head, copied back at the end
+   int        numOfRebuilt = 0;
+   int        numOfUrgent = (int32_t)( writer->urgentEnd - writer->head );
+   uint32_t   next = writer->head;                     // First buffer waiting not in rebuilt[] yet
+   size_t     pendingBytes = 0;
+   size_t     droppedBytes = 0;
+
+   if( numOfUrgent < 0 || (uint32_t)numOfUrgent > writer->tail - writer->head )
+   {
+      numOfUrgent = 0;                                 // Stale, head passed it
+   }
+   if( numOfFrames < 0 || numOfUrgent + 1 + numOfFrames > SERIAL_WRITER_QUEUE_LENGTH )
+   {
+      writer->rejected++;
+      return false;
+   }
+   if( writer->head == writer->tail )
+   {
+      writer->progressNs = nowNs;       // The stuck timer starts when the queue stops being empty
+   }
+
+   // What can not be passed: the urgent batches before it, or the end of the frame the UART is in the middle of
+   while( numOfRebuilt < numOfUrgent )
+   {
+      rebuilt[numOfRebuilt++] = writer->queue[next++ & _QUEUE_MASK];
+   }
+   if( numOfUrgent == 0 && next != writer->tail && writer->frameOffset != 0 )
+   {
+      vcpIovec_t* buffer = &writer->queue[next & _QUEUE_MASK];
+      size_t      rest = RELAY_FRAME_LENGTH - writer->frameOffset;
+      rest = ( rest < buffer->iov_len ) ? rest : buffer->iov_len;
+      rebuilt[numOfRebuilt].iov_base = buffer->iov_base;
+      rebuilt[numOfRebuilt].iov_len = rest;
+      numOfRebuilt++;
+      buffer->iov_base = (char*)buffer->iov_base + rest;
+      buffer->iov_len -= rest;
+      if( buffer->iov_len == 0 )
+      {
+         next++;
+      }
+   }
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      rebuilt[numOfRebuilt++] = frames[i];
+   }
+   int urgentEnd = numOfRebuilt;
+
+   // Everything else, without the ON frames of the relays
+   for( ; next != writer->tail; next++ )
+   {
+      vcpIovec_t* buffer = &writer->queue[next & _QUEUE_MASK];
+      int         kept = filterRelayFrames( &rebuilt[numOfRebuilt], SERIAL_WRITER_QUEUE_LENGTH - numOfRebuilt,
+                                            buffer, 1, cancel, RELAY_FRAME_ON );
+      if( kept < 0 )
+      {
+         for( ; next != writer->tail; next++ )
+         {
+            droppedBytes += writer->queue[next & _QUEUE_MASK].iov_len;
+         }
+         break;
+      }
+      numOfRebuilt += kept;
+   }
+   if( droppedBytes > 0 )
+   {
+      LOG_PRINT( LOG_LEVEL_WARNING, "%s()::No room to split the frames of %s, %zu bytes dropped", __func__,
+                 writer->vcp->name, droppedBytes );
+      countMetrics( METRIC_WRITE_FAILURES );
+      writer->lostFrames = true;
+   }
+
+   for( int i = 0; i < numOfRebuilt; i++ )
+   {
+      writer->queue[( writer->head + (uint32_t)i ) & _QUEUE_MASK] = rebuilt[i];
+      pendingBytes += rebuilt[i].iov_len;
+   }
+   writer->canceled += (uint32_t)( ( writer->pendingBytes + lengthRelayFrames( frames, numOfFrames ) -
+                                     droppedBytes - pendingBytes ) / RELAY_FRAME_LENGTH );
+   writer->pendingBytes = pendingBytes;
+   writer->tail = writer->head + (uint32_t)numOfRebuilt;
+   writer->urgentEnd = writer->head + (uint32_t)urgentEnd;
+   return true;
+}
+// END f_preemptSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_runSerialWriter( .. )
+ * @brief:  Function to write as much of the queue as the port takes without blocking (and a paced writer lets it
+ *          take). Call it when the port is writable (POLLOUT) or at nextSerialWriter() time
+ * @param1: <serialWriter_t*> writer: The writer
+ * @param2: <uint64_t> nowNs: Current time
+ * @return: <bool> FALSE if the queue had to be dropped (write error or stuck port)
+ **********************************************************************************************************************/
+bool runSerialWriter( serialWriter_t* writer, const uint64_t nowNs )
+{
+   while( writer->head != writer->tail )
+   {
+      // Buffers up to the end of the ring, the ones after the wrap go in the next writev()
+      uint32_t first = writer->head & _QUEUE_MASK;
+      uint32_t count = writer->tail - writer->head;
+      if( count > SERIAL_WRITER_QUEUE_LENGTH - first )
+      {
+         count = SERIAL_WRITER_QUEUE_LENGTH - first;
+      }
+      if( count > VCP_MAX_IOVECS )
+      {
+         count = VCP_MAX_IOVECS;
+      }
+
+      // Paced: only the bytes the UART may still take, the rest waits here where it can be passed
+      const vcpIovec_t* buffers = &writer->queue[first];
+      vcpIovec_t        paced[VCP_MAX_IOVECS];
+      size_t            room = _roomInFlight( writer, nowNs, NULL );
+      if( room == 0 )
+      {
+         break;
+      }
+      if( room != SIZE_MAX )
+      {
+         uint32_t used = 0;
+         room += ( RELAY_FRAME_LENGTH - writer->frameOffset ) % RELAY_FRAME_LENGTH;   // Cut at a frame boundary
+         for( ; used < count && room > 0; used++ )
+         {
+            paced[used] = buffers[used];
+            paced[used].iov_len = ( paced[used].iov_len < room ) ? paced[used].iov_len : room;
+            room -= paced[used].iov_len;
+         }
+         buffers = paced;
+         count = used;
+      }
+
+      uint64_t startNs = nowPulseTimer();
+      ssize_t  bytesWritten = writev( writer->vcp->fd, buffers, (int)count );
+      if( bytesWritten < 0 )
+      {
+         if( errno == EINTR )
+         {
+            continue;
+         }
+         if( errno == EAGAIN || errno == EWOULDBLOCK )
+         {
+            writer->blocked = true;
+            break;
+         }
+         LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Error writing to %s (%s), %zu bytes dropped", __func__,
+                    writer->vcp->name, strerror( errno ), writer->pendingBytes );
+         writer->writeError = true;
+         countMetrics( METRIC_WRITE_FAILURES );
+         _dropQueue( writer );
+         return false;
+      }
+
+      recordMetrics( METRIC_WRITE, nowPulseTimer() - startNs );
+
+      // Pop the buffers fully written, trim the one cut by a partial write
+      TRACE_FRAMES( writer->vcp->bus, buffers, (int)count,
+                    ( RELAY_FRAME_LENGTH - writer->frameOffset ) % RELAY_FRAME_LENGTH, (size_t)bytesWritten );
+      writer->blocked = false;
+      writer->progressNs = nowNs;
+      writer->frameOffset = (uint32_t)( ( writer->frameOffset + (size_t)bytesWritten ) % RELAY_FRAME_LENGTH );
+      writer->wireIdleNs = ( ( writer->wireIdleNs > nowNs ) ? writer->wireIdleNs : nowNs ) +
+                           wireTimeVCP( writer->vcp, (size_t)bytesWritten );
+      writer->pendingBytes -= (size_t)bytesWritten;
+      size_t left = (size_t)bytesWritten;
+      while( left > 0 )
+      {
+         vcpIovec_t* buffer = &writer->queue[writer->head & _QUEUE_MASK];
+         if( left < buffer->iov_len )
+         {
+            buffer->iov_base = (char*)buffer->iov_base + left;
+            buffer->iov_len -= left;
+            break;
+         }
+         left -= buffer->iov_len;
+         writer->head++;
+      }
+   }
+
+   if( writer->head != writer->tail && nowNs >= _stuckTime( writer ) )
+   {
+      LOG_PRINT( LOG_LEVEL_ERROR, "%s()::%s took no byte for %.0f ms, %zu bytes dropped", __func__,
+                 writer->vcp->name, (double)writer->stuckNs / NS_PER_MS, writer->pendingBytes );
+      writer->timeouts++;
+      countMetrics( METRIC_WRITE_FAILURES );
+      _dropQueue( writer );
+      return false;
+   }
+   return true;
+}
+// END f_runSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isPendingSerialWriter( .. )
+ * @brief:  Function to know if there is something waiting, the port must then be polled for POLLOUT
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @return: <bool> TRUE if the queue is not empty
+ **********************************************************************************************************************/
+bool isPendingSerialWriter( const serialWriter_t* writer )
+{
+   return ( writer->head != writer->tail );
+}
+// END f_isPendingSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isReadySerialWriter( .. )
+ * @brief:  Function to know if the port must be polled for POLLOUT: something is waiting and, for a paced writer, the
+ *          UART may take more of it. Otherwise the poll() loop only has to wake up at nextSerialWriter()
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @param2: <uint64_t> nowNs: Current time
+ * @return: <bool> TRUE if the port must be polled
+ **********************************************************************************************************************/
+bool isReadySerialWriter( const serialWriter_t* writer, const uint64_t nowNs )
+{
+   return isPendingSerialWriter( writer ) && _roomInFlight( writer, nowNs, NULL ) > 0;
+}
+// END f_isReadySerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nextSerialWriter( .. )
+ * @brief:  Function to know when the poll() loop has to wake up for the writer: a paced writer waiting for the UART
+ *          to have room again, or the queue being considered stuck. A UART still sending the bytes it took (slow baud
+ *          rates) is not stuck
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @return: <uint64_t> Absolute time in ns, UINT64_MAX if the queue is empty
+ **********************************************************************************************************************/
+uint64_t nextSerialWriter( const serialWriter_t* writer )
+{
+   uint64_t refillNs;
+
+   if( !isPendingSerialWriter( writer ) )
+   {
+      return UINT64_MAX;
+   }
+   // A full UART wakes the loop up through POLLOUT
+   if( !writer->blocked && _roomInFlight( writer, writer->wireIdleNs, &refillNs ) != SIZE_MAX &&
+       refillNs < _stuckTime( writer ) )
+   {
+      return refillNs;
+   }
+   return _stuckTime( writer );
+}
+// END f_nextSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wireBacklogSerialWriter( .. )
+ * @brief:  Function to know how long the port needs to put on the wire every byte queued or already taken by the UART,
+ *          at its baud rate
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @param2: <uint64_t> nowNs: Current time
+ * @return: <uint64_t> Time in ns, 0 if the line is idle
+ **********************************************************************************************************************/
+uint64_t wireBacklogSerialWriter( const serialWriter_t* writer, const uint64_t nowNs )
+{
+   uint64_t backlogNs = ( writer->wireIdleNs > nowNs ) ? writer->wireIdleNs - nowNs : 0;
+
+   return backlogNs + wireTimeVCP( writer->vcp, writer->pendingBytes );
+}
+// END f_wireBacklogSerialWriter( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_drainSerialWriters( .. )
+ * @brief:  Function to write the queues of several ports at the same time, each one as fast as its port takes them,
+ *          until all of them are empty (or found stuck) or the deadline comes
+ * @param1: <serialWriter_t*> writers: Array of writers, one per port
+ * @param2: <int> numOfWriters: Number of writers
+ * @param3: <uint64_t> deadlineNs: Absolute time to give up waiting, UINT64_MAX to wait until every queue is empty
+ * @return: <bool> FALSE if a queue had to be dropped
+ **********************************************************************************************************************/
+bool drainSerialWriters( serialWriter_t* writers, const int numOfWriters, const uint64_t deadlineNs )
+{
+   struct pollfd fds[MAX_RS485_BUSES];
+   bool          written = true;
+
+   for( ;; )
+   {
+      uint64_t now = nowPulseTimer();
+      uint64_t wakeUp = deadlineNs;
+      nfds_t   nfds = 0;
+      bool     pending = false;
+
+      for( int i = 0; i < numOfWriters; i++ )
+      {
+         if( !isPendingSerialWriter( &writers[i] ) )
+         {
+            continue;
+         }
+         pending = true;
+         if( nextSerialWriter( &writers[i] ) < wakeUp )
+         {
+            wakeUp = nextSerialWriter( &writers[i] );
+         }
+         if( nfds < MAX_RS485_BUSES && isReadySerialWriter( &writers[i], now ) )
+         {
+            fds[nfds].fd = writers[i].vcp->fd;
+            fds[nfds].events = POLLOUT;
+            fds[nfds].revents = 0;
+            nfds++;
+         }
+      }
+      if( !pending || now >= deadlineNs )
+      {
+         return written;
+      }
+
+      int timeoutMs = ( wakeUp > now ) ? (int)( ( wakeUp - now + NS_PER_MS - 1 ) / NS_PER_MS ) : 0;
+      if( poll( fds, nfds, timeoutMs ) < 0 && errno != EINTR )
+      {
+         for( int i = 0; i < numOfWriters; i++ )
+         {
+            _dropQueue( &writers[i] );
+         }
+         return false;
+      }
+      now = nowPulseTimer();
+      for( int i = 0; i < numOfWriters; i++ )
+      {
+         written = runSerialWriter( &writers[i], now ) && written;
+      }
+   }
+}
+// END f_drainSerialWriters( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_dropQueue( serialWriter_t* writer )                                                                  //
+//   uint64_t  f_stuckTime( const serialWriter_t* writer )                                                            //
+//   size_t    f_roomInFlight( const serialWriter_t* writer, uint64_t nowNs, uint64_t* refillNs )                     //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_dropQueue( .. )
+ * @brief:  Function to forget every buffer waiting. The owner is told frames were lost
+ * @param1: <serialWriter_t*> writer: The writer
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _dropQueue( serialWriter_t* writer )
+{
+   if( writer->head != writer->tail )
+   {
+      writer->lostFrames = true;
+   }
+   writer->head = writer->tail;
+   writer->urgentEnd = writer->tail;
+   writer->frameOffset = 0;
+   writer->pendingBytes = 0;
+}
+// END f_dropQueue( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_stuckTime( .. )
+ * @brief:  Function to know when the queue is considered stuck if the UART takes no byte before
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @return: <uint64_t> Absolute time in ns
+ **********************************************************************************************************************/
+static uint64_t _stuckTime( const serialWriter_t* writer )
+{
+   return ( ( writer->wireIdleNs > writer->progressNs ) ? writer->wireIdleNs : writer->progressNs ) + writer->stuckNs;
+}
+// END f_stuckTime( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_roomInFlight( .. )
+ * @brief:  Function to know how many bytes a paced writer may hand the UART. Room is given once a refill worth of wire
+ *          time (half the limit, at least a frame) has left, so the loop does not wake up for every frame
+ * @param1: <const serialWriter_t*> writer: The writer
+ * @param2: <uint64_t> nowNs: Current time
+ * @param3: <uint64_t*> refillNs: When there is room again (absolute, ns), can be NULL
+ * @return: <size_t> Whole frames of bytes, 0 if none, SIZE_MAX if the writer is not paced
+ **********************************************************************************************************************/
+static size_t _roomInFlight( const serialWriter_t* writer, const uint64_t nowNs, uint64_t* refillNs )
+{
+   if( writer->inFlightNs == SERIAL_WRITER_NOT_PACED )
+   {
+      return SIZE_MAX;
+   }
+   uint64_t frameNs = wireTimeVCP( writer->vcp, RELAY_FRAME_LENGTH );
+   uint64_t limitNs = ( writer->inFlightNs > frameNs ) ? writer->inFlightNs : frameNs;
+   uint64_t refillTimeNs = ( limitNs / 2 > frameNs ) ? limitNs / 2 : frameNs;
+   uint64_t busyNs = ( writer->wireIdleNs > nowNs ) ? writer->wireIdleNs - nowNs : 0;
+
+   if( refillNs != NULL )
+   {
+      *refillNs = ( writer->wireIdleNs + refillTimeNs > limitNs ) ? writer->wireIdleNs + refillTimeNs - limitNs : 0;
+   }
+   if( busyNs + refillTimeNs > limitNs )
+   {
+      return 0;
+   }
+   return (size_t)( ( limitNs - busyNs ) / frameNs ) * RELAY_FRAME_LENGTH;
+}
+// END f_roomInFlight( .. ) ...
+
+#endif // !_WIN32
@@ -0,0 +1,372 @@
+/***********************************************************************************************************************
+ * timerWheel.c
+ * @brief:  Hierarchical timer wheel.
+ *          Level 0 holds the timers due in the next 256 ticks, one slot per tick. Level L holds the ones due in the
+ *          next 256^(L+1) ticks, one slot per 256^L ticks, and they are cascaded to the level below when the lower
+ *          level wraps. A bitmap of non empty slots lets the wheel jump over idle ticks.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stddef.h>  // NULL
+#include <stdint.h>  // uint64_t
+#include "timerWheel.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _SLOT_MASK            ( TIMER_WHEEL_SLOTS - 1 )
+#define _LEVEL_SHIFT( l )     ( ( l ) * TIMER_WHEEL_SLOT_BITS )
+#define _MAX_DELTA            ( ( 1ULL << _LEVEL_SHIFT( TIMER_WHEEL_LEVELS ) ) - 1 )
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static void _insert( timerWheel_t* wheel, wheelTimer_t* timer );
+static void _unlink( timerWheel_t* wheel, wheelTimer_t* timer );
+static void _cascade( timerWheel_t* wheel, const int level );
+static void _expireSlot( timerWheel_t* wheel, const uint32_t slot, uint32_t* expired );
+static int  _firstOccupied( const timerWheel_t* wheel, const int level, const uint32_t from );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   void      f_initTimerWheel( timerWheel_t* wheel, uint64_t nowNs )                                                //
+//   void      f_initWheelTimer( wheelTimer_t* timer, wheelCallback_t callback, void* context )                       //
+//   void      f_addTimerWheel( timerWheel_t* wheel, wheelTimer_t* timer, uint64_t expiryNs )                         //
+//   void      f_cancelTimerWheel( timerWheel_t* wheel, wheelTimer_t* timer )                                         //
+//   bool      f_isPendingWheelTimer( const wheelTimer_t* timer )                                                     //
+//   uint64_t  f_nextExpiryTimerWheel( const timerWheel_t* wheel )                                                    //
+//   uint32_t  f_advanceTimerWheel( timerWheel_t* wheel, uint64_t nowNs )                                             //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_initTimerWheel( .. )
+ * @brief:  Function to set up an empty wheel
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <uint64_t> nowNs: Current time (nowPulseTimer() time base)
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initTimerWheel( timerWheel_t* wheel, const uint64_t nowNs )
+{
+   wheel->currentTick = nowNs / TIMER_WHEEL_TICK_NS;
+   wheel->pending = 0;
+   for( int level = 0; level < TIMER_WHEEL_LEVELS; level++ )
+   {
+      for( int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++ )
+      {
+         wheel->slots[level][slot].next = &wheel->slots[level][slot];
+         wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+      }
+      for( int word = 0; word < TIMER_WHEEL_SLOTS / 64; word++ )
+      {
+         wheel->occupied[level][word] = 0;
+      }
+   }
+}
+// END f_initTimerWheel( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_initWheelTimer( .. )
+ * @brief:  Function to set up a timer before its first use
+ * @param1: <wheelTimer_t*> timer: The timer
+ * @param2: <wheelCallback_t> callback: Function called when it expires
+ * @param3: <void*> context: Passed to the callback
+ * @return: <void> None
+ **********************************************************************************************************************/
+void initWheelTimer( wheelTimer_t* timer, wheelCallback_t callback, void* context )
+{
+   timer->next = NULL;
+   timer->prev = NULL;
+   timer->expiryTick = 0;
+   timer->callback = callback;
+   timer->context = context;
+}
+// END f_initWheelTimer( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_addTimerWheel( .. )
+ * @brief:  Function to arm a timer. An already pending timer is rearmed. Deadlines in the past expire on the next
+ *          advance. Deadlines are rounded up to the next tick, a timer never expires early.
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <wheelTimer_t*> timer: The timer
+ * @param3: <uint64_t> expiryNs: Absolute deadline (nowPulseTimer() time base)
+ * @return: <void> None
+ **********************************************************************************************************************/
+void addTimerWheel( timerWheel_t* wheel, wheelTimer_t* timer, const uint64_t expiryNs )
+{
+   if( isPendingWheelTimer( timer ) )
+   {
+      _unlink( wheel, timer );
+   }
+   timer->expiryTick = ( expiryNs + TIMER_WHEEL_TICK_NS - 1 ) / TIMER_WHEEL_TICK_NS;
+   _insert( wheel, timer );
+}
+// END f_addTimerWheel( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_cancelTimerWheel( .. )
+ * @brief:  Function to disarm a timer. Nothing happens if it was not pending
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <wheelTimer_t*> timer: The timer
+ * @return: <void> None
+ **********************************************************************************************************************/
+void cancelTimerWheel( timerWheel_t* wheel, wheelTimer_t* timer )
+{
+   if( isPendingWheelTimer( timer ) )
+   {
+      _unlink( wheel, timer );
+   }
+}
+// END f_cancelTimerWheel( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isPendingWheelTimer( .. )
+ * @brief:  Function to know if a timer is armed
+ * @param1: <const wheelTimer_t*> timer: The timer
+ * @return: <bool> TRUE if it is waiting in a wheel
+ **********************************************************************************************************************/
+bool isPendingWheelTimer( const wheelTimer_t* timer )
+{
+   return ( timer->next != NULL );
+}
+// END f_isPendingWheelTimer( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_nextExpiryTimerWheel( .. )
+ * @brief:  Function to know when advanceTimerWheel() must be called next. Exact for the timers of the next 256 ticks,
+ *          for farther timers it is the next cascade, which is never later than them
+ * @param1: <const timerWheel_t*> wheel: The wheel
+ * @return: <uint64_t> Absolute time in ns, TIMER_WHEEL_NEVER if the wheel is empty
+ **********************************************************************************************************************/
+uint64_t nextExpiryTimerWheel( const timerWheel_t* wheel )
+{
+   uint64_t nextTick = UINT64_MAX;
+   uint32_t index = (uint32_t)( wheel->currentTick & _SLOT_MASK );
+
+   if( wheel->pending == 0 )
+   {
+      return TIMER_WHEEL_NEVER;
+   }
+   // Level 0, slots from the current one to the end belong to this turn, the ones before it to the next
+   int slot = _firstOccupied( wheel, 0, index );
+   if( slot >= 0 )
+   {
+      nextTick = wheel->currentTick + (uint32_t)slot - index;
+   }
+   else if( ( slot = _firstOccupied( wheel, 0, 0 ) ) >= 0 )
+   {
+      nextTick = wheel->currentTick + TIMER_WHEEL_SLOTS + (uint32_t)slot - index;
+   }
+   // Upper levels, wake up for the cascade
+   for( int level = 1; level < TIMER_WHEEL_LEVELS; level++ )
+   {
+      if( _firstOccupied( wheel, level, 0 ) >= 0 )
+      {
+         uint64_t cascadeTick = ( wheel->currentTick | _SLOT_MASK ) + 1;
+         if( cascadeTick < nextTick )
+         {
+            nextTick = cascadeTick;
+         }
+         break;
+      }
+   }
+   return nextTick * TIMER_WHEEL_TICK_NS;
+}
+// END f_nextExpiryTimerWheel( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_advanceTimerWheel( .. )
+ * @brief:  Function to expire every timer due up to now, in deadline order. Callbacks may add or cancel timers
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <uint64_t> nowNs: Current time (nowPulseTimer() time base)
+ * @return: <uint32_t> Number of timers expired
+ **********************************************************************************************************************/
+uint32_t advanceTimerWheel( timerWheel_t* wheel, const uint64_t nowNs )
+{
+   uint64_t targetTick = nowNs / TIMER_WHEEL_TICK_NS;
+   uint32_t expired = 0;
+
+   while( wheel->currentTick <= targetTick )
+   {
+      uint32_t index = (uint32_t)( wheel->currentTick & _SLOT_MASK );
+
+      // Level 0 wrapped, bring down the next group of timers (upper levels first)
+      if( index == 0 )
+      {
+         int level = 1;
+         while( level < TIMER_WHEEL_LEVELS &&
+                ( ( wheel->currentTick >> _LEVEL_SHIFT( level ) ) & _SLOT_MASK ) == 0 )
+         {
+            level++;
+         }
+         for( level = ( level < TIMER_WHEEL_LEVELS ) ? level : TIMER_WHEEL_LEVELS - 1; level >= 1; level-- )
+         {
+            _cascade( wheel, level );
+         }
+      }
+
+      _expireSlot( wheel, index, &expired );
+
+      // Jump to the next occupied slot of this turn, or to the next turn, but never beyond now
+      int slot = ( index + 1 < TIMER_WHEEL_SLOTS ) ? _firstOccupied( wheel, 0, index + 1 ) : -1;
+      uint64_t nextTick = ( slot >= 0 ) ? wheel->currentTick + (uint32_t)slot - index
+                                        : ( wheel->currentTick | _SLOT_MASK ) + 1;
+      wheel->currentTick = ( nextTick <= targetTick ) ? nextTick : targetTick + 1;
+   }
+   return expired;
+}
+// END f_advanceTimerWheel( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_insert( .. )
+ * @brief:  Function to put a timer in the slot that matches its expiry tick
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <wheelTimer_t*> timer: The timer, not pending
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _insert( timerWheel_t* wheel, wheelTimer_t* timer )
+{
+   if( timer->expiryTick < wheel->currentTick )
+   {
+      timer->expiryTick = wheel->currentTick;
+   }
+   uint64_t delta = timer->expiryTick - wheel->currentTick;
+   if( delta > _MAX_DELTA )
+   {
+      delta = _MAX_DELTA;
+      timer->expiryTick = wheel->currentTick + delta;
+   }
+
+   int level = 0;
+   while( level < TIMER_WHEEL_LEVELS - 1 && delta >= ( 1ULL << _LEVEL_SHIFT( level + 1 ) ) )
+   {
+      level++;
+   }
+   uint32_t slot = (uint32_t)( ( timer->expiryTick >> _LEVEL_SHIFT( level ) ) & _SLOT_MASK );
+   wheelTimer_t* head = &wheel->slots[level][slot];
+
+   timer->prev = head->prev;
+   timer->next = head;
+   head->prev->next = timer;
+   head->prev = timer;
+   wheel->occupied[level][slot / 64] |= ( 1ULL << ( slot % 64 ) );
+   wheel->pending++;
+}
+// END f_insert( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_unlink( .. )
+ * @brief:  Function to take a pending timer out of its slot
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <wheelTimer_t*> timer: The timer, pending
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _unlink( timerWheel_t* wheel, wheelTimer_t* timer )
+{
+   wheelTimer_t* next = timer->next;
+
+   timer->prev->next = next;
+   next->prev = timer->prev;
+   timer->next = NULL;
+   timer->prev = NULL;
+   wheel->pending--;
+
+   // If the slot became empty the neighbours are the head itself, clear its occupied bit
+   if( next == next->prev )
+   {
+      for( int level = 0; level < TIMER_WHEEL_LEVELS; level++ )
+      {
+         if( next >= &wheel->slots[level][0] && next < &wheel->slots[level][TIMER_WHEEL_SLOTS] )
+         {
+            uint32_t slot = (uint32_t)( next - &wheel->slots[level][0] );
+            wheel->occupied[level][slot / 64] &= ~( 1ULL << ( slot % 64 ) );
+            break;
+         }
+      }
+   }
+}
+// END f_unlink( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_cascade( .. )
+ * @brief:  Function to move the timers of the current slot of a level to the levels below
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <int> level: Level to cascade (>= 1)
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _cascade( timerWheel_t* wheel, const int level )
+{
+   uint32_t      slot = (uint32_t)( ( wheel->currentTick >> _LEVEL_SHIFT( level ) ) & _SLOT_MASK );
+   wheelTimer_t* head = &wheel->slots[level][slot];
+
+   while( head->next != head )
+   {
+      wheelTimer_t* timer = head->next;
+      _unlink( wheel, timer );
+      _insert( wheel, timer );
+   }
+}
+// END f_cascade( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_expireSlot( .. )
+ * @brief:  Function to run the callbacks of every timer of a level 0 slot. Timers added for the current tick by the
+ *          callbacks themselves are run too
+ * @param1: <timerWheel_t*> wheel: The wheel
+ * @param2: <uint32_t> slot: Level 0 slot of the current tick
+ * @param3: <uint32_t*> expired: Counter of expired timers
+ * @return: <void> None
+ **********************************************************************************************************************/
+static void _expireSlot( timerWheel_t* wheel, const uint32_t slot, uint32_t* expired )
+{
+   wheelTimer_t* head = &wheel->slots[0][slot];
+
+   while( head->next != head )
+   {
+      wheelTimer_t* timer = head->next;
+      _unlink( wheel, timer );
+      ( *expired )++;
+      timer->callback( timer, timer->context );
+   }
+}
+// END f_expireSlot( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_firstOccupied( .. )
+ * @brief:  Function to find the first non empty slot of a level starting at a given slot (no wrap around)
+ * @param1: <const timerWheel_t*> wheel: The wheel
+ * @param2: <int> level: Level to search
+ * @param3: <uint32_t> from: First slot to check
+ * @return: <int> The slot, -1 if all of them are empty
+ **********************************************************************************************************************/
+static int _firstOccupied( const timerWheel_t* wheel, const int level, const uint32_t from )
+{
+   for( uint32_t word = from / 64; word < TIMER_WHEEL_SLOTS / 64; word++ )
+   {
+      uint64_t bits = wheel->occupied[level][word];
+      if( word == from / 64 )
+      {
+         bits &= ~0ULL << ( from % 64 );
+      }
+      if( bits != 0 )
+      {
+         return (int)( word * 64 + (uint32_t)__builtin_ctzll( bits ) );
+      }
+   }
+   return -1;
+}
+// END f_firstOccupied( .. ) ...
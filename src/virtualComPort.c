@@ -1,91 +1,161 @@
 /***********************************************************************************************************************
  * virtualComPort.c
- * @brief:  Library to manage comPorts objects
+ * @brief:  Library to manage comPorts objects (Win32 transport, see virtualComPortPosix.c for termios)
  * @author: Xavier Aguirre Torres @ The microBoard Order
  * @date:   December 2019
  *
  **********************************************************************************************************************/
+#ifdef _WIN32
 /* Includes ----------------------------------------------------------------------------------------------------------*/
 #include <stdio.h>   //
 #include <stdbool.h> // bool
+#include <string.h>  // memcpy()
 #include <windows.h> // MAX_PATH, HANDLE, DCB, COMMTIMEOUTS, CreateFile(), DWORD
 #include "main.h"
+#include "pulseTimer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "retryPolicy.h"
+#include "frameTrace.h"
 #include "virtualComPort.h"
 
 
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _GATHER_LENGTH        512   // Stack buffer sendFramesVCP() gathers the frames into before every WriteFile()
+
+
 /* Private objects/variables -----------------------------------------------------------------------------------------*/
-DCB _dcbSerialParams = {0};     // DCB by default
-COMMTIMEOUTS _timeouts = {0};   // COMMTIMEOUTS by default
+static const DCB          _dcbSerialParams = {0};   // DCB by default, copied into every vcp_t
+static const COMMTIMEOUTS _timeouts = {0};          // COMMTIMEOUTS by default, copied into every vcp_t
 
 /* Private functions declaration -------------------------------------------------------------------------------------*/
 static int _setConnectionParameters( vcp_t* vcp );
+static HANDLE _createFile( const char* name );
 
 
 /* Functions definition ----------------------------------------------------------------------------------------------*/
 // PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                                    //
-//   vcp_t     f_createVCP( int comPortNumber )                                                                       //
+//   vcp_t     f_createVCP( int comPortNumber, int baudRate, const retryPolicy_t* retry )                             //
+//   vcp_t     f_createVCPByName( const char* name, int baudRate, const retryPolicy_t* retry )                        //
+//   bool      f_initVCPByName( vcp_t* vcp, const char* name, int baudRate, const retryPolicy_t* retry )              //
 //   bool      f_openVCP( vcp_t vcp )                                                                                 //
 //   bool      f_closeVCP( vcp_t vcp )                                                                                //
-//   bool      f_tryOpenVCP( vcp_t _vcp, uint8_t maxNtries )                                                          //
-//   bool      f_tryCloseVCP( vcp_t _vcp, uint8_t maxNtries )                                                         //
+//   void      f_destroyVCP( vcp_t* vcp )                                                                             //
+//   bool      f_setNonBlockingVCP( vcp_t* vcp, bool nonBlocking )                                                    //
+//   bool      f_sendFrameVCP( const vcp_t* vcp, const char* message, size_t frameLength )                            //
+//   bool      f_sendFramesVCP( const vcp_t* vcp, const vcpIovec_t* frames, int numOfFrames )                         //
+//   int       f_readVCP( const vcp_t* vcp, char* buffer, size_t length, uint32_t timeoutMs )                         //
+//   bool      f_isValidBaudRateVCP( int baudRate )                                                                   //
+//   bool      f_setBaudRateVCP( vcp_t* vcp, int baudRate )                                                           //
+//   uint64_t  f_wireTimeVCP( const vcp_t* vcp, size_t bytes )                                                        //
+//   bool      f_tryOpenVCP( vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )                       //
+//   bool      f_tryCloseVCP( const vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )                //
 //                                                                                                                    //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /***********************************************************************************************************************
  * f_createVCP( .. )
  * @brief:  Function to create the COM port number to establish the communication with the relays boards
  * @param1: <int> portNum : Number of the highest probable COM port
+ * @param2: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_*
+ * @param3: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
  * @return: <vcp_t> The VirtualComPort object
  **********************************************************************************************************************/
-vcp_t createVCP( const int portNum )
+vcp_t createVCP( const int portNum, const int baudRate, const retryPolicy_t* retry )
+{
+   char name[MAX_PATH];
+
+   sprintf( name, VCP_DEVICE_NAME_FORMAT, portNum );
+   vcp_t _VCP = createVCPByName( name, baudRate, retry );
+   _VCP.number = portNum;
+   return _VCP;
+}
+// END f_createVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_createVCPByName( .. )
+ * @brief:  Function to create the VCP from a full device name (Ex. "\\\\.\\COM12")
+ * @param1: <const char*> name : Device name
+ * @param2: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_*
+ * @param3: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
+ * @return: <vcp_t> The VirtualComPort object. The program ends if the device could not be opened within the policy
+ **********************************************************************************************************************/
+vcp_t createVCPByName( const char* name, const int baudRate, const retryPolicy_t* retry )
 {
    vcp_t _VCP;                    // Object to return
-   uint8_t tries = MAX_TRIES_TO_CREATE_VCP;
 
+   if( !initVCPByName( &_VCP, name, baudRate, retry ) )
+   {
+      fprintf( stderr, "%s %s()::Impossible to create a VCP in port %s. Ending program...\n" , LOG_ERROR, __func__,
+               name );
+      exit(0); // Kill the program
+   }
+   return _VCP;
+}
+// END f_createVCPByName( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_initVCPByName( .. )
+ * @brief:  Function to set up a VCP from a full device name, as createVCPByName() but the caller decides what to do
+ *          when the device can not be opened (a library must not end the program)
+ * @param1: <vcp_t*> vcp : The VirtualComPort object to fill
+ * @param2: <const char*> name : Device name
+ * @param3: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_*
+ * @param4: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
+ * @return: <bool> TRUE if the connection parameters are set (the handle is left closed), FALSE if the policy gave up
+ **********************************************************************************************************************/
+bool initVCPByName( vcp_t* vcp, const char* name, const int baudRate, const retryPolicy_t* retry )
+{
+   retry_t attempt;
+   bool    created = false;
+
+   // Set vcp->name
+   snprintf( vcp->name, sizeof( vcp->name ), "%s", name );
+   vcp->number = -1;
+   vcp->bus = 0;
+   vcp->baudRate = isValidBaudRateVCP( baudRate ) ? baudRate : BAUD_RATE_DEFAULT;
    // Loop to search for the device
-   while( tries >= 0 )
+   startRetry( &attempt, retry );
+   while( !created )
    {
-      // Set _VCP.name
-      sprintf( _VCP.name, "\\\\.\\COM%d", portNum );
-      // Set _VCP.handle
-      _VCP.hSerial = CreateFile( _VCP.name,        // File Name
-                                 GENERIC_WRITE,    // Access Mode
-                                 0,                // Share Mode (Serial ports can't be shared)
-                                 NULL,             // Security Attributes
-                                 OPEN_EXISTING,    // Creation Disposition //OPEN_ALWAYS
-                                 0,                // Flags and Attributes (Non Overlapped IO)
-                                 NULL );           // Template File
+      // Set vcp->handle
+      vcp->hSerial = _createFile( vcp->name );
       // If it was not possible to open the COM port try again
-      if( _VCP.hSerial == INVALID_HANDLE_VALUE )
+      if( vcp->hSerial == INVALID_HANDLE_VALUE )
       {
-         fprintf( stderr, "%s %s()::Error in opening serial port %s\n" , LOG_ERROR, __func__, _VCP.name );
-         Sleep(50);
-         tries--;
+         fprintf( stderr, "%s %s()::Error in opening serial port %s\n" , LOG_ERROR, __func__, vcp->name );
+         if( !waitRetry( &attempt ) )
+         {
+            break;
+         }
+         countMetrics( METRIC_OPEN_RETRIES );
       }
       // Otherwise we've found it
       else
       {
-         // Set _VCP object
-         _VCP.number = portNum;
-         _VCP.dcbSerialParams = _dcbSerialParams;
-         _VCP.timeouts = _timeouts;
-         _setConnectionParameters( &_VCP );
-         fprintf( stdout, "%s %s()::Successfully VCP created in port: %s\n" , LOG_INFO, __func__, _VCP.name );
-         break;
+         // Set vcp object
+         vcp->dcbSerialParams = _dcbSerialParams;
+         vcp->timeouts = _timeouts;
+         _setConnectionParameters( vcp );
+         fprintf( stdout, "%s %s()::Successfully VCP created in port: %s\n" , LOG_INFO, __func__, vcp->name );
+         created = true;
       }
    }
-   if( tries < 0 )
+   if( !created )
    {
-      fprintf( stderr, "%s %s()::Impossible to create a VCP in port %s. Ending program...\n" , LOG_ERROR, __func__, _VCP.name );
-      exit(0); // Kill the program
+      fprintf( stderr, "%s %s()::Serial port %s given up after %u tries (%s)\n" , LOG_ERROR, __func__, vcp->name,
+               attempt.tries, nameRetryOutcome( attempt.outcome ) );
+      countMetrics( METRIC_OPEN_FAILURES );
+      countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+      return false;
    }
    // UART Connection parameters are ready. Close it by the time.
-   //closeVCP( &_VCP );
-   CloseHandle( _VCP.hSerial );
-   // Return object
-   return _VCP;
+   CloseHandle( vcp->hSerial );
+   return true;
 }
-// END f_createVCP( .. ) ...
+// END f_initVCPByName( .. ) ...
 
 
 /***********************************************************************************************************************
@@ -96,14 +166,9 @@ vcp_t createVCP( const int portNum )
  **********************************************************************************************************************/
 bool openVCP( vcp_t* vcp  )
 {
-   bool retValue = true;
-   vcp->hSerial = CreateFile( vcp->name,        // File Name
-                              GENERIC_WRITE,    // Access Mode
-                              0,                // Share Mode (Serial ports can't be shared)
-                              NULL,             // Security Attributes
-                              OPEN_EXISTING,    // Creation Disposition //OPEN_ALWAYS
-                              0,                // Flags and Attributes (Non Overlapped IO)
-                              NULL );           // Template File
+   bool     retValue = true;
+   uint64_t startNs = nowPulseTimer();
+   vcp->hSerial = _createFile( vcp->name );
 
    if( vcp->hSerial == INVALID_HANDLE_VALUE )
    {
@@ -113,6 +178,7 @@ bool openVCP( vcp_t* vcp  )
    else
    {
       //fprintf( stdout, "%s %s()::Successfully opened %s\n" , LOG_INFO, __func__, vcp->name );
+      recordMetrics( METRIC_OPEN, nowPulseTimer() - startNs );
    }
    return retValue;
 }
@@ -127,8 +193,11 @@ bool openVCP( vcp_t* vcp  )
  **********************************************************************************************************************/
 bool closeVCP( const vcp_t* vcp )
 {
-   bool retValue = true;
+   bool     retValue = true;
+   uint64_t startNs = nowPulseTimer();
    FlushFileBuffers( vcp->hSerial );
+   uint64_t flushedNs = nowPulseTimer();
+   recordMetrics( METRIC_DRAIN, flushedNs - startNs );
    if( !CloseHandle( vcp->hSerial ) )
    {
       //fprintf( stderr, "%s %s()::Unable to close port %s\n", LOG_ERROR, __func__, vcp->name );
@@ -137,12 +206,42 @@ bool closeVCP( const vcp_t* vcp )
    else
    {
       //fprintf( stdout, "%s %s()::Successfully closed %s\n" , LOG_INFO, __func__, vcp->name );
+      recordMetrics( METRIC_CLOSE, nowPulseTimer() - flushedNs );
    }
    return retValue;
 }
 // END f_closeVCP( .. ) ...
 
 
+/***********************************************************************************************************************
+ * f_destroyVCP( .. )
+ * @brief:  Function to release the VCP at the end of the program. The Win32 transport already closes the handle in
+ *          closeVCP() so there is nothing left to release
+ * @param1: <vcp_t*> vcp: The Virtual Com Port to release
+ * @return: <void> None
+ **********************************************************************************************************************/
+void destroyVCP( vcp_t* vcp )
+{
+   (void)vcp;
+}
+// END f_destroyVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setNonBlockingVCP( .. )
+ * @brief:  Function to make writes return at once. Not supported by this transport, it would need overlapped I/O
+ * @param1: <vcp_t*> vcp: The Virtual Com Port
+ * @param2: <bool> nonBlocking: TRUE for non blocking writes, FALSE for blocking ones
+ * @return: <bool> TRUE only when blocking writes are requested
+ **********************************************************************************************************************/
+bool setNonBlockingVCP( vcp_t* vcp, const bool nonBlocking )
+{
+   (void)vcp;
+   return !nonBlocking;
+}
+// END f_setNonBlockingVCP( .. ) ...
+
+
 /***********************************************************************************************************************
  * f_sendFrameVCP( .. )
  * @brief:  Function to send a frame to the
@@ -153,78 +252,264 @@ bool closeVCP( const vcp_t* vcp )
  **********************************************************************************************************************/
 bool sendFrameVCP( const vcp_t* vcp, const char * message, size_t frameLength )
 {
-   DWORD bytesWritten = 0,
-         totalBytesWritten = 0;
+   DWORD    bytesWritten = 0,
+            totalBytesWritten = 0;
+   uint64_t startNs = nowPulseTimer();
 
    while( totalBytesWritten < frameLength )
    {
       if( !WriteFile( vcp->hSerial, message + totalBytesWritten, frameLength - totalBytesWritten, &bytesWritten, NULL ) )
       {
-         fprintf( stderr, "%s Error writing text to %s\n", LOG_ERROR, vcp->name );
+         LOG_PRINT( LOG_LEVEL_ERROR, "Error writing text to %s", vcp->name );
+         break;
       }
-      else
+      if( bytesWritten == 0 )
       {
-         totalBytesWritten += bytesWritten;
+         break;   // Write timeout expired without progress, do not spin on a stuck port
       }
+      totalBytesWritten += bytesWritten;
    }
-   if( bytesWritten != frameLength )
+   if( totalBytesWritten != frameLength )
    {
-      fprintf( stderr, "%s Incomplete message written\n", LOG_ERROR );
+      LOG_PRINT( LOG_LEVEL_ERROR, "Incomplete message written" );
+      countMetrics( METRIC_WRITE_FAILURES );
       return false;
    }
+   recordMetrics( METRIC_WRITE, nowPulseTimer() - startNs );
+   vcpIovec_t written = { .iov_base = (void*)message, .iov_len = frameLength };
+   TRACE_FRAMES( vcp->bus, &written, 1, 0, frameLength );
    return true;
 }
 // END f_sendFrameVCP( .. ) ...
 
 
+/***********************************************************************************************************************
+ * f_sendFramesVCP( .. )
+ * @brief:  Function to send several buffers in order. Serial handles have no gather write, so the buffers are copied
+ *          into a stack buffer and sent with as few WriteFile() calls as possible
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order
+ * @param3: <int> numOfFrames: Number of buffers
+ * @return: <bool> TRUE if every byte was written FALSE if not
+ **********************************************************************************************************************/
+bool sendFramesVCP( const vcp_t* vcp, const vcpIovec_t* frames, const int numOfFrames )
+{
+   char   gather[_GATHER_LENGTH];
+   size_t used = 0;
+
+   for( int i = 0; i < numOfFrames; i++ )
+   {
+      const char* base = (const char*)frames[i].iov_base;
+      size_t      length = frames[i].iov_len;
+      while( length > 0 )
+      {
+         size_t chunk = ( length < sizeof( gather ) - used ) ? length : sizeof( gather ) - used;
+         memcpy( gather + used, base, chunk );
+         used += chunk;
+         base += chunk;
+         length -= chunk;
+         if( used == sizeof( gather ) )
+         {
+            if( !sendFrameVCP( vcp, gather, used ) )
+            {
+               return false;
+            }
+            used = 0;
+         }
+      }
+   }
+   return ( used == 0 ) || sendFrameVCP( vcp, gather, used );
+}
+// END f_sendFramesVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_readVCP( .. )
+ * @brief:  Function to read the bytes the boards send back. The read timeouts are set for this call only and put
+ *          back to the ones of _setConnectionParameters() at the end
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used, open
+ * @param2: <char*> buffer: Where to store the bytes
+ * @param3: <size_t> length: Number of bytes expected
+ * @param4: <uint32_t> timeoutMs: Max time to wait for all of them, 0 to take only what already arrived
+ * @return: <int> Number of bytes read (less than length on timeout), -1 on error
+ **********************************************************************************************************************/
+int readVCP( const vcp_t* vcp, char* buffer, const size_t length, const uint32_t timeoutMs )
+{
+   COMMTIMEOUTS timeouts = vcp->timeouts;
+   ULONGLONG    deadline = GetTickCount64() + timeoutMs;
+   DWORD        bytesRead = 0;
+   size_t       totalBytesRead = 0;
+   int          retValue;
+
+   // ReadFile() returns as soon as a byte is there or when the constant expires (MAXDWORD interval and multiplier).
+   // With a 0 constant and multiplier it returns at once with the bytes already received
+   timeouts.ReadIntervalTimeout = MAXDWORD;
+   timeouts.ReadTotalTimeoutMultiplier = ( timeoutMs > 0 ) ? MAXDWORD : 0;
+   timeouts.ReadTotalTimeoutConstant = timeoutMs;
+   if( SetCommTimeouts( vcp->hSerial, &timeouts ) == 0 )
+   {
+      return -1;
+   }
+   retValue = 0;
+   while( totalBytesRead < length )
+   {
+      if( !ReadFile( vcp->hSerial, buffer + totalBytesRead, (DWORD)( length - totalBytesRead ), &bytesRead, NULL ) )
+      {
+         LOG_PRINT( LOG_LEVEL_ERROR, "Error reading from %s", vcp->name );
+         retValue = -1;
+         break;
+      }
+      if( bytesRead == 0 )
+      {
+         break;      // Timeout
+      }
+      totalBytesRead += bytesRead;
+
+      ULONGLONG now = GetTickCount64();
+      if( now >= deadline )
+      {
+         break;
+      }
+      timeouts.ReadTotalTimeoutConstant = (DWORD)( deadline - now );
+      SetCommTimeouts( vcp->hSerial, &timeouts );
+   }
+   SetCommTimeouts( vcp->hSerial, &( vcp->timeouts ) );
+   return ( retValue < 0 ) ? -1 : (int)totalBytesRead;
+}
+// END f_readVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isValidBaudRateVCP( .. )
+ * @brief:  Function to know if a baud rate is one of BAUD_RATE_* (every one of them is a valid DCB BaudRate)
+ * @param1: <int> baudRate: The baud rate
+ * @return: <bool> TRUE if it can be used
+ **********************************************************************************************************************/
+bool isValidBaudRateVCP( const int baudRate )
+{
+   static const int baudRates[] = BAUD_RATES_HIGHEST_FIRST;
+
+   for( size_t i = 0; i < sizeof( baudRates ) / sizeof( baudRates[0] ); i++ )
+   {
+      if( baudRates[i] == baudRate )
+      {
+         return true;
+      }
+   }
+   return false;
+}
+// END f_isValidBaudRateVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setBaudRateVCP( .. )
+ * @brief:  Function to change the baud rate. The port must be closed, it is opened just to apply the new rate
+ * @param1: <vcp_t*> vcp: The Virtual COM port
+ * @param2: <int> baudRate: The new baud rate
+ * @return: <bool> TRUE if success FALSE if the rate is not valid or could not be set
+ **********************************************************************************************************************/
+bool setBaudRateVCP( vcp_t* vcp, const int baudRate )
+{
+   int oldBaudRate = vcp->baudRate;
+
+   if( !isValidBaudRateVCP( baudRate ) )
+   {
+      return false;
+   }
+   vcp->hSerial = _createFile( vcp->name );
+   if( vcp->hSerial == INVALID_HANDLE_VALUE )
+   {
+      return false;
+   }
+   vcp->baudRate = baudRate;
+   if( _setConnectionParameters( vcp ) != 0 )      // Closes the handle on failure
+   {
+      vcp->baudRate = oldBaudRate;
+      return false;
+   }
+   CloseHandle( vcp->hSerial );
+   return true;
+}
+// END f_setBaudRateVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wireTimeVCP( .. )
+ * @brief:  Function to know how long some bytes take on the wire at the current baud rate
+ * @param1: <const vcp_t*> vcp: The Virtual COM port
+ * @param2: <size_t> bytes: Number of bytes
+ * @return: <uint64_t> Time in ns
+ **********************************************************************************************************************/
+uint64_t wireTimeVCP( const vcp_t* vcp, const size_t bytes )
+{
+   return (uint64_t)bytes * VCP_BITS_PER_BYTE * NS_PER_SEC / (uint64_t)vcp->baudRate;
+}
+// END f_wireTimeVCP( .. ) ...
+
+
 /**********************************************************************************************************************
  * f_tryOpenVCP( .. )
- * @brief: Function to stablish a maximum number of tries to Open the COM Port
+ * @brief: Function to open the COM Port, trying again as the policy says
  * @param1 <vcp_t*> _vcp : the Virtual Com Port
- * @param2 <uint8_t> maxNtries : Maximum number of tries
+ * @param2 <const retryPolicy_t*> retry : Backoff, tries and deadline
+ * @param3 <retryOutcome_t*> outcome : Where to store how it ended, NULL if not needed
  * @return: <bool> TRUE if succeed FALSE if not
  *********************************************************************************************************************/
-bool tryOpenVCP( vcp_t* _vcp, uint8_t maxNtries )
+bool tryOpenVCP( vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )
 {
-   uint8_t triesToOpen = 0;
+   retry_t attempt;
+   bool    opened;
 
-   while( !openVCP( _vcp ) )
+   startRetry( &attempt, retry );
+   while( !( opened = openVCP( _vcp ) ) )
    {
-      fprintf( stderr, "%s %s()::Try %d: Unable to open port %s\n" , LOG_ERROR, __func__, triesToOpen, _vcp->name );
-      Sleep( 50 );
-      triesToOpen++;
-      if( triesToOpen >= maxNtries )
+      LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Try %u: Unable to open port %s", __func__, attempt.tries, _vcp->name );
+      if( !waitRetry( &attempt ) )
       {
-         return false;
+         countMetrics( METRIC_OPEN_FAILURES );
+         countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+         break;
       }
+      countMetrics( METRIC_OPEN_RETRIES );
    }
-   return true;
+   if( outcome != NULL )
+   {
+      *outcome = endRetry( &attempt, opened );
+   }
+   return opened;
 }
 // END f_tryOpenVCP( .. ) ...
 
 
 /**********************************************************************************************************************
  * tryCloseVCP( .. )
- * @brief: Function to stablish a maximum number of tries to Close the COM Port
+ * @brief: Function to close the COM Port, trying again as the policy says
  * @param1 <vcp_t*> _vcp : the Virtual Com Port
- * @param2 <uint8_t> maxNtries : Maximum number of tries
+ * @param2 <const retryPolicy_t*> retry : Backoff, tries and deadline
+ * @param3 <retryOutcome_t*> outcome : Where to store how it ended, NULL if not needed
  * @return: <bool> TRUE if succeed FALSE if not
  *********************************************************************************************************************/
-bool tryCloseVCP( const vcp_t* _vcp, uint8_t maxNtries )
+bool tryCloseVCP( const vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )
 {
-   uint8_t triesToClose = 0;
+   retry_t attempt;
+   bool    closed;
 
-   while( !closeVCP( _vcp ) )
+   startRetry( &attempt, retry );
+   while( !( closed = closeVCP( _vcp ) ) )
    {
-      fprintf( stderr, "%s %s()::Try %d: Unable to close port %s\n" , LOG_ERROR, __func__, triesToClose, _vcp->name );
-      Sleep( 50 );
-      triesToClose++;
-      if( triesToClose >= maxNtries )
+      LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Try %u: Unable to close port %s", __func__, attempt.tries, _vcp->name );
+      if( !waitRetry( &attempt ) )
       {
-         return false;
+         countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+         break;
       }
+      countMetrics( METRIC_CLOSE_RETRIES );
    }
-   return true;
+   if( outcome != NULL )
+   {
+      *outcome = endRetry( &attempt, closed );
+   }
+   return closed;
 }
 // END f_tryCloseVCP( .. ) ...
 
@@ -239,6 +524,8 @@ bool tryCloseVCP( const vcp_t* _vcp, uint8_t maxNtries )
  **********************************************************************************************************************/
 static int _setConnectionParameters( vcp_t* vcp )
 {
+   uint64_t startNs = nowPulseTimer();
+
    vcp->dcbSerialParams.DCBlength = sizeof( vcp->dcbSerialParams );
 
    if( GetCommState( vcp->hSerial, &( vcp->dcbSerialParams ) ) == 0 )
@@ -248,7 +535,7 @@ static int _setConnectionParameters( vcp_t* vcp )
      return 1;
    }
 
-   vcp->dcbSerialParams.BaudRate = BAUD_RATE_DEFAULT;
+   vcp->dcbSerialParams.BaudRate = (DWORD)vcp->baudRate;
    vcp->dcbSerialParams.ByteSize = 8;
    vcp->dcbSerialParams.StopBits = ONESTOPBIT;
    vcp->dcbSerialParams.Parity = NOPARITY;
@@ -270,6 +557,28 @@ static int _setConnectionParameters( vcp_t* vcp )
      closeVCP( vcp );
      return 1;
    }
+   recordMetrics( METRIC_CONFIGURE, nowPulseTimer() - startNs );
    return 0;
 }
 // END f_setConnectionParameters( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_createFile( .. )
+ * @brief:  Function to open the handle of a COM port
+ * @param1: <const char*> name: Device name
+ * @return: <HANDLE> The handle, INVALID_HANDLE_VALUE if the port could not be opened
+ **********************************************************************************************************************/
+static HANDLE _createFile( const char* name )
+{
+   return CreateFile( name,             // File Name
+                      GENERIC_READ | GENERIC_WRITE,  // Access Mode, the boards answer status queries
+                      0,                // Share Mode (Serial ports can't be shared)
+                      NULL,             // Security Attributes
+                      OPEN_EXISTING,    // Creation Disposition //OPEN_ALWAYS
+                      0,                // Flags and Attributes (Non Overlapped IO)
+                      NULL );           // Template File
+}
+// END f_createFile( .. ) ...
+
+#endif // _WIN32
@@ -0,0 +1,660 @@
+/***********************************************************************************************************************
+ * virtualComPortPosix.c
+ * @brief:  Library to manage comPorts objects (POSIX termios transport, see virtualComPort.c for Win32)
+ *          The descriptor is opened and configured once in createVCP() and kept open for the life of the process.
+ *          openVCP()/closeVCP() only make sure it is usable/drained, destroyVCP() releases it.
+ * @author: Xavier Aguirre Torres @ The microBoard Order
+ * @date:   December 2019
+ *
+ **********************************************************************************************************************/
+#ifndef _WIN32
+/* Includes ----------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>   // fprintf(), snprintf()
+#include <stdlib.h>  // exit()
+#include <stdbool.h> // bool
+#include <string.h>  // strerror()
+#include <errno.h>   // errno, EINTR, EAGAIN, ETIMEDOUT, EIO
+#include <fcntl.h>   // open(), fcntl(), O_RDWR, O_NOCTTY, O_NONBLOCK
+#include <unistd.h>  // write(), close()
+#include <poll.h>    // poll()
+#include <sys/uio.h> // writev()
+#include <termios.h> // tcgetattr(), tcsetattr(), tcdrain(), tcflush(), speed_t
+#include "main.h"
+#include "pulseTimer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "retryPolicy.h"
+#include "frameTrace.h"
+#include "virtualComPort.h"
+
+
+/* Private defines ---------------------------------------------------------------------------------------------------*/
+#define _WRITE_STUCK_NS   ( 1000 * NS_PER_MS )   // Non blocking port taking no byte for this long fails the write
+
+
+/* Private typedefs --------------------------------------------------------------------------------------------------*/
+// termios speed of every baud rate, the ones without a Bxxx constant (14400, 128000, 256000) are not available
+typedef struct baudRateSpeed_type
+{
+   int     baudRate;
+   speed_t speed;
+} baudRateSpeed_t;
+
+
+/* Private objects/variables -----------------------------------------------------------------------------------------*/
+static const baudRateSpeed_t _speeds[] =
+{
+   { BAUD_RATE_110,    B110 },
+   { BAUD_RATE_300,    B300 },
+   { BAUD_RATE_600,    B600 },
+   { BAUD_RATE_1200,   B1200 },
+   { BAUD_RATE_2400,   B2400 },
+   { BAUD_RATE_4800,   B4800 },
+   { BAUD_RATE_9600,   B9600 },
+   { BAUD_RATE_19200,  B19200 },
+   { BAUD_RATE_38400,  B38400 },
+   { BAUD_RATE_57600,  B57600 },
+   { BAUD_RATE_115200, B115200 },
+};
+
+
+/* Private functions declaration -------------------------------------------------------------------------------------*/
+static int     _openDevice( vcp_t* vcp );
+static int     _setConnectionParameters( vcp_t* vcp );
+static speed_t _speed( const int baudRate );
+static bool    _waitWritable( const vcp_t* vcp, const uint64_t deadlineNs );
+
+
+/* Functions definition ----------------------------------------------------------------------------------------------*/
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//   vcp_t     f_createVCP( int comPortNumber, int baudRate, const retryPolicy_t* retry )                             //
+//   vcp_t     f_createVCPByName( const char* name, int baudRate, const retryPolicy_t* retry )                        //
+//   bool      f_initVCPByName( vcp_t* vcp, const char* name, int baudRate, const retryPolicy_t* retry )              //
+//   bool      f_openVCP( vcp_t vcp )                                                                                 //
+//   bool      f_closeVCP( vcp_t vcp )                                                                                //
+//   void      f_destroyVCP( vcp_t* vcp )                                                                             //
+//   bool      f_setNonBlockingVCP( vcp_t* vcp, bool nonBlocking )                                                    //
+//   bool      f_sendFrameVCP( const vcp_t* vcp, const char* message, size_t frameLength )                            //
+//   bool      f_sendFramesVCP( const vcp_t* vcp, const vcpIovec_t* frames, int numOfFrames )                         //
+//   int       f_readVCP( const vcp_t* vcp, char* buffer, size_t length, uint32_t timeoutMs )                         //
+//   bool      f_isValidBaudRateVCP( int baudRate )                                                                   //
+//   bool      f_setBaudRateVCP( vcp_t* vcp, int baudRate )                                                           //
+//   uint64_t  f_wireTimeVCP( const vcp_t* vcp, size_t bytes )                                                        //
+//   bool      f_tryOpenVCP( vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )                       //
+//   bool      f_tryCloseVCP( const vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )                //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_createVCP( .. )
+ * @brief:  Function to create the VCP on /dev/ttyUSB<portNum>
+ * @param1: <int> portNum : Number of the ttyUSB device
+ * @param2: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_* valid for this transport
+ * @param3: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
+ * @return: <vcp_t> The VirtualComPort object
+ **********************************************************************************************************************/
+vcp_t createVCP( const int portNum, const int baudRate, const retryPolicy_t* retry )
+{
+   char name[MAX_PATH];
+
+   snprintf( name, sizeof( name ), VCP_DEVICE_NAME_FORMAT, portNum );
+   vcp_t _VCP = createVCPByName( name, baudRate, retry );
+   _VCP.number = portNum;
+   return _VCP;
+}
+// END f_createVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_createVCPByName( .. )
+ * @brief:  Function to create the VCP from a device path (Ex. "/dev/ttyUSB0", "/dev/serial/by-id/..", "/dev/pts/3")
+ * @param1: <const char*> name : Device path
+ * @param2: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_* valid for this transport
+ * @param3: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
+ * @return: <vcp_t> The VirtualComPort object, with its descriptor already open and configured. The program ends if
+ *          the device could not be opened within the policy
+ **********************************************************************************************************************/
+vcp_t createVCPByName( const char* name, const int baudRate, const retryPolicy_t* retry )
+{
+   vcp_t _VCP;                      // Object to return
+
+   if( !initVCPByName( &_VCP, name, baudRate, retry ) )
+   {
+      fprintf( stderr, "%s %s()::Impossible to create a VCP in port %s. Ending program...\n" , LOG_ERROR, __func__,
+               name );
+      exit(0); // Kill the program
+   }
+   return _VCP;
+}
+// END f_createVCPByName( .. ) ...
+
+/***********************************************************************************************************************
+ * f_initVCPByName( .. )
+ * @brief:  Function to set up a VCP from a device path, as createVCPByName() but the caller decides what to do when
+ *          the device can not be opened (a library must not end the program)
+ * @param1: <vcp_t*> vcp : The VirtualComPort object to fill
+ * @param2: <const char*> name : Device path
+ * @param3: <int> baudRate : Baud rate of the UART, one of BAUD_RATE_* valid for this transport
+ * @param4: <const retryPolicy_t*> retry : How the device is tried again while it can not be opened
+ * @return: <bool> TRUE if the descriptor is open and configured, FALSE if the policy gave up
+ **********************************************************************************************************************/
+bool initVCPByName( vcp_t* vcp, const char* name, const int baudRate, const retryPolicy_t* retry )
+{
+   retry_t attempt;
+
+   snprintf( vcp->name, sizeof( vcp->name ), "%s", name );
+   vcp->number = -1;
+   vcp->bus = 0;
+   vcp->fd = -1;
+   vcp->baudRate = isValidBaudRateVCP( baudRate ) ? baudRate : BAUD_RATE_DEFAULT;
+
+   // Loop to search for the device
+   startRetry( &attempt, retry );
+   while( _openDevice( vcp ) != 0 )
+   {
+      fprintf( stderr, "%s %s()::Error in opening serial port %s (%s)\n" , LOG_ERROR, __func__, vcp->name,
+               strerror( errno ) );
+      if( !waitRetry( &attempt ) )
+      {
+         fprintf( stderr, "%s %s()::Serial port %s given up after %u tries (%s)\n" , LOG_ERROR, __func__, vcp->name,
+                  attempt.tries, nameRetryOutcome( attempt.outcome ) );
+         countMetrics( METRIC_OPEN_FAILURES );
+         countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+         return false;
+      }
+      countMetrics( METRIC_OPEN_RETRIES );
+   }
+   fprintf( stdout, "%s %s()::Successfully VCP created in port: %s (%d baud)\n" , LOG_INFO, __func__, vcp->name,
+            vcp->baudRate );
+   return true;
+}
+// END f_initVCPByName( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_openVCP( .. )
+ * @brief:  Function to open the VCP. The descriptor created by createVCP() is reused, it is only reopened if it was
+ *          released by destroyVCP()
+ * @param1: <vcp_t*> vcp: The Virtual Com Port we pretend to open
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+bool openVCP( vcp_t* vcp )
+{
+   if( vcp->fd >= 0 )
+   {
+      return true;
+   }
+   return ( _openDevice( vcp ) == 0 );
+}
+// END f_openVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_closeVCP( .. )
+ * @brief:  Function to close the VCP. Waits until every queued byte is on the wire but keeps the descriptor open
+ * @param1: <vcp_t*> vcp: The Virtual Com Port we pretend to close
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+bool closeVCP( const vcp_t* vcp )
+{
+   uint64_t startNs = nowPulseTimer();
+
+   if( vcp->fd < 0 )
+   {
+      return false;
+   }
+   while( tcdrain( vcp->fd ) != 0 )
+   {
+      if( errno != EINTR )
+      {
+         // Pseudo terminals used for testing may not support drain, it is not an error for them
+         return ( errno == ENOTTY || errno == EINVAL );
+      }
+   }
+   recordMetrics( METRIC_DRAIN, nowPulseTimer() - startNs );
+   return true;
+}
+// END f_closeVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_destroyVCP( .. )
+ * @brief:  Function to release the VCP descriptor at the end of the program
+ * @param1: <vcp_t*> vcp: The Virtual Com Port to release
+ * @return: <void> None
+ **********************************************************************************************************************/
+void destroyVCP( vcp_t* vcp )
+{
+   if( vcp->fd >= 0 )
+   {
+      closeVCP( vcp );
+      uint64_t startNs = nowPulseTimer();
+      close( vcp->fd );
+      recordMetrics( METRIC_CLOSE, nowPulseTimer() - startNs );
+      vcp->fd = -1;
+   }
+}
+// END f_destroyVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setNonBlockingVCP( .. )
+ * @brief:  Function to make writes return at once with EAGAIN instead of waiting for room in the UART buffer
+ * @param1: <vcp_t*> vcp: The Virtual Com Port, open
+ * @param2: <bool> nonBlocking: TRUE for non blocking writes, FALSE to go back to blocking ones
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+bool setNonBlockingVCP( vcp_t* vcp, const bool nonBlocking )
+{
+   int flags = fcntl( vcp->fd, F_GETFL );
+
+   if( flags < 0 )
+   {
+      return false;
+   }
+   flags = nonBlocking ? ( flags | O_NONBLOCK ) : ( flags & ~O_NONBLOCK );
+   return ( fcntl( vcp->fd, F_SETFL, flags ) == 0 );
+}
+// END f_setNonBlockingVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sendFrameVCP( .. )
+ * @brief:  Function to send a frame to the relays boards
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used
+ * @param2: <const char *> message: The message to send
+ * @param3: <size_t> frameLength: The message length
+ * @return: <bool> TRUE if success FALSE if not
+ **********************************************************************************************************************/
+bool sendFrameVCP( const vcp_t* vcp, const char * message, size_t frameLength )
+{
+   size_t   totalBytesWritten = 0;
+   uint64_t startNs = nowPulseTimer();
+   uint64_t stuckNs = startNs + _WRITE_STUCK_NS;
+
+   while( totalBytesWritten < frameLength )
+   {
+      ssize_t bytesWritten = write( vcp->fd, message + totalBytesWritten, frameLength - totalBytesWritten );
+      if( bytesWritten < 0 )
+      {
+         // A non blocking port without room is waited for, not spun on
+         if( errno == EINTR || ( errno == EAGAIN && _waitWritable( vcp, stuckNs ) ) )
+         {
+            continue;
+         }
+         LOG_PRINT( LOG_LEVEL_ERROR, "Error writing text to %s (%s)", vcp->name, strerror( errno ) );
+         break;
+      }
+      totalBytesWritten += (size_t)bytesWritten;
+      stuckNs = nowPulseTimer() + _WRITE_STUCK_NS;
+   }
+   if( totalBytesWritten != frameLength )
+   {
+      LOG_PRINT( LOG_LEVEL_ERROR, "Incomplete message written" );
+      countMetrics( METRIC_WRITE_FAILURES );
+      return false;
+   }
+   recordMetrics( METRIC_WRITE, nowPulseTimer() - startNs );
+   vcpIovec_t written = { .iov_base = (void*)message, .iov_len = frameLength };
+   TRACE_FRAMES( vcp->bus, &written, 1, 0, frameLength );
+   return true;
+}
+// END f_sendFrameVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_sendFramesVCP( .. )
+ * @brief:  Function to send several buffers with vectored writes, nothing is copied. A partial write is resumed from
+ *          the first byte not written
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used
+ * @param2: <const vcpIovec_t*> frames: Buffers to send, in order
+ * @param3: <int> numOfFrames: Number of buffers
+ * @return: <bool> TRUE if every byte was written FALSE if not
+ **********************************************************************************************************************/
+bool sendFramesVCP( const vcp_t* vcp, const vcpIovec_t* frames, const int numOfFrames )
+{
+   int      index = 0;     // First buffer not completely written
+   size_t   offset = 0;    // Bytes of frames[index] already written
+   size_t   total = 0;     // Bytes written
+   uint64_t startNs = nowPulseTimer();
+   uint64_t stuckNs = startNs + _WRITE_STUCK_NS;
+
+   while( index < numOfFrames )
+   {
+      ssize_t bytesWritten;
+      if( offset > 0 )
+      {
+         // Finish the buffer cut by the last write before going vectored again
+         bytesWritten = write( vcp->fd, (const char*)frames[index].iov_base + offset, frames[index].iov_len - offset );
+      }
+      else
+      {
+         int count = numOfFrames - index;
+         bytesWritten = writev( vcp->fd, frames + index, ( count < VCP_MAX_IOVECS ) ? count : VCP_MAX_IOVECS );
+      }
+      if( bytesWritten < 0 )
+      {
+         if( errno == EINTR || ( errno == EAGAIN && _waitWritable( vcp, stuckNs ) ) )
+         {
+            continue;
+         }
+         LOG_PRINT( LOG_LEVEL_ERROR, "Error writing text to %s (%s)", vcp->name, strerror( errno ) );
+         countMetrics( METRIC_WRITE_FAILURES );
+         return false;
+      }
+      stuckNs = nowPulseTimer() + _WRITE_STUCK_NS;
+
+      size_t left = (size_t)bytesWritten;
+      total += left;
+      while( index < numOfFrames && left >= frames[index].iov_len - offset )
+      {
+         left -= frames[index].iov_len - offset;
+         offset = 0;
+         index++;
+      }
+      offset += left;
+   }
+   recordMetrics( METRIC_WRITE, nowPulseTimer() - startNs );
+   TRACE_FRAMES( vcp->bus, frames, numOfFrames, 0, total );
+   return true;
+}
+// END f_sendFramesVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_readVCP( .. )
+ * @brief:  Function to read the bytes the boards send back
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used
+ * @param2: <char*> buffer: Where to store the bytes
+ * @param3: <size_t> length: Number of bytes expected
+ * @param4: <uint32_t> timeoutMs: Max time to wait for all of them, 0 to take only what already arrived
+ * @return: <int> Number of bytes read (less than length on timeout), -1 on error
+ **********************************************************************************************************************/
+int readVCP( const vcp_t* vcp, char* buffer, const size_t length, const uint32_t timeoutMs )
+{
+   uint64_t deadline = nowPulseTimer() + (uint64_t)timeoutMs * NS_PER_MS;
+   size_t   totalBytesRead = 0;
+
+   while( totalBytesRead < length )
+   {
+      uint64_t now = nowPulseTimer();
+      int      waitMs = ( deadline > now ) ? (int)( ( deadline - now + NS_PER_MS - 1 ) / NS_PER_MS ) : 0;
+      struct pollfd fd = { .fd = vcp->fd, .events = POLLIN, .revents = 0 };
+      int ready = poll( &fd, 1, waitMs );
+      if( ready < 0 )
+      {
+         if( errno == EINTR )
+         {
+            continue;
+         }
+         return -1;
+      }
+      if( ready == 0 )
+      {
+         break;      // Timeout
+      }
+      ssize_t bytesRead = read( vcp->fd, buffer + totalBytesRead, length - totalBytesRead );
+      if( bytesRead < 0 )
+      {
+         if( errno == EINTR || errno == EAGAIN )
+         {
+            continue;
+         }
+         LOG_PRINT( LOG_LEVEL_ERROR, "Error reading from %s (%s)", vcp->name, strerror( errno ) );
+         return -1;
+      }
+      if( bytesRead == 0 )
+      {
+         break;      // Hung up
+      }
+      totalBytesRead += (size_t)bytesRead;
+   }
+   return (int)totalBytesRead;
+}
+// END f_readVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_isValidBaudRateVCP( .. )
+ * @brief:  Function to know if a baud rate is one of BAUD_RATE_* and termios can set it
+ * @param1: <int> baudRate: The baud rate
+ * @return: <bool> TRUE if it can be used
+ **********************************************************************************************************************/
+bool isValidBaudRateVCP( const int baudRate )
+{
+   return ( _speed( baudRate ) != B0 );
+}
+// END f_isValidBaudRateVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setBaudRateVCP( .. )
+ * @brief:  Function to change the baud rate of an open port. Bytes not sent yet are sent at the old rate first
+ * @param1: <vcp_t*> vcp: The Virtual COM port
+ * @param2: <int> baudRate: The new baud rate
+ * @return: <bool> TRUE if success FALSE if the rate is not valid or could not be set
+ **********************************************************************************************************************/
+bool setBaudRateVCP( vcp_t* vcp, const int baudRate )
+{
+   if( !isValidBaudRateVCP( baudRate ) )
+   {
+      return false;
+   }
+   uint64_t startNs = nowPulseTimer();
+   cfsetispeed( &( vcp->tty ), _speed( baudRate ) );
+   cfsetospeed( &( vcp->tty ), _speed( baudRate ) );
+   if( tcsetattr( vcp->fd, TCSADRAIN, &( vcp->tty ) ) != 0 )
+   {
+      return false;
+   }
+   recordMetrics( METRIC_CONFIGURE, nowPulseTimer() - startNs );
+   vcp->baudRate = baudRate;
+   return true;
+}
+// END f_setBaudRateVCP( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_wireTimeVCP( .. )
+ * @brief:  Function to know how long some bytes take on the wire at the current baud rate
+ * @param1: <const vcp_t*> vcp: The Virtual COM port
+ * @param2: <size_t> bytes: Number of bytes
+ * @return: <uint64_t> Time in ns
+ **********************************************************************************************************************/
+uint64_t wireTimeVCP( const vcp_t* vcp, const size_t bytes )
+{
+   return (uint64_t)bytes * VCP_BITS_PER_BYTE * NS_PER_SEC / (uint64_t)vcp->baudRate;
+}
+// END f_wireTimeVCP( .. ) ...
+
+
+/**********************************************************************************************************************
+ * f_tryOpenVCP( .. )
+ * @brief: Function to open the COM Port, trying again as the policy says
+ * @param1 <vcp_t*> _vcp : the Virtual Com Port
+ * @param2 <const retryPolicy_t*> retry : Backoff, tries and deadline
+ * @param3 <retryOutcome_t*> outcome : Where to store how it ended, NULL if not needed
+ * @return: <bool> TRUE if succeed FALSE if not
+ *********************************************************************************************************************/
+bool tryOpenVCP( vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )
+{
+   retry_t attempt;
+   bool    opened;
+
+   startRetry( &attempt, retry );
+   while( !( opened = openVCP( _vcp ) ) )
+   {
+      LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Try %u: Unable to open port %s", __func__, attempt.tries, _vcp->name );
+      if( !waitRetry( &attempt ) )
+      {
+         countMetrics( METRIC_OPEN_FAILURES );
+         countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+         break;
+      }
+      countMetrics( METRIC_OPEN_RETRIES );
+   }
+   if( outcome != NULL )
+   {
+      *outcome = endRetry( &attempt, opened );
+   }
+   return opened;
+}
+// END f_tryOpenVCP( .. ) ...
+
+
+/**********************************************************************************************************************
+ * tryCloseVCP( .. )
+ * @brief: Function to close the COM Port, trying again as the policy says
+ * @param1 <vcp_t*> _vcp : the Virtual Com Port
+ * @param2 <const retryPolicy_t*> retry : Backoff, tries and deadline
+ * @param3 <retryOutcome_t*> outcome : Where to store how it ended, NULL if not needed
+ * @return: <bool> TRUE if succeed FALSE if not
+ *********************************************************************************************************************/
+bool tryCloseVCP( const vcp_t* _vcp, const retryPolicy_t* retry, retryOutcome_t* outcome )
+{
+   retry_t attempt;
+   bool    closed;
+
+   startRetry( &attempt, retry );
+   while( !( closed = closeVCP( _vcp ) ) )
+   {
+      LOG_PRINT( LOG_LEVEL_ERROR, "%s()::Try %u: Unable to close port %s", __func__, attempt.tries, _vcp->name );
+      if( !waitRetry( &attempt ) )
+      {
+         countMetrics( ( attempt.outcome == RETRY_DEADLINE ) ? METRIC_RETRY_DEADLINES : METRIC_RETRY_EXHAUSTED );
+         break;
+      }
+      countMetrics( METRIC_CLOSE_RETRIES );
+   }
+   if( outcome != NULL )
+   {
+      *outcome = endRetry( &attempt, closed );
+   }
+   return closed;
+}
+// END f_tryCloseVCP( .. ) ...
+
+
+
+// PRIVATE FUNCTIONS ///////////////////////////////////////////////////////////////////////////////////////////////////
+/***********************************************************************************************************************
+ * f_openDevice( .. )
+ * @brief:  Function to open the device node and apply the connection parameters
+ * @param1: <vcp_t *> vcp: The Virtual COM port to open
+ * @return: <int> 0 if Success -1 if not (errno is set)
+ **********************************************************************************************************************/
+static int _openDevice( vcp_t* vcp )
+{
+   uint64_t startNs = nowPulseTimer();
+
+   vcp->fd = open( vcp->name, O_RDWR | O_NOCTTY | O_CLOEXEC );
+   if( vcp->fd < 0 )
+   {
+      return -1;
+   }
+   uint64_t openedNs = nowPulseTimer();
+   recordMetrics( METRIC_OPEN, openedNs - startNs );
+   if( _setConnectionParameters( vcp ) != 0 )
+   {
+      int savedErrno = errno;
+      close( vcp->fd );
+      vcp->fd = -1;
+      errno = savedErrno;
+      return -1;
+   }
+   recordMetrics( METRIC_CONFIGURE, nowPulseTimer() - openedNs );
+   return 0;
+}
+// END f_openDevice( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_setConnectionParameters( .. )
+ * @brief:  Function to setUp the UART connection (raw 8N1, no flow control)
+ * @param1: <vcp_t *> vcp: The Virtual COM port to set up connection
+ * @return: <int> 0 if Success 1 if not
+ **********************************************************************************************************************/
+static int _setConnectionParameters( vcp_t* vcp )
+{
+   if( tcgetattr( vcp->fd, &( vcp->tty ) ) != 0 )
+   {
+     fprintf( stderr, "%s Error getting device state\n", LOG_ERROR );
+     return 1;
+   }
+
+   cfmakeraw( &( vcp->tty ) );
+   cfsetispeed( &( vcp->tty ), _speed( vcp->baudRate ) );
+   cfsetospeed( &( vcp->tty ), _speed( vcp->baudRate ) );
+   vcp->tty.c_cflag &= ~( CSIZE | PARENB | CSTOPB | CRTSCTS );
+   vcp->tty.c_cflag |= CS8 | CLOCAL | CREAD;
+   vcp->tty.c_iflag &= ~( IXON | IXOFF | IXANY );
+   // Read timeouts, same order of magnitude than the Win32 COMMTIMEOUTS (tenths of second)
+   vcp->tty.c_cc[VMIN]  = 0;
+   vcp->tty.c_cc[VTIME] = 1;
+   if( tcsetattr( vcp->fd, TCSANOW, &( vcp->tty ) ) != 0 )
+   {
+     fprintf( stderr, "%s Error setting device parameters\n", LOG_ERROR );
+     return 1;
+   }
+   return 0;
+}
+// END f_setConnectionParameters( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_speed( .. )
+ * @brief:  Function to get the termios speed of a baud rate
+ * @param1: <int> baudRate: The baud rate
+ * @return: <speed_t> The speed, B0 if the rate is not available
+ **********************************************************************************************************************/
+static speed_t _speed( const int baudRate )
+{
+   for( size_t i = 0; i < sizeof( _speeds ) / sizeof( _speeds[0] ); i++ )
+   {
+      if( _speeds[i].baudRate == baudRate )
+      {
+         return _speeds[i].speed;
+      }
+   }
+   return B0;
+}
+// END f_speed( .. ) ...
+
+
+/***********************************************************************************************************************
+ * f_waitWritable( .. )
+ * @brief:  Function to wait for room in the output buffer of a non blocking port
+ * @param1: <const vcp_t*> vcp: the Virtual COM port used
+ * @param2: <uint64_t> deadlineNs: Absolute time to give up
+ * @return: <bool> TRUE if the port takes bytes again, FALSE on deadline or error (errno is set)
+ **********************************************************************************************************************/
+static bool _waitWritable( const vcp_t* vcp, const uint64_t deadlineNs )
+{
+   for( ;; )
+   {
+      uint64_t now = nowPulseTimer();
+      if( now >= deadlineNs )
+      {
+         errno = ETIMEDOUT;
+         return false;
+      }
+      struct pollfd fd = { .fd = vcp->fd, .events = POLLOUT, .revents = 0 };
+      int ready = poll( &fd, 1, (int)( ( deadlineNs - now + NS_PER_MS - 1 ) / NS_PER_MS ) );
+      if( ready < 0 && errno != EINTR )
+      {
+         return false;
+      }
+      if( ready > 0 )
+      {
+         if( ( fd.revents & POLLOUT ) == 0 )
+         {
+            errno = EIO;                                // Hung up or failing
+            return false;
+         }
+         return true;
+      }
+   }
+}
+// END f_waitWritable( .. ) ...
+
+#endif // !_WIN32